@@ -59,6 +59,13 @@ Direct inquiries to 30 Frost Street, Cambridge, MA 02140
 
 static int cephes_errno = 0;
 
+/* make the error code thread-local, so that the cephes
+   functions can be called in parallel */
+
+#if defined(_OPENMP) && !defined(OS_OSX)
+#pragma omp threadprivate(cephes_errno)
+#endif
+
 /* Notice: the order of appearance of the following
  * messages is bound to the error codes defined
  * in mconf.h.
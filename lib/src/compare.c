@@ -28,6 +28,7 @@
 #include "plotspec.h"
 #include "tsls.h"
 #include "uservar.h"
+#include "gretl_rls.h"
 
 /**
  * SECTION:compare
@@ -2836,6 +2837,125 @@ static int QLR_plot_wanted (gretlopt opt)
     return ret;
 }
 
+/* Can we use recursive least squares for the QLR test? This
+   requires the non-robust variant, with all coefficients allowed
+   to shift and a constant in the model, so that the unrestricted
+   regression at each break is equivalent to separate regressions
+   on the two subsamples.
+*/
+
+static int QLR_recursive_ok (const MODEL *pmod, gretlopt opt)
+{
+    return !(pmod->opt & OPT_R) && !(opt & OPT_L) && pmod->ifc &&
+	pmod->nobs > 2 * pmod->ncoeff;
+}
+
+static void QLR_load_x (const MODEL *pmod, const DATASET *dset,
+			int t, double *x)
+{
+    int i;
+
+    for (i=0; i<pmod->ncoeff; i++) {
+	x[i] = dset->Z[pmod->list[i+2]][t];
+    }
+}
+
+/* Compute the QLR sequence from one forward and one backward pass
+   of recursive least squares, which give the sums of squared
+   residuals for all the leading and trailing subsamples at O(k^2)
+   cost per observation. Returns E_SINGULAR if a subsample regression
+   is of less than full rank at some candidate break, in which case
+   the caller should run explicit regressions instead.
+*/
+
+static int QLR_recursive (const MODEL *pmod, const DATASET *dset,
+			  int split, int smax, double *testvec,
+			  double *ptestmax, int *ptmax)
+{
+    const double *y = dset->Z[pmod->list[1]];
+    int k = pmod->ncoeff;
+    int m = pmod->nobs;
+    int dfd = m - 2 * k;
+    rls_state *r = NULL;
+    double *essf, *essb, *x = NULL;
+    double ess, test, testmax = 0.0;
+    int t, c, tmax = 0;
+    int err = 0;
+
+    essf = malloc(2 * (m + 1) * sizeof *essf);
+    x = malloc(k * sizeof *x);
+    if (essf == NULL || x == NULL) {
+	err = E_ALLOC;
+    } else {
+	r = rls_state_new(k, &err);
+    }
+
+    if (err) {
+	goto bailout;
+    }
+
+    /* essf[c]: SSR using the first c observations; essb[c]: SSR
+       using observations c and following */
+    essb = essf + m + 1;
+    essf[0] = essb[m] = NADBL;
+
+    c = 0;
+    for (t=pmod->t1; t<=pmod->t2; t++) {
+	if (!model_missing(pmod, t)) {
+	    QLR_load_x(pmod, dset, t, x);
+	    rls_add_obs(r, x, y[t]);
+	    essf[++c] = rls_get_ess(r);
+	}
+    }
+
+    rls_state_reset(r);
+    for (t=pmod->t2; t>=pmod->t1; t--) {
+	if (!model_missing(pmod, t)) {
+	    QLR_load_x(pmod, dset, t, x);
+	    rls_add_obs(r, x, y[t]);
+	    c--;
+	    essb[c] = rls_get_ess(r);
+	}
+    }
+
+    /* c = number of observations preceding the break */
+    for (t=pmod->t1; t<split; t++) {
+	c += !model_missing(pmod, t);
+    }
+
+    for (t=split; t<=smax; t++) {
+	if (t > split && !model_missing(pmod, t-1)) {
+	    c++;
+	}
+	if (na(essf[c]) || na(essb[c])) {
+	    err = E_SINGULAR;
+	    break;
+	}
+	ess = essf[c] + essb[c];
+	test = (pmod->ess - ess) * dfd / (ess * k);
+	if (test > testmax) {
+	    tmax = t;
+	    testmax = test;
+	}
+	if (testvec != NULL) {
+	    testvec[t - split] = test;
+	}
+    }
+
+    if (!err) {
+	*ptestmax = testmax;
+	*ptmax = tmax;
+    }
+
+ bailout:
+
+    rls_state_destroy(r);
+    free(essf);
+    free(x);
+
+    return err;
+}
+
 /*
  * real_chow_test:
  * @chowparm: sample breakpoint; or ID number of dummy
@@ -2895,15 +3015,6 @@ static int real_chow_test (int chowparm, MODEL *pmod, DATASET *dset,
 	smax = split = chowparm;
     }
 
-    if (!err) {
-	chowlist = make_chow_list(pmod, dset, split, dumv, ci,
-				  opt, &err);
-    }
-
-    if (err) {
-	goto bailout;
-    }
-
     if (QLR) {
 	/* Quandt likelihood ratio */
 	int robust = (pmod->opt & OPT_R);
@@ -2913,15 +3024,34 @@ static int real_chow_test (int chowparm, MODEL *pmod, DATASET *dset,
 	double *testvec = NULL;
 	int *testlist = NULL;
 	int dfn = 0, dfd = 0;
-	int nextra = dset->v - origv;
+	int nextra = 0;
 	int tmax = 0;
+	int done = 0;
 	int i, t;
 
 	if (do_plot) {
 	    testvec = malloc((smax - split + 1) * sizeof *testvec);
 	}
 
-	if (robust) {
+	if (QLR_recursive_ok(pmod, opt)) {
+	    err = QLR_recursive(pmod, dset, split, smax, testvec,
+				&testmax, &tmax);
+	    if (!err) {
+		dfn = pmod->ncoeff;
+		dfd = pmod->nobs - 2 * pmod->ncoeff;
+		done = 1;
+	    } else if (err == E_SINGULAR) {
+		err = 0;
+	    }
+	}
+
+	if (!err && !done) {
+	    chowlist = make_chow_list(pmod, dset, split, dumv, ci,
+				      opt, &err);
+	    nextra = dset->v - origv;
+	}
+
+	if (!err && !done && robust) {
 	    lsqopt |= OPT_R;
 	    testlist = gretl_list_diff_new(chowlist, pmod->list, 2);
 	    if (testlist == NULL) {
@@ -2929,7 +3059,7 @@ static int real_chow_test (int chowparm, MODEL *pmod, DATASET *dset,
 	    }
 	}
 
-	for (t=split; t<=smax && !err; t++) {
+	for (t=split; t<=smax && !err && !done; t++) {
 	    chow_mod = lsq(chowlist, dset, OLS, lsqopt);
 	    if (chow_mod.errcode) {
 		err = chow_mod.errcode;
@@ -2999,6 +3129,12 @@ static int real_chow_test (int chowparm, MODEL *pmod, DATASET *dset,
 	gretlopt lsqopt = OPT_A;
 	int *testlist = NULL;
 
+	chowlist = make_chow_list(pmod, dset, split, dumv, ci,
+				  opt, &err);
+	if (err) {
+	    goto bailout;
+	}
+
 	if (robust) {
 	    lsqopt |= OPT_R;
 	}
@@ -3213,13 +3349,59 @@ static double vprime_M_v (double *v, double *M, int n)
     return val;
 }
 
-/* Compute scaled recursive residuals and cumulate \bar{w} via a
-   sequence of OLS regressions. See William Greene, Econometric
-   Analysis 5e, pp. 135-136.
+/* Compute scaled recursive residuals and cumulate \bar{w} via
+   recursive least squares, updating the fit at O(k^2) cost per
+   observation. See William Greene, Econometric Analysis 5e,
+   pp. 135-136. Returns E_SINGULAR if the regressors are not of
+   full rank on some initial subsample.
 */
 
-static int cusum_compute (MODEL *pmod, double *cresid, int T, int k,
-			  double *wbar, DATASET *dset)
+static int cusum_compute_rls (MODEL *pmod, double *cresid, int T, int k,
+			      double *wbar, const DATASET *dset)
+{
+    const double *y = dset->Z[pmod->list[1]];
+    rls_state *r;
+    double *xt;
+    int n = T - k;
+    int i, j, t;
+    int err = 0;
+
+    xt = malloc(k * sizeof *xt);
+    if (xt == NULL) {
+	return E_ALLOC;
+    }
+
+    r = rls_state_new(k, &err);
+
+    for (j=0, t=pmod->t1; t<=pmod->t2 && !err; t++) {
+	for (i=0; i<k; i++) {
+	    xt[i] = dset->Z[pmod->list[i+2]][t];
+	}
+	if (t >= pmod->t1 + k) {
+	    cresid[j] = rls_recursive_resid(r, xt, y[t], &err);
+	    if (!err) {
+		*wbar += cresid[j++];
+	    }
+	}
+	rls_add_obs(r, xt, y[t]);
+    }
+
+    if (!err && j != n) {
+	err = E_DATA;
+    }
+
+    rls_state_destroy(r);
+    free(xt);
+
+    return err;
+}
+
+/* The same computation via a sequence of OLS regressions, for use
+   when the recursive method fails due to collinearity.
+*/
+
+static int cusum_compute_ols (MODEL *pmod, double *cresid, int T, int k,
+			      double *wbar, DATASET *dset)
 {
     MODEL cmod;
     gretlopt opt = OPT_X | OPT_A;
@@ -3390,7 +3572,7 @@ int cusum_test (MODEL *pmod, DATASET *dset,
     double wbar = 0.0;
     double *cresid = NULL, *W = NULL;
     int quiet = opt & OPT_Q;
-    int m, i, j;
+    int m, j;
     int err = 0;
 
     if (pmod->ci != OLS) {
@@ -3416,7 +3598,11 @@ int cusum_test (MODEL *pmod, DATASET *dset,
     }
 
     if (!err) {
-	err = cusum_compute(pmod, cresid, T, k, &wbar, dset);
+	err = cusum_compute_rls(pmod, cresid, T, k, &wbar, dset);
+	if (err == E_SINGULAR) {
+	    wbar = 0.0;
+	    err = cusum_compute_ols(pmod, cresid, T, k, &wbar, dset);
+	}
 	if (err) {
 	    errmsg(err, prn);
 	}
@@ -3476,17 +3662,17 @@ int cusum_test (MODEL *pmod, DATASET *dset,
 	pputs(prn, "\n\n");
 
 	for (j=0; j<m; j++) {
-	    W[j] = 0.0;
 	    if (opt & OPT_R) {
-		for (i=0; i<=j; i++) {
-		    W[j] += cresid[i] * cresid[i] / den;
+		W[j] = cresid[j] * cresid[j] / den;
+		if (j > 0) {
+		    W[j] += W[j-1];
 		}
 		sig = fabs(W[j] - (j+1) / (double) m) > a;
 	    } else {
-		for (i=0; i<=j; i++) {
-		    W[j] += cresid[i];
+		W[j] = cresid[j] / sigma;
+		if (j > 0) {
+		    W[j] += W[j-1];
 		}
-		W[j] /= sigma;
 		sig = fabs(W[j]) > a + j * b;
 	    }
 	    if (!quiet) {
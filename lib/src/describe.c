@@ -523,6 +523,29 @@ int gretl_array_quantiles (double *a, int n, double *p, int k)
     return err;
 }
 
+/**
+ * gretl_array_order_statistic:
+ * @a: array on which to operate (this gets re-ordered).
+ * @n: number of elements in @a.
+ * @k: 0-based rank of the element wanted.
+ *
+ * Finds the element that would be at position @k if the first
+ * @n elements of @a were sorted in ascending order, without
+ * performing a full sort.
+ *
+ * Returns: the order statistic, or #NADBL if @k is out of
+ * bounds.
+ */
+
+double gretl_array_order_statistic (double *a, int n, int k)
+{
+    if (k < 0 || k >= n) {
+	return NADBL;
+    }
+
+    return find_hoare(a, n, k);
+}
+
 /**
  * gretl_array_quantile:
  * @a: array on which to operate.
@@ -3280,6 +3303,48 @@ static double gretl_acf (int k, int t1, int t2, const double *y,
     return num / den;
 }
 
+/* Fill @acf with the autocorrelations of @y at lags 1 to @m, over
+   the range @t1 to @t2, as per gretl_acf(). When there are many
+   lags of a long series we get them all in one go via FFT.
+*/
+
+static int acf_fill (double *acf, int m, int t1, int t2,
+		     const double *y, double ybar)
+{
+    int T = t2 - t1 + 1;
+    int mfft = MIN(m, T - 1);
+    int k;
+
+    if (mfft > 0 && gretl_fft_worthwhile(T, mfft) &&
+	first_missing_index(y, t1, t2) < 0) {
+	double *z, *c;
+	int t, err;
+
+	z = malloc((T + mfft + 1) * sizeof *z);
+	if (z == NULL) {
+	    return E_ALLOC;
+	}
+	c = z + T;
+	for (t=0; t<T; t++) {
+	    z[t] = y[t1+t] - ybar;
+	}
+	err = gretl_fft_autocov(z, T, mfft, c);
+	if (!err) {
+	    for (k=1; k<=m; k++) {
+		acf[k-1] = k <= mfft ? c[k] / c[0] : NADBL;
+	    }
+	}
+	free(z);
+	return err;
+    }
+
+    for (k=1; k<=m; k++) {
+	acf[k-1] = gretl_acf(k, t1, t2, y, ybar);
+    }
+
+    return 0;
+}
+
 /**
  * ljung_box:
  * @m: maximum lag.
@@ -3295,7 +3360,8 @@ static double gretl_acf (int k, int t1, int t2, const double *y,
 
 double ljung_box (int m, int t1, int t2, const double *y, int *err)
 {
-    double acf, ybar = 0.0, LB = 0.0;
+    double *acf = NULL;
+    double ybar = 0.0, LB = 0.0;
     int k, n = t2 - t1 + 1;
 
     *err = 0;
@@ -3316,16 +3382,24 @@ double ljung_box (int m, int t1, int t2, const double *y, int *err)
 	return NADBL;
     }
 
+    acf = malloc(m * sizeof *acf);
+    if (acf == NULL) {
+	*err = E_ALLOC;
+	return NADBL;
+    }
+
     /* calculate acf up to lag m, cumulating LB */
-    for (k=1; k<=m; k++) {
-	acf = gretl_acf(k, t1, t2, y, ybar);
-	if (na(acf)) {
+    *err = acf_fill(acf, m, t1, t2, y, ybar);
+    for (k=1; k<=m && !*err; k++) {
+	if (na(acf[k-1])) {
 	    *err = E_MISSDATA;
 	    break;
 	}
-	LB += acf * acf / (n - k);
+	LB += acf[k-1] * acf[k-1] / (n - k);
     }
 
+    free(acf);
+
     if (*err) {
 	LB = NADBL;
     } else {
@@ -3543,8 +3617,9 @@ int corrgram (int varno, int order, int nparam, DATASET *dset,
     pacf = acf + m;
 
     /* calculate acf up to order acf_m */
-    for (k=1; k<=m; k++) {
-	acf[k-1] = gretl_acf(k, t1, t2, dset->Z[varno], ybar);
+    err = acf_fill(acf, m, t1, t2, dset->Z[varno], ybar);
+    if (err) {
+	goto bailout;
     }
 
     /* graphing? */
@@ -3760,8 +3835,8 @@ gretl_matrix *acf_matrix (const double *x, int order,
     }
 
     /* calculate ACF up to order m */
+    *err = acf_fill(A->val, m, t1, t2, x, xbar);
     for (k=0; k<m && !*err; k++) {
-	A->val[k] = gretl_acf(k+1, t1, t2, x, xbar);
 	if (na(A->val[k])) {
 	    *err = E_DATA;
 	}
@@ -103,6 +103,8 @@ int gretl_array_quantiles (double *a, int n, double *p, int k);
 
 double gretl_array_quantile (double *a, int n, double p);
 
+double gretl_array_order_statistic (double *a, int n, int k);
+
 double gretl_median (int t1, int t2, const double *x);
 
 double gretl_sst (int t1, int t2, const double *x);
@@ -23,6 +23,7 @@
 #include "gretl_bfgs.h"
 #include "gretl_normal.h"
 #include "qr_estimate.h"
+#include "gretl_mt.h"
 
 #include <errno.h>
 
@@ -43,6 +44,15 @@
 
 #define CHOL_TINY 1.0e-13
 
+/* Number of observations per work unit in the loglikelihood
+   kernels for binary and multinomial logit/probit. Partial sums
+   are formed per block and then added in block order, so that
+   results do not depend on the number of threads used.
+*/
+#define LL_BLOCK 4096
+
+#define n_ll_blocks(T) (((T) + LL_BLOCK - 1) / LL_BLOCK)
+
 typedef struct op_container_ op_container;
 
 /* structure for handling ordered probit or logit */
@@ -1626,6 +1636,10 @@ struct mnl_info_ {
     gretl_matrix *b;  /* coefficients, matrix form */
     gretl_matrix *Xb; /* coeffs times regressors */
     gretl_matrix *P;  /* probabilities */
+    gretl_matrix *E;  /* "residuals": outcome dummies minus P */
+    gretl_matrix *G;  /* gradient, k x n */
+    gretl_matrix *WX; /* workspace for Hessian */
+    double *llb;      /* per-block loglikelihood */
 };
 
 static void mnl_info_destroy (mnl_info *mnl)
@@ -1633,6 +1647,7 @@ static void mnl_info_destroy (mnl_info *mnl)
     if (mnl != NULL) {
 	gretl_matrix_block_destroy(mnl->B);
 	free(mnl->theta);
+	free(mnl->llb);
 	free(mnl);
     }
 }
@@ -1648,7 +1663,10 @@ static mnl_info *mnl_info_new (int n, int k, int T)
 	mnl->T = T;
 	mnl->npar = k * n;
 	mnl->theta = malloc(mnl->npar * sizeof *mnl->theta);
-	if (mnl->theta == NULL) {
+	mnl->llb = malloc(n_ll_blocks(T) * sizeof *mnl->llb);
+	if (mnl->theta == NULL || mnl->llb == NULL) {
+	    free(mnl->theta);
+	    free(mnl->llb);
 	    free(mnl);
 	    return NULL;
 	}
@@ -1657,9 +1675,13 @@ static mnl_info *mnl_info_new (int n, int k, int T)
 					&mnl->b, k, n,
 					&mnl->Xb, T, n,
 					&mnl->P, T, n,
+					&mnl->E, T, n,
+					&mnl->G, k, n,
+					&mnl->WX, T, k,
 					NULL);
 	if (mnl->B == NULL) {
 	    free(mnl->theta);
+	    free(mnl->llb);
 	    free(mnl);
 	    mnl = NULL;
 	} else {
@@ -1672,15 +1694,18 @@ static mnl_info *mnl_info_new (int n, int k, int T)
     return mnl;
 }
 
-/* compute loglikelihood for multinomial logit */
+/* Compute the loglikelihood for multinomial logit. In the
+   same pass over the data we record the outcome probabilities
+   and the generalized residuals, which are then all that's
+   needed for the score and Hessian at the same @theta.
+*/
 
 static double mn_logit_loglik (const double *theta, void *ptr)
 {
     mnl_info *mnl = (mnl_info *) ptr;
-    double x, xti, exti, ll = 0.0;
-    int yt, i, t;
-
-    errno = 0;
+    int nb = n_ll_blocks(mnl->T);
+    double ll = 0.0;
+    int b, i;
 
     for (i=0; i<mnl->npar; i++) {
 	mnl->b->val[i] = theta[i];
@@ -1688,92 +1713,83 @@ static double mn_logit_loglik (const double *theta, void *ptr)
 
     gretl_matrix_multiply(mnl->X, mnl->b, mnl->Xb);
 
-    /* 2020-05-06: errno was ref'd below */
-
-    for (t=0; t<mnl->T; t++) {
-	x = 1.0;
-	for (i=0; i<mnl->n; i++) {
-	    /* sum row i of exp(Xb) */
-	    xti = gretl_matrix_get(mnl->Xb, t, i);
-	    exti = exp(xti); /* errno check? */
-	    x += exti;
-	}
-	ll -= log(x);
-	yt = gretl_vector_get(mnl->y, t);
-	if (yt > 0) {
-	    ll += gretl_matrix_get(mnl->Xb, t, yt-1);
+#if defined(_OPENMP)
+#pragma omp parallel for private(b) if (nb > 1 && gretl_use_openmp(mnl->T))
+#endif
+    for (b=0; b<nb; b++) {
+	int t1 = b * LL_BLOCK;
+	int t2 = MIN(t1 + LL_BLOCK, mnl->T);
+	double x, pti, llsum = 0.0;
+	int i, t, yt;
+
+	for (t=t1; t<t2; t++) {
+	    x = 1.0;
+	    for (i=0; i<mnl->n; i++) {
+		/* sum row t of exp(Xb) */
+		pti = exp(gretl_matrix_get(mnl->Xb, t, i));
+		gretl_matrix_set(mnl->P, t, i, pti);
+		x += pti;
+	    }
+	    yt = gretl_vector_get(mnl->y, t);
+	    for (i=0; i<mnl->n; i++) {
+		pti = gretl_matrix_get(mnl->P, t, i) / x;
+		gretl_matrix_set(mnl->P, t, i, pti);
+		gretl_matrix_set(mnl->E, t, i, (i == (yt-1)) - pti);
+	    }
+	    llsum -= log(x);
+	    if (yt > 0) {
+		llsum += gretl_matrix_get(mnl->Xb, t, yt-1);
+	    }
 	}
+	mnl->llb[b] = llsum;
+    }
+
+    for (b=0; b<nb; b++) {
+	ll += mnl->llb[b];
     }
 
     return ll;
 }
 
+/* Note: relies on mn_logit_loglik() having been called
+   at @theta */
+
 static int mn_logit_score (double *theta, double *s, int npar,
 			   BFGS_CRIT_FUNC ll, void *ptr)
 {
     mnl_info *mnl = (mnl_info *) ptr;
-    double x, xti, exti, pti, p, g;
-    int i, j, k, t, yt;
-    int err = 0;
+    int i, err = 0;
 
-    errno = 0;
+    /* G = X'E, which is laid out in the order of @theta */
+    gretl_matrix_multiply_mod(mnl->X, GRETL_MOD_TRANSPOSE,
+			      mnl->E, GRETL_MOD_NONE,
+			      mnl->G, GRETL_MOD_NONE);
 
     for (i=0; i<npar; i++) {
-	s[i] = 0.0;
-    }
-
-    for (t=0; t<mnl->T && !errno; t++) {
-	x = 1.0;
-	for (i=0; i<mnl->n; i++) {
-	    /* sum row i of exp(Xb) */
-	    xti = gretl_matrix_get(mnl->Xb, t, i);
-	    exti = exp(xti); /* errno check */
-	    x += exti;
-	    gretl_matrix_set(mnl->P, t, i, exti);
-	}
-
-	if (!errno) { /* conditionality? */
-	    yt = gretl_vector_get(mnl->y, t);
-	    k = 0;
-	    for (i=0; i<mnl->n; i++) {
-		pti = gretl_matrix_get(mnl->P, t, i) / x;
-		gretl_matrix_set(mnl->P, t, i, pti);
-		p = (i == (yt-1)) - pti;
-		for (j=0; j<mnl->k; j++) {
-		    g = p * gretl_matrix_get(mnl->X, t, j);
-		    s[k++] += g;
-		}
-	    }
+	s[i] = mnl->G->val[i];
+	if (isnan(s[i])) {
+	    err = E_NAN;
 	}
     }
 
-    if (errno != 0) {
-	/* ?? */
-	err = E_NAN;
-    }
-
     return err;
 }
 
 /* multinomial logit: form the negative of the analytical
-   Hessian */
+   Hessian, block by block, as X'WX with W diagonal
+*/
 
 static int mnl_hessian (double *theta, gretl_matrix *H, void *data)
 {
     mnl_info *mnl = data;
-    gretl_matrix_block *B;
-    gretl_matrix *x;
-    gretl_matrix *xx;
     gretl_matrix *hjk;
-    double xti, ptj, ptk;
+    double ptj, ptk, wt;
+    int T = mnl->T;
     int r, c;
     int i, j, k, t;
 
-    B = gretl_matrix_block_new(&x, 1, mnl->k,
-			       &xx, mnl->k, mnl->k,
-			       &hjk, mnl->k, mnl->k,
-			       NULL);
-    if (B == NULL) {
+    hjk = gretl_matrix_alloc(mnl->k, mnl->k);
+    if (hjk == NULL) {
 	return E_ALLOC;
     }
 
@@ -1781,20 +1797,17 @@ static int mnl_hessian (double *theta, gretl_matrix *H, void *data)
 
     for (j=0; j<mnl->n; j++) {
 	for (k=0; k<=j; k++) {
-	    gretl_matrix_zero(hjk);
-	    for (t=0; t<mnl->T; t++) {
-		for (i=0; i<mnl->k; i++) {
-		    xti = gretl_matrix_get(mnl->X, t, i);
-		    gretl_vector_set(x, i, xti);
+	    for (i=0; i<mnl->k; i++) {
+		for (t=0; t<T; t++) {
+		    ptj = gretl_matrix_get(mnl->P, t, j);
+		    ptk = gretl_matrix_get(mnl->P, t, k);
+		    wt = ptj * ((j == k) - ptk);
+		    mnl->WX->val[i*T+t] = wt * mnl->X->val[i*T+t];
 		}
-		gretl_matrix_multiply_mod(x, GRETL_MOD_TRANSPOSE,
-					  x, GRETL_MOD_NONE,
-					  xx, GRETL_MOD_NONE);
-		ptj = gretl_matrix_get(mnl->P, t, j);
-		ptk = gretl_matrix_get(mnl->P, t, k);
-		gretl_matrix_multiply_by_scalar(xx, ptj * ((j == k) - ptk));
-		gretl_matrix_add_to(hjk, xx);
 	    }
+	    gretl_matrix_multiply_mod(mnl->WX, GRETL_MOD_TRANSPOSE,
+				      mnl->X, GRETL_MOD_NONE,
+				      hjk, GRETL_MOD_NONE);
 	    gretl_matrix_inscribe_matrix(H, hjk, r, c, GRETL_MOD_NONE);
 	    if (j != k) {
 		gretl_matrix_inscribe_matrix(H, hjk, c, r, GRETL_MOD_NONE);
@@ -1805,7 +1818,7 @@ static int mnl_hessian (double *theta, gretl_matrix *H, void *data)
 	c = 0;
     }
 
-    gretl_matrix_block_destroy(B);
+    gretl_matrix_free(hjk);
 
     return 0;
 }
@@ -1832,7 +1845,7 @@ static gretl_matrix *mnl_score_matrix (mnl_info *mnl, int *err)
 {
     gretl_matrix *G;
     double p, g;
-    int yt, i, j, k, t;
+    int i, j, k, t;
 
     G = gretl_matrix_alloc(mnl->T, mnl->npar);
     if (G == NULL) {
@@ -1841,10 +1854,9 @@ static gretl_matrix *mnl_score_matrix (mnl_info *mnl, int *err)
     }
 
     for (t=0; t<mnl->T; t++) {
-	yt = gretl_vector_get(mnl->y, t);
 	k = 0;
 	for (i=0; i<mnl->n; i++) {
-	    p = (i == (yt-1)) - gretl_matrix_get(mnl->P, t, i);
+	    p = gretl_matrix_get(mnl->E, t, i);
 	    for (j=0; j<mnl->k; j++) {
 		g = p * gretl_matrix_get(mnl->X, t, j);
 		gretl_matrix_set(G, t, k++, g);
@@ -2226,12 +2238,14 @@ static void mnl_finish (mnl_info *mnl, MODEL *pmod,
     pmod->errcode = gretl_model_write_coeffs(pmod, mnl->theta, mnl->npar);
 
     if (!pmod->errcode) {
+	/* note: this call also refreshes the probabilities
+	   on which the variance matrix depends */
+	pmod->lnL = mn_logit_loglik(mnl->theta, mnl);
 	pmod->errcode = mnl_add_variance_matrix(pmod, mnl, dset, opt);
     }
 
     if (!pmod->errcode) {
 	pmod->ci = LOGIT;
-	pmod->lnL = mn_logit_loglik(mnl->theta, mnl);
 	mle_criteria(pmod, 0);
 
 	gretl_model_set_int(pmod, "multinom", mnl->n);
@@ -2472,6 +2486,10 @@ struct bin_info_ {
     gretl_matrix *pX; /* for use with Hessian */
     gretl_matrix *b;  /* coefficients in matrix form */
     gretl_matrix *Xb; /* index function values */
+    gretl_matrix *w;  /* per-observation score weights */
+    gretl_matrix *h;  /* per-observation Hessian weights */
+    gretl_matrix *g;  /* gradient */
+    double *llb;      /* per-block loglikelihood */
 };
 
 static void bin_info_destroy (bin_info *bin)
@@ -2480,6 +2498,7 @@ static void bin_info_destroy (bin_info *bin)
 	gretl_matrix_block_destroy(bin->B);
 	free(bin->theta);
 	free(bin->y);
+	free(bin->llb);
 	free(bin);
     }
 }
@@ -2494,13 +2513,12 @@ static bin_info *bin_info_new (int ci, int k, int T)
 	bin->T = T;
 	bin->pp_err = 0;
 	bin->theta = malloc(k * sizeof *bin->theta);
-	if (bin->theta == NULL) {
-	    free(bin);
-	    return NULL;
-	}
 	bin->y = malloc(T * sizeof *bin->y);
-	if (bin->y == NULL) {
+	bin->llb = malloc(n_ll_blocks(T) * sizeof *bin->llb);
+	if (bin->theta == NULL || bin->y == NULL || bin->llb == NULL) {
 	    free(bin->theta);
+	    free(bin->y);
+	    free(bin->llb);
 	    free(bin);
 	    return NULL;
 	}
@@ -2508,10 +2526,14 @@ static bin_info *bin_info_new (int ci, int k, int T)
 					&bin->pX, T, k,
 					&bin->b, k, 1,
 					&bin->Xb, T, 1,
+					&bin->w, T, 1,
+					&bin->h, T, 1,
+					&bin->g, k, 1,
 					NULL);
 	if (bin->B == NULL) {
 	    free(bin->theta);
 	    free(bin->y);
+	    free(bin->llb);
 	    free(bin);
 	    bin = NULL;
 	}
@@ -2543,13 +2565,22 @@ static int perfect_prediction_check (bin_info *bin)
     return (min1 > max0);
 }
 
-/* compute loglikelihood for binary probit/logit */
+/* Compute the loglikelihood for binary probit/logit. In the
+   same pass over the data we record, for each observation, the
+   weights on x_t that make up the score and the negative Hessian,
+   so that neither binary_score() nor binary_hessian() has to
+   re-evaluate the CDF or the inverse Mills ratio.
+*/
 
 static double binary_loglik (const double *theta, void *ptr)
 {
     bin_info *bin = (bin_info *) ptr;
-    double e, ndx, p, ll = 0.0;
-    int yt, i, t;
+    const double *ndx = bin->Xb->val;
+    double *w = bin->w->val;
+    double *h = bin->h->val;
+    int nb = n_ll_blocks(bin->T);
+    double ll = 0.0;
+    int b, i;
 
     for (i=0; i<bin->k; i++) {
 	bin->b->val[i] = theta[i];
@@ -2564,49 +2595,63 @@ static double binary_loglik (const double *theta, void *ptr)
 
     errno = 0;
 
-    for (t=0; t<bin->T; t++) {
-	yt = bin->y[t];
-	ndx = gretl_vector_get(bin->Xb, t);
-	if (bin->ci == PROBIT) {
-	    p = yt ? normal_cdf(ndx) : normal_cdf(-ndx);
-	} else {
-	    e = logit(ndx); /* errno check? */
-	    p = yt ? e : 1-e;
+#if defined(_OPENMP)
+#pragma omp parallel for private(b) if (nb > 1 && gretl_use_openmp(bin->T))
+#endif
+    for (b=0; b<nb; b++) {
+	int t1 = b * LL_BLOCK;
+	int t2 = MIN(t1 + LL_BLOCK, bin->T);
+	double e, p, llsum = 0.0;
+	int t;
+
+	for (t=t1; t<t2; t++) {
+	    if (bin->ci == PROBIT) {
+		if (bin->y[t]) {
+		    p = normal_cdf(ndx[t]);
+		    w[t] = invmills(-ndx[t]);
+		} else {
+		    p = normal_cdf(-ndx[t]);
+		    w[t] = -invmills(ndx[t]);
+		}
+		h[t] = w[t] * (ndx[t] + w[t]);
+	    } else {
+		e = logit(ndx[t]);
+		p = bin->y[t] ? e : 1-e;
+		w[t] = bin->y[t] - e;
+		h[t] = e * (1-e);
+	    }
+	    llsum += log(p);
 	}
-	ll += log(p);
+	bin->llb[b] = llsum;
+    }
+
+    for (b=0; b<nb; b++) {
+	ll += bin->llb[b];
     }
 
     return ll;
 }
 
+/* Note: the score and Hessian functions rely on binary_loglik()
+   having been called at @theta */
+
 static int binary_score (double *theta, double *s, int k,
 			 BFGS_CRIT_FUNC ll, void *ptr)
 {
     bin_info *bin = (bin_info *) ptr;
-    double ndx, w;
-    int t, j, yt;
-    int err = 0;
+    int j;
 
-    for (j=0; j<bin->k; j++) {
-	s[j] = 0.0;
-    }
+    gretl_matrix_multiply_mod(bin->X, GRETL_MOD_TRANSPOSE,
+			      bin->w, GRETL_MOD_NONE,
+			      bin->g, GRETL_MOD_NONE);
 
-    for (t=0; t<bin->T; t++) {
-	yt = bin->y[t];
-	ndx = gretl_vector_get(bin->Xb, t);
-	if (bin->ci == PROBIT) {
-	    w = yt ? invmills(-ndx) : -invmills(ndx);
-	} else {
-	    w = yt - logit(ndx);
-	}
-	for (j=0; j<bin->k; j++) {
-	    s[j] += w * gretl_matrix_get(bin->X, t, j);
-	}
+    for (j=0; j<bin->k; j++) {
+	s[j] = bin->g->val[j];
     }
 
     errno = 0;
 
-    return err;
+    return 0;
 }
 
 /* binary probit/logit: form the negative of the analytical
@@ -2616,21 +2661,16 @@ static int binary_hessian (double *theta, gretl_matrix *H,
 			   void *data)
 {
     bin_info *bin = data;
-    double w, p, ndx, xtj;
+    const double *h = bin->h->val;
+    const double *xj;
+    double *pxj;
     int t, j;
 
-    for (t=0; t<bin->T; t++) {
-	ndx = gretl_vector_get(bin->Xb, t);
-	if (bin->ci == PROBIT) {
-	    w = bin->y[t] ? invmills(-ndx) : -invmills(ndx);
-	    p = w * (ndx + w);
-	} else {
-	    p = logit(ndx);
-	    p = p * (1-p);
-	}
-	for (j=0; j<bin->k; j++) {
-	    xtj = gretl_matrix_get(bin->X, t, j);
-	    gretl_matrix_set(bin->pX, t, j, p * xtj);
+    for (j=0; j<bin->k; j++) {
+	xj = bin->X->val + j * bin->T;
+	pxj = bin->pX->val + j * bin->T;
+	for (t=0; t<bin->T; t++) {
+	    pxj[t] = h[t] * xj[t];
 	}
     }
 
@@ -2662,8 +2702,8 @@ static gretl_matrix *binary_hessian_inverse (bin_info *bin, int *err)
 static gretl_matrix *binary_score_matrix (bin_info *bin, int *err)
 {
     gretl_matrix *G;
-    double w, ndx, xtj;
-    int yt, j, t;
+    double w, xtj;
+    int j, t;
 
     G = gretl_matrix_alloc(bin->T, bin->k);
 
@@ -2675,13 +2715,7 @@ static gretl_matrix *binary_score_matrix (bin_info *bin, int *err)
     /* errno checking? */
 
     for (t=0; t<bin->T && !errno; t++) {
-	yt = bin->y[t];
-	ndx = gretl_vector_get(bin->Xb, t);
-	if (bin->ci == PROBIT) {
-	    w = yt ? invmills(-ndx) : -invmills(ndx);
-	} else {
-	    w = yt - logit(ndx);
-	}
+	w = bin->w->val[t];
 	for (j=0; j<bin->k; j++) {
 	    xtj = gretl_matrix_get(bin->X, t, j);
 	    gretl_matrix_set(G, t, j, w * xtj);
@@ -29,6 +29,7 @@
 #include "system.h"
 #include "tsls.h"
 #include "nls.h"
+#include "gretl_mt.h"
 
 #ifdef WIN32
 # include "gretl_win32.h"
@@ -684,6 +685,172 @@ void maybe_shift_ldepvar (MODEL *pmod, DATASET *dset)
     }
 }
 
+/* Above this many (observations x columns^2) XTX_XTy() switches to
+   the tiled computation below; and the number of doubles in a
+   packed tile of observations.
+*/
+#define XTX_TILE_MIN  2000000
+#define XTX_TILE_SIZE 524288
+
+/* Tiled variant of XTX_XTy(), for large problems: the (weighted or
+   quasi-differenced) data for a block of observations are packed
+   into the columns of a contiguous matrix, with masked observations
+   skipped once per block, and the block's contribution to the
+   moment matrix is then added via a single symmetric rank-k update,
+   which uses BLAS or multiple threads as appropriate. The dependent
+   variable, if wanted, goes in the last column so that X'y and y'y
+   are obtained in the same operation.
+*/
+
+static int XTX_XTy_tiled (const int *list, int t1, int t2,
+			  const DATASET *dset, int nwt,
+			  double rho, int pwe,
+			  double *xpx, double *xpy,
+			  double *ysum, double *ypy,
+			  const char *mask)
+{
+    int lmin = (xpy != NULL)? 2 : 1;
+    int nx = list[0] - lmin + 1;
+    int p = nx + (xpy != NULL);
+    int qdiff = (rho != 0.0);
+    const double **Z = NULL;
+    const double *w = NULL;
+    gretl_matrix *tile = NULL;
+    gretl_matrix *A = NULL;
+    double *wt = NULL;
+    double x, pw1 = 0.0;
+    double ys = 0.0;
+    int *idx = NULL;
+    int B, nr, s, t, r;
+    int i, j, m;
+    int err = 0;
+
+    if (qdiff && pwe) {
+	pw1 = sqrt(1.0 - rho * rho);
+    } else {
+	pwe = 0;
+    }
+
+    if (nwt && !qdiff) {
+	w = dset->Z[nwt];
+    }
+
+    B = XTX_TILE_SIZE / p;
+    if (B < 64) {
+	B = 64;
+    }
+    if (B > t2 - t1 + 1) {
+	B = t2 - t1 + 1;
+    }
+
+    Z = malloc(p * sizeof *Z);
+    idx = malloc(B * sizeof *idx);
+    wt = malloc(B * sizeof *wt);
+    tile = gretl_matrix_alloc(B, p);
+    A = gretl_zero_matrix_new(p, p);
+
+    if (Z == NULL || idx == NULL || wt == NULL ||
+	tile == NULL || A == NULL) {
+	err = E_ALLOC;
+	goto bailout;
+    }
+
+    for (i=0; i<nx; i++) {
+	Z[i] = dset->Z[list[lmin+i]];
+    }
+    if (xpy != NULL) {
+	Z[nx] = dset->Z[list[1]];
+    }
+
+    for (s=t1; s<=t2; s+=B) {
+	/* select the observations in this block */
+	nr = 0;
+	for (t=s; t<=t2 && t<s+B; t++) {
+	    if (masked(mask, t) || (w != NULL && w[t] == 0.0)) {
+		continue;
+	    }
+	    if (w != NULL) {
+		wt[nr] = sqrt(w[t]);
+	    }
+	    idx[nr++] = t;
+	}
+	if (nr == 0) {
+	    continue;
+	}
+
+	gretl_matrix_reuse(tile, nr, p);
+
+#if defined(_OPENMP)
+#pragma omp parallel for private(j, r, t) if (gretl_use_openmp((guint64) nr * p))
+#endif
+	for (j=0; j<p; j++) {
+	    const double *z = Z[j];
+	    double *col = tile->val + j * nr;
+
+	    for (r=0; r<nr; r++) {
+		t = idx[r];
+		if (qdiff) {
+		    col[r] = (pwe && t == t1)? pw1 * z[t] : z[t] - rho * z[t-1];
+		} else if (w != NULL) {
+		    col[r] = wt[r] * z[t];
+		} else {
+		    col[r] = z[t];
+		}
+	    }
+	}
+
+	if (xpy != NULL) {
+	    const double *col = tile->val + nx * nr;
+
+	    for (r=0; r<nr; r++) {
+		ys += col[r];
+	    }
+	}
+
+	err = gretl_matrix_multiply_mod(tile, GRETL_MOD_TRANSPOSE,
+					tile, GRETL_MOD_NONE,
+					A, GRETL_MOD_CUMULATE);
+	if (err) {
+	    goto bailout;
+	}
+    }
+
+    if (xpy != NULL) {
+	*ysum = ys;
+	*ypy = gretl_matrix_get(A, nx, nx);
+	if (*ypy <= 0.0) {
+	    /* error condition */
+	    err = list[1];
+	    goto bailout;
+	}
+	for (i=0; i<nx; i++) {
+	    xpy[i] = gretl_matrix_get(A, i, nx);
+	}
+    }
+
+    m = 0;
+    for (i=0; i<nx && !err; i++) {
+	for (j=i; j<nx; j++) {
+	    x = gretl_matrix_get(A, i, j);
+	    if (i == j && x < DBL_EPSILON) {
+		err = E_SINGULAR;
+		break;
+	    }
+	    xpx[m++] = x;
+	}
+    }
+
+ bailout:
+
+    free(Z);
+    free(idx);
+    free(wt);
+    gretl_matrix_free(tile);
+    gretl_matrix_free(A);
+
+    return err;
+}
+
 /*
  * XTX_XTy:
  * @list: list of variables in model.
@@ -729,6 +896,12 @@ static int XTX_XTy (const int *list, int t1, int t2,
     int i, j, t, m;
     int err = 0;
 
+    if ((guint64) (t2 - t1 + 1) * (lmax - lmin + 2) * (lmax - lmin + 2)
+	>= XTX_TILE_MIN) {
+	return XTX_XTy_tiled(list, t1, t2, dset, nwt, rho, pwe,
+			     xpx, xpy, ysum, ypy, mask);
+    }
+
     /* Prais-Winsten term */
     if (qdiff && pwe) {
 	pw1 = sqrt(1.0 - rho * rho);
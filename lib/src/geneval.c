@@ -36,6 +36,8 @@
 #include "uservar_priv.h"
 #include "genr_optim.h"
 #include "gretl_cmatrix.h"
+#include "gretl_rls.h"
+#include "streamols.h"
 #include "qr_estimate.h"
 #include "gretl_foreign.h"
 #include "gretl_midas.h"
@@ -1573,24 +1575,43 @@ static double scalar_pdist (int t, int d, const double *parm,
    @argvec contains a series of argument values.
 */
 
+static int pdist_fill_array (int f, int d, double *parm,
+			     double *x, int n)
+{
+    if (f == F_PDF) {
+	return gretl_fill_pdf_array(d, parm, x, n);
+    } else if (f == F_CDF) {
+	return gretl_fill_cdf_array(d, parm, x, n);
+    } else if (f == F_PVAL) {
+	return gretl_fill_pvalue_array(d, parm, x, n);
+    } else if (f == F_INVCDF) {
+	return gretl_fill_cdf_inverse_array(d, parm, x, n);
+    } else {
+	return gretl_fill_critval_array(d, parm, x, n);
+    }
+}
+
 static int series_pdist (double *x, int f, int d,
 			 double *parm, int np,
 			 const double *argvec,
 			 parser *p)
 {
+    int n = sample_size(p->dset);
     int t;
 
-    if (f == F_PDF) {
-	/* fast treatment, for pdf only at this point */
-	int n = sample_size(p->dset);
+    if (f != F_PDF && f != F_CDF && f != F_PVAL &&
+	f != F_INVCDF && f != F_CRIT) {
+	return E_PARSE;
+    }
 
+    for (t=p->dset->t1; t<=p->dset->t2; t++) {
+	x[t] = argvec[t];
+    }
+
+    if (pdist_fill_array(f, d, parm, x + p->dset->t1, n)) {
+	/* as with scalar_pdist(), the result is missing */
 	for (t=p->dset->t1; t<=p->dset->t2; t++) {
-	    x[t] = argvec[t];
-	}
-	gretl_fill_pdf_array(d, parm, x + p->dset->t1, n);
-    } else {
-	for (t=p->dset->t1; t<=p->dset->t2; t++) {
-	    x[t] = scalar_pdist(f, d, parm, np, argvec[t], p);
+	    x[t] = NADBL;
 	}
     }
 
@@ -1607,14 +1628,13 @@ static gretl_matrix *matrix_pdist (int f, int d,
 				   parser *p)
 {
     gretl_matrix *m;
-    double x;
     int i, n;
 
     if (gretl_is_null_matrix(argmat)) {
 	return gretl_null_matrix_new();
     }
 
-    m = gretl_matrix_alloc(argmat->rows, argmat->cols);
+    m = gretl_matrix_copy(argmat);
     if (m == NULL) {
 	p->err = E_ALLOC;
 	return NULL;
@@ -1622,12 +1642,16 @@ static gretl_matrix *matrix_pdist (int f, int d,
 
     n = m->rows * m->cols;
 
+    if (f != F_PDF && f != F_CDF && f != F_PVAL &&
+	f != F_INVCDF && f != F_CRIT) {
+	p->err = E_PARSE;
+    } else if (pdist_fill_array(f, d, parm, m->val, n)) {
+	p->err = E_MISSDATA;
+    }
+
     for (i=0; i<n && !p->err; i++) {
-	x = scalar_pdist(f, d, parm, np, argmat->val[i], p);
-	if (na(x)) {
+	if (na(m->val[i])) {
 	    p->err = E_MISSDATA;
-	} else {
-	    m->val[i] = x;
 	}
     }
 
@@ -7154,6 +7178,15 @@ static NODE *npcorr_node (NODE *l, NODE *m, NODE *r, parser *p)
         gretlopt opt = OPT_NONE;
         int n1 = 0, n2 = 0;
 
+        if (null_node(m)) {
+            /* matrix mode: rank correlations among the columns */
+            opt = get_npcorr_option(r, p);
+            if (!p->err) {
+                ret->v.m = rank_correlation_matrix(l->v.m, opt, &p->err);
+            }
+            return ret;
+        }
+
         if (l->t == SERIES) {
             x = l->v.xvec + p->dset->t1;
             n1 = sample_size(p->dset);
@@ -11752,6 +11785,11 @@ static gretl_matrix *get_density_matrix (NODE *t, double bws,
     kdfunc1 = NULL;
     kdfunc2 = NULL;
 
+    if (libset_get_bool(KDENSITY_EXACT)) {
+        /* don't use binning for large samples */
+        opt |= OPT_X;
+    }
+
     if (t->t == SERIES) {
         n = sample_size(p->dset);
         x = t->v.xvec + p->dset->t1;
@@ -11941,6 +11979,21 @@ static NODE *eval_3args_func (NODE *l, NODE *m, NODE *r,
                 A = gretl_matrix_varsimul(m1, m2, m3, &p->err);
             }
         }
+    } else if (f == F_ROLLOLS) {
+        gretl_matrix *m1 = node_get_real_matrix(l, p, 0, 1);
+        gretl_matrix *m2 = node_get_real_matrix(m, p, 1, 2);
+        int w = 0;
+
+        if (!p->err && !null_node(r)) {
+            if (scalar_node(r)) {
+                w = node_get_int(r, p);
+            } else {
+                node_type_error(f, 3, NUM, r, p);
+            }
+        }
+        if (!p->err) {
+            A = gretl_matrix_rolling_ols(m1, m2, w, &p->err);
+        }
     } else if (f == F_EIGEN || f == F_EIGGEN) {
         gretl_matrix *lm = node_get_matrix(l, p, 0, 1);
         gretl_matrix *v1 = NULL, *v2 = NULL;
@@ -12527,6 +12580,42 @@ static NODE *eval_3args_func (NODE *l, NODE *m, NODE *r,
     return ret;
 }
 
+/* out-of-core OLS/WLS: filename, specification, options */
+
+static NODE *streamols_node (NODE *l, NODE *m, NODE *r, parser *p)
+{
+    gretl_bundle *opts = NULL;
+    gretl_bundle *b = NULL;
+    NODE *ret = NULL;
+
+    if (l->t != STR) {
+        node_type_error(F_STREAMOLS, 1, STR, l, p);
+    } else if (m->t != STR) {
+        node_type_error(F_STREAMOLS, 2, STR, m, p);
+    } else if (!null_node(r)) {
+        if (r->t == BUNDLE) {
+            opts = r->v.b;
+        } else {
+            node_type_error(F_STREAMOLS, 3, BUNDLE, r, p);
+        }
+    }
+
+    if (!p->err) {
+        b = stream_ols(l->v.str, m->v.str, opts, p->prn, &p->err);
+    }
+
+    if (!p->err) {
+        ret = aux_bundle_node(p);
+        if (ret != NULL) {
+            ret->v.b = b;
+        } else {
+            gretl_bundle_destroy(b);
+        }
+    }
+
+    return ret;
+}
+
 static NODE *geoplot_node (NODE *l, NODE *m, NODE *r, parser *p)
 {
     NODE *ret = aux_scalar_node(p);
@@ -13725,8 +13814,8 @@ static NODE *eval_nargs_func (NODE *t, parser *p)
         int poly_order = 1;
         gretlopt opt = OPT_NONE;
 
-        if (k < 2 || k > 6) {
-            n_args_error(k, 5, t->t, p);
+        if (k < 2 || k > 7) {
+            n_args_error(k, 7, t->t, p);
         }
 
         for (i=0; i<k && !p->err; i++) {
@@ -13759,8 +13848,10 @@ static NODE *eval_nargs_func (NODE *t, parser *p)
                     if (!p->err && ival != 0) {
                         if (i == 4) {
                             opt |= OPT_R;
-                        } else {
+                        } else if (i == 5) {
                             opt |= OPT_O;
+                        } else {
+                            opt |= OPT_I;
                         }
                     }
                 }
@@ -17406,10 +17497,12 @@ static NODE *eval (NODE *t, parser *p)
         }
         break;
     case F_NPCORR:
-        /* two series or vectors, plus optional control string */
-        if ((l->t == SERIES || l->t == MAT) &&
-            (m->t == SERIES || m->t == MAT) &&
-            null_or_string(r)) {
+        /* two series or vectors, or a single matrix, plus optional
+           control string */
+        if (((l->t == SERIES || l->t == MAT) &&
+             (m->t == SERIES || m->t == MAT) &&
+             null_or_string(r)) ||
+            (l->t == MAT && null_node(m) && null_or_string(r))) {
             ret = npcorr_node(l, m, r, p);
         } else {
             p->err = E_INVARG;
@@ -17695,6 +17788,7 @@ static NODE *eval (NODE *t, parser *p)
     case F_STACK:
     case F_VMA:
     case F_BCHECK:
+    case F_ROLLOLS:
     case HF_REGLS:
         /* built-in functions taking three args */
         if (t->t == F_REPLACE) {
@@ -17710,6 +17804,9 @@ static NODE *eval (NODE *t, parser *p)
     case F_GEOPLOT:
 	ret = geoplot_node(l, m, r, p);
 	break;
+    case F_STREAMOLS:
+	ret = streamols_node(l, m, r, p);
+	break;
     case F_PRINTF:
     case F_SPRINTF:
         if (l->t == STR && null_or_string(r)) {
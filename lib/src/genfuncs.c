@@ -29,6 +29,7 @@
 #include "estim_private.h"
 #include "matrix_extra.h"
 #include "gretl_btree.h"
+#include "gretl_mt.h"
 #include "kalman.h"
 #include "../../cephes/cephes.h"
 
@@ -435,6 +436,7 @@ int fracdiff_series (const double *x, double *y, double d,
     int t2 = (obs >= 0)? obs : dset->t2;
     int tmiss = 0;
     double phi = (diff)? -d : d;
+    int err = 0;
 
 #if 0
     fprintf(stderr, "Doing fracdiff_series, with d = %g\n", d);
@@ -464,6 +466,9 @@ int fracdiff_series (const double *x, double *y, double d,
 	}
     } else {
 	/* doing the whole series */
+	double *h;
+	int nh;
+
 	T = t2 - t1 + 1;
 	for (t=0; t<=t2; t++) {
 	    if (t >= t1 && t <= t2) {
@@ -472,15 +477,35 @@ int fracdiff_series (const double *x, double *y, double d,
 		y[t] = NADBL;
 	    }
 	}
-	for (dd=1; dd<=T && fabs(phi)>TOL; dd++) {
-	    for (t=t1+dd; t<=t2; t++) {
-		y[t] += phi * x[t - dd];
+
+	/* the filter coefficients, up to the point where
+	   they become negligible */
+	h = malloc(T * sizeof *h);
+	if (h == NULL) {
+	    return E_ALLOC;
+	}
+	h[0] = (diff)? 1 : 0;
+	for (nh=1; nh<T && fabs(phi)>TOL; nh++) {
+	    h[nh] = phi;
+	    phi *= (nh - d)/(nh + 1);
+	}
+
+	if (gretl_fft_worthwhile(T, nh) &&
+	    first_missing_index(x, t1, t2) < 0) {
+	    /* long filter: convolve via FFT */
+	    err = gretl_fft_convolve(x + t1, T, h, nh, y + t1);
+	} else {
+	    for (dd=1; dd<nh; dd++) {
+		for (t=t1+dd; t<=t2; t++) {
+		    y[t] += h[dd] * x[t - dd];
+		}
 	    }
-	    phi *= (dd - d)/(dd + 1);
 	}
+
+	free(h);
     }
 
-    return 0;
+    return err;
 }
 
 static int boxcox_vector (const double *x, double *y, double d,
@@ -789,6 +814,70 @@ static double get_xlag (int lag, int t1, gretl_vector *x0, int n)
     }
 }
 
+/* Should we do the MA part of filter_vector() via FFT? Only if
+   the filter is long enough to make it worthwhile, and there are
+   no missing values to propagate.
+*/
+
+static int filter_use_fft (const double *x, int t1, int t2,
+			   int cmax, gretl_vector *x0)
+{
+    if (!gretl_fft_worthwhile(t2 - t1 + 1, cmax)) {
+	return 0;
+    } else if (first_missing_index(x, t1, t2) >= 0) {
+	return 0;
+    } else if (x0 != NULL) {
+	int i, n = gretl_vector_get_length(x0);
+
+	for (i=0; i<n; i++) {
+	    if (na(x0->val[i])) {
+		return 0;
+	    }
+	}
+    }
+
+    return 1;
+}
+
+/* The MA part of filter_vector() via FFT: we prepend the
+   relevant prior values of x, if any, and convolve.
+*/
+
+static int filter_ma_fft (const double *x, double *e, int t1, int t2,
+			  gretl_vector *C, gretl_vector *x0)
+{
+    int n = t2 - t1 + 1;
+    int cmax = gretl_vector_get_length(C);
+    int x0len = 0, pre = 0;
+    double *z, *w;
+    int i, err;
+
+    if (x0 != NULL) {
+	x0len = gretl_vector_get_length(x0);
+	pre = MIN(x0len, cmax - 1);
+    }
+
+    z = malloc(2 * (pre + n) * sizeof *z);
+    if (z == NULL) {
+	return E_ALLOC;
+    }
+
+    w = z + pre + n;
+    for (i=0; i<pre; i++) {
+	z[i] = x0->val[x0len - pre + i];
+    }
+    memcpy(z + pre, x + t1, n * sizeof *z);
+
+    err = gretl_fft_convolve(z, pre + n, C->val, cmax, w);
+    if (!err) {
+	memcpy(e, w + pre, n * sizeof *e);
+    }
+
+    free(z);
+
+    return err;
+}
+
 /* implements filter_series() and filter_matrix() */
 
 static int filter_vector (const double *x, double *y, int t1, int t2,
@@ -834,7 +923,13 @@ static int filter_vector (const double *x, double *y, int t1, int t2,
     }
 
     s = 0;
-    if (cmax) {
+    if (cmax && filter_use_fft(x, t1, t2, cmax, x0)) {
+	err = filter_ma_fft(x, e, t1, t2, C, x0);
+	if (err) {
+	    free(e);
+	    return err;
+	}
+    } else if (cmax) {
 	for (t=t1; t<=t2; t++) {
 	    e[s] = 0;
 	    for (i=0; i<cmax; i++) {
@@ -1375,6 +1470,13 @@ int panel_statistic (const double *x, double *y, const DATASET *dset,
 	if (k == F_PMEAN || TV) {
 	    double xbar;
 
+	    /* the units are contiguous blocks of the dataset, so
+	       they can be handled independently
+	    */
+#if defined(_OPENMP)
+#pragma omp parallel for private(i, t, s, xbar, Ti) \
+    if (gretl_use_openmp((guint64) (u2 - u1 + 1) * T))
+#endif
 	    for (i=u1; i<=u2; i++) {
 		xbar = NADBL;
 		Ti = 0;
@@ -1420,6 +1522,10 @@ int panel_statistic (const double *x, double *y, const DATASET *dset,
 	       calculated above */
 	    double sd, xbar, ssx, dev;
 
+#if defined(_OPENMP)
+#pragma omp parallel for private(i, t, s, sd, xbar, ssx, dev, Ti) \
+    if (gretl_use_openmp((guint64) (u2 - u1 + 1) * T))
+#endif
 	    for (i=u1; i<=u2; i++) {
 		ssx = NADBL;
 		xbar = y[i*T];
@@ -6991,6 +7097,108 @@ static gretl_matrix *delete_null_cases (gretl_matrix *m,
     return ret;
 }
 
+/* Binary search for @x in the sorted, distinct values @v;
+   returns the 0-based position or -1 if not found.
+*/
+
+static int aggr_value_index (const double *v, int m, double x)
+{
+    int lo = 0, hi = m - 1, mid;
+
+    while (lo <= hi) {
+	mid = (lo + hi) / 2;
+	if (v[mid] < x) {
+	    lo = mid + 1;
+	} else if (v[mid] > x) {
+	    hi = mid - 1;
+	} else {
+	    return mid;
+	}
+    }
+
+    return -1;
+}
+
+/* Assign each observation to a "case", meaning a combination of
+   the values of the by-variable(s), in a single pass over the data.
+   Cases are numbered in the row order of the aggregate_by() output
+   matrix, with the first by-variable varying slowest; observations
+   at which any by-variable is missing get code -1. On successful
+   return @start holds the offsets of the cases in @rows, which
+   lists the observations grouped by case, in dataset order within
+   each case.
+*/
+
+static int aggr_group_obs (const double *y, const int *ylist,
+			   const DATASET *dset, gretl_matrix **listvals,
+			   int ny, int n, int ncases, int *start,
+			   int *rows)
+{
+    const double *yj;
+    int *code = rows;
+    int i, j, t, c, p;
+
+    /* compute the case codes (using @rows for storage) */
+#if defined(_OPENMP)
+#pragma omp parallel for private(t, j, c, p, yj) \
+    if (gretl_use_openmp((guint64) n * ny))
+#endif
+    for (t=0; t<n; t++) {
+	c = 0;
+	for (j=0; j<ny; j++) {
+	    yj = ylist == NULL ? y : dset->Z[ylist[j+1]] + dset->t1;
+	    if (na(yj[t])) {
+		c = -1;
+		break;
+	    }
+	    p = aggr_value_index(listvals[j]->val, listvals[j]->rows,
+				 yj[t]);
+	    if (p < 0) {
+		c = -1;
+		break;
+	    }
+	    c = c * listvals[j]->rows + p;
+	}
+	code[t] = c;
+    }
+
+    /* count the observations per case and cumulate */
+    for (i=0; i<=ncases; i++) {
+	start[i] = 0;
+    }
+    for (t=0; t<n; t++) {
+	if (code[t] >= 0) {
+	    start[code[t]+1] += 1;
+	}
+    }
+    for (i=0; i<ncases; i++) {
+	start[i+1] += start[i];
+    }
+
+    /* stable scatter of observation indices into @rows: we need
+       the codes intact while doing this, so work from a copy
+    */
+    code = malloc(n * sizeof *code);
+    if (code == NULL) {
+	return E_ALLOC;
+    }
+    memcpy(code, rows, n * sizeof *code);
+    for (t=0; t<n; t++) {
+	if (code[t] >= 0) {
+	    rows[start[code[t]]++] = t;
+	}
+    }
+    free(code);
+
+    /* restore the offsets, which were advanced by the scatter */
+    for (i=ncases; i>0; i--) {
+	start[i] = start[i-1];
+    }
+    start[0] = 0;
+
+    return 0;
+}
+
 static gretl_matrix *real_aggregate_by (const double *x,
 					const double *y,
 					const int *xlist,
@@ -6998,6 +7206,7 @@ static gretl_matrix *real_aggregate_by (const double *x,
 					const DATASET *dset,
 					double *tmp,
 					double (*builtin)(),
+					int builtin_mt,
 					gchar *usercall,
 					DATASET *tmpset,
 					int just_count,
@@ -7005,16 +7214,15 @@ static gretl_matrix *real_aggregate_by (const double *x,
 {
     gretl_matrix *m = NULL;
     gretl_matrix **listvals;
-    gretl_matrix *yvals;
     int n = sample_size(dset);
-    int match, skipnull = 0;
+    int skipnull = 0;
     int countcol = 1;
     int maxcases;
     int ny, nx, mcols;
-    int *idx;
-    double *valvec;
+    int *start = NULL;
+    int *rows = NULL;
     double fx;
-    int i, j, k, t, ni, ii;
+    int i, j, k, s, r, ni, ii, nv;
 
     /* note:
        - to skip null cases in the output matrix, set skipnull = 1
@@ -7023,11 +7231,9 @@ static gretl_matrix *real_aggregate_by (const double *x,
 
     ny = ylist == NULL ? 1 : ylist[0];
 
-    valvec = malloc(ny * sizeof *valvec);
-    idx = malloc(ny * sizeof *idx);
     listvals = malloc(ny * sizeof *listvals);
 
-    if (valvec == NULL || idx == NULL || listvals == NULL) {
+    if (listvals == NULL) {
 	*err = E_ALLOC;
 	goto bailout;
     }
@@ -7038,7 +7244,7 @@ static gretl_matrix *real_aggregate_by (const double *x,
 
     /* For @y (or each member of @ylist), create a vector holding
        its distinct values. As we go, count the combinations of
-       y-values and initialize the valvec and idx arrays.
+       y-values.
     */
 
     maxcases = 1;
@@ -7049,8 +7255,6 @@ static gretl_matrix *real_aggregate_by (const double *x,
 	listvals[j] = gretl_matrix_values(y, n, OPT_S, err);
 	if (!*err) {
 	    maxcases *= listvals[j]->rows;
-	    valvec[j] = listvals[j]->val[0];
-	    idx[j] = 0;
 	}
     }
 
@@ -7074,102 +7278,89 @@ static gretl_matrix *real_aggregate_by (const double *x,
 
     if (!*err) {
 	m = gretl_zero_matrix_new(maxcases, mcols);
-	if (m == NULL) {
+	start = malloc((maxcases + 1) * sizeof *start);
+	rows = malloc(n * sizeof *rows);
+	if (m == NULL || start == NULL || rows == NULL) {
 	    *err = E_ALLOC;
 	}
     }
 
-    if (*err) {
-	goto bailout;
+    if (!*err && maxcases > 0) {
+	*err = aggr_group_obs(y, ylist, dset, listvals, ny, n,
+			      maxcases, start, rows);
     }
 
-    ii = 0;
+    if (*err || maxcases == 0) {
+	goto bailout;
+    }
 
+    /* record the y-values and the case counts */
     for (i=0; i<maxcases; i++) {
-	ni = 0;
-	for (k=0; k<nx && !*err; k++) {
-	    /* fill tmp with x for {y} == {yi} */
-	    if (xlist != NULL) {
-		x = dset->Z[xlist[k+1]] + dset->t1;
-	    }
-	    ni = 0;
-	    for (t=0; t<n; t++) {
-		match = 1;
-		for (j=0; j<ny; j++) {
-		    if (ylist != NULL) {
-			y = dset->Z[ylist[j+1]] + dset->t1;
-		    }
-		    if (y[t] != valvec[j]) {
-			match = 0;
-			break;
-		    }
-		}
-		if (match) {
-		    if (x != NULL) {
-			tmp[ni] = x[t];
-		    }
-		    ni++;
-		}
-	    }
-	    if (just_count) {
-		gretl_matrix_set(m, ii, ny, ni);
-		break;
-	    } else if (ni == 0 && skipnull) {
-		/* exclude cases where the obs count is 0 */
-		break;
-	    } else {
-		/* aggregate x at current y values */
-		if (builtin != NULL) {
-		    fx = (*builtin)(0, ni-1, tmp);
-		} else {
-		    tmpset->t2 = ni-1;
-		    fx = generate_scalar(usercall, tmpset, err);
-		}
-		gretl_matrix_set(m, ii, ny+k+countcol, fx);
-	    }
+	r = i;
+	for (j=ny-1; j>=0; j--) {
+	    nv = listvals[j]->rows;
+	    gretl_matrix_set(m, i, j, listvals[j]->val[r % nv]);
+	    r /= nv;
 	}
-
-	if (ni > 0 || !skipnull) {
-	    for (j=0; j<ny; j++) {
-		gretl_matrix_set(m, ii, j, valvec[j]);
-	    }
-	    if (countcol) {
-		gretl_matrix_set(m, ii, ny, ni);
-	    }
-	    ii++;
+	if (just_count || countcol) {
+	    gretl_matrix_set(m, i, ny, start[i+1] - start[i]);
 	}
+    }
 
-	if (*err) {
-	    break;
+    for (k=0; k<nx && !just_count && !*err; k++) {
+	if (xlist != NULL) {
+	    x = dset->Z[xlist[k+1]] + dset->t1;
 	}
-
-	/* set up the next y-values array */
-	for (j=ny-1; j>=0; j--) {
-	    yvals = listvals[j];
-	    if (idx[j] == yvals->rows - 1) {
-		/* restart the index at this level and pass
-		   the buck */
-		idx[j] = 0;
-		valvec[j] = yvals->val[0];
-	    } else {
-		/* increment the index at this level and
-		   we're done */
-		idx[j] += 1;
-		valvec[j] = yvals->val[idx[j]];
-		break;
+	if (builtin != NULL) {
+	    /* gather x by case, so that each case occupies a
+	       contiguous range of @tmp */
+	    for (s=0; s<start[maxcases]; s++) {
+		tmp[s] = x[rows[s]];
+	    }
+#if defined(_OPENMP)
+#pragma omp parallel for private(i, fx) \
+    if (builtin_mt && gretl_use_openmp((guint64) start[maxcases]))
+#endif
+	    for (i=0; i<maxcases; i++) {
+		fx = (*builtin)(start[i], start[i+1]-1, tmp);
+		gretl_matrix_set(m, i, ny+k+countcol, fx);
+	    }
+	} else {
+	    for (i=0; i<maxcases && !*err; i++) {
+		ni = start[i+1] - start[i];
+		for (s=0; s<ni; s++) {
+		    tmp[s] = x[rows[start[i]+s]];
+		}
+		tmpset->t2 = ni-1;
+		fx = generate_scalar(usercall, tmpset, err);
+		gretl_matrix_set(m, i, ny+k+countcol, fx);
 	    }
 	}
     }
 
-    if (skipnull && ii < maxcases) {
-	/* the matrix contains some null cases: shrink it */
-	m = delete_null_cases(m, ii, err);
+    if (!*err && skipnull) {
+	/* exclude cases where the obs count is 0 */
+	ii = 0;
+	for (i=0; i<maxcases; i++) {
+	    if (start[i+1] > start[i]) {
+		if (ii < i) {
+		    for (j=0; j<mcols; j++) {
+			gretl_matrix_set(m, ii, j, gretl_matrix_get(m, i, j));
+		    }
+		}
+		ii++;
+	    }
+	}
+	if (ii < maxcases) {
+	    /* the matrix contains some null cases: shrink it */
+	    m = delete_null_cases(m, ii, err);
+	}
     }
 
  bailout:
 
-    free(valvec);
-    free(idx);
+    free(start);
+    free(rows);
 
     if (listvals != NULL) {
 	for (j=0; j<ny; j++) {
@@ -7273,6 +7464,7 @@ gretl_matrix *aggregate_by (const double *x,
     double *tmp = NULL;
     double (*builtin) (int, int, const double *) = NULL;
     gchar *usercall = NULL;
+    int builtin_mt = 1;
     int just_count = 0;
     int n;
 
@@ -7324,7 +7516,9 @@ gretl_matrix *aggregate_by (const double *x,
 	    builtin = gretl_median;
 	    break;
 	case F_GINI:
+	    /* may set the error message: not thread-safe */
 	    builtin = gretl_gini;
+	    builtin_mt = 0;
 	    break;
 	case F_NOBS:
 	    builtin = series_get_nobs;
@@ -7360,7 +7554,7 @@ gretl_matrix *aggregate_by (const double *x,
 	x = (x == NULL)? NULL : x + dset->t1;
 	y = (y == NULL)? NULL : y + dset->t1;
 	m = real_aggregate_by(x, y, xlist, ylist, dset, tmp,
-			      builtin, usercall, tmpset,
+			      builtin, builtin_mt, usercall, tmpset,
 			      just_count, err);
     }
 
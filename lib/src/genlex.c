@@ -582,6 +582,8 @@ struct str_table funcs[] = {
     { F_BCHECK,    "bcheck" },
     { F_CONTAINS,  "contains" },
     { F_LPSOLVE,   "lpsolve" },
+    { F_ROLLOLS,   "rollols" },
+    { F_STREAMOLS, "streamols" },
     { 0,           NULL }
 };
 
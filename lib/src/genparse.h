@@ -471,6 +471,8 @@ enum {
     F_FCSTATS,
     F_BCHECK,
     F_MSPLITBY,
+    F_ROLLOLS,
+    F_STREAMOLS,
     HF_REGLS,
     F3_MAX,       /* SEPARATOR: end of three-arg functions */
     F_BKFILT,
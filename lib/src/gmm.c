@@ -24,7 +24,10 @@
 #include "qr_estimate.h"
 #include "gretl_bfgs.h"
 #include "uservar.h"
+#include "gretl_mt.h"
 
+#include "gretl_f2c.h"
+#include "clapack_double.h"
 #include "../../minpack/minpack.h"
 
 #include <errno.h>
@@ -54,6 +57,9 @@ struct ocset_ {
     gretl_matrix *tmp;    /* holds columnwise product of e and Z */
     gretl_matrix *sum;    /* holds column sums of tmp */
     gretl_matrix *S;      /* selector matrix for computing tmp */
+    gretl_matrix *eZ;     /* workspace for the cross-product e'Z */
+    int *pairs;           /* (e, Z) column pairs for the O.C.s */
+    int tmp_ok;           /* tmp is in sync with e (1) or not (0) */
     colsrc *ecols;        /* info on provenance of columns of 'e' */
     int noc;              /* total number of orthogonality conds. */
     int step;             /* number of estimation steps */
@@ -81,8 +87,10 @@ void oc_set_destroy (ocset *oc)
     gretl_matrix_free(oc->tmp);
     gretl_matrix_free(oc->sum);
     gretl_matrix_free(oc->S);
+    gretl_matrix_free(oc->eZ);
 
     free(oc->ecols);
+    free(oc->pairs);
 
     if (oc->lnames != NULL) {
 	strings_array_free(oc->lnames, oc->n_names);
@@ -113,6 +121,9 @@ static ocset *oc_set_new (void)
 	oc->tmp = NULL;
 	oc->sum = NULL;
 	oc->S = NULL;
+	oc->eZ = NULL;
+	oc->pairs = NULL;
+	oc->tmp_ok = 0;
 	oc->ecols = NULL;
 	oc->noc = 0;
 	oc->step = 0;
@@ -801,6 +812,50 @@ static int gmm_fix_datarows (nlspec *s)
     return err;
 }
 
+/* Record the (e, Z) column pair behind each O.C., in the order
+   used by gretl_matrix_columnwise_product(); and if most of the
+   possible pairs are in use, add a workspace in which we can form
+   e'Z in one shot.
+*/
+
+static int gmm_add_oc_pairs (ocset *oc)
+{
+    int k = oc->e->cols;
+    int n = oc->Z->cols;
+    int i, j, p = 0;
+
+    oc->pairs = malloc(2 * oc->noc * sizeof *oc->pairs);
+    if (oc->pairs == NULL) {
+	return E_ALLOC;
+    }
+
+    for (i=0; i<k; i++) {
+	for (j=0; j<n; j++) {
+	    if (oc->S == NULL || gretl_matrix_get(oc->S, i, j) != 0) {
+		if (p == oc->noc) {
+		    return E_NONCONF;
+		}
+		oc->pairs[2*p] = i;
+		oc->pairs[2*p+1] = j;
+		p++;
+	    }
+	}
+    }
+
+    if (p != oc->noc) {
+	return E_NONCONF;
+    }
+
+    if (2 * oc->noc >= k * n) {
+	oc->eZ = gretl_matrix_alloc(k, n);
+	if (oc->eZ == NULL) {
+	    return E_ALLOC;
+	}
+    }
+
+    return 0;
+}
+
 static int gmm_add_workspace (nlspec *s)
 {
     int k = s->oc->noc;
@@ -811,6 +866,8 @@ static int gmm_add_workspace (nlspec *s)
 
     if (s->oc->tmp == NULL || s->oc->sum == NULL) {
 	err = E_ALLOC;
+    } else {
+	err = gmm_add_oc_pairs(s->oc);
     }
 
     return err;
@@ -961,6 +1018,8 @@ static int gmm_update_e (nlspec *s)
     int j, t, v;
     int err = 0;
 
+    s->oc->tmp_ok = 0;
+
     for (j=0; j<s->oc->e->cols && !err; j++) {
 	v = s->oc->ecols[j].v;
 	if (v > 0) {
@@ -995,19 +1054,56 @@ static int gmm_update_e (nlspec *s)
 }
 
 /* Carry out the required O.C. columnwise multiplications:
-   e_i * Z_j */
+   e_i * Z_j. This T x noc matrix is needed only for the
+   weights and the covariance matrix, not for the criterion
+   itself, so we form it on demand.
+*/
 
 static int gmm_multiply_ocs (nlspec *s)
 {
-    int err;
+    int err = 0;
+
+    if (s->oc->tmp_ok) {
+	return 0;
+    }
+
+    if (s->oc->pairs != NULL && !gretl_is_null_matrix(s->oc->tmp)) {
+	const gretl_matrix *e = s->oc->e;
+	const gretl_matrix *Z = s->oc->Z;
+	gretl_matrix *tmp = s->oc->tmp;
+	int T = tmp->rows;
+	int *pairs = s->oc->pairs;
+	const double *ei, *zj;
+	double *cp;
+	int p, t;
+
+	if (e->rows != T || Z->rows != T || tmp->cols != s->oc->noc) {
+	    err = E_NONCONF;
+	} else {
+#if defined(_OPENMP)
+#pragma omp parallel for private(p, t, ei, zj, cp) \
+    if (gretl_use_openmp((guint64) T * tmp->cols))
+#endif
+	    for (p=0; p<tmp->cols; p++) {
+		ei = e->val + (size_t) pairs[2*p] * T;
+		zj = Z->val + (size_t) pairs[2*p+1] * T;
+		cp = tmp->val + (size_t) p * T;
+		for (t=0; t<T; t++) {
+		    cp[t] = ei[t] * zj[t];
+		}
+	    }
+	}
+    } else {
+	err = gretl_matrix_columnwise_product(s->oc->e,
+					      s->oc->Z,
+					      s->oc->S,
+					      s->oc->tmp);
+    }
 
-    err = gretl_matrix_columnwise_product(s->oc->e,
-					  s->oc->Z,
-					  s->oc->S,
-					  s->oc->tmp);
     if (err) {
-	fprintf(stderr, "gmm_multiply_ocs: err = %d from "
-		"gretl_matrix_columnwise_product\n", err);
+	fprintf(stderr, "gmm_multiply_ocs: err = %d\n", err);
+    } else {
+	s->oc->tmp_ok = 1;
     }
 
 #if GMM_DEBUG > 1
@@ -1020,27 +1116,88 @@ static int gmm_multiply_ocs (nlspec *s)
     return err;
 }
 
+/* Compute the sums of the orthogonality conditions, times @fac,
+   directly from e and Z, without forming the T x noc matrix of
+   products. If most of the (e_i, Z_j) pairs are in use we get
+   e'Z in a single BLAS call and pick out the wanted elements;
+   otherwise we take the required dot products, in parallel if
+   the problem is big enough.
+*/
+
+static int gmm_oc_sums (nlspec *s, double *f, double fac)
+{
+    const gretl_matrix *e = s->oc->e;
+    const gretl_matrix *Z = s->oc->Z;
+    int *pairs = s->oc->pairs;
+    int m = s->oc->noc;
+    int T = s->nobs;
+    int p, err = 0;
+
+    if (pairs == NULL || e->rows != T || Z->rows != T) {
+	/* fallback: shouldn't happen */
+	err = gmm_multiply_ocs(s);
+	if (!err) {
+	    const double *cp;
+	    int t;
+
+	    for (p=0; p<m; p++) {
+		cp = s->oc->tmp->val + (size_t) p * T;
+		f[p] = 0.0;
+		for (t=0; t<T; t++) {
+		    f[p] += cp[t];
+		}
+		f[p] *= fac;
+	    }
+	}
+	return err;
+    }
+
+    if (s->oc->eZ != NULL) {
+	gretl_matrix *eZ = s->oc->eZ;
+
+	err = gretl_matrix_multiply_mod(e, GRETL_MOD_TRANSPOSE,
+					Z, GRETL_MOD_NONE,
+					eZ, GRETL_MOD_NONE);
+	if (!err) {
+	    for (p=0; p<m; p++) {
+		f[p] = fac * gretl_matrix_get(eZ, pairs[2*p], pairs[2*p+1]);
+	    }
+	}
+    } else {
+	const double *ei, *zj;
+	double x;
+	int t;
+
+#if defined(_OPENMP)
+#pragma omp parallel for private(p, t, ei, zj, x) \
+    if (gretl_use_openmp((guint64) T * m))
+#endif
+	for (p=0; p<m; p++) {
+	    ei = e->val + (size_t) pairs[2*p] * T;
+	    zj = Z->val + (size_t) pairs[2*p+1] * T;
+	    x = 0.0;
+	    for (t=0; t<T; t++) {
+		x += ei[t] * zj[t];
+	    }
+	    f[p] = fac * x;
+	}
+    }
+
+    return err;
+}
+
 static double gmm_criterion (nlspec *s)
 {
     double crit = 0.0;
     gretl_matrix *sum = s->oc->sum;
     gretl_matrix *W = s->oc->W;
-    int k = s->oc->noc;
-    int i, j, err;
+    int err;
 
-    err = gmm_multiply_ocs(s);
+    err = gmm_oc_sums(s, sum->val, 1.0);
     if (err) {
 	return NADBL;
     }
 
-    /* compute column sums */
-    for (i=0; i<k; i++) {
-	sum->val[i] = 0.0;
-	for (j=0; j<s->nobs; j++) {
-	    sum->val[i] += gretl_matrix_get(s->oc->tmp, j, i);
-	}
-    }
-
     crit = gretl_scalar_qform(sum, W, &err);
     if (!err) {
 	crit = -crit;
@@ -1086,7 +1243,7 @@ static int gmm_jacobian_calc (int m, int n, double *x, double *f,
 {
     nlspec *s = (nlspec *) p;
     double fac;
-    int i, t, T;
+    int T;
 
     update_coeff_values(x, p);
 
@@ -1100,20 +1257,12 @@ static int gmm_jacobian_calc (int m, int n, double *x, double *f,
 	return 1;
     }
 
-    if (gmm_multiply_ocs(s)) {
-	*iflag = -1;
-	return 1;
-    }
-    
     T = s->nobs;
     fac = sqrt((double) T) / T;
 
-    for (i=0; i<m; i++) {
-	f[i] = 0.0;
-	for (t=0; t<T; t++) {
-	    f[i] += gretl_matrix_get(s->oc->tmp, t, i);
-	}
-	f[i] *= fac;
+    if (gmm_oc_sums(s, f, fac)) {
+	*iflag = -1;
+	return 1;
     }
 
     return 0;
@@ -1213,9 +1362,28 @@ static int HAC_prewhiten (gretl_matrix *E, gretl_matrix *A)
     return err;
 }
 
+/* Compute C = w * sum_t e_t e_{t-lag}', where e_t is the t-th row
+   of @E. The operands are the last and first T - @lag rows of @E:
+   since @E is column-major these are just offsets into its
+   storage, so we can hand them to dgemm directly rather than
+   building a lagged copy of @E.
+*/
+
+static void HAC_lag_product (const gretl_matrix *E, int lag,
+			     double w, gretl_matrix *C)
+{
+    char TN = 'T', NN = 'N';
+    integer T = E->rows;
+    integer k = E->cols;
+    integer n = T - lag;
+    double beta = 0.0;
+
+    dgemm_(&TN, &NN, &k, &k, &n, &w, E->val + lag, &T,
+	   E->val, &T, &beta, C->val, &k);
+}
+
 static int gmm_HAC (gretl_matrix *E, gretl_matrix *V, hac_info *hinfo)
 {
-    static gretl_matrix *W;
     static gretl_matrix *Tmp;
     static gretl_matrix *A;
     static gretl_matrix *E2;
@@ -1225,21 +1393,19 @@ static int gmm_HAC (gretl_matrix *E, gretl_matrix *V, hac_info *hinfo)
 
     if (E == NULL) {
 	/* cleanup signal */
-	gretl_matrix_free(W);
 	gretl_matrix_free(Tmp);
 	gretl_matrix_free(A);
 	gretl_matrix_free(E2);
-	W = Tmp = A = E2 = NULL;
+	Tmp = A = E2 = NULL;
 	return 0;
     }
 
     T = E->rows;
     k = E->cols;
 
-    if (W == NULL) {
-	W = gretl_matrix_alloc(T, k);
+    if (Tmp == NULL) {
 	Tmp = gretl_matrix_alloc(k, k);
-	if (W == NULL || Tmp == NULL) {
+	if (Tmp == NULL) {
 	    return E_ALLOC;
 	}
 	if (hinfo->whiten) {
@@ -1277,11 +1443,7 @@ static int gmm_HAC (gretl_matrix *E, gretl_matrix *V, hac_info *hinfo)
 	} else {
 	    w = hac_weight(hinfo->kern, hinfo->h, i);
 	}
-	gretl_matrix_inplace_lag(W, E, i);
-	gretl_matrix_multiply_by_scalar(W, 2*w);
-	gretl_matrix_multiply_mod(E, GRETL_MOD_TRANSPOSE,
-				  W, GRETL_MOD_NONE,
-				  Tmp, GRETL_MOD_NONE);
+	HAC_lag_product(E, i, 2*w, Tmp);
 	gretl_matrix_xtr_symmetric(Tmp);
 	gretl_matrix_add_to(V, Tmp);
     }
@@ -1337,7 +1499,7 @@ int gmm_add_vcv (MODEL *pmod, nlspec *s)
     gretl_matrix_block *B;
     gretl_matrix *V, *J, *S;
     gretl_matrix *m1, *m2, *m3;
-    int i, j, k = s->ncoeff;
+    int k = s->ncoeff;
     int T = s->nobs;
     double *wa4;
     int m, n;
@@ -1365,7 +1527,11 @@ int gmm_add_vcv (MODEL *pmod, nlspec *s)
 	return E_ALLOC;
     }
 
-    if (using_HAC(s)) {
+    err = gmm_multiply_ocs(s);
+
+    if (err) {
+	; /* can't proceed */
+    } else if (using_HAC(s)) {
 	err = gmm_HAC(s->oc->tmp, S, &s->oc->hinfo);
 	gmm_HAC_cleanup();
     } else {
@@ -1379,15 +1545,10 @@ int gmm_add_vcv (MODEL *pmod, nlspec *s)
 
 	gretl_matrix_divide_by_scalar(S, T);
 	f = s->oc->sum->val;
+	err = gmm_oc_sums(s, f, Tfac);
+    }
 
-	for (i=0; i<m; i++) {
-	    f[i] = 0.0;
-	    for (j=0; j<T; j++) {
-		f[i] += gretl_matrix_get(s->oc->tmp, j, i);
-	    }
-	    f[i] *= Tfac;
-	}
-
+    if (!err) {
 	fdjac2_(gmm_jacobian_calc, m, n, 0, s->coeff, f, 
 		J->val, m, &iflag, 0.0, wa4, s);
 
@@ -1492,9 +1653,13 @@ static double gmm_get_icrit (nlspec *s, double *oldcoeff)
 static int gmm_recompute_weights (nlspec *s)
 {
     gretl_matrix *W = s->oc->W;
-    int err = 0;
+    int err;
 
-    if (using_HAC(s)) {
+    err = gmm_multiply_ocs(s);
+
+    if (err) {
+	return err;
+    } else if (using_HAC(s)) {
 	err = gmm_HAC(s->oc->tmp, W, &s->oc->hinfo);
     } else {
 	err = gretl_matrix_multiply_mod(s->oc->tmp, GRETL_MOD_TRANSPOSE,
@@ -1523,7 +1688,11 @@ static void gmm_print_oc (nlspec *s, PRN *prn)
 	return;
     }
 
-    if (using_HAC(s)) {
+    err = gmm_multiply_ocs(s);
+
+    if (err) {
+	; /* report NA below */
+    } else if (using_HAC(s)) {
 	err = gmm_HAC(s->oc->tmp, V, &s->oc->hinfo);
     } else {
 	err = gretl_matrix_multiply_mod(s->oc->tmp, GRETL_MOD_TRANSPOSE,
@@ -1634,6 +1803,10 @@ static int gmm_normalize_wts_2 (nlspec *s)
     inicrit = -1 * get_gmm_crit(coeff, s);
 
     if (inicrit > 0 && !na(inicrit)) {
+	err = gmm_multiply_ocs(s);
+    }
+
+    if (!err && inicrit > 0 && !na(inicrit)) {
 	int k = s->oc->noc;
 	int n = s->oc->tmp->rows;
 	gretl_vector *qvec;
@@ -1865,6 +2038,7 @@ static int resize_oc_matrices (nlspec *s, int oldt1)
 
     if (!err) {
 	gretl_matrix_reuse(s->oc->tmp, T, 0);
+	s->oc->tmp_ok = 0;
     }
 
     return 0;
@@ -3226,6 +3226,246 @@ static int use_lines (gnuplot_info *gi)
    with NAs when printing the plot data */
 static int *na_skiplist;
 
+/* Level-of-detail reduction for plots with a great many
+   observations: beyond GP_LOD_MIN points per series we write
+   a reduced set of observations which gives the same picture
+   at any realistic output resolution. This can be turned off
+   via "set plot_lod off".
+*/
+
+#define GP_LOD_MIN 10000     /* minimum number of obs for reduction */
+#define GP_LOD_BUCKETS 2000  /* buckets for line-type plots */
+#define GP_LOD_GRID 800      /* cells per axis for scatter plots */
+
+/* print the data for observation @t of the current series */
+
+static void print_gp_obs (gnuplot_info *gi, const DATASET *dset,
+			  const int *datlist, int t, int i,
+			  int nomarkers, double xoff, FILE *fp)
+{
+    const char *label = NULL;
+    char obs[OBSLEN];
+
+    if (!(gi->flags & GPT_TS) && i == 1) {
+	if (dset->markers) {
+	    label = dset->S[t];
+	} else if (!nomarkers && dataset_is_time_series(dset)) {
+	    ntolabel(obs, t, dset);
+	    label = obs;
+	}
+    }
+    if ((gi->flags & GPT_TS) && dset->structure == STACKED_TIME_SERIES) {
+	maybe_print_panel_jot(t, dset, fp);
+    }
+    printvars(fp, t, datlist, dset, gi, label, xoff);
+}
+
+/* Is level-of-detail reduction applicable to the current plot
+   at all? */
+
+static int gp_lod_ok (gnuplot_info *gi, const DATASET *dset, int n)
+{
+    if (n <= GP_LOD_MIN || !libset_get_bool(PLOT_LOD)) {
+	return 0;
+    } else if ((gi->flags & GPT_TS) && dset->structure == STACKED_TIME_SERIES) {
+	/* keep the panel unit separators intact */
+	return 0;
+    } else {
+	return 1;
+    }
+}
+
+/* Decide which sort of level-of-detail reduction suits the
+   y series at position @i in the plot list, given its plotting
+   style: 1 for series drawn as lines, impulses or steps against
+   time or index, where the envelope within each block of
+   observations determines the picture; 2 for series drawn with
+   points, where we thin the cloud at plot resolution; otherwise
+   0 (e.g. lines in an X-Y plot, or lines with points), meaning
+   that all the observations must be written.
+*/
+
+static int gp_lod_mode (gnuplot_info *gi, int i)
+{
+    int w;
+
+    if (gi->withlist != NULL && i <= gi->withlist[0]) {
+	w = gi->withlist[i];
+    } else if (gi->flags & GPT_LINES) {
+	w = W_LINES;
+    } else if (gi->flags & GPT_IMPULSES) {
+	w = W_IMPULSES;
+    } else if (gi->flags & GPT_STEPS) {
+	w = W_STEPS;
+    } else {
+	w = W_POINTS;
+    }
+
+    if (w == W_POINTS) {
+	return 2;
+    } else if (gi->x != NULL &&
+	       (w == W_LINES || w == W_IMPULSES || w == W_STEPS)) {
+	return 1;
+    } else {
+	return 0;
+    }
+}
+
+/* For plots in observation order: divide the sample into
+   buckets of consecutive observations and write, for each
+   bucket, the first and last valid observations along with
+   those at which the series attains its minimum and maximum,
+   in their original order. This preserves the envelope of the
+   series exactly. If a bucket contains missing values, the
+   first of these is also written so that gaps in the plotted
+   line are retained.
+*/
+
+static void print_gp_lod_lines (gnuplot_info *gi, const DATASET *dset,
+				const int *datlist, int vy, int i,
+				int nomarkers, double xoff, FILE *fp)
+{
+    const double *y = dset->Z[vy];
+    int skipna = in_gretl_list(na_skiplist, vy);
+    int n = gi->t2 - gi->t1 + 1;
+    int b, nb = GP_LOD_BUCKETS;
+    int sel[5];
+    int j, k, ns;
+    int t, t0, t1;
+
+    for (b=0; b<nb; b++) {
+	int tfirst = -1, tlast = -1;
+	int tmin = -1, tmax = -1;
+	int tna = -1;
+
+	t0 = gi->t1 + (int) (((guint64) n * b) / nb);
+	t1 = gi->t1 + (int) (((guint64) n * (b + 1)) / nb) - 1;
+
+	for (t=t0; t<=t1; t++) {
+	    if (na(y[t])) {
+		if (!skipna && tna < 0) {
+		    tna = t;
+		}
+		continue;
+	    }
+	    if (tfirst < 0) {
+		tfirst = tmin = tmax = t;
+	    } else if (y[t] < y[tmin]) {
+		tmin = t;
+	    } else if (y[t] > y[tmax]) {
+		tmax = t;
+	    }
+	    tlast = t;
+	}
+
+	/* gather the selected observations in time order,
+	   dropping duplicates */
+	ns = 0;
+	if (tfirst >= 0) {
+	    sel[ns++] = tfirst;
+	    sel[ns++] = tmin;
+	    sel[ns++] = tmax;
+	    sel[ns++] = tlast;
+	}
+	if (tna >= 0) {
+	    sel[ns++] = tna;
+	}
+	for (j=1; j<ns; j++) {
+	    t = sel[j];
+	    for (k=j; k>0 && sel[k-1] > t; k--) {
+		sel[k] = sel[k-1];
+	    }
+	    sel[k] = t;
+	}
+	for (j=0; j<ns; j++) {
+	    if (j == 0 || sel[j] != sel[j-1]) {
+		print_gp_obs(gi, dset, datlist, sel[j], i,
+			     nomarkers, xoff, fp);
+	    }
+	}
+    }
+}
+
+/* For series drawn with points: superimpose a grid of
+   GP_LOD_GRID by GP_LOD_GRID cells on the range of the data
+   and write only the first observation falling into each
+   occupied cell. At plot resolution the result is
+   indistinguishable from the full scatter, but its size is
+   bounded by the number of cells rather than the number of
+   observations. The x-axis values are those of the time or
+   index variable, if present, otherwise the X series.
+*/
+
+static int print_gp_lod_points (gnuplot_info *gi, const DATASET *dset,
+				const int *datlist, int vy, int i,
+				int nomarkers, FILE *fp)
+{
+    const double *x = (gi->x != NULL)? gi->x : dset->Z[datlist[1]];
+    const double *y = dset->Z[vy];
+    int skipna = in_gretl_list(na_skiplist, vy);
+    int g = GP_LOD_GRID;
+    double xmin, xmax, ymin, ymax;
+    double xs, ys;
+    unsigned char *cells;
+    int r, c, t;
+
+    xmin = ymin = NADBL;
+    xmax = ymax = 0;
+
+    for (t=gi->t1; t<=gi->t2; t++) {
+	if (!na(x[t]) && !na(y[t])) {
+	    if (na(xmin)) {
+		xmin = xmax = x[t];
+		ymin = ymax = y[t];
+	    } else {
+		xmin = x[t] < xmin ? x[t] : xmin;
+		xmax = x[t] > xmax ? x[t] : xmax;
+		ymin = y[t] < ymin ? y[t] : ymin;
+		ymax = y[t] > ymax ? y[t] : ymax;
+	    }
+	}
+    }
+
+    if (na(xmin)) {
+	/* nothing to reduce */
+	return 1;
+    }
+
+    cells = calloc((size_t) g * g, 1);
+    if (cells == NULL) {
+	/* fall back on writing all the data */
+	return 1;
+    }
+
+    xs = (xmax > xmin)? (g - 1) / (xmax - xmin) : 0.0;
+    ys = (ymax > ymin)? (g - 1) / (ymax - ymin) : 0.0;
+
+    for (t=gi->t1; t<=gi->t2; t++) {
+	if (na(x[t]) || na(y[t])) {
+	    if (skipna && na(y[t])) {
+		continue;
+	    } else if (all_graph_data_missing(gi->list, t,
+					      (const double **) dset->Z)) {
+		continue;
+	    }
+	    /* as in the unreduced case, a missing value is written
+	       to give a break in the data */
+	    print_gp_obs(gi, dset, datlist, t, i, nomarkers, 0.0, fp);
+	    continue;
+	}
+	c = (int) ((x[t] - xmin) * xs + 0.5);
+	r = (int) ((y[t] - ymin) * ys + 0.5);
+	if (!cells[(size_t) r * g + c]) {
+	    cells[(size_t) r * g + c] = 1;
+	    print_gp_obs(gi, dset, datlist, t, i, nomarkers, 0.0, fp);
+	}
+    }
+
+    free(cells);
+
+    return 0;
+}
+
 static void print_gp_data (gnuplot_info *gi, const DATASET *dset,
 			   FILE *fp)
 {
@@ -3234,6 +3474,7 @@ static void print_gp_data (gnuplot_info *gi, const DATASET *dset,
     int datlist[3];
     int lmax, ynum = 2;
     int nomarkers = 0;
+    int lod_ok, lod;
     int i, t;
 
     /* multi impulse plot? calculate offset for lines */
@@ -3255,17 +3496,30 @@ static void print_gp_data (gnuplot_info *gi, const DATASET *dset,
 	nomarkers = 1;
     }
 
+    lod_ok = gp_lod_ok(gi, dset, n);
+
     /* loop across the variables, printing x then y[i] for each i */
 
     for (i=1; i<=lmax; i++) {
 	double xoff = offset * (i - 1);
 
 	datlist[ynum] = gi->list[i];
+	lod = lod_ok ? gp_lod_mode(gi, i) : 0;
 
-	for (t=gi->t1; t<=gi->t2; t++) {
-	    const char *label = NULL;
-	    char obs[OBSLEN];
+	if (lod == 1) {
+	    print_gp_lod_lines(gi, dset, datlist, datlist[ynum], i,
+			       nomarkers, xoff, fp);
+	    fputs("e\n", fp);
+	    continue;
+	} else if (lod == 2) {
+	    if (print_gp_lod_points(gi, dset, datlist, datlist[ynum], i,
+				    nomarkers, fp) == 0) {
+		fputs("e\n", fp);
+		continue;
+	    }
+	}
 
+	for (t=gi->t1; t<=gi->t2; t++) {
 	    if (in_gretl_list(na_skiplist, datlist[ynum]) &&
 		na(dset->Z[datlist[ynum]][t])) {
 		continue;
@@ -3273,18 +3527,7 @@ static void print_gp_data (gnuplot_info *gi, const DATASET *dset,
 		       all_graph_data_missing(gi->list, t, (const double **) dset->Z)) {
 		continue;
 	    }
-	    if (!(gi->flags & GPT_TS) && i == 1) {
-		if (dset->markers) {
-		    label = dset->S[t];
-		} else if (!nomarkers && dataset_is_time_series(dset)) {
-		    ntolabel(obs, t, dset);
-		    label = obs;
-		}
-	    }
-	    if ((gi->flags & GPT_TS) && dset->structure == STACKED_TIME_SERIES) {
-		maybe_print_panel_jot(t, dset, fp);
-	    }
-	    printvars(fp, t, datlist, dset, gi, label, xoff);
+	    print_gp_obs(gi, dset, datlist, t, i, nomarkers, xoff, fp);
 	}
 
 	fputs("e\n", fp);
@@ -7023,10 +7266,38 @@ int rmplot (const int *list, DATASET *dset,
     return range_mean_graph(list[1], dset, opt, prn);
 }
 
+static int hurst_matrix_driver (const int *list, gretlopt opt,
+				PRN *prn)
+{
+    int (*hurst_matrix) (const gretl_matrix *, const int *,
+			 gretlopt, PRN *);
+    const char *mname = get_optval_string(HURST, OPT_X);
+    gretl_matrix *m = NULL;
+
+    if (mname != NULL) {
+	m = get_matrix_by_name(mname);
+    }
+    if (gretl_is_null_matrix(m)) {
+	return E_DATA;
+    }
+
+    hurst_matrix = get_plugin_function("hurst_matrix");
+    if (hurst_matrix == NULL) {
+	return 1;
+    }
+
+    return hurst_matrix(m, list, opt, prn);
+}
+
 int hurstplot (const int *list, DATASET *dset, gretlopt opt, PRN *prn)
 {
     int (*hurst_exponent) (int, const DATASET *, gretlopt, PRN *);
 
+    if (opt & OPT_X) {
+	/* estimate for the column(s) of a named matrix */
+	return hurst_matrix_driver(list, opt, prn);
+    }
+
     hurst_exponent = get_plugin_function("hurst_exponent");
     if (hurst_exponent == NULL) {
 	return 1;
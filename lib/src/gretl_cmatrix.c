@@ -33,6 +33,297 @@
 
 #define cscalar(m) (m->rows == 1 && m->cols == 1)
 
+/* Cache of FFTW plans, keyed by transform length, kind and
+   placement, so that repeated transforms of a given length need
+   not be re-planned. Each cached plan is made on buffers owned by
+   the cache and is run on the caller's arrays via FFTW's new-array
+   execute functions; this requires that the caller's arrays have
+   the same alignment as the planning buffers, which holds for
+   arrays obtained via fftw_malloc. For other arrays we fall back
+   to a one-off plan.
+
+   Plans are made with FFTW_ESTIMATE unless GRETL_FFTW_MEASURE is
+   set in the environment, in which case FFTW_MEASURE is used and
+   the accumulated wisdom is saved in the user's dotdir, to be
+   reloaded next time.
+
+   Since the FFTW planner is not thread-safe, access to the cache
+   and any planning is serialized when running under OpenMP. Plans
+   are executed outside of the lock, so each slot carries a count
+   of its current users and a slot that is in use is never
+   recycled: if all slots are busy we make a one-off plan.
+*/
+
+enum {
+    FFT_R2C,
+    FFT_C2R,
+    FFT_C2C_FWD,
+    FFT_C2C_BWD
+};
+
+#define N_FFT_PLANS 16
+#define FFT_WISDOM_FILE "fftw.wisdom"
+
+typedef struct fft_plan_info_ fft_plan_info;
+
+struct fft_plan_info_ {
+    int n;           /* transform length */
+    int kind;        /* one of the FFT_* values above */
+    int inplace;     /* input and output arrays coincide? */
+    int users;       /* number of executions in progress */
+    fftw_plan p;     /* the plan */
+    void *in;        /* planning buffers */
+    void *out;
+};
+
+static fft_plan_info fft_plans[N_FFT_PLANS];
+static int n_fft_plans;
+static int fft_evict;
+static int fft_flags = -1;
+static int fft_wisdom_changed;
+
+static void fft_set_flags (void)
+{
+    if (getenv("GRETL_FFTW_MEASURE") != NULL) {
+	gchar *fname;
+
+	fft_flags = FFTW_MEASURE;
+	fname = g_build_filename(gretl_dotdir(), FFT_WISDOM_FILE, NULL);
+	fftw_import_wisdom_from_filename(fname);
+	g_free(fname);
+    } else {
+	fft_flags = FFTW_ESTIMATE;
+    }
+}
+
+static fftw_plan fft_make_plan (int n, int kind, void *in, void *out,
+				int flags)
+{
+    switch (kind) {
+    case FFT_R2C:
+	return fftw_plan_dft_r2c_1d(n, in, out, flags);
+    case FFT_C2R:
+	return fftw_plan_dft_c2r_1d(n, in, out, flags);
+    case FFT_C2C_FWD:
+	return fftw_plan_dft_1d(n, in, out, FFTW_FORWARD, flags);
+    default:
+	return fftw_plan_dft_1d(n, in, out, FFTW_BACKWARD, flags);
+    }
+}
+
+/* allocate planning buffers for a cached plan */
+
+static int fft_plan_buffers (fft_plan_info *fp)
+{
+    size_t nc = fp->n/2 + 1;
+    size_t inbytes, outbytes;
+
+    if (fp->kind == FFT_R2C) {
+	inbytes = fp->n * sizeof(double);
+	outbytes = nc * sizeof(double complex);
+    } else if (fp->kind == FFT_C2R) {
+	inbytes = nc * sizeof(double complex);
+	outbytes = fp->n * sizeof(double);
+    } else {
+	inbytes = outbytes = fp->n * sizeof(double complex);
+    }
+
+    fp->in = fftw_malloc(inbytes);
+    fp->out = fp->inplace ? fp->in : fftw_malloc(outbytes);
+
+    return (fp->in == NULL || fp->out == NULL) ? E_ALLOC : 0;
+}
+
+static void fft_plan_info_free (fft_plan_info *fp)
+{
+    if (fp->p != NULL) {
+	fftw_destroy_plan(fp->p);
+    }
+    if (fp->out != fp->in) {
+	fftw_free(fp->out);
+    }
+    fftw_free(fp->in);
+    fp->p = NULL;
+    fp->in = fp->out = NULL;
+}
+
+/* Find a slot for a new cached plan: an unused one if available,
+   otherwise the next recyclable slot in round-robin order, skipping
+   any slot whose plan is currently being executed. Returns NULL if
+   all slots are busy.
+*/
+
+static fft_plan_info *fft_free_slot (void)
+{
+    fft_plan_info *fp;
+    int i;
+
+    if (n_fft_plans < N_FFT_PLANS) {
+	return &fft_plans[n_fft_plans++];
+    }
+
+    for (i=0; i<N_FFT_PLANS; i++) {
+	fp = &fft_plans[fft_evict];
+	fft_evict = (fft_evict + 1) % N_FFT_PLANS;
+	if (fp->users == 0) {
+	    fft_plan_info_free(fp);
+	    return fp;
+	}
+    }
+
+    return NULL;
+}
+
+static fftw_plan real_fft_get_plan (int n, int kind, void *in,
+				    void *out, int *slot)
+{
+    fft_plan_info *fp = NULL;
+    int inplace = (in == out);
+    int i;
+
+    if (fft_flags < 0) {
+	fft_set_flags();
+    }
+
+    *slot = -1;
+
+    if (fftw_alignment_of(in) != 0 || fftw_alignment_of(out) != 0) {
+	/* can't use a cached plan on these arrays */
+	return fft_make_plan(n, kind, in, out, FFTW_ESTIMATE);
+    }
+
+    for (i=0; i<n_fft_plans; i++) {
+	fp = &fft_plans[i];
+	if (fp->p != NULL && fp->n == n && fp->kind == kind &&
+	    fp->inplace == inplace) {
+	    fp->users += 1;
+	    *slot = i;
+	    return fp->p;
+	}
+    }
+
+    /* not found: add a new plan, recycling a slot if need be */
+    fp = fft_free_slot();
+    if (fp == NULL) {
+	/* all slots are in use */
+	return fft_make_plan(n, kind, in, out, FFTW_ESTIMATE);
+    }
+
+    fp->n = n;
+    fp->kind = kind;
+    fp->inplace = inplace;
+
+    if (fft_plan_buffers(fp) == 0) {
+	fp->p = fft_make_plan(n, kind, fp->in, fp->out, fft_flags);
+    }
+
+    if (fp->p == NULL) {
+	/* disable this slot */
+	fft_plan_info_free(fp);
+	fp->n = 0;
+	return fft_make_plan(n, kind, in, out, FFTW_ESTIMATE);
+    }
+
+    if (fft_flags == FFTW_MEASURE) {
+	fft_wisdom_changed = 1;
+    }
+
+    fp->users = 1;
+    *slot = fp - fft_plans;
+
+    return fp->p;
+}
+
+/* Get a plan for a transform of length @n and type @kind from
+   @in to @out. On return @slot holds the index of the cache slot
+   that the plan belongs to, or -1 if the plan was made just for
+   these arrays. In either case the plan must be passed to
+   fft_plan_release() when done.
+*/
+
+static fftw_plan fft_get_plan (int n, int kind, void *in, void *out,
+			       int *slot)
+{
+    fftw_plan p;
+
+#if defined(_OPENMP)
+#pragma omp critical (gretl_fftw)
+#endif
+    p = real_fft_get_plan(n, kind, in, out, slot);
+
+    return p;
+}
+
+static void fft_plan_release (fftw_plan p, int slot)
+{
+    if (p == NULL) {
+	return;
+    }
+
+#if defined(_OPENMP)
+#pragma omp critical (gretl_fftw)
+#endif
+    {
+	if (slot >= 0) {
+	    fft_plans[slot].users -= 1;
+	} else {
+	    fftw_destroy_plan(p);
+	}
+    }
+}
+
+/* run a transform of length @n and type @kind from @in to @out */
+
+static int fft_execute (int n, int kind, void *in, void *out)
+{
+    fftw_plan p;
+    int slot;
+
+    p = fft_get_plan(n, kind, in, out, &slot);
+    if (p == NULL) {
+	return E_ALLOC;
+    }
+
+    if (kind == FFT_R2C) {
+	fftw_execute_dft_r2c(p, in, out);
+    } else if (kind == FFT_C2R) {
+	fftw_execute_dft_c2r(p, in, out);
+    } else {
+	fftw_execute_dft(p, in, out);
+    }
+
+    fft_plan_release(p, slot);
+
+    return 0;
+}
+
+/**
+ * gretl_fft_cleanup:
+ *
+ * Frees the cached FFTW plans, first saving the accumulated
+ * FFTW wisdom if we have been doing measured planning.
+ */
+
+void gretl_fft_cleanup (void)
+{
+    int i;
+
+    if (fft_wisdom_changed) {
+	gchar *fname;
+
+	fname = g_build_filename(gretl_dotdir(), FFT_WISDOM_FILE, NULL);
+	fftw_export_wisdom_to_filename(fname);
+	g_free(fname);
+	fft_wisdom_changed = 0;
+    }
+
+    for (i=0; i<n_fft_plans; i++) {
+	fft_plan_info_free(&fft_plans[i]);
+	fft_plans[i].users = 0;
+    }
+    n_fft_plans = fft_evict = 0;
+}
+
 /* helper function for fftw-based real FFT functions */
 
 static int fft_allocate (double **ffx, double complex **ffz,
@@ -78,7 +369,6 @@ real_matrix_fft (const gretl_matrix *y, int inverse,
 		 int newstyle, int *err)
 {
     gretl_matrix *ret = NULL;
-    fftw_plan p = NULL;
     double *ffx = NULL;
     double complex *ffz = NULL;
     double xr, xi;
@@ -134,17 +424,17 @@ real_matrix_fft (const gretl_matrix *y, int inverse,
 	    }
 	}
 
-	if (j == 0) {
-	    /* make the plan just once */
-	    if (inverse) {
-		p = fftw_plan_dft_c2r_1d(r, ffz, ffx, FFTW_ESTIMATE);
-	    } else {
-		p = fftw_plan_dft_r2c_1d(r, ffx, ffz, FFTW_ESTIMATE);
-	    }
-	}
-
 	/* run the transform */
-	fftw_execute(p);
+	if (inverse) {
+	    *err = fft_execute(r, FFT_C2R, ffz, ffx);
+	} else {
+	    *err = fft_execute(r, FFT_R2C, ffx, ffz);
+	}
+	if (*err) {
+	    gretl_matrix_free(ret);
+	    ret = NULL;
+	    break;
+	}
 
 	/* transcribe the result */
 	if (inverse) {
@@ -172,7 +462,6 @@ real_matrix_fft (const gretl_matrix *y, int inverse,
 	ci += 2;
     }
 
-    fftw_destroy_plan(p);
     fftw_free(ffz);
     fftw_free(ffx);
 
@@ -1213,6 +1502,181 @@ gretl_matrix *gretl_cmatrix_kronecker (const gretl_matrix *A,
     return gretl_cmatrix_kronlike(A, B, 0, err);
 }
 
+/* Smallest integer >= @n with no prime factors other than 2, 3
+   and 5: FFTW is at its fastest on transforms of such lengths.
+*/
+
+static int fft_good_size (int n)
+{
+    int m, k;
+
+    for (m=n; ; m++) {
+	k = m;
+	while (k % 2 == 0) k /= 2;
+	while (k % 3 == 0) k /= 3;
+	while (k % 5 == 0) k /= 5;
+	if (k == 1) {
+	    return m;
+	}
+    }
+
+    return n; /* not reached */
+}
+
+/**
+ * gretl_fft_worthwhile:
+ * @n: number of outputs required.
+ * @k: number of terms in each output (filter length or
+ * number of lags).
+ *
+ * Returns: 1 if a set of @n sums of @k products, such as a
+ * convolution or a set of autocovariances, should be computed
+ * via FFT rather than directly, otherwise 0.
+ */
+
+int gretl_fft_worthwhile (int n, int k)
+{
+    return k >= 32 && (double) n * k >= 2.0e5;
+}
+
+/**
+ * gretl_fft_convolve:
+ * @x: array of length @nx.
+ * @nx: length of @x.
+ * @h: array of filter coefficients, lag 0 first.
+ * @nh: length of @h.
+ * @y: array of length @nx to receive the output.
+ *
+ * Computes via FFT the causal convolution y_t = \sum_i h_i x_{t-i},
+ * for t = 0 to @nx - 1, treating x_s as zero for s < 0. The
+ * arrays @x and @h must not contain missing values.
+ *
+ * Returns: 0 on success, non-zero code on error.
+ */
+
+int gretl_fft_convolve (const double *x, int nx,
+			const double *h, int nh,
+			double *y)
+{
+    double *fx;
+    double complex *zx, *zh;
+    int i, N, nz;
+    int err;
+
+    if (nx < 1 || nh < 1) {
+	return E_DATA;
+    }
+
+    /* lags of order >= nx don't contribute */
+    nh = MIN(nh, nx);
+    /* avoid wrap-around in the first nx outputs */
+    N = fft_good_size(nx + nh - 1);
+    nz = N/2 + 1;
+
+    fx = fftw_malloc(N * sizeof *fx);
+    zx = fftw_malloc(nz * sizeof *zx);
+    zh = fftw_malloc(nz * sizeof *zh);
+    if (fx == NULL || zx == NULL || zh == NULL) {
+	fftw_free(fx);
+	fftw_free(zx);
+	fftw_free(zh);
+	return E_ALLOC;
+    }
+
+    /* transform of the filter */
+    for (i=0; i<N; i++) {
+	fx[i] = i < nh ? h[i] : 0.0;
+    }
+    err = fft_execute(N, FFT_R2C, fx, zh);
+
+    if (!err) {
+	/* transform of the data */
+	for (i=0; i<N; i++) {
+	    fx[i] = i < nx ? x[i] : 0.0;
+	}
+	err = fft_execute(N, FFT_R2C, fx, zx);
+    }
+
+    if (!err) {
+	for (i=0; i<nz; i++) {
+	    zx[i] *= zh[i] / N;
+	}
+	err = fft_execute(N, FFT_C2R, zx, fx);
+    }
+
+    if (!err) {
+	memcpy(y, fx, nx * sizeof *y);
+    }
+
+    fftw_free(fx);
+    fftw_free(zx);
+    fftw_free(zh);
+
+    return err;
+}
+
+/**
+ * gretl_fft_autocov:
+ * @x: array of length @n, which should have been demeaned
+ * if central moments are wanted.
+ * @n: length of @x.
+ * @m: maximum lag, less than @n.
+ * @c: array of length @m + 1 to receive the results.
+ *
+ * Computes via FFT the lagged cross-products
+ * c_k = \sum_{t=k}^{n-1} x_t x_{t-k} for k = 0 to @m. The
+ * array @x must not contain missing values.
+ *
+ * Returns: 0 on success, non-zero code on error.
+ */
+
+int gretl_fft_autocov (const double *x, int n, int m, double *c)
+{
+    double *fx;
+    double complex *zx;
+    int i, N, nz;
+    int err;
+
+    if (n < 1 || m < 0 || m >= n) {
+	return E_DATA;
+    }
+
+    /* padding by m suffices to keep the first m+1 lags
+       free of wrap-around */
+    N = fft_good_size(n + m);
+    nz = N/2 + 1;
+
+    fx = fftw_malloc(N * sizeof *fx);
+    zx = fftw_malloc(nz * sizeof *zx);
+    if (fx == NULL || zx == NULL) {
+	fftw_free(fx);
+	fftw_free(zx);
+	return E_ALLOC;
+    }
+
+    for (i=0; i<N; i++) {
+	fx[i] = i < n ? x[i] : 0.0;
+    }
+    err = fft_execute(N, FFT_R2C, fx, zx);
+
+    if (!err) {
+	for (i=0; i<nz; i++) {
+	    zx[i] = (creal(zx[i]) * creal(zx[i]) +
+		     cimag(zx[i]) * cimag(zx[i])) / N;
+	}
+	err = fft_execute(N, FFT_C2R, zx, fx);
+    }
+
+    if (!err) {
+	memcpy(c, fx, (m + 1) * sizeof *c);
+    }
+
+    fftw_free(fx);
+    fftw_free(zx);
+
+    return err;
+}
+
 /* Complex FFT (or inverse) via fftw */
 
 gretl_matrix *gretl_cmatrix_fft (const gretl_matrix *A,
@@ -1220,8 +1684,7 @@ gretl_matrix *gretl_cmatrix_fft (const gretl_matrix *A,
 {
     gretl_matrix *B = NULL;
     double complex *tmp, *ptr;
-    fftw_plan p;
-    int sign;
+    int kind;
     int r, c, j;
 
     if (!cmatrix_validate(A, 0)) {
@@ -1239,13 +1702,15 @@ gretl_matrix *gretl_cmatrix_fft (const gretl_matrix *A,
     c = A->cols;
 
     tmp = (double complex *) B->val;
-    sign = inverse ? FFTW_BACKWARD : FFTW_FORWARD;
+    kind = inverse ? FFT_C2C_BWD : FFT_C2C_FWD;
 
     ptr = tmp;
     for (j=0; j<c; j++) {
-	p = fftw_plan_dft_1d(r, ptr, ptr, sign, FFTW_ESTIMATE);
-	fftw_execute(p);
-	fftw_destroy_plan(p);
+	*err = fft_execute(r, kind, ptr, ptr);
+	if (*err) {
+	    gretl_matrix_free(B);
+	    return NULL;
+	}
 	/* advance pointer to next column */
 	ptr += r;
     }
@@ -62,6 +62,16 @@ int gretl_cmatrix_rank (const gretl_matrix *A, int *err);
 gretl_matrix *gretl_cmatrix_fft (const gretl_matrix *A, int inverse,
 				 int *err);
 
+int gretl_fft_worthwhile (int n, int k);
+
+int gretl_fft_convolve (const double *x, int nx,
+			const double *h, int nh,
+			double *y);
+
+int gretl_fft_autocov (const double *x, int n, int m, double *c);
+
+void gretl_fft_cleanup (void);
+
 gretl_matrix *gretl_cmatrix_build (const gretl_matrix *Re,
 				   const gretl_matrix *Im,
 				   double x, double y,
@@ -698,225 +698,348 @@ gretl_matrix *gretl_GHK (const gretl_matrix *C,
 
 /* below: revised version of GHK (plus score) */
 
-static void scaled_convex_combo (gretl_matrix *targ, double w,
-				 const gretl_matrix *m1,
-				 const gretl_matrix *m2,
-				 double scale)
-{
-    int i, n = gretl_vector_get_length(targ);
-    double x1, x2;
+/* Number of draws handled together in computing GHK plus
+   score: the per-draw quantities are stored with the draw
+   index varying fastest, so that the inner loops, over draws,
+   run on contiguous memory and can be vectorized.
+*/
 
-    for (i=0; i<n; i++) {
-	x1 = m1->val[i] * scale;
-	x2 = m2->val[i] * scale;
-	targ->val[i] = x2 - w * (x2 - x1);
+#define GHK_BATCH 64
+
+/* workspace for the GHK score calculation */
+
+typedef struct ghk_work_ ghk_work;
+
+struct ghk_work_ {
+    int m;         /* dimension */
+    int npar;      /* number of parameters */
+    double *TT;    /* m x GHK_BATCH: truncated normal draws */
+    double *dTT;   /* (m * npar) x GHK_BATCH: derivatives of TT */
+    double *dTA;   /* npar x GHK_BATCH: derivatives of TA */
+    double *dTB;   /* npar x GHK_BATCH: derivatives of TB */
+    double *dm;    /* npar x GHK_BATCH: derivatives of mj */
+    double *dWT;   /* npar x GHK_BATCH: derivatives of WT */
+    double *WT;    /* accumulated weights */
+    double *mj;    /* conditional means */
+    double *Tdiff; /* current probability increments */
+    double *xA;    /* standardized lower bounds */
+    double *xB;    /* standardized upper bounds */
+    double *sA;    /* scale factors for dTA */
+    double *sB;    /* scale factors for dTB */
+    double *sT;    /* scale factors for dTT */
+    double *uj;    /* current row of uniform draws */
+    double *dA0;   /* npar: derivatives of TA, first component */
+    double *dB0;   /* npar: derivatives of TB, first component */
+    double *a;     /* m: lower bounds for current obs */
+    double *b;     /* m: upper bounds for current obs */
+    double *dp;    /* npar: score for current obs */
+    double TA0;    /* first-component lower probability */
+    double TB0;    /* first-component upper probability */
+    char *okA;     /* lower bound is finite? */
+    char *okB;     /* upper bound is finite? */
+    char *okT;     /* density of TT is non-negligible? */
+    double *val;   /* storage for all of the above */
+};
+
+static void ghk_work_free (ghk_work *w)
+{
+    if (w != NULL) {
+	free(w->val);
+	free(w->okA);
+	free(w);
     }
 }
 
-static void combo_2 (gretl_matrix *targ,
-		     double w1, const gretl_matrix *m1,
-		     double w2, const gretl_matrix *m2)
+static ghk_work *ghk_work_new (int m, int npar)
 {
-    int i, n = gretl_vector_get_length(targ);
+    ghk_work *w = malloc(sizeof *w);
+    int nb = GHK_BATCH;
+    size_t sz;
 
-    for (i=0; i<n; i++) {
-	targ->val[i] = w1 * m1->val[i] + w2 * m2->val[i];
+    if (w == NULL) {
+	return NULL;
     }
-}
 
-static void vector_copy_mul (gretl_matrix *targ,
-			     const gretl_matrix *src,
-			     double w)
-{
-    int i, n = gretl_vector_get_length(targ);
+    sz = (m + m * npar + 4 * npar + 9) * nb + 3 * npar + 2 * m;
+    w->val = malloc(sz * sizeof *w->val);
+    w->okA = malloc(3 * nb);
 
-    for (i=0; i<n; i++) {
-	targ->val[i] = w * src->val[i];
+    if (w->val == NULL || w->okA == NULL) {
+	free(w->val);
+	free(w->okA);
+	free(w);
+	return NULL;
     }
+
+    w->m = m;
+    w->npar = npar;
+    w->TT = w->val;
+    w->dTT = w->TT + m * nb;
+    w->dTA = w->dTT + m * npar * nb;
+    w->dTB = w->dTA + npar * nb;
+    w->dm = w->dTB + npar * nb;
+    w->dWT = w->dm + npar * nb;
+    w->WT = w->dWT + npar * nb;
+    w->mj = w->WT + nb;
+    w->Tdiff = w->mj + nb;
+    w->xA = w->Tdiff + nb;
+    w->xB = w->xA + nb;
+    w->sA = w->xB + nb;
+    w->sB = w->sA + nb;
+    w->sT = w->sB + nb;
+    w->uj = w->sT + nb;
+    w->dA0 = w->uj + nb;
+    w->dB0 = w->dA0 + npar;
+    w->dp = w->dB0 + npar;
+    w->a = w->dp + npar;
+    w->b = w->a + m;
+    w->okB = w->okA + nb;
+    w->okT = w->okB + nb;
+
+    return w;
 }
 
-/* New-style GHK computation for observation t, iteration j,
-   including the derivatives.
+/* Compute the probabilities for the first component of the
+   current observation, and their derivatives: these do not
+   depend on the draws.
 */
 
-static double ghk_tj (const gretl_matrix *C,
-		      const gretl_matrix *a,
-		      const gretl_matrix *b,
-		      const double *u,
-		      gretl_matrix *dWT,
-		      gretl_matrix_block *Bk,
-		      double huge,
-		      int *err)
+static void ghk_obs_init (const gretl_matrix *C, ghk_work *w,
+			  double huge)
 {
-    double phi_min = 1.0e-300;
-    gretl_matrix *dTA = NULL;
-    gretl_matrix *dTB = NULL;
-    gretl_matrix *dm = NULL;
-    gretl_matrix *dx = NULL;
-    gretl_matrix *tmp = NULL;
-    gretl_matrix *cj = NULL;
-    gretl_matrix *TT = NULL;
-    gretl_matrix *dTT = NULL;
-    double TA, TB, Tdiff, WT;
-    double z, x, fx, den;
-    int m = C->rows;
-    int npar = m + m + m*(m+1)/2;
-    int inicol, j, i;
-
-    dTA = gretl_matrix_block_get_matrix(Bk, 0);
-    dTB = gretl_matrix_block_get_matrix(Bk, 1);
-    dm  = gretl_matrix_block_get_matrix(Bk, 2);
-    dx  = gretl_matrix_block_get_matrix(Bk, 3);
-    tmp = gretl_matrix_block_get_matrix(Bk, 4);
-    cj  = gretl_matrix_block_get_matrix(Bk, 5);
-    TT  = gretl_matrix_block_get_matrix(Bk, 6);
-    dTT = gretl_matrix_block_get_matrix(Bk, 7);
-
-    gretl_matrix_block_zero(Bk);
-    den = C->val[0];
-    gretl_matrix_reuse(dTT, npar, 1);
-
-    if (a->val[0] == -huge) {
-	TA = 0.0;
+    const double *a = w->a;
+    const double *b = w->b;
+    int m = w->m;
+    double z, x, den = C->val[0];
+    int i;
+
+    for (i=0; i<w->npar; i++) {
+	w->dA0[i] = w->dB0[i] = w->dp[i] = 0.0;
+    }
+
+    if (a[0] == -huge) {
+	w->TA0 = 0.0;
     } else {
-	z = a->val[0] / den;
-	TA = normal_cdf(z);
+	z = a[0] / den;
+	w->TA0 = normal_cdf(z);
 	x = normal_pdf(z) / den;
-	dTA->val[0] = x;
-	dTA->val[2*m] = -x/den;
+	w->dA0[0] = x;
+	w->dA0[2*m] = -x/den;
     }
 
-    if (b->val[0] == huge) {
-	TB = 1.0;
+    if (b[0] == huge) {
+	w->TB0 = 1.0;
     } else {
-	z = b->val[0] / den;
-	TB = normal_cdf(z);
+	z = b[0] / den;
+	w->TB0 = normal_cdf(z);
 	x = normal_pdf(z) / den;
-	dTB->val[m] = x;
-	dTB->val[2*m] = -x/den;
+	w->dB0[m] = x;
+	w->dB0[2*m] = -x/den;
+    }
+}
+
+/* GHK computation for the current observation, for the @nd
+   draws in the columns of @U, including the derivatives. The
+   probability is added to @P and the score to w->dp.
+*/
+
+static void ghk_batch (const gretl_matrix *C,
+		       const double *U, int nd,
+		       ghk_work *w, double huge,
+		       double *P)
+{
+    const double phi_min = 1.0e-300;
+    const double *a = w->a;
+    const double *b = w->b;
+    double *TT = w->TT;
+    double *dTT = w->dTT;
+    double *dTA = w->dTA;
+    double *dTB = w->dTB;
+    double *dm = w->dm;
+    double *dWT = w->dWT;
+    double *WT = w->WT;
+    double *uj = w->uj;
+    int m = w->m;
+    int npar = w->npar;
+    int nb = GHK_BATCH;
+    double TA, TB, x, fx, den;
+    double x1, x2, cjk;
+    int inicol, d, i, j, k;
+
+    /* first component */
+    for (d=0; d<nd; d++) {
+	uj[d] = U[d*m];
+	WT[d] = w->TB0 - w->TA0;
+	x = w->TB0 - uj[d] * WT[d];
+	TT[d] = normal_cdf_inverse(x);
+	w->sT[d] = 1 / normal_pdf(TT[d]);
     }
 
-    WT = TB - TA;
-    x = TB - u[0] * WT;
-    TT->val[0] = normal_cdf_inverse(x);
+    for (i=0; i<npar; i++) {
+	double *dTTi = dTT + i*nb;
+	double *dWTi = dWT + i*nb;
 
-    fx = normal_pdf(TT->val[0]);
-    scaled_convex_combo(dTT, u[0], dTA, dTB, 1/fx);
-    vector_diff(dWT, dTB, dTA);
+	for (d=0; d<nd; d++) {
+	    x1 = w->dA0[i] * w->sT[d];
+	    x2 = w->dB0[i] * w->sT[d];
+	    dTTi[d] = x2 - uj[d] * (x2 - x1);
+	    dWTi[d] = w->dB0[i] - w->dA0[i];
+	}
+    }
 
     /* first column of the gradient which refers to C */
     inicol = 2*m + 1;
 
     for (j=1; j<m; j++) {
-	double mj = 0.0;
-	int k = 0, flip = 0;
-
-	/* the "flip" switch implements a numerical trick
-	   that's needed to achieve acceptable precision when a[i]
-	   is large: in that case, we flip the signs of a and b
-	   so to exploit the greater accuracy of ndtr in the left-hand
-	   tail than in the right-hand one.
-	*/
+	double *TTj = TT + j*nb;
+	double *dTTj = dTT + j*npar*nb;
 
-	gretl_matrix_reuse(TT, j, 1);
-	gretl_matrix_reuse(cj, 1, j);
+	den = gretl_matrix_get(C, j, j);
 
-	for (i=0; i<j; i++) {
-	    cj->val[i] = gretl_matrix_get(C, j, i);
-	    mj += cj->val[i] * TT->val[i];
+	/* conditional means and their derivatives */
+	for (d=0; d<nd; d++) {
+	    uj[d] = U[d*m + j];
+	    w->mj[d] = 0.0;
 	}
+	for (k=0; k<j; k++) {
+	    cjk = gretl_matrix_get(C, j, k);
+	    for (d=0; d<nd; d++) {
+		w->mj[d] += cjk * TT[k*nb+d];
+	    }
+	}
+	for (i=0; i<npar; i++) {
+	    double *dmi = dm + i*nb;
 
-	gretl_matrix_zero(dx);
-	gretl_matrix_zero(dm);
+	    for (d=0; d<nd; d++) {
+		dmi[d] = 0.0;
+	    }
+	    for (k=0; k<j; k++) {
+		const double *dTTki = dTT + (k*npar + i)*nb;
 
-	for (i=inicol; i<=inicol+j-1; i++) {
-	    dm->val[i] = TT->val[k++];
-	}
-	/* don't do threaded multiplication under an OMP thread */
-	gretl_matrix_multiply_mod_single(cj, GRETL_MOD_NONE,
-					 dTT, GRETL_MOD_TRANSPOSE,
-					 tmp, GRETL_MOD_NONE);
-	gretl_matrix_add_to(dm, tmp);
-
-        den = gretl_matrix_get(C, j, j);
-
-	x = (a->val[j] - mj) / den;
-	if (x <= -huge) {
-            TA = 0.0;
-	    gretl_matrix_zero(dTA);
-	} else {	    
-	    if (x > 8.0) {
-#if GHK_DEBUG > 1
-		fprintf(stderr, "x=%.3f, flipping!\n", x);
-#endif
-		flip = 1;
-		TA = normal_cdf(-x);
-	    } else {
-		TA = normal_cdf(x);
+		cjk = gretl_matrix_get(C, j, k);
+		for (d=0; d<nd; d++) {
+		    dmi[d] += cjk * dTTki[d];
+		}
 	    }
-	    fx = normal_pdf(x);
-	    dx->val[j] = 1;
-	    vector_subtract(dx, dm);
-	    dx->val[inicol+j] -= x;
-	    vector_copy_mul(dTA, dx, fx/den);
-	}
-	
-	gretl_matrix_zero(dx);
-
-	x = (b->val[j] - mj) / den;
- 	if (x >= huge) {
-            TB = flip ? 0.0 : 1.0;
-	    gretl_matrix_zero(dTB);
-	} else {	    
-	    TB = normal_cdf(flip ? -x : x);
-	    fx = normal_pdf(x);
-	    dx->val[m+j] = 1;
-	    vector_subtract(dx, dm);
-	    dx->val[inicol+j] -= x;
-	    vector_copy_mul(dTB, dx, fx/den);
 	}
+	for (k=0; k<j; k++) {
+	    double *dmi = dm + (inicol+k)*nb;
 
-	if (flip) {
-	    Tdiff = TA - TB;
-	    x = TA - u[j] * Tdiff;
-	    TT->val[j] = -normal_cdf_inverse(x);
-	} else {
-	    Tdiff = TB - TA;
-	    x = TB - u[j] * Tdiff;
-	    TT->val[j] = normal_cdf_inverse(x);
+	    for (d=0; d<nd; d++) {
+		dmi[d] += TT[k*nb+d];
+	    }
 	}
 
-	if (na(TT->val[j])) {
-#if GHK_DEBUG
-	    fprintf(stderr, "TT is NA at j=%d (x=%g)\n", j, x);
-	    fprintf(stderr, " (TA=%.16g, TB=%.16g, u[j]=%g)\n", TA, TB, u[j]);
-#endif
-	    fx = 0.0;
-	} else {
-	    fx = normal_pdf(TT->val[j]);
+	/* The "flip" switch implements a numerical trick that's
+	   needed to achieve acceptable precision when a[j] is
+	   large: in that case, we flip the signs of a and b so
+	   as to exploit the greater accuracy of ndtr in the
+	   left-hand tail than in the right-hand one.
+	*/
+
+	for (d=0; d<nd; d++) {
+	    int flip = 0;
+
+	    x = (a[j] - w->mj[d]) / den;
+	    w->xA[d] = x;
+	    if (x <= -huge) {
+		TA = 0.0;
+		w->okA[d] = 0;
+	    } else {
+		if (x > 8.0) {
+		    flip = 1;
+		    TA = normal_cdf(-x);
+		} else {
+		    TA = normal_cdf(x);
+		}
+		w->sA[d] = normal_pdf(x) / den;
+		w->okA[d] = 1;
+	    }
+
+	    x = (b[j] - w->mj[d]) / den;
+	    w->xB[d] = x;
+	    if (x >= huge) {
+		TB = flip ? 0.0 : 1.0;
+		w->okB[d] = 0;
+	    } else {
+		TB = normal_cdf(flip ? -x : x);
+		w->sB[d] = normal_pdf(x) / den;
+		w->okB[d] = 1;
+	    }
+
+	    if (flip) {
+		w->Tdiff[d] = TA - TB;
+		x = TA - uj[d] * w->Tdiff[d];
+		TTj[d] = -normal_cdf_inverse(x);
+	    } else {
+		w->Tdiff[d] = TB - TA;
+		x = TB - uj[d] * w->Tdiff[d];
+		TTj[d] = normal_cdf_inverse(x);
+	    }
+
+	    fx = na(TTj[d]) ? 0.0 : normal_pdf(TTj[d]);
+	    if (fx < phi_min) {
+		w->okT[d] = 0;
+	    } else {
+		w->sT[d] = 1 / fx;
+		w->okT[d] = 1;
+	    }
 	}
 
-	if (fx < phi_min) {
-#if GHK_DEBUG
-	    fprintf(stderr, "uh-oh, phi=%g\n", fx);
-#endif
-	    gretl_matrix_zero(tmp);	    
-	} else {
-	    scaled_convex_combo(tmp, u[j], dTA, dTB, 1/fx);
+	/* derivatives of TA, TB, TT and the weight */
+	for (i=0; i<npar; i++) {
+	    double *dTAi = dTA + i*nb;
+	    double *dTBi = dTB + i*nb;
+	    double *dTTji = dTTj + i*nb;
+	    double *dWTi = dWT + i*nb;
+	    const double *dmi = dm + i*nb;
+	    double ea = (i == j)? 1.0 : 0.0;
+	    double eb = (i == m+j)? 1.0 : 0.0;
+	    int ec = (i == inicol+j);
+
+	    for (d=0; d<nd; d++) {
+		x = ea - dmi[d];
+		if (ec) {
+		    x -= w->xA[d];
+		}
+		dTAi[d] = w->okA[d] ? x * w->sA[d] : 0.0;
+		x = eb - dmi[d];
+		if (ec) {
+		    x -= w->xB[d];
+		}
+		dTBi[d] = w->okB[d] ? x * w->sB[d] : 0.0;
+	    }
+	    for (d=0; d<nd; d++) {
+		if (w->okT[d]) {
+		    x1 = dTAi[d] * w->sT[d];
+		    x2 = dTBi[d] * w->sT[d];
+		    dTTji[d] = x2 - uj[d] * (x2 - x1);
+		} else {
+		    dTTji[d] = 0.0;
+		}
+		dWTi[d] = WT[d] * (dTBi[d] - dTAi[d]) + w->Tdiff[d] * dWTi[d];
+	    }
 	}
-	gretl_matrix_reuse(dTT, npar, j+1);
-	gretl_matrix_inscribe_matrix(dTT, tmp, 0, j, GRETL_MOD_TRANSPOSE);
-	vector_diff(tmp, dTB, dTA);
-	combo_2(dWT, WT, tmp, Tdiff, dWT);
 
-	if (WT > 0) {
-	    WT *= Tdiff; /* accumulate weight */
+	for (d=0; d<nd; d++) {
+	    if (WT[d] > 0) {
+		WT[d] *= w->Tdiff[d]; /* accumulate weight */
+	    }
 	}
 
         inicol += j+1;
     }
 
-    return WT;
+    for (d=0; d<nd; d++) {
+	*P += WT[d];
+    }
+    for (i=0; i<npar; i++) {
+	const double *dWTi = dWT + i*nb;
+
+	for (d=0; d<nd; d++) {
+	    w->dp[i] += dWTi[d];
+	}
+    }
 }
 
 /* This function translates column positions
@@ -983,25 +1106,6 @@ static int reorder_dP (gretl_matrix *dP, int m)
     return 0;
 }
 
-/* workspace for ghk_tj */
-
-static gretl_matrix_block *ghk_block_alloc (int m, int npar)
-{
-    gretl_matrix_block *B = NULL;
-    gretl_matrix *M[8] = {NULL};
-
-    B = gretl_matrix_block_new(&M[0], 1, npar, /* dTA */
-			       &M[1], 1, npar, /* dTB */
-			       &M[2], 1, npar, /* dm */
-			       &M[3], 1, npar, /* dx */
-			       &M[4], 1, npar, /* tmp */
-			       &M[5], 1, m,    /* cj */
-			       &M[6], m, 1,    /* TT */
-			       &M[7], npar, m, /* dTT */
-			       NULL);
-    return B;
-}
-
 /* GHK including calculation of derivative */
 
 gretl_matrix *gretl_GHK2 (const gretl_matrix *C,
@@ -1014,12 +1118,8 @@ gretl_matrix *gretl_GHK2 (const gretl_matrix *C,
 #ifdef GHK_OMP
     unsigned sz = 0;
 #endif
-    gretl_matrix_block *Bk;
-    gretl_matrix_block *Bk2;
-    gretl_matrix *a, *b;
+    ghk_work *w;
     gretl_matrix *P = NULL;
-    gretl_matrix *dpj = NULL;
-    const double *uj;
     int r, n, m, npar;
     double huge;
     int t, i, j;
@@ -1057,24 +1157,12 @@ gretl_matrix *gretl_GHK2 (const gretl_matrix *C,
     set_cephes_hush(1);
 
 #ifdef GHK_OMP
-#pragma omp parallel if (sz>OMP_GHK_MIN) private(i,j,t,a,b,uj,Bk,Bk2,dpj)
+#pragma omp parallel if (sz>OMP_GHK_MIN) private(i,j,t,w)
 #endif
     {
-	Bk = gretl_matrix_block_new(&a, 1, m,
-				    &b, 1, m,
-				    NULL);
-	if (Bk == NULL) {
-	    *err = E_ALLOC;
-	}
-	Bk2 = ghk_block_alloc(m, npar);
-	if (Bk2 == NULL) {
-	    *err = E_ALLOC;
-	}
-	dpj = gretl_matrix_alloc(1, npar);
-	if (dpj == NULL) {
+	w = ghk_work_new(m, npar);
+	if (w == NULL) {
 	    *err = E_ALLOC;
-	}
-	if (*err) {
 	    goto calc_end;
 	}
 
@@ -1087,12 +1175,12 @@ gretl_matrix *gretl_GHK2 (const gretl_matrix *C,
 
 	    for (i=0; i<m; i++) {
 		/* transcribe and check bounds at current obs */
-		a->val[i] = gretl_matrix_get(A, t, i);
-		b->val[i] = gretl_matrix_get(B, t, i);
-		if (isnan(a->val[i]) || isnan(b->val[i])) {
+		w->a[i] = gretl_matrix_get(A, t, i);
+		w->b[i] = gretl_matrix_get(B, t, i);
+		if (isnan(w->a[i]) || isnan(w->b[i])) {
 		    err_t = E_MISSDATA;
 		    break;
-		} else if (b->val[i] < a->val[i]) {
+		} else if (w->b[i] < w->a[i]) {
 		    *err = err_t = E_DATA;
 		    break;
 		}
@@ -1108,20 +1196,23 @@ gretl_matrix *gretl_GHK2 (const gretl_matrix *C,
 		}
 	    }
 
-	    if (!err_t) {
-		for (j=0; j<r && !*err; j++) {
-		    /* Monte Carlo iterations, using successive columns of U */
-		    uj = U->val + j * m;
-		    P->val[t] += ghk_tj(C, a, b, uj, dpj, Bk2, huge, err);
-		    gretl_matrix_inscribe_matrix(dP, dpj, t, 0, GRETL_MOD_CUMULATE);
+	    if (!err_t && !*err) {
+		ghk_obs_init(C, w, huge);
+		for (j=0; j<r; j+=GHK_BATCH) {
+		    /* Monte Carlo iterations, using successive
+		       batches of columns of U */
+		    int nd = (r - j < GHK_BATCH)? r - j : GHK_BATCH;
+
+		    ghk_batch(C, U->val + j * m, nd, w, huge, &P->val[t]);
+		}
+		for (i=0; i<npar; i++) {
+		    gretl_matrix_set(dP, t, i, w->dp[i]);
 		}
 	    }
 	}
 
     calc_end:
-	gretl_matrix_block_destroy(Bk);
-	gretl_matrix_block_destroy(Bk2);
-	gretl_matrix_free(dpj);
+	ghk_work_free(w);
     } /* end (possibly) parallel section */
 
     set_cephes_hush(0);
@@ -0,0 +1,486 @@
+/*
+ *  gretl -- Gnu Regression, Econometrics and Time-series Library
+ *  Copyright (C) 2001 Allin Cottrell and Riccardo "Jack" Lucchetti
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Recursive least squares: an OLS fit that can be extended by one
+   observation, or shortened by one, at a cost of O(k^2) operations.
+
+   We hold the upper triangular Cholesky factor R of the augmented
+   cross-product matrix [X y]'[X y], of order k+1. Adding a row is
+   done via Givens rotations (as in a row-wise QR decomposition) and
+   removing one via the LINPACK dchdd downdating algorithm. The
+   leading k x k block of R is the factor of X'X; its last column
+   holds Q'y, from which the coefficients follow by back-substitution;
+   and the square of the bottom-right element is the sum of squared
+   residuals.
+*/
+
+#include "libgretl.h"
+#include "gretl_rls.h"
+
+/* relative size of a diagonal element of R, compared with the norm
+   of the corresponding column of X, below which we judge X to be of
+   less than full rank */
+#define RLS_RANK_TOL 1.0e-9
+
+struct rls_state_ {
+    int k;      /* number of regressors */
+    int K;      /* k + 1 */
+    int nobs;   /* number of observations included */
+    double *R;  /* K x K upper triangle, column-major */
+    double *ss; /* sums of squares of the columns of X */
+    double *a;  /* workspace, length 3 * K */
+};
+
+#define Rij(r,i,j) (r->R[(i) + (j) * r->K])
+
+/**
+ * rls_state_new:
+ * @k: number of regressors.
+ * @err: location to receive error code.
+ *
+ * Returns: a new recursive least squares state for @k regressors,
+ * holding no observations, or NULL on failure.
+ */
+
+rls_state *rls_state_new (int k, int *err)
+{
+    rls_state *r;
+
+    if (k < 1) {
+	*err = E_INVARG;
+	return NULL;
+    }
+
+    r = malloc(sizeof *r);
+    if (r == NULL) {
+	*err = E_ALLOC;
+	return NULL;
+    }
+
+    r->k = k;
+    r->K = k + 1;
+    r->R = malloc(r->K * r->K * sizeof *r->R);
+    r->ss = malloc(k * sizeof *r->ss);
+    r->a = malloc(3 * r->K * sizeof *r->a);
+
+    if (r->R == NULL || r->ss == NULL || r->a == NULL) {
+	rls_state_destroy(r);
+	*err = E_ALLOC;
+	return NULL;
+    }
+
+    rls_state_reset(r);
+
+    return r;
+}
+
+void rls_state_destroy (rls_state *r)
+{
+    if (r != NULL) {
+	free(r->R);
+	free(r->ss);
+	free(r->a);
+	free(r);
+    }
+}
+
+/**
+ * rls_state_reset:
+ * @r: recursive least squares state.
+ *
+ * Removes all observations from @r.
+ */
+
+void rls_state_reset (rls_state *r)
+{
+    int i;
+
+    for (i=0; i<r->K*r->K; i++) {
+	r->R[i] = 0.0;
+    }
+    for (i=0; i<r->k; i++) {
+	r->ss[i] = 0.0;
+    }
+    r->nobs = 0;
+}
+
+/**
+ * rls_add_obs:
+ * @r: recursive least squares state.
+ * @x: array of k regressor values.
+ * @y: value of the dependent variable.
+ *
+ * Adds the observation (@x, @y) to @r.
+ */
+
+void rls_add_obs (rls_state *r, const double *x, double y)
+{
+    double *a = r->a;
+    double h, c, s, t;
+    int j, l;
+
+    for (j=0; j<r->k; j++) {
+	a[j] = x[j];
+	r->ss[j] += x[j] * x[j];
+    }
+    a[r->k] = y;
+
+    for (j=0; j<r->K; j++) {
+	if (a[j] == 0.0) {
+	    continue;
+	}
+	h = hypot(Rij(r, j, j), a[j]);
+	c = Rij(r, j, j) / h;
+	s = a[j] / h;
+	Rij(r, j, j) = h;
+	for (l=j+1; l<r->K; l++) {
+	    t = Rij(r, j, l);
+	    Rij(r, j, l) = c * t + s * a[l];
+	    a[l] = c * a[l] - s * t;
+	}
+    }
+
+    r->nobs += 1;
+}
+
+/**
+ * rls_drop_obs:
+ * @r: recursive least squares state.
+ * @x: array of k regressor values.
+ * @y: value of the dependent variable.
+ *
+ * Removes the observation (@x, @y), which must previously have
+ * been added, from @r. This can fail if R is singular (including
+ * the case of an exact fit) or if the downdate is numerically
+ * unstable; the state of @r is then undefined and the caller
+ * should reset it and add back the wanted observations.
+ *
+ * Returns: 0 on success, %E_SINGULAR on failure.
+ */
+
+int rls_drop_obs (rls_state *r, const double *x, double y)
+{
+    double *p = r->a;
+    double *c = p + r->K;
+    double *s = c + r->K;
+    double alpha, scale, aa, bb, nrm;
+    double xx, t;
+    int i, j;
+
+    /* solve R'p = [x y] */
+    nrm = 0.0;
+    for (i=0; i<r->K; i++) {
+	if (Rij(r, i, i) == 0.0) {
+	    return E_SINGULAR;
+	}
+	p[i] = (i < r->k)? x[i] : y;
+	for (j=0; j<i; j++) {
+	    p[i] -= Rij(r, j, i) * p[j];
+	}
+	p[i] /= Rij(r, i, i);
+	nrm += p[i] * p[i];
+    }
+
+    if (nrm >= 1.0) {
+	return E_SINGULAR;
+    }
+
+    /* generate the rotations */
+    alpha = sqrt(1.0 - nrm);
+    for (i=r->K-1; i>=0; i--) {
+	scale = alpha + fabs(p[i]);
+	aa = alpha / scale;
+	bb = p[i] / scale;
+	nrm = sqrt(aa * aa + bb * bb);
+	c[i] = aa / nrm;
+	s[i] = bb / nrm;
+	alpha = scale * nrm;
+    }
+
+    /* and apply them */
+    for (j=0; j<r->K; j++) {
+	xx = 0.0;
+	for (i=j; i>=0; i--) {
+	    t = c[i] * xx + s[i] * Rij(r, i, j);
+	    Rij(r, i, j) = c[i] * Rij(r, i, j) - s[i] * xx;
+	    xx = t;
+	}
+    }
+
+    for (j=0; j<r->k; j++) {
+	r->ss[j] -= x[j] * x[j];
+	if (r->ss[j] < 0) {
+	    r->ss[j] = 0.0;
+	}
+    }
+
+    r->nobs -= 1;
+
+    return 0;
+}
+
+int rls_get_nobs (const rls_state *r)
+{
+    return r->nobs;
+}
+
+/**
+ * rls_full_rank:
+ * @r: recursive least squares state.
+ *
+ * Returns: 1 if the regressors in @r are of full column rank,
+ * otherwise 0.
+ */
+
+int rls_full_rank (const rls_state *r)
+{
+    int j;
+
+    if (r->nobs < r->k) {
+	return 0;
+    }
+
+    for (j=0; j<r->k; j++) {
+	if (r->ss[j] == 0.0 ||
+	    fabs(Rij(r, j, j)) <= RLS_RANK_TOL * sqrt(r->ss[j])) {
+	    return 0;
+	}
+    }
+
+    return 1;
+}
+
+/**
+ * rls_get_ess:
+ * @r: recursive least squares state.
+ *
+ * Returns: the sum of squared residuals for the observations
+ * currently in @r, or #NADBL if the regressors are not of
+ * full rank.
+ */
+
+double rls_get_ess (const rls_state *r)
+{
+    double e;
+
+    if (!rls_full_rank(r)) {
+	return NADBL;
+    }
+
+    e = Rij(r, r->k, r->k);
+
+    return e * e;
+}
+
+/**
+ * rls_get_coeffs:
+ * @r: recursive least squares state.
+ * @b: array of length k to receive the coefficients.
+ *
+ * Returns: 0 on success, %E_SINGULAR if the regressors in @r
+ * are not of full rank.
+ */
+
+int rls_get_coeffs (rls_state *r, double *b)
+{
+    int i, j;
+
+    if (!rls_full_rank(r)) {
+	return E_SINGULAR;
+    }
+
+    for (i=r->k-1; i>=0; i--) {
+	b[i] = Rij(r, i, r->k);
+	for (j=i+1; j<r->k; j++) {
+	    b[i] -= Rij(r, i, j) * b[j];
+	}
+	b[i] /= Rij(r, i, i);
+    }
+
+    return 0;
+}
+
+/**
+ * rls_recursive_resid:
+ * @r: recursive least squares state.
+ * @x: array of k regressor values.
+ * @y: value of the dependent variable.
+ * @err: location to receive error code.
+ *
+ * Computes the scaled one-step prediction error for (@x, @y)
+ * based on the observations currently in @r, namely
+ * (y - x'b) / sqrt(1 + x'(X'X)^{-1}x). Adding the observation
+ * to @r afterwards increases the sum of squared residuals by
+ * the square of this quantity.
+ *
+ * Returns: the recursive residual, or #NADBL on failure.
+ */
+
+double rls_recursive_resid (rls_state *r, const double *x,
+			    double y, int *err)
+{
+    double *b = r->a;
+    double *u = b + r->K;
+    double e, f = 1.0;
+    int i, j;
+
+    *err = rls_get_coeffs(r, b);
+    if (*err) {
+	return NADBL;
+    }
+
+    e = y;
+    for (i=0; i<r->k; i++) {
+	e -= x[i] * b[i];
+	/* forward-solve R'u = x */
+	u[i] = x[i];
+	for (j=0; j<i; j++) {
+	    u[i] -= Rij(r, j, i) * u[j];
+	}
+	u[i] /= Rij(r, i, i);
+	f += u[i] * u[i];
+    }
+
+    return e / sqrt(f);
+}
+
+static void rls_load_row (const gretl_matrix *X, int t, double *x)
+{
+    int j;
+
+    for (j=0; j<X->cols; j++) {
+	x[j] = gretl_matrix_get(X, t, j);
+    }
+}
+
+/* (Re-)initialize @r using rows @t1 to @t2 of X and y */
+
+static void rls_load_rows (rls_state *r, const gretl_matrix *y,
+			   const gretl_matrix *X, int t1, int t2,
+			   double *x)
+{
+    int t;
+
+    rls_state_reset(r);
+
+    for (t=t1; t<=t2; t++) {
+	rls_load_row(X, t, x);
+	rls_add_obs(r, x, y->val[t]);
+    }
+}
+
+/**
+ * gretl_matrix_rolling_ols:
+ * @y: T-vector, dependent variable.
+ * @X: T x k matrix of regressors.
+ * @window: length of estimation window, or 0 for recursive
+ * (expanding window) estimation.
+ * @err: location to receive error code.
+ *
+ * Computes the OLS coefficients for each window of @window
+ * consecutive observations, or if @window is 0 for each sample
+ * starting at the first observation, updating the fit with one
+ * observation added (and, for rolling windows, one dropped) at
+ * each step. Row t of the result holds the estimates based on
+ * data ending at observation t; rows for which the estimates
+ * are not defined are filled with NaN.
+ *
+ * Returns: a T x k matrix, or NULL on failure.
+ */
+
+gretl_matrix *gretl_matrix_rolling_ols (const gretl_matrix *y,
+					const gretl_matrix *X,
+					int window, int *err)
+{
+    gretl_matrix *B = NULL;
+    rls_state *r = NULL;
+    double *x = NULL, *b = NULL;
+    int T, k, t, j;
+    int ndrop = 0;
+
+    if (gretl_is_null_matrix(y) || gretl_is_null_matrix(X)) {
+	*err = E_INVARG;
+	return NULL;
+    }
+
+    T = gretl_vector_get_length(y);
+    k = X->cols;
+
+    if (T != X->rows) {
+	*err = E_NONCONF;
+	return NULL;
+    } else if (window < 0 || window > T || (window > 0 && window < k)) {
+	*err = E_INVARG;
+	return NULL;
+    } else if (gretl_matrix_na_check(y) || gretl_matrix_na_check(X)) {
+	*err = E_MISSDATA;
+	return NULL;
+    }
+
+    r = rls_state_new(k, err);
+    if (*err) {
+	return NULL;
+    }
+
+    B = gretl_matrix_alloc(T, k);
+    x = malloc(2 * k * sizeof *x);
+
+    if (B == NULL || x == NULL) {
+	*err = E_ALLOC;
+	goto bailout;
+    }
+
+    b = x + k;
+
+    for (t=0; t<T; t++) {
+	rls_load_row(X, t, x);
+	rls_add_obs(r, x, y->val[t]);
+	if (window > 0 && t >= window) {
+	    rls_load_row(X, t - window, x);
+	    /* re-accumulate from scratch once per full turnover
+	       of the window, to limit the build-up of rounding
+	       error from repeated downdating */
+	    if (++ndrop == window || rls_drop_obs(r, x, y->val[t - window])) {
+		rls_load_rows(r, y, X, t - window + 1, t, x);
+		ndrop = 0;
+	    }
+	}
+	if ((window > 0 && t < window - 1) || rls_get_coeffs(r, b)) {
+	    for (j=0; j<k; j++) {
+		gretl_matrix_set(B, t, j, NADBL);
+	    }
+	} else {
+	    for (j=0; j<k; j++) {
+		gretl_matrix_set(B, t, j, b[j]);
+	    }
+	}
+    }
+
+ bailout:
+
+    if (*err) {
+	gretl_matrix_free(B);
+	B = NULL;
+    }
+
+    rls_state_destroy(r);
+    free(x);
+
+    return B;
+}
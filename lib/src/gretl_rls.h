@@ -0,0 +1,50 @@
+/*
+ *  gretl -- Gnu Regression, Econometrics and Time-series Library
+ *  Copyright (C) 2001 Allin Cottrell and Riccardo "Jack" Lucchetti
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef GRETL_RLS_H
+#define GRETL_RLS_H
+
+typedef struct rls_state_ rls_state;
+
+rls_state *rls_state_new (int k, int *err);
+
+void rls_state_destroy (rls_state *r);
+
+void rls_state_reset (rls_state *r);
+
+void rls_add_obs (rls_state *r, const double *x, double y);
+
+int rls_drop_obs (rls_state *r, const double *x, double y);
+
+int rls_get_nobs (const rls_state *r);
+
+int rls_full_rank (const rls_state *r);
+
+double rls_get_ess (const rls_state *r);
+
+int rls_get_coeffs (rls_state *r, double *b);
+
+double rls_recursive_resid (rls_state *r, const double *x,
+			    double y, int *err);
+
+gretl_matrix *gretl_matrix_rolling_ols (const gretl_matrix *y,
+					const gretl_matrix *X,
+					int window, int *err);
+
+#endif /* GRETL_RLS_H */
@@ -30,6 +30,7 @@
 #include "gretl_xml.h"
 #include "forecast.h"
 #include "gretl_typemap.h"
+#include "gretl_cmatrix.h"
 
 #ifdef USE_CURL
 # include "gretl_www.h"
@@ -2642,6 +2643,7 @@ static void dotdir_cleanup (void)
 			       strcmp(fname, ".gretl2rc") &&
 			       strcmp(fname, "gretl.pid") &&
 			       strcmp(fname, "addons.idx") &&
+			       strcmp(fname, "fftw.wisdom") &&
 			       strcmp(fname, "mail.dat")) {
 			gretl_remove(fname);
 		    }
@@ -2692,6 +2694,7 @@ void libgretl_cleanup (void)
     gretl_command_hash_cleanup();
     gretl_function_hash_cleanup();
     lapack_mem_free();
+    gretl_fft_cleanup();
     forecast_matrix_cleanup();
     stored_options_cleanup();
     option_printing_cleanup();
@@ -25,6 +25,11 @@
 #include "vartest.h"
 #include "matrix_extra.h"
 #include "libset.h"
+#include "gretl_mt.h"
+
+#if defined(_OPENMP)
+# include <omp.h>
+#endif
 
 #define BDEBUG 0
 
@@ -51,6 +56,7 @@ struct irfboot_ {
     gretl_array *aresp; /* array variant of @resp */
     gretl_matrix *C0;   /* initial coefficient estimates (VECM only) */
     int *sample;        /* resampling array */
+    int shared;         /* @resp or @aresp belongs to another irfboot */
     DATASET *dset;      /* dummy dataset for levels (VECM only) */
 };
 
@@ -71,7 +77,8 @@ static void irf_boot_free (irfboot *b)
 	destroy_dataset(b->dset);
     }
 
-    if (b->aresp != NULL) {
+    if (!b->shared) {
+	gretl_matrix_free(b->resp);
 	gretl_array_destroy(b->aresp);
     }
 
@@ -79,32 +86,37 @@ static void irf_boot_free (irfboot *b)
     free(b);
 }
 
+/* Allocate workspace for @b; the storage for the responses
+   is allocated only if @b->shared is zero.
+*/
+
 static int boot_allocate (irfboot *b, const GRETL_VAR *v)
 {
     int n = v->neqns;
     int np = n * effective_order(v);
     int err = 0;
 
-    if (b->nresp > 1) {
-	b->aresp = gretl_matrix_array_sized(b->nresp,
-					    b->horizon, b->iters,
-					    &err);
-	if (!err) {
-	    b->MB = gretl_matrix_block_new(&b->rtmp, np, n,
-					   &b->wk1,   n, n,
-					   &b->wk2,  np, n,
-					   &b->rE, v->T, n,
-					   NULL);
+    if (!b->shared) {
+	if (b->nresp > 1) {
+	    b->aresp = gretl_matrix_array_sized(b->nresp,
+						b->horizon, b->iters,
+						&err);
+	} else {
+	    b->resp = gretl_matrix_alloc(b->horizon, b->iters);
+	    if (b->resp == NULL) {
+		err = E_ALLOC;
+	    }
+	}
+	if (err) {
+	    return err;
 	}
-    } else {
-	b->MB = gretl_matrix_block_new(&b->rtmp, np, n,
-				       &b->wk1,   n, n,
-				       &b->wk2,  np, n,
-				       &b->rE, v->T, n,
-				       &b->resp, b->horizon, b->iters,
-				       NULL);
     }
 
+    b->MB = gretl_matrix_block_new(&b->rtmp, np, n,
+				   &b->wk1,   n, n,
+				   &b->wk2,  np, n,
+				   &b->rE, v->T, n,
+				   NULL);
     if (b->MB == NULL) {
 	return E_ALLOC;
     }
@@ -145,6 +157,7 @@ static irfboot *irf_boot_new (const GRETL_VAR *var,
     b->Et = NULL;
     b->C0 = NULL;
     b->sample = NULL;
+    b->shared = 0;
     b->dset = NULL;
 
     b->nresp = nresp;
@@ -182,6 +195,36 @@ static irfboot *irf_boot_new (const GRETL_VAR *var,
     return b;
 }
 
+#if defined(_OPENMP)
+
+/* For use with parallel bootstrap rounds: create a "worker"
+   irfboot, with its own workspace, which writes its results
+   into the response storage of @b.
+*/
+
+static irfboot *irf_boot_clone (const irfboot *b, const GRETL_VAR *var)
+{
+    irfboot *w = malloc(sizeof *w);
+
+    if (w != NULL) {
+	*w = *b;
+	w->MB = NULL;
+	w->Xt = w->Yt = w->Et = NULL;
+	w->C0 = NULL;
+	w->sample = NULL;
+	w->dset = NULL;
+	w->shared = 1;
+	if (boot_allocate(w, var)) {
+	    irf_boot_free(w);
+	    w = NULL;
+	}
+    }
+
+    return w;
+}
+
+#endif
+
 /* Copy from @src into @rmax rows in @targ, starting
    at the row given by @offset; it is assumed that
    the two matrices have the same number of columns
@@ -814,7 +857,17 @@ static void compute_VAR_dataset (irfboot *b, GRETL_VAR *var,
    VAR/VECM.
 */
 
-static void irf_resample_resids (irfboot *b, const GRETL_VAR *vbak)
+static void irf_draw_sample (int *sample, int T)
+{
+    int t;
+
+    for (t=0; t<T; t++) {
+	sample[t] = gretl_rand_int_max(T);
+    }
+}
+
+static void irf_fill_resids (irfboot *b, const GRETL_VAR *vbak,
+			     const int *sample)
 {
     double eti;
     int i, t;
@@ -824,20 +877,27 @@ static void irf_resample_resids (irfboot *b, const GRETL_VAR *vbak)
     return;
 #endif
 
-    /* construct sampling array */
-    for (t=0; t<vbak->T; t++) {
-	b->sample[t] = gretl_rand_int_max(vbak->T);
-    }
-
     /* draw from the original residuals */
     for (i=0; i<vbak->neqns; i++) {
 	for (t=0; t<vbak->T; t++) {
-	    eti = gretl_matrix_get(vbak->E, b->sample[t], i);
+	    eti = gretl_matrix_get(vbak->E, sample[t], i);
 	    gretl_matrix_set(b->rE, t, i, eti);
 	}
     }
 }
 
+static void irf_resample_resids (irfboot *b, const GRETL_VAR *vbak)
+{
+    /* construct sampling array */
+    irf_draw_sample(b->sample, vbak->T);
+    irf_fill_resids(b, vbak, b->sample);
+}
+
+/* Note: the bounds are order statistics of the bootstrap
+   responses (plus the point estimate), which we find by
+   selection rather than by sorting the full set of draws
+*/
+
 static int irf_boot_quantiles (irfboot *b,
 			       gretl_matrix *R,
 			       double alpha,
@@ -871,10 +931,11 @@ static int irf_boot_quantiles (irfboot *b,
 		r0 = gretl_matrix_get(point, i, j);
 		gretl_matrix_row_to_array(resp, i, ri);
 		ri[b->iters] = r0;
-		qsort(ri, nr, sizeof *ri, gretl_compare_doubles);
 		gretl_matrix_set(R, i, Rcol, r0);
-		gretl_matrix_set(R, i, Rcol+1, ri[ilo-1]);
-		gretl_matrix_set(R, i, Rcol+2, ri[ihi-1]);
+		gretl_matrix_set(R, i, Rcol+1,
+				 gretl_array_order_statistic(ri, nr, ilo-1));
+		gretl_matrix_set(R, i, Rcol+2,
+				 gretl_array_order_statistic(ri, nr, ihi-1));
 	    }
 	    Rcol += 3;
 	}
@@ -883,10 +944,11 @@ static int irf_boot_quantiles (irfboot *b,
 	    r0 = point->val[i];
 	    gretl_matrix_row_to_array(b->resp, i, ri);
 	    ri[b->iters] = r0;
-	    qsort(ri, nr, sizeof *ri, gretl_compare_doubles);
 	    gretl_matrix_set(R, i, 0, r0);
-	    gretl_matrix_set(R, i, 1, ri[ilo-1]);
-	    gretl_matrix_set(R, i, 2, ri[ihi-1]);
+	    gretl_matrix_set(R, i, 1,
+			     gretl_array_order_statistic(ri, nr, ilo-1));
+	    gretl_matrix_set(R, i, 2,
+			     gretl_array_order_statistic(ri, nr, ihi-1));
 	}
     }
 
@@ -1036,6 +1098,163 @@ static GRETL_VAR *back_up_VAR (GRETL_VAR *v)
     return vbak;
 }
 
+#if defined(_OPENMP)
+
+/* Support for running the bootstrap rounds for a plain VAR in
+   parallel. Each thread gets its own workspace and its own copy
+   of the VAR matrices that are rewritten in each round. The
+   resampling arrays for each batch are drawn up front, in
+   sequence, from the common RNG, and any rounds that fail on
+   collinearity are redrawn serially after the batch, so for a
+   given seed the results do not depend on the number of threads.
+   They match those from the serial code only if no redraws are
+   needed: the serial code takes a redraw from the very next RNG
+   values, while here those have already gone to the following
+   rounds of the batch.
+*/
+
+#define IRF_CHUNK 32 /* rounds per thread, per batch */
+
+static void thread_VAR_free (GRETL_VAR *vt)
+{
+    if (vt != NULL) {
+	gretl_matrix_free(vt->Y);
+	gretl_matrix_free(vt->X);
+	gretl_matrix_free(vt->B);
+	gretl_matrix_free(vt->E);
+	gretl_matrix_free(vt->S);
+	gretl_matrix_free(vt->C);
+	gretl_matrix_free(vt->A);
+	free(vt);
+    }
+}
+
+/* A shallow copy of @v, sharing its read-only members but
+   with private copies of the matrices that get overwritten
+   by compute_VAR_dataset() and re_estimate_VAR().
+*/
+
+static GRETL_VAR *thread_VAR_new (const GRETL_VAR *v)
+{
+    GRETL_VAR *vt = malloc(sizeof *vt);
+
+    if (vt != NULL) {
+	*vt = *v;
+	vt->Y = gretl_matrix_copy(v->Y);
+	vt->X = gretl_matrix_copy(v->X);
+	vt->B = gretl_matrix_copy(v->B);
+	vt->E = gretl_matrix_copy(v->E);
+	vt->S = gretl_matrix_copy(v->S);
+	vt->C = gretl_matrix_copy(v->C);
+	vt->A = gretl_matrix_copy(v->A);
+	if (vt->Y == NULL || vt->X == NULL || vt->B == NULL ||
+	    vt->E == NULL || vt->S == NULL || vt->C == NULL ||
+	    vt->A == NULL) {
+	    thread_VAR_free(vt);
+	    vt = NULL;
+	}
+    }
+
+    return vt;
+}
+
+static int irf_boot_VAR_parallel (irfboot *boot, GRETL_VAR *var,
+				  const GRETL_VAR *vbak,
+				  int targ, int shock, int nt,
+				  int *scount)
+{
+    irfboot **wb = NULL;
+    GRETL_VAR **wv = NULL;
+    int *samples = NULL;
+    int *errs = NULL;
+    int T = vbak->T;
+    int chunk = IRF_CHUNK * nt;
+    int save_nt = 0;
+    int i, i0, n;
+    int err = 0;
+
+    wb = calloc(nt, sizeof *wb);
+    wv = calloc(nt, sizeof *wv);
+    samples = malloc((size_t) chunk * T * sizeof *samples);
+    errs = malloc(chunk * sizeof *errs);
+
+    if (wb == NULL || wv == NULL || samples == NULL || errs == NULL) {
+	err = E_ALLOC;
+    }
+
+    for (i=0; i<nt && !err; i++) {
+	wb[i] = irf_boot_clone(boot, var);
+	wv[i] = thread_VAR_new(var);
+	if (wb[i] == NULL || wv[i] == NULL) {
+	    err = E_ALLOC;
+	}
+    }
+
+    if (!err && blas_is_openblas()) {
+	/* avoid over-subscription within the parallel region */
+	save_nt = blas_get_num_threads();
+	blas_set_num_threads(1);
+    }
+
+    for (i0=0; i0<boot->iters && !err; i0+=chunk) {
+	n = MIN(chunk, boot->iters - i0);
+
+	/* draw the sampling arrays, in sequence */
+	for (i=0; i<n; i++) {
+	    irf_draw_sample(samples + (size_t) i * T, T);
+	}
+
+#pragma omp parallel for private(i) num_threads(nt)
+	for (i=0; i<n; i++) {
+	    int tid = omp_get_thread_num();
+	    irfboot *b = wb[tid];
+	    GRETL_VAR *v = wv[tid];
+
+	    irf_fill_resids(b, vbak, samples + (size_t) i * T);
+	    compute_VAR_dataset(b, v, vbak, i0 + i);
+	    errs[i] = re_estimate_VAR(b, v, targ, shock, i0 + i);
+	}
+
+	/* re-run any failed rounds serially, with fresh draws */
+	for (i=0; i<n && !err; i++) {
+	    int iter = i0 + i;
+
+	    while (errs[i]) {
+		if (irf_fatal(errs[i], boot, iter, *scount)) {
+		    err = errs[i];
+		    break;
+		}
+		*scount += 1;
+		irf_resample_resids(wb[0], vbak);
+		compute_VAR_dataset(wb[0], wv[0], vbak, iter);
+		errs[i] = re_estimate_VAR(wb[0], wv[0], targ, shock, iter);
+	    }
+	}
+    }
+
+    if (save_nt > 0) {
+	blas_set_num_threads(save_nt);
+    }
+
+    for (i=0; i<nt; i++) {
+	if (wb != NULL) {
+	    irf_boot_free(wb[i]);
+	}
+	if (wv != NULL) {
+	    thread_VAR_free(wv[i]);
+	}
+    }
+
+    free(wb);
+    free(wv);
+    free(samples);
+    free(errs);
+
+    return err;
+}
+
+#endif /* _OPENMP */
+
 /* public bootstrapping function, called from var.c */
 
 gretl_matrix *irf_bootstrap (GRETL_VAR *var,
@@ -1050,6 +1269,7 @@ gretl_matrix *irf_bootstrap (GRETL_VAR *var,
     irfboot *boot = NULL;
     int scount = 0;
     int nresp = 1;
+    int done = 0;
     int iter;
 
     if (targ < 0 && shock < 0) {
@@ -1097,7 +1317,19 @@ gretl_matrix *irf_bootstrap (GRETL_VAR *var,
     gretl_matrix_print(boot->C0, "boot->C0");
 #endif
 
-    for (iter=0; iter<boot->iters && !*err; iter++) {
+#if defined(_OPENMP)
+    if (!*err && var->ci == VAR && boot->iters > 1) {
+	int nt = get_omp_n_threads();
+
+	if (nt > 1) {
+	    *err = irf_boot_VAR_parallel(boot, var, vbak, targ, shock,
+					 nt, &scount);
+	    done = 1;
+	}
+    }
+#endif
+
+    for (iter=0; iter<boot->iters && !done && !*err; iter++) {
 #if BDEBUG
 	fprintf(stderr, "starting iteration %d\n", iter);
 #endif
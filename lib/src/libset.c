@@ -162,6 +162,8 @@ setvar setvars[] = {
     { ROBUST_Z,     "robust_z", CAT_ROBUST },
     { MWRITE_G,     "mwrite_g", CAT_BEHAVE },
     { MPI_USE_SMT,  "mpi_use_smt", CAT_BEHAVE },
+    { PLOT_LOD,     "plot_lod", CAT_BEHAVE },
+    { KDENSITY_EXACT, "kdensity_exact", CAT_BEHAVE },
     { STATE_FLAG_MAX, NULL },
     /* small integers */
     { GRETL_OPTIM,  "optimizer", CAT_NUMERIC, offsetof(set_state,optim) },
@@ -537,7 +539,7 @@ static void state_vars_copy (set_state *sv)
 }
 
 static set_state default_state = {
-    ECHO_ON | MSGS_ON | WARNINGS | SKIP_MISSING, /* .flags */
+    ECHO_ON | MSGS_ON | WARNINGS | SKIP_MISSING | PLOT_LOD, /* .flags */
     OPTIM_AUTO,     /* .optim */
     NORM_PHILLIPS,  /* .vecm_norm */
     ML_UNSET,       /* .garch_vcv */
@@ -53,7 +53,9 @@ typedef enum {
     ROBUST_Z        = 1 << 14, /* use z- not t-score with HCCM/HAC */
     MWRITE_G        = 1 << 15, /* use %g format with mwrite() */
     MPI_USE_SMT     = 1 << 16, /* MPI: use hyperthreads by default */
-    STATE_FLAG_MAX  = 1 << 17, /* separator */
+    PLOT_LOD        = 1 << 17, /* reduce plot data for large samples */
+    KDENSITY_EXACT  = 1 << 18, /* kdensity: always use direct summation */
+    STATE_FLAG_MAX  = 1 << 19, /* separator */
     /* state small int (but non-boolean) vars */
     GRETL_OPTIM,
     VECM_NORM,
@@ -18,6 +18,7 @@
  */
 
 #include "libgretl.h"
+#include "gretl_mt.h"
 
 /**
  * SECTION:nonparam
@@ -74,58 +75,52 @@ static double spearman_signif (double rho, int n)
     return 1.0;
 }
 
-enum {
-    RANK_X,
-    RANK_Y
+struct val_idx {
+    double v;
+    int i;
 };
 
-/* m = number of sorted values (sz); n = number of raw values (either
-   x or y); in case of missing values in x and/or y we may have m < n.
-*/
+/* sort into descending order of value, so that the largest
+   value gets rank 1 */
 
-static void make_ranking (const double *sz, int m,
-			  const double *x, const double *y,
-			  int n, double *rz, int *ties,
-			  int which)
+static int compare_vals_inverse (const void *a, const void *b)
 {
-    const double *z;
-    int cases, k, i, j;
-    double avg, r = 1;
+    const struct val_idx *pa = a;
+    const struct val_idx *pb = b;
+
+    return (pa->v < pb->v) - (pa->v > pb->v);
+}
+
+/* Write into @rz the (descending) ranks of the @m values in @z,
+   with tied values getting the average of the ranks they span.
+   @vi is workspace of length @m. Sorting (value, index) pairs
+   makes this O(m log m) rather than scanning the raw data once
+   per distinct value.
+*/
 
-    z = (which == RANK_X)? x : y;
+static void make_ranking (const double *z, int m, double *rz,
+			  struct val_idx *vi, int *ties)
+{
+    double avg;
+    int i, j, k;
 
     for (i=0; i<m; i++) {
-	/* scan sorted z */
-	cases = k = 0;
+	vi[i].v = z[i];
+	vi[i].i = i;
+    }
 
-	if (i > 0 && sz[i] == sz[i-1]) {
-	    continue;
-	}
+    qsort(vi, m, sizeof *vi, compare_vals_inverse);
 
-	for (j=0; j<n; j++) {
-	    /* scan raw z for matches */
-	    if (!na(x[j]) && !na(y[j])) {
-		if (z[j] == sz[i]) {
-		    rz[k] = r;
-		    cases++;
-		}
-		k++;
-	    }
+    for (i=0; i<m; i=j) {
+	for (j=i+1; j<m && vi[j].v == vi[i].v; j++) ;
+	/* positions i to j-1 hold ranks i+1 to j */
+	avg = (i + 1 + j) / 2.0;
+	for (k=i; k<j; k++) {
+	    rz[vi[k].i] = avg;
 	}
-
-	if (cases > 1) {
-	    avg = (r + r + cases - 1.0) / 2.0;
-	    for (j=0; j<m; j++) {
-		if (rz[j] == r) {
-		    rz[j] = avg;
-		}
-	    }
-	    if (ties != NULL) {
-		*ties = 1;
-	    }
+	if (j - i > 1 && ties != NULL) {
+	    *ties = 1;
 	}
-
-	r += cases;
     }
 }
 
@@ -133,6 +128,7 @@ static int rankcorr_get_rankings (const double *x, const double *y, int n,
 				  double **rxout, double **ryout,
 				  int *pm, int *ties)
 {
+    struct val_idx *vi = NULL;
     double *sx = NULL, *sy = NULL;
     double *rx = NULL, *ry = NULL;
     int i, m = 0;
@@ -152,13 +148,15 @@ static int rankcorr_get_rankings (const double *x, const double *y, int n,
     sy = malloc(m * sizeof *sy);
     rx = malloc(m * sizeof *rx);
     ry = malloc(m * sizeof *ry);
+    vi = malloc(m * sizeof *vi);
 
-    if (sx == NULL || sy == NULL ||
-	rx == NULL || ry == NULL) {
+    if (sx == NULL || sy == NULL || rx == NULL ||
+	ry == NULL || vi == NULL) {
 	free(sx);
 	free(sy);
 	free(rx);
 	free(ry);
+	free(vi);
 	return E_ALLOC;
     }
 
@@ -172,17 +170,8 @@ static int rankcorr_get_rankings (const double *x, const double *y, int n,
 	}
     }
 
-    /* get sorted series */
-    qsort(sx, m, sizeof *sx, gretl_inverse_compare_doubles);
-    qsort(sy, m, sizeof *sy, gretl_inverse_compare_doubles);
-
-    for (i=0; i<m; i++) {
-	rx[i] = ry[i] = 0.0;
-    }
-
-    /* make rankings by comparing "raw" x, y with sorted */
-    make_ranking(sx, m, x, y, n, rx, ties, RANK_X);
-    make_ranking(sy, m, x, y, n, ry, ties, RANK_Y);
+    make_ranking(sx, m, rx, vi, ties);
+    make_ranking(sy, m, ry, vi, ties);
 
     /* save the ranks */
     *rxout = rx;
@@ -194,6 +183,7 @@ static int rankcorr_get_rankings (const double *x, const double *y, int n,
 
     free(sx);
     free(sy);
+    free(vi);
 
     return 0;
 }
@@ -412,127 +402,189 @@ static int compare_pairs_x (const void *a, const void *b)
     return ret;
 }
 
-static int compare_pairs_y (const void *a, const void *b)
-{
-    const struct xy_pair *pa = a;
-    const struct xy_pair *pb = b;
-
-    return (pa->y > pb->y) - (pa->y < pb->y);
-}
+/* Accumulate the tie statistics used by Kendall's tau over the
+   sorted array @z: T[0] = sum of t(t-1), T[1] = sum of t(t-1)(t-2)
+   and T[2] = sum of t(t-1)(2t+5), where t is the length of each
+   run of tied values.
+*/
 
-static int real_kendall_tau (const double *x, const double *y,
-			     int n, struct xy_pair *xy, int nn,
-			     double *ptau, double *pz)
+static void kendall_tie_sums (const double *z, int n, double *T)
 {
-    double tau, nn1, s2, z;
-    int tt1, tx = 0, ty = 0;
-    int Tx = 0, Ty = 0;
-    int Tx2 = 0, Ty2 = 0;
-    int Tx25 = 0, Ty25 = 0;
-    int tie, N0, N1, S;
+    double t, tt1;
     int i, j;
 
-    /* populate sorter */
-    j = 0;
-    for (i=0; i<n; i++) {
-	if (!na(x[i]) && !na(y[i])) {
-	    xy[j].x = x[i];
-	    xy[j].y = y[i];
-	    j++;
+    T[0] = T[1] = T[2] = 0.0;
+
+    for (i=0; i<n; i=j) {
+	for (j=i+1; j<n && z[j] == z[i]; j++) ;
+	if (j - i > 1) {
+	    t = j - i;
+	    tt1 = t * (t - 1);
+	    T[0] += tt1;
+	    T[1] += tt1 * (t - 2);
+	    T[2] += tt1 * (2 * t + 5);
 	}
     }
+}
 
-    /* sort pairs by x */
-    qsort(xy, nn, sizeof *xy, compare_pairs_x);
+/* Sort @y into ascending order by bottom-up merge sort, returning
+   the number of strict inversions (i < j with y[i] > y[j]) that
+   were removed; @tmp is workspace of the same length as @y.
+*/
 
-    /* make order counts */
-    N0 = N1 = 0;
-    for (i=0; i<nn; i++) {
-	for (j=i+1; j<nn; j++) {
-	    if (xy[j].y == xy[i].y) {
-		Ty++;
-	    } else if (xy[j].x != xy[i].x) {
-		if (xy[j].y > xy[i].y) {
-		    N0++;
-		} else if (xy[j].y < xy[i].y) {
-		    N1++;
+static double merge_count_swaps (double *y, double *tmp, int n)
+{
+    double *src = y, *dst = tmp, *sw;
+    double swaps = 0;
+    int w, lo, mid, hi;
+    int i, j, k;
+
+    for (w=1; w<n; w*=2) {
+	for (lo=0; lo<n; lo+=2*w) {
+	    mid = (lo + w < n)? lo + w : n;
+	    hi = (lo + 2*w < n)? lo + 2*w : n;
+	    i = k = lo;
+	    j = mid;
+	    while (i < mid && j < hi) {
+		if (src[j] < src[i]) {
+		    swaps += mid - i;
+		    dst[k++] = src[j++];
+		} else {
+		    dst[k++] = src[i++];
 		}
 	    }
-	}
-	if (i > 0) {
-	    /* account for ties in x */
-	    tie = (xy[i].x == xy[i-1].x);
-	    if (tie) {
-		tx++;
+	    while (i < mid) {
+		dst[k++] = src[i++];
 	    }
-	    if (tx > 0 && (!tie || i == nn - 1)) {
-		tx++;
-		tt1 = tx * (tx - 1);
-		Tx += tt1;
-		Tx2 += tt1 * (tx - 2);
-		Tx25 += tt1 * (2 * tx + 5);
-		tx = 0;
+	    while (j < hi) {
+		dst[k++] = src[j++];
 	    }
 	}
+	sw = src;
+	src = dst;
+	dst = sw;
     }
 
-    if (Ty > 0) {
-	/* account for ties in y */
-	Ty = 0;
-	qsort(xy, nn, sizeof *xy, compare_pairs_y);
-	for (i=1; i<nn; i++) {
-	    tie = (xy[i].y == xy[i-1].y);
-	    if (tie) {
-		ty++;
-	    }
-	    if (ty > 0 && (!tie || i == nn - 1)) {
-		ty++;
-		tt1 = ty * (ty - 1);
-		Ty += tt1;
-		Ty2 += tt1 * (ty - 2);
-		Ty25 += tt1 * (2 * ty + 5);
-		ty = 0;
-	    }
-	}
+    if (src != y) {
+	memcpy(y, src, n * sizeof *y);
     }
 
-    S = N0 - N1;
-
-#if 0
-    fprintf(stderr, "N0 = %d, N1 = %d, S = %d\n", N0, N1, S);
-    fprintf(stderr, "Tx = %d, Ty = %d\n", Tx, Ty);
-#endif
+    return swaps;
+}
 
-    nn1 = nn * (nn - 1.0);
+/* Given @nn valid pairs, the score S = concordant minus discordant
+   pairs and the tie sums for x and y, compute tau and the z-score
+   for the normal approximation as in Shapiro and Chen, Journal of
+   Quality Technology, 2001.
+*/
 
-    /* normal approximation as in Shapiro and Chen,
-       Journal of Quality Technology, 2001 */
+static void kendall_finish (int nn, double S,
+			    const double *Tx, const double *Ty,
+			    double *ptau, double *pz)
+{
+    double tau, s2, nn1 = nn * (nn - 1.0);
 
-    if (Tx == 0 && Ty == 0) {
+    if (Tx[0] == 0 && Ty[0] == 0) {
 	tau = 2 * S / nn1;
 	s2 = (1.0/18) * nn1 * (2 * nn + 5);
     } else {
-	double den = (nn1 - Tx) * (nn1 - Ty);
+	double den = (nn1 - Tx[0]) * (nn1 - Ty[0]);
 
 	tau = 2 * S / sqrt(den);
-	s2 = (1.0/18) * (nn1 * (2 * nn + 5) - Tx25 - Ty25);
-	if (Tx2 != 0 && Ty2 != 0) {
-	    s2 += (1.0/(9*nn1*(nn-2))) * Tx2 * Ty2;
+	s2 = (1.0/18) * (nn1 * (2 * nn + 5) - Tx[2] - Ty[2]);
+	if (Tx[1] != 0 && Ty[1] != 0) {
+	    s2 += (1.0/(9*nn1*(nn-2))) * Tx[1] * Ty[1];
 	}
-	if (Tx != 0 && Ty != 0) {
-	    s2 += (1.0/(2*nn1)) * Tx * Ty;
+	if (Tx[0] != 0 && Ty[0] != 0) {
+	    s2 += (1.0/(2*nn1)) * Tx[0] * Ty[0];
 	}
     }
 
-    z = (S - 1) / sqrt(s2);
-
     if (ptau != NULL) {
 	*ptau = tau;
     }
-
     if (pz != NULL) {
-	*pz = z;
+	*pz = (S - 1) / sqrt(s2);
     }
+}
+
+/* Count the pairs tied on both x and y, given @xy sorted by
+   x then y: such pairs form contiguous runs.
+*/
+
+static double joint_tie_pairs (const struct xy_pair *xy, int nn)
+{
+    double n3 = 0;
+    int i, j;
+
+    for (i=0; i<nn; i=j) {
+	for (j=i+1; j<nn && xy[j].x == xy[i].x &&
+		 xy[j].y == xy[i].y; j++) ;
+	n3 += (j - i) * (j - i - 1.0) / 2;
+    }
+
+    return n3;
+}
+
+/* Kendall's tau via Knight's O(n log n) algorithm (JASA, 1966):
+   with the pairs sorted by x then y, the number of discordant pairs
+   equals the number of swaps needed to merge-sort the y values, and
+   the counts of tied pairs drop out of run-length scans.
+*/
+
+static int real_kendall_tau (const double *x, const double *y,
+			     int n, struct xy_pair *xy, int nn,
+			     double *ptau, double *pz)
+{
+    double Tx[3], Ty[3];
+    double *ys, *tmp;
+    double n0, n3, swaps, S;
+    int i, j;
+
+    ys = malloc(2 * nn * sizeof *ys);
+    if (ys == NULL) {
+	return E_ALLOC;
+    }
+    tmp = ys + nn;
+
+    /* populate sorter */
+    j = 0;
+    for (i=0; i<n; i++) {
+	if (!na(x[i]) && !na(y[i])) {
+	    xy[j].x = x[i];
+	    xy[j].y = y[i];
+	    j++;
+	}
+    }
+
+    /* sort pairs by x, then y */
+    qsort(xy, nn, sizeof *xy, compare_pairs_x);
+
+    /* ties in x, and joint ties */
+    for (i=0; i<nn; i++) {
+	ys[i] = xy[i].x;
+    }
+    kendall_tie_sums(ys, nn, Tx);
+    n3 = joint_tie_pairs(xy, nn);
+
+    /* discordant pairs, and ties in y */
+    for (i=0; i<nn; i++) {
+	ys[i] = xy[i].y;
+    }
+    swaps = merge_count_swaps(ys, tmp, nn);
+    kendall_tie_sums(ys, nn, Ty);
+
+    n0 = nn * (nn - 1.0) / 2;
+    S = n0 - Tx[0]/2 - Ty[0]/2 + n3 - 2 * swaps;
+
+#if 0
+    fprintf(stderr, "swaps = %g, n3 = %g, S = %g\n", swaps, n3, S);
+    fprintf(stderr, "Tx = %g, Ty = %g\n", Tx[0], Ty[0]);
+#endif
+
+    kendall_finish(nn, S, Tx, Ty, ptau, pz);
+
+    free(ys);
 
     return 0;
 }
@@ -665,6 +717,299 @@ int kendall_tau (const int *list, const DATASET *dset,
     return err;
 }
 
+static int compare_vals (const void *a, const void *b)
+{
+    const struct val_idx *pa = a;
+    const struct val_idx *pb = b;
+
+    return (pa->v > pb->v) - (pa->v < pb->v);
+}
+
+/* Kendall's tau for columns @i and @j of @X, which has no missing
+   values, given the ascending sort order of each column in @ord and
+   the per-column tie sums in @T. @ys is workspace of length
+   2 * X->rows.
+*/
+
+static double kendall_tau_cols (const gretl_matrix *X, int i, int j,
+				const int *ord, const double *T,
+				double *ys)
+{
+    int n = X->rows;
+    const int *oi = ord + i * n;
+    const double *xi = X->val + i * n;
+    const double *xj = X->val + j * n;
+    double n3 = 0, swaps, S, tau;
+    int s, t, u, v;
+
+    for (t=0; t<n; t++) {
+	ys[t] = xj[oi[t]];
+    }
+
+    /* order y within runs of tied x, and count joint ties */
+    for (s=0; s<n; s=t) {
+	for (t=s+1; t<n && xi[oi[t]] == xi[oi[s]]; t++) ;
+	if (t - s > 1) {
+	    qsort(ys + s, t - s, sizeof *ys, gretl_compare_doubles);
+	    for (u=s; u<t; u=v) {
+		for (v=u+1; v<t && ys[v] == ys[u]; v++) ;
+		n3 += (v - u) * (v - u - 1.0) / 2;
+	    }
+	}
+    }
+
+    swaps = merge_count_swaps(ys, ys + n, n);
+    S = n * (n - 1.0) / 2 - T[3*i]/2 - T[3*j]/2 + n3 - 2 * swaps;
+    kendall_finish(n, S, T + 3*i, T + 3*j, &tau, NULL);
+
+    return tau;
+}
+
+/* Kendall matrix for @X with no missing values: each column is
+   sorted just once, then the pairs are handled in parallel.
+*/
+
+static int kendall_matrix_fill (const gretl_matrix *X, gretl_matrix *R)
+{
+    int n = X->rows;
+    int k = X->cols;
+    struct val_idx *vi;
+    double *T, *sv;
+    int *ord;
+    int i, j, t;
+    int err = 0;
+
+    vi = malloc(n * sizeof *vi);
+    sv = malloc(n * sizeof *sv);
+    ord = malloc(n * k * sizeof *ord);
+    T = malloc(3 * k * sizeof *T);
+
+    if (vi == NULL || sv == NULL || ord == NULL || T == NULL) {
+	err = E_ALLOC;
+	goto bailout;
+    }
+
+    for (j=0; j<k; j++) {
+	const double *xj = X->val + j * n;
+
+	for (t=0; t<n; t++) {
+	    vi[t].v = xj[t];
+	    vi[t].i = t;
+	}
+	qsort(vi, n, sizeof *vi, compare_vals);
+	for (t=0; t<n; t++) {
+	    ord[j*n+t] = vi[t].i;
+	    sv[t] = vi[t].v;
+	}
+	kendall_tie_sums(sv, n, T + 3*j);
+    }
+
+#if defined(_OPENMP)
+#pragma omp parallel for private(i, j) if (gretl_use_openmp((guint64) k * k * n))
+#endif
+    for (i=0; i<k-1; i++) {
+	double tau, *ys = malloc(2 * n * sizeof *ys);
+
+	if (ys == NULL) {
+#if defined(_OPENMP)
+#pragma omp critical (rankcorr_error)
+#endif
+	    err = E_ALLOC;
+	    continue;
+	}
+	for (j=i+1; j<k; j++) {
+	    tau = kendall_tau_cols(X, i, j, ord, T, ys);
+	    gretl_matrix_set(R, i, j, tau);
+	    gretl_matrix_set(R, j, i, tau);
+	}
+	free(ys);
+    }
+
+ bailout:
+
+    free(vi);
+    free(sv);
+    free(ord);
+    free(T);
+
+    return err;
+}
+
+/* Spearman matrix for @X with no missing values: rank each column
+   once, then take Pearson correlations of the centered ranks via a
+   single cross-product.
+*/
+
+static int spearman_matrix_fill (const gretl_matrix *X, gretl_matrix *R)
+{
+    int n = X->rows;
+    int k = X->cols;
+    struct val_idx *vi;
+    gretl_matrix *Rk;
+    double rbar = (n + 1) / 2.0;
+    double d;
+    int i, j, t;
+    int err = 0;
+
+    vi = malloc(n * sizeof *vi);
+    Rk = gretl_matrix_alloc(n, k);
+
+    if (vi == NULL || Rk == NULL) {
+	err = E_ALLOC;
+	goto bailout;
+    }
+
+    for (j=0; j<k; j++) {
+	double *rj = Rk->val + j * n;
+
+	make_ranking(X->val + j * n, n, rj, vi, NULL);
+	for (t=0; t<n; t++) {
+	    rj[t] -= rbar;
+	}
+    }
+
+    err = gretl_matrix_multiply_mod(Rk, GRETL_MOD_TRANSPOSE,
+				    Rk, GRETL_MOD_NONE,
+				    R, GRETL_MOD_NONE);
+
+    if (!err) {
+	for (i=0; i<k; i++) {
+	    for (j=i+1; j<k; j++) {
+		d = gretl_matrix_get(R, i, i) * gretl_matrix_get(R, j, j);
+		d = (d > 0)? gretl_matrix_get(R, i, j) / sqrt(d) : NADBL;
+		gretl_matrix_set(R, i, j, d);
+		gretl_matrix_set(R, j, i, d);
+	    }
+	}
+    }
+
+ bailout:
+
+    free(vi);
+    gretl_matrix_free(Rk);
+
+    return err;
+}
+
+/* Fallback for data with missing values: each pair is handled
+   separately, using the observations valid for both columns.
+*/
+
+static int rankcorr_matrix_pairwise (const gretl_matrix *X,
+				     gretl_matrix *R,
+				     gretlopt opt)
+{
+    int n = X->rows;
+    int k = X->cols;
+    int i, j;
+    int err = 0;
+
+#if defined(_OPENMP)
+#pragma omp parallel for private(i, j) if (gretl_use_openmp((guint64) k * k * n))
+#endif
+    for (i=0; i<k-1; i++) {
+	const double *xi = X->val + i * n;
+	struct xy_pair *xy = NULL;
+	double r, z;
+	int m, t, e;
+
+	if (!(opt & OPT_S)) {
+	    xy = malloc(n * sizeof *xy);
+	    if (xy == NULL) {
+#if defined(_OPENMP)
+#pragma omp critical (rankcorr_error)
+#endif
+		err = E_ALLOC;
+		continue;
+	    }
+	}
+	for (j=i+1; j<k; j++) {
+	    const double *xj = X->val + j * n;
+
+	    r = NADBL;
+	    if (opt & OPT_S) {
+		e = real_spearman_rho(xi, xj, n, &r, &z, NULL, NULL, &m);
+	    } else {
+		for (m=0, t=0; t<n; t++) {
+		    m += !na(xi[t]) && !na(xj[t]);
+		}
+		e = (m < 2)? E_TOOFEW :
+		    real_kendall_tau(xi, xj, n, xy, m, &r, NULL);
+	    }
+	    if (e == E_ALLOC) {
+#if defined(_OPENMP)
+#pragma omp critical (rankcorr_error)
+#endif
+		err = e;
+	    }
+	    if (e) {
+		r = NADBL;
+	    }
+	    gretl_matrix_set(R, i, j, r);
+	    gretl_matrix_set(R, j, i, r);
+	}
+	free(xy);
+    }
+
+    return err;
+}
+
+/**
+ * rank_correlation_matrix:
+ * @X: data matrix, with observations in rows.
+ * @opt: %OPT_S for Spearman's rho, otherwise Kendall's tau.
+ * @err: location to receive error code.
+ *
+ * Computes the matrix of rank correlations between the columns
+ * of @X. If @X contains no missing values each column is sorted
+ * or ranked only once; otherwise each pair of columns uses the
+ * observations at which both are valid.
+ *
+ * Returns: a k x k symmetric matrix, where k is the number of
+ * columns in @X, or NULL on failure.
+ */
+
+gretl_matrix *rank_correlation_matrix (const gretl_matrix *X,
+				       gretlopt opt, int *err)
+{
+    gretl_matrix *R;
+    int i, k;
+
+    if (gretl_is_null_matrix(X) || X->cols < 2 || X->rows < 2) {
+	*err = E_INVARG;
+	return NULL;
+    }
+
+    k = X->cols;
+    R = gretl_matrix_alloc(k, k);
+    if (R == NULL) {
+	*err = E_ALLOC;
+	return NULL;
+    }
+
+    for (i=0; i<k; i++) {
+	gretl_matrix_set(R, i, i, 1.0);
+    }
+
+    if (gretl_matrix_na_check(X)) {
+	*err = rankcorr_matrix_pairwise(X, R, opt);
+    } else if (opt & OPT_S) {
+	*err = spearman_matrix_fill(X, R);
+	for (i=0; i<k && !*err; i++) {
+	    gretl_matrix_set(R, i, i, 1.0);
+	}
+    } else {
+	*err = kendall_matrix_fill(X, R);
+    }
+
+    if (*err) {
+	gretl_matrix_free(R);
+	R = NULL;
+    }
+
+    return R;
+}
+
 #define LOCKE_DEBUG 0
 
 static int randomize_doubles (const void *a, const void *b)
@@ -777,7 +1122,11 @@ double lockes_test (const double *x, int t1, int t2)
 	    }
 	    t += 2;
 	}
-	real_kendall_tau(u, v, m, uv, m, NULL, &zj);
+	err = real_kendall_tau(u, v, m, uv, m, NULL, &zj);
+	if (err) {
+	    z = NADBL;
+	    goto bailout;
+	}
 	z += zj;
 #if LOCKE_DEBUG
 	fprintf(stderr, "z[%d] = %g\n", j, zj);
@@ -1447,21 +1796,27 @@ static int data_pre_sorted (const gretl_matrix *x)
     return 1;
 }
 
-#define LDEBUG 0
+/* Minimum number of usable observations for loess to be computed
+   by interpolation, if this is requested, and the maximum number of
+   points in a cell of the interpolation tree, as a fraction of the
+   size of the local sub-sample (cf. the "cell" parameter in
+   Cleveland's netlib loess).
+*/
+
+#define LOESS_INTERP_MIN 5000
+#define LOESS_CELL 0.2
 
-/* convenience struct for passing loess data */
+/* convenience struct for passing loess data: the arrays hold
+   just the observations with valid y-values, sorted by x
+*/
 
 struct loess_info {
-    const gretl_matrix *y;
-    const gretl_matrix *x;
-    gretl_matrix *Xi;
-    gretl_matrix *yi;
-    gretl_matrix *wt;
-    int d;
-    int n;
-    int N;
-    int n_ok;
-    int loo;
+    const double *x;   /* x-values */
+    const double *y;   /* y-values */
+    const double *rw;  /* robustness weights, or NULL */
+    int n_ok;          /* number of usable observations */
+    int n;             /* size of local sub-sample */
+    int d;             /* order of local polynomial */
 };
 
 /* Compute robustness weights for loess, if wanted: on input @rw
@@ -1513,200 +1868,308 @@ static int make_robustness_weights (gretl_matrix *rw, int N)
     return err;
 }
 
-/* Multiply the robustness weights, @rw, into the regular
-   weights, @wt, taking care to register the two vectors
-   (rw is full-length while wt is local), and to skip any
-   missing values in rw.
+/* Would moving the local window starting at @a one place to
+   the right reduce (or at least not increase) the maximum
+   distance from @x0?
 */
 
-static void adjust_weights (const gretl_matrix *rw,
-			    gretl_matrix *wt, int a)
+static inline int window_shift_ok (const double *x, double x0,
+				   int a, int n)
 {
-    int k, n = gretl_vector_get_length(wt);
-    int t = a;
+    return fabs(x0 - x[a]) >= fabs(x0 - x[a+n]);
+}
 
-    for (k=0; k<n; k++) {
-	wt->val[k] *= rw->val[t];
-	if (k < n - 1) {
-	    t++;
-	    while (na(rw->val[t])) t++;
+/* Find the index of the first of the n nearest neighbors of @x0.
+   Since the data are sorted by x the neighbors form a contiguous
+   block: we locate @x0 by bisection, then bisect again for the
+   start of the block, which must lie in the range of n places to
+   the left of that position.
+*/
+
+static int loess_window_start (const struct loess_info *lo, double x0)
+{
+    const double *x = lo->x;
+    int n = lo->n;
+    int amax = lo->n_ok - n;
+    int a, a0, a1, p;
+
+    /* p = the first index at which x >= x0 */
+    a0 = 0;
+    a1 = lo->n_ok;
+    while (a0 < a1) {
+	p = (a0 + a1) / 2;
+	if (x[p] < x0) {
+	    a0 = p + 1;
+	} else {
+	    a1 = p;
 	}
     }
+    p = a0;
+
+    a0 = (p - n < 0)? 0 : p - n;
+    a1 = (p < amax)? p : amax;
+    if (a0 > a1) {
+	a0 = a1;
+    }
+
+    while (a0 < a1) {
+	a = (a0 + a1) / 2;
+	if (window_shift_ok(x, x0, a, n)) {
+	    a0 = a + 1;
+	} else {
+	    a1 = a;
+	}
+    }
+
+    /* allow for ties to the right of x0 */
+    a = a0;
+    while (a < amax && window_shift_ok(x, x0, a, n)) {
+	a++;
+    }
+
+    return a;
 }
 
-/* Apply the weights in lo->wt to the local data matrices
-   lo->Xi and lo->yi. This is straightforward since all
-   the matrices have lo->n rows.
+/* Solve the @p x @p weighted least squares normal equations for
+   the local polynomial, with moments in @m (the matrix element
+   i,j being m[i+j]) and right-hand side @r, via Cholesky.
 */
 
-static void weight_local_data (struct loess_info *lo)
+static int loess_solve (const double *m, const double *r,
+			int p, double *b)
 {
-    double xkj, wk;
-    int k, j;
+    double L[3][3], z[3];
+    double s;
+    int i, j, k;
+
+    for (i=0; i<p; i++) {
+	for (j=0; j<=i; j++) {
+	    s = m[i+j];
+	    for (k=0; k<j; k++) {
+		s -= L[i][k] * L[j][k];
+	    }
+	    if (i == j) {
+		if (s <= 1.0e-10 * m[0]) {
+		    return E_SINGULAR;
+		}
+		L[i][i] = sqrt(s);
+	    } else {
+		L[i][j] = s / L[j][j];
+	    }
+	}
+    }
 
-    for (k=0; k<lo->n; k++) {
-	wk = sqrt(lo->wt->val[k]);
-	for (j=0; j<lo->Xi->cols; j++) {
-	    xkj = gretl_matrix_get(lo->Xi, k, j);
-	    gretl_matrix_set(lo->Xi, k, j, xkj * wk);
+    for (i=0; i<p; i++) {
+	s = r[i];
+	for (k=0; k<i; k++) {
+	    s -= L[i][k] * z[k];
 	}
-	lo->yi->val[k] *= wk;
+	z[i] = s / L[i][i];
     }
 
-#if LDEBUG > 1
-    gretl_matrix_print(lo->Xi, "Xi, weighted");
-    gretl_matrix_print(lo->yi, "yi, weighted");
-#endif
-}
+    for (i=p-1; i>=0; i--) {
+	s = z[i];
+	for (k=i+1; k<p; k++) {
+	    s -= L[k][i] * b[k];
+	}
+	b[i] = s / L[i][i];
+    }
 
-static int next_ok_obs (const double *y, int i)
-{
-    i++;
-    while (na(y[i])) i++;
-    return i;
+    return 0;
 }
 
-static int loess_get_local_data (int i, int *pa,
-				 struct loess_info *lo,
-				 int *xconst)
-{
-    const double *x = lo->x->val;
-    const double *y = lo->y->val;
-    double xk, xk1, xds, h = 0;
-    int n = lo->n, n_ok = lo->n_ok;
-    int k_skip = -1;
-    int a, b, k, m, t;
-    int err = 0;
+/* Compute the loess fit at @x0 using its n nearest neighbors,
+   excluding observation @skip if this is non-negative. The
+   local polynomial is expressed in terms of (x - x0)/h, where
+   h is the maximum distance, so its value at @x0 is just the
+   intercept and the problem is well scaled. If @slope is
+   non-NULL it receives the derivative at @x0.
+*/
 
-    gretl_matrix_zero(lo->Xi);
-    gretl_matrix_zero(lo->yi);
-    gretl_matrix_zero(lo->wt);
+static double loess_local_fit (const struct loess_info *lo, double x0,
+			       int skip, double *slope)
+{
+    const double *x = lo->x;
+    const double *y = lo->y;
+    double m[5] = {0};
+    double r[3] = {0};
+    double b[3];
+    double h, hn, u, uj, w;
+    int a, t, j, p;
 
-    a = *pa;
+    a = loess_window_start(lo, x0);
 
-#if LDEBUG
-    fprintf(stderr, "\ni=%d, a=%d, n_ok=%d\n", i, a, n_ok);
-#endif
+    h = fabs(x0 - x[a]);
+    hn = fabs(x0 - x[a+lo->n-1]);
+    if (hn > h) {
+	h = hn;
+    }
 
-    /* First determine where we should start reading the
-       neighbors of xi: search rightward from a, so far as
-       this is feasible.
-    */
+    /* if x is constant in the sub-sample we don't use it */
+    p = (lo->d == 0 || x[a] == x[a+lo->n-1])? 1 : lo->d + 1;
 
-    while (n_ok > n) {
-	/* find b, the next point that would be included if
-	   we move the neighbor set one place to the right:
-	   start at a+1 and proceed until we have n points
-	   with valid y-values
-	*/
-	for (m=0, b=a+1; ; b++) {
-	    if (!na(y[b]) && ++m == n) {
-		break;
+    for (t=a; t<a+lo->n; t++) {
+	if (t == skip) {
+	    continue;
+	}
+	if (h == 0.0) {
+	    u = 0.0;
+	    w = 1.0;
+	} else {
+	    /* scaled distance and tricube weight */
+	    u = (x[t] - x0) / h;
+	    w = fabs(u);
+	    if (w >= 1.0) {
+		continue;
 	    }
+	    w = 1.0 - w * w * w;
+	    w = w * w * w;
 	}
-	if (fabs(x[i] - x[a]) < fabs(x[i] - x[b])) {
-	    /* the max distance increased: get out */
-	    break;
+	if (lo->rw != NULL) {
+	    if (na(lo->rw[t])) {
+		continue;
+	    }
+	    w *= lo->rw[t];
+	}
+	for (j=0, uj=w; j<2*p-1; j++) {
+	    m[j] += uj;
+	    if (j < p) {
+		r[j] += uj * y[t];
+	    }
+	    uj *= u;
 	}
-	/* shift one (valid) place to the right */
-	a = next_ok_obs(y, a);
-	n_ok--;
     }
 
-    /* record status for next round */
-    *pa = a;
-    lo->n_ok = n_ok;
+    if (m[0] <= 0.0) {
+	return NADBL;
+    }
 
-    /* Having found the starting index for the n nearest neighbors
-       of xi, transcribe the relevant data into Xi and yi. As we
-       go, check whether x is constant in this sub-sample.
-    */
+    /* if the full polynomial is not identified, drop the
+       higher-order terms */
+    while (loess_solve(m, r, p, b) && p > 1) {
+	p--;
+    }
 
-    *xconst = 1;
-    xk1 = 0;
-    t = a;
+    if (slope != NULL) {
+	*slope = (p > 1)? b[1] / h : 0.0;
+    }
 
-    for (k=0; k<n; k++) {
-	if (lo->loo && t == i) {
-	    /* leave-one-out: mark this observation */
-	    k_skip = k;
-	}
-	lo->yi->val[k] = y[t];
-	xk = x[t];
-	gretl_matrix_set(lo->Xi, k, 0, 1.0);
-	gretl_matrix_set(lo->Xi, k, 1, xk);
-	if (lo->Xi->cols > 2) {
-	    gretl_matrix_set(lo->Xi, k, 2, xk * xk);
-	}
-	if (*xconst && k > 0 && xk > xk1) {
-	    *xconst = 0;
-	}
-	xk1 = xk;
-	if (k < n - 1) {
-	    t = next_ok_obs(y, t);
-	}
+    return b[0];
+}
+
+/* Recursively split the (sorted) observations in the range @lo
+   to @hi at the median, until no cell contains more than @fc
+   points, writing the cut-points into @v. This is the 1-D case
+   of the k-d tree used by Cleveland's netlib loess.
+*/
+
+static void loess_kd_split (const double *x, int lo, int hi, int fc,
+			    double *v, int *nv)
+{
+    int m = (lo + hi) / 2;
+    double cut;
+
+    if (hi - lo + 1 <= fc) {
+	return;
     }
 
-#if LDEBUG
-    fprintf(stderr, " -> a=%d, n_ok=%d (xconst = %d)\n",
-	    a, n_ok, *xconst);
-#endif
+    cut = 0.5 * (x[m] + x[m+1]);
+    if (cut <= x[lo] || cut >= x[hi]) {
+	/* the cell can't be split at the median */
+	return;
+    }
 
-    if (!err) {
-	/* find the max(abs) distance from xi */
-	double h0 = fabs(x[i] - gretl_matrix_get(lo->Xi, 0, 1));
-	double hn = fabs(x[i] - gretl_matrix_get(lo->Xi, n-1, 1));
+    v[(*nv)++] = cut;
+    loess_kd_split(x, lo, m, fc, v, nv);
+    loess_kd_split(x, m+1, hi, fc, v, nv);
+}
 
-	h = (h0 > hn)? h0 : hn;
+/* Compute loess estimates at a set of vertices and obtain the
+   estimates for all the @N points in @x by cubic Hermite
+   interpolation, using the values and slopes at the vertices.
+*/
+
+static int loess_interpolate (const struct loess_info *lo,
+			      const double *x, int N,
+			      double *yh)
+{
+    double *v, *f, *s;
+    int nv = 0;
+    int fc, i, j;
+
+    v = malloc(3 * (lo->n_ok + 2) * sizeof *v);
+    if (v == NULL) {
+	return E_ALLOC;
     }
 
-    /* compute scaled distances and tricube weights */
-    for (k=0; k<n; k++) {
-	if (k == k_skip) {
-	    /* exclude this obs via a zero weight? */
-	    lo->wt->val[k] = 0.0;
-	    continue;
-	}
-	xk = gretl_matrix_get(lo->Xi, k, 1);
-	if (h == 0.0) {
-	    lo->wt->val[k] = 1.0;
-	} else {
-	    xds = fabs(x[i] - xk) / h;
-	    if (xds < 1.0) {
-		lo->wt->val[k] = pow(1.0 - pow(xds, 3.0), 3.0);
-	    }
+    fc = (int) floor(lo->n * LOESS_CELL);
+    if (fc < 1) {
+	fc = 1;
+    }
+
+    /* vertices: the extremes of x plus the cut-points */
+    v[nv++] = x[0];
+    loess_kd_split(lo->x, 0, lo->n_ok - 1, fc, v, &nv);
+    v[nv++] = x[N-1];
+    qsort(v, nv, sizeof *v, gretl_compare_doubles);
+    for (i=1, j=0; i<nv; i++) {
+	if (v[i] > v[j]) {
+	    v[++j] = v[i];
 	}
-#if LDEBUG > 1
-	fprintf(stderr, "y=%10g, x=%10g, dist=%10g\n",
-		lo->yi->val[k], xk, fabs(x[i] - xk));
-#endif
     }
+    nv = j + 1;
+
+    f = v + nv;
+    s = f + nv;
 
-#if LDEBUG > 1
-    gretl_matrix_print(lo->Xi, "Xi");
-    gretl_matrix_print(lo->yi, "yi");
-    gretl_matrix_print(lo->wt, "wt");
+#if defined(_OPENMP)
+#pragma omp parallel for private(j) if (gretl_use_openmp((guint64) nv * lo->n))
 #endif
+    for (j=0; j<nv; j++) {
+	f[j] = loess_local_fit(lo, v[j], -1, &s[j]);
+    }
 
-    return err;
-}
+    if (lo->d == 0 && nv > 1) {
+	/* the local fits are flat: take the slopes from the
+	   secants between adjacent vertices */
+	for (j=0; j<nv; j++) {
+	    int j0 = (j > 0)? j - 1 : j;
+	    int j1 = (j < nv - 1)? j + 1 : j;
 
-static int loess_count_usable_obs (const gretl_matrix *y,
-				   int N, int *amin)
-{
-    int i, n_ok = 0;
+	    s[j] = (f[j1] - f[j0]) / (v[j1] - v[j0]);
+	}
+    }
 
+#if defined(_OPENMP)
+#pragma omp parallel for private(i) if (gretl_use_openmp((guint64) N))
+#endif
     for (i=0; i<N; i++) {
-	if (!na(y->val[i])) {
-	    if (n_ok == 0) {
-		/* record the first usable obs index */
-		*amin = i;
+	double dv, z, z1;
+	int j0 = 0, j1 = nv - 1, jm;
+
+	if (nv == 1) {
+	    yh[i] = f[0];
+	    continue;
+	}
+	/* find the cell containing x[i] */
+	while (j1 - j0 > 1) {
+	    jm = (j0 + j1) / 2;
+	    if (v[jm] <= x[i]) {
+		j0 = jm;
+	    } else {
+		j1 = jm;
 	    }
-	    n_ok++;
 	}
+	dv = v[j1] - v[j0];
+	z = (x[i] - v[j0]) / dv;
+	z1 = 1.0 - z;
+	yh[i] = (1 + 2*z) * z1 * z1 * f[j0] + z * z1 * z1 * dv * s[j0] +
+	    z * z * (3 - 2*z) * f[j1] - z * z * z1 * dv * s[j1];
     }
 
-    return n_ok;
+    free(v);
+
+    return 0;
 }
 
 /**
@@ -1716,7 +2179,8 @@ static int loess_count_usable_obs (const gretl_matrix *y,
  * @d: order for polynomial fit (0 <= d <= 2).
  * @q: bandwidth (0 < q <= 1).
  * @opt: give %OPT_R for robust variant (with re-weighting based on
- * the first-stage residuals).
+ * the first-stage residuals); %OPT_I to compute the local fits only
+ * at a set of vertices and interpolate, when the sample is large.
  * @err: location to receive error code.
  *
  * Computes loess estimates based on William Cleveland, "Robust Locally
@@ -1729,6 +2193,12 @@ static int loess_count_usable_obs (const gretl_matrix *y,
  * error is flagged if this is not the case.  See also
  * sort_pairs_by_x().
  *
+ * With %OPT_I, the vertices are the cut-points of a k-d tree
+ * built on @x, as in Cleveland and Grosse, "Computational Methods
+ * for Local Regression", Statistics and Computing, Vol. 1 (1991),
+ * and the fitted values are obtained by cubic interpolation; this
+ * is only done given at least 5000 usable observations.
+ *
  * Returns: allocated vector containing the loess fitted values, or
  * %NULL on failure.
  */
@@ -1737,13 +2207,14 @@ gretl_matrix *loess_fit (const gretl_matrix *x, const gretl_matrix *y,
 			 int d, double q, gretlopt opt, int *err)
 {
     struct loess_info lo;
-    gretl_matrix_block *B;
-    gretl_matrix *Xi, *yi, *wt, *b;
     gretl_matrix *yh = NULL;
     gretl_matrix *rw = NULL;
+    double *xv = NULL, *yv = NULL;
+    int *cpos = NULL;
     int N = gretl_vector_get_length(y);
-    int k, iters, Xic, amin = 0;
-    int n_ok, robust = 0, loo = 0;
+    int k, iters, n_ok = 0;
+    int robust = 0, loo = 0;
+    int interp = 0;
     int i, n;
 
     if (d < 0 || d > 2 || q > 1.0) {
@@ -1757,16 +2228,37 @@ gretl_matrix *loess_fit (const gretl_matrix *x, const gretl_matrix *y,
 	return NULL;
     }
 
-    /* check for usable data points */
-    n_ok = loess_count_usable_obs(y, N, &amin);
+    /* pack the usable data points, recording their positions */
+    xv = malloc(N * sizeof *xv);
+    yv = malloc(N * sizeof *yv);
+    cpos = malloc(N * sizeof *cpos);
+    yh = gretl_column_vector_alloc(N);
+
+    if (xv == NULL || yv == NULL || cpos == NULL || yh == NULL) {
+	*err = E_ALLOC;
+	goto bailout;
+    }
+
+    for (i=0; i<N; i++) {
+	if (na(y->val[i])) {
+	    cpos[i] = -1;
+	} else {
+	    xv[n_ok] = x->val[i];
+	    yv[n_ok] = y->val[i];
+	    cpos[i] = n_ok++;
+	}
+    }
+
     if (n_ok < 4) {
 	*err = E_TOOFEW;
-	return NULL;
+	goto bailout;
     }
 
     if (opt & OPT_O) {
 	/* leave one out: experimental */
 	loo = 1;
+    } else if ((opt & OPT_I) && n_ok >= LOESS_INTERP_MIN) {
+	interp = 1;
     }
 
     /* check for q too small */
@@ -1777,30 +2269,9 @@ gretl_matrix *loess_fit (const gretl_matrix *x, const gretl_matrix *y,
     /* set the local sub-sample size */
     n = (int) ceil(q * n_ok);
 
-    /* we need a minimum of two columns in Xi, in order
-       to compute the x-distance based weights */
-    Xic = (d == 0)? 2 : d + 1;
-
-    B = gretl_matrix_block_new(&Xi, n, Xic,
-			       &yi, n, 1,
-			       &wt, n, 1,
-			       &b, d+1, 1,
-			       NULL);
-    if (B == NULL) {
-	*err = E_ALLOC;
-	return NULL;
-    }
-
-    /* vector to hold the fitted values */
-    yh = gretl_column_vector_alloc(N);
-    if (yh == NULL) {
-	*err = E_ALLOC;
-	goto bailout;
-    }
-
     if (opt & OPT_R) {
 	/* extra storage for residuals/robustness weights */
-	rw = gretl_column_vector_alloc(N);
+	rw = gretl_column_vector_alloc(n_ok);
 	if (rw == NULL) {
 	    *err = E_ALLOC;
 	    goto bailout;
@@ -1812,90 +2283,50 @@ gretl_matrix *loess_fit (const gretl_matrix *x, const gretl_matrix *y,
     }
 
     /* fill out the convenience struct */
-    lo.y = y;
-    lo.x = x;
-    lo.Xi = Xi;
-    lo.yi = yi;
-    lo.wt = wt;
-    lo.d = d;
+    lo.x = xv;
+    lo.y = yv;
+    lo.rw = NULL;
+    lo.n_ok = n_ok;
     lo.n = n;
-    lo.N = N;
-    lo.loo = loo;
+    lo.d = d;
 
     for (k=0; k<iters && !*err; k++) {
 	/* iterations for robustness, if wanted */
-	int a = amin;
-
-	lo.n_ok = n_ok;
-
-	for (i=0; i<N && !*err; i++) {
-	    /* iterate across points in full sample */
-	    double xi = x->val[i];
-	    int xconst = 0;
-
-	    /* a is the leftmost possible index for starting to
-	       read the n nearest neighbors of xi.
-	    */
-	    *err = loess_get_local_data(i, &a, &lo, &xconst);
-	    if (*err) {
-		break;
-	    }
-
-	    if (k > 0) {
-		/* We have robustness weights, rw, based on the residuals
-		   from the last round, which should be used to adjust
-		   the wt as computed in loess_get_local_data().
-		*/
-		adjust_weights(rw, wt, a);
-	    }
+	if (k > 0) {
+	    /* use the robustness weights based on the residuals
+	       from the last round */
+	    lo.rw = rw->val;
+	}
 
-	    /* apply weights to the local data */
-	    weight_local_data(&lo);
+	if (interp) {
+	    *err = loess_interpolate(&lo, x->val, N, yh->val);
+	} else {
+#if defined(_OPENMP)
+#pragma omp parallel for private(i) if (gretl_use_openmp((guint64) N * n))
+#endif
+	    for (i=0; i<N; i++) {
+		int skip = loo ? cpos[i] : -1;
 
-	    if (d == 0 || xconst) {
-		/* not using x in the regressions: mask the x column(s) */
-		gretl_matrix_reuse(Xi, -1, 1);
-		if (b->rows > 1) {
-		    gretl_matrix_reuse(b, 1, 1);
-		}
+		yh->val[i] = loess_local_fit(&lo, x->val[i], skip, NULL);
 	    }
+	}
 
-	    /* run local WLS */
-	    *err = gretl_matrix_SVD_ols(yi, Xi, b, NULL, NULL, NULL);
-
-	    if (!*err) {
-		/* yh: evaluate the polynomial at xi */
-		yh->val[i] = b->val[0];
-		if (b->rows > 1) {
-		    yh->val[i] += b->val[1] * xi;
-		    if (b->rows == 3) {
-			yh->val[i] += b->val[2] * xi * xi;
-		    }
-		}
-		if (robust && k < iters - 1) {
-		    /* save residual for robustness weights */
-		    if (na(y->val[i])) {
-			rw->val[i] = NADBL;
-		    } else {
-			rw->val[i] = y->val[i] - yh->val[i];
-		    }
+	if (!*err && robust && k < iters - 1) {
+	    /* save residuals for robustness weights */
+	    for (i=0; i<N; i++) {
+		if (cpos[i] >= 0) {
+		    rw->val[cpos[i]] = y->val[i] - yh->val[i];
 		}
 	    }
-
-	    /* ensure matrices are at full size */
-	    gretl_matrix_reuse(Xi, -1, Xic);
-	    gretl_matrix_reuse(b, d+1, -1);
-
-	} /* end loop over sample */
-
-	if (!*err && robust && k < iters - 1) {
-	    *err = make_robustness_weights(rw, N);
+	    *err = make_robustness_weights(rw, n_ok);
 	}
     } /* end robustness iterations */
 
  bailout:
 
-    gretl_matrix_block_destroy(B);
+    free(xv);
+    free(yv);
+    free(cpos);
     gretl_matrix_free(rw);
 
     if (*err) {
@@ -36,6 +36,9 @@ gretl_matrix *kendall_tau_func (const double *x,
 				const double *y,
 				int n, int *err);
 
+gretl_matrix *rank_correlation_matrix (const gretl_matrix *X,
+				       gretlopt opt, int *err);
+
 double lockes_test (const double *x, int t1, int t2);
 
 int runs_test (int v, const DATASET *dset, 
@@ -175,6 +175,7 @@ struct gretl_option gretl_opts[] = {
     { COINT,    OPT_V, "verbose", 0 },
     { COINT,    OPT_I, "silent", 0 },
     { COINT2,   OPT_A, "crt", 0 },
+    { COINT2,   OPT_B, "bootstrap", 0 },
     { COINT2,   OPT_D, "seasonals", 0 },
     { COINT2,   OPT_N, "nc", 0 },
     { COINT2,   OPT_R, "rc", 0 },
@@ -315,6 +316,8 @@ struct gretl_option gretl_opts[] = {
     { HFPLOT,   OPT_U, "output", 2 },
     { HSK,      OPT_N, "no-squares", 0 },
     { HURST,    OPT_U, "plot", 2 },
+    { HURST,    OPT_X, "matrix", 2 },
+    { HURST,    OPT_Q, "quiet", 0 },
     { INCLUDE,  OPT_F, "force", 0 },
     { INTREG,   OPT_G, "opg", 0 },
     { INTREG,   OPT_R, "robust", 0 },
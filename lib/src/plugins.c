@@ -260,6 +260,7 @@ struct plugin_function_info plugin_functions[] = {
 
     /* Hurst exponent estimation */
     { "hurst_exponent", P_FRACTAL },
+    { "hurst_matrix", P_FRACTAL },
 
     /* Send email */
     { "email_file", P_MAILER },
@@ -326,6 +327,7 @@ struct plugin_function_info plugin_functions[] = {
     { "purebin_write_data", P_PUREBIN},
     { "purebin_read_subset",   P_PUREBIN},
     { "purebin_read_varnames", P_PUREBIN},
+    { "purebin_stream_open",   P_PUREBIN},
 
     /* BDS nonlinearity test */
     { "bdstest", P_BDSTEST},
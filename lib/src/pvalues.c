@@ -23,6 +23,7 @@
 
 #include "libgretl.h"
 #include "libset.h"
+#include "gretl_mt.h"
 #include "../../cephes/libprob.h"
 
 #include <errno.h>
@@ -3460,14 +3461,10 @@ int gretl_fill_pdf_array (int dist, const double *parm,
  * @parm from @x to infinity, or #NADBL on error.
  */
 
-double gretl_get_pvalue (int dist, const double *parm, double x)
+static double pvalue_eval (int dist, const double *parm, double x)
 {
     double y = NADBL;
 
-    if (pdist_check_input(dist, parm, x) == E_MISSDATA) {
-	return y;
-    }
-
     if (dist == D_NORMAL) {
 	y = normal_cdf_comp(x);
     } else if (dist == D_STUDENT) {
@@ -3495,11 +3492,167 @@ double gretl_get_pvalue (int dist, const double *parm, double x)
 				(int) parm[2], x);
     }
 
+    return y;
+}
+
+double gretl_get_pvalue (int dist, const double *parm, double x)
+{
+    double y = NADBL;
+
+    if (pdist_check_input(dist, parm, x) == E_MISSDATA) {
+	return y;
+    }
+
+    y = pvalue_eval(dist, parm, x);
     remember_pvalue_args(parm, x);
 
     return y;
 }
 
+/* Array versions of the p-value, CDF, inverse CDF and critical
+   value functions. For the commonly used distributions, whose
+   evaluation involves no shared state (the cephes error code
+   being thread-local), long arrays are split across threads.
+*/
+
+#if defined(_OPENMP) && !defined(OS_OSX)
+# define PDIST_OMP 1
+#endif
+
+enum {
+    PD_PVAL,
+    PD_CDF,
+    PD_INVCDF,
+    PD_CRIT
+};
+
+static int pdist_threadsafe (int dist)
+{
+    return dist == D_NORMAL || dist == D_STUDENT ||
+	dist == D_CHISQ || dist == D_SNEDECOR ||
+	dist == D_GAMMA || dist == D_BETA ||
+	dist == D_BINOMIAL || dist == D_POISSON ||
+	dist == D_EXPON || dist == D_WEIBULL ||
+	dist == D_LAPLACE || dist == D_LOGISTIC;
+}
+
+static int pdist_fill_array (int f, int dist, const double *parm,
+			     double *x, int n)
+{
+    int i;
+
+    if (pdist_check_input(dist, parm, 0) == E_MISSDATA) {
+	for (i=0; i<n; i++) {
+	    x[i] = NADBL;
+	}
+	return E_MISSDATA;
+    }
+
+#if defined(PDIST_OMP)
+#pragma omp parallel for private(i) \
+    if (pdist_threadsafe(dist) && gretl_use_openmp((guint64) n * 20))
+#endif
+    for (i=0; i<n; i++) {
+	if (na(x[i])) {
+	    continue;
+	} else if (f == PD_PVAL) {
+	    x[i] = pvalue_eval(dist, parm, x[i]);
+	} else if (f == PD_CDF) {
+	    x[i] = gretl_get_cdf(dist, parm, x[i]);
+	} else if (f == PD_INVCDF) {
+	    x[i] = gretl_get_cdf_inverse(dist, parm, x[i]);
+	} else {
+	    x[i] = gretl_get_critval(dist, parm, x[i]);
+	}
+    }
+
+    return 0;
+}
+
+/**
+ * gretl_fill_pvalue_array:
+ * @dist: distribution code.
+ * @parm: array holding from zero to two parameter values,
+ * depending on the distribution.
+ * @x: see below.
+ * @n: number of elements in @x.
+ *
+ * On input, @x contains an array of abscissae; on output it
+ * contains the corresponding right-tail probabilities, as
+ * per gretl_get_pvalue(). Missing values are passed through.
+ *
+ * Returns: 0 on success, non-zero on error.
+ */
+
+int gretl_fill_pvalue_array (int dist, const double *parm,
+			     double *x, int n)
+{
+    return pdist_fill_array(PD_PVAL, dist, parm, x, n);
+}
+
+/**
+ * gretl_fill_cdf_array:
+ * @dist: distribution code.
+ * @parm: array holding from zero to two parameter values,
+ * depending on the distribution.
+ * @x: see below.
+ * @n: number of elements in @x.
+ *
+ * On input, @x contains an array of abscissae; on output it
+ * contains the corresponding CDF values, as per gretl_get_cdf().
+ * Missing values are passed through.
+ *
+ * Returns: 0 on success, non-zero on error.
+ */
+
+int gretl_fill_cdf_array (int dist, const double *parm,
+			  double *x, int n)
+{
+    return pdist_fill_array(PD_CDF, dist, parm, x, n);
+}
+
+/**
+ * gretl_fill_cdf_inverse_array:
+ * @dist: distribution code.
+ * @parm: array holding from zero to two parameter values,
+ * depending on the distribution.
+ * @x: see below.
+ * @n: number of elements in @x.
+ *
+ * On input, @x contains an array of probabilities; on output
+ * it contains the corresponding quantiles, as per
+ * gretl_get_cdf_inverse(). Missing values are passed through.
+ *
+ * Returns: 0 on success, non-zero on error.
+ */
+
+int gretl_fill_cdf_inverse_array (int dist, const double *parm,
+				  double *x, int n)
+{
+    return pdist_fill_array(PD_INVCDF, dist, parm, x, n);
+}
+
+/**
+ * gretl_fill_critval_array:
+ * @dist: distribution code.
+ * @parm: array holding from zero to two parameter values,
+ * depending on the distribution.
+ * @x: see below.
+ * @n: number of elements in @x.
+ *
+ * On input, @x contains an array of right-tail probabilities;
+ * on output it contains the corresponding critical values, as
+ * per gretl_get_critval(). Missing values are passed through.
+ *
+ * Returns: 0 on success, non-zero on error.
+ */
+
+int gretl_fill_critval_array (int dist, const double *parm,
+			      double *x, int n)
+{
+    return pdist_fill_array(PD_CRIT, dist, parm, x, n);
+}
+
 static int gretl_fill_random_array (double *x, int t1, int t2,
 				    int dist, const double *parm,
 				    const double *vecp1,
@@ -150,6 +150,16 @@ double gretl_get_pdf (int dist, const double *parm, double x);
 
 int gretl_fill_pdf_array (int dist, const double *parm, double *x, int n);
 
+int gretl_fill_pvalue_array (int dist, const double *parm, double *x, int n);
+
+int gretl_fill_cdf_array (int dist, const double *parm, double *x, int n);
+
+int gretl_fill_cdf_inverse_array (int dist, const double *parm,
+				  double *x, int n);
+
+int gretl_fill_critval_array (int dist, const double *parm,
+			      double *x, int n);
+
 double gretl_get_cdf (int dist, const double *parm, double x);
 
 double gretl_get_cdf_inverse (int dist, const double *parm, double a);
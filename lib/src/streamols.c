@@ -0,0 +1,1049 @@
+/*
+ *  gretl -- Gnu Regression, Econometrics and Time-series Library
+ *  Copyright (C) 2001 Allin Cottrell and Riccardo "Jack" Lucchetti
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Out-of-core OLS and WLS: the data are read from file in chunks
+   of observations and only the sufficient statistics are retained,
+   namely the cross-product matrix of [X y] and, for robust or
+   clustered standard errors, the outer products of the scores
+   (which take a second pass over the data). Memory use therefore
+   depends on the number of regressors and not the number of
+   observations.
+*/
+
+#include "libgretl.h"
+#include "gretl_array.h"
+#include "modelprint.h"
+#include "streamols.h"
+
+/* number of doubles read per chunk */
+#define STREAM_CHUNK_SIZE 524288
+
+void data_stream_destroy (data_stream *ds)
+{
+    if (ds != NULL) {
+	if (ds->destroy != NULL) {
+	    ds->destroy(ds);
+	}
+	strings_array_free(ds->vnames, ds->nv);
+	free(ds);
+    }
+}
+
+/* Streaming reader for plain-text delimited data: the first line
+   must hold the series names, and the remaining lines numerical
+   values (with "NA", "." or an empty field for missing values).
+*/
+
+typedef struct csv_stream_ {
+    FILE *fp;
+    char delim[2];
+    char *line;
+    size_t len;
+    long data_start;
+    int lineno;
+} csv_stream;
+
+/* read a line of arbitrary length into cs->line */
+
+static int csv_stream_getline (csv_stream *cs)
+{
+    size_t n = 0;
+
+    while (fgets(cs->line + n, cs->len - n, cs->fp) != NULL) {
+	n += strlen(cs->line + n);
+	if (n > 0 && cs->line[n-1] == '\n') {
+	    break;
+	} else if (n == cs->len - 1) {
+	    char *tmp = realloc(cs->line, 2 * cs->len);
+
+	    if (tmp == NULL) {
+		return -1;
+	    }
+	    cs->line = tmp;
+	    cs->len *= 2;
+	}
+    }
+
+    while (n > 0 && (cs->line[n-1] == '\n' || cs->line[n-1] == '\r')) {
+	cs->line[--n] = '\0';
+    }
+
+    cs->lineno += 1;
+
+    return (n > 0 || !feof(cs->fp))? 1 : 0;
+}
+
+/* If the field starting at @s opens with a double quote
+   (possibly after spaces), return a pointer to the character
+   following the matching closing quote, a doubled quote within
+   the field standing for a literal one; otherwise return @s.
+*/
+
+static char *csv_skip_quoted (char *s)
+{
+    char *p = s + strspn(s, " ");
+
+    if (*p != '"') {
+	return s;
+    }
+
+    for (p++; *p; p++) {
+	if (*p == '"') {
+	    if (p[1] == '"') {
+		p++;
+	    } else {
+		return p + 1;
+	    }
+	}
+    }
+
+    return p;
+}
+
+/* Split cs->line in place into at most @nf fields; returns the
+   number of fields found. A delimiter inside a double-quoted
+   field does not end the field.
+*/
+
+static int csv_split_fields (csv_stream *cs, char **f, int nf)
+{
+    char *s = cs->line;
+    int i = 0;
+
+    while (i < nf) {
+	if (*cs->delim == ' ') {
+	    s += strspn(s, " \t");
+	    if (*s == '\0') {
+		break;
+	    }
+	}
+	f[i++] = s;
+	s = csv_skip_quoted(s);
+	if (*cs->delim == ' ') {
+	    s += strcspn(s, " \t");
+	} else {
+	    s += strcspn(s, cs->delim);
+	}
+	if (*s == '\0') {
+	    break;
+	}
+	*s++ = '\0';
+    }
+
+    return i;
+}
+
+static double csv_field_value (char *s, int *err)
+{
+    char *test;
+    double x;
+
+    while (isspace((unsigned char) *s)) s++;
+    if (*s == '"') {
+	s++;
+	s[strcspn(s, "\"")] = '\0';
+    }
+
+    if (*s == '\0' || !strcmp(s, "NA") || !strcmp(s, ".") ||
+	!strcmp(s, "na") || !strcmp(s, "NaN")) {
+	return NADBL;
+    }
+
+    x = strtod(s, &test);
+    while (isspace((unsigned char) *test)) test++;
+    if (*test != '\0') {
+	*err = E_DATA;
+    }
+
+    return x;
+}
+
+static int csv_read_chunk (data_stream *ds, const int *sel, int nsel,
+			   double *X, int maxrows, int *nrows)
+{
+    csv_stream *cs = ds->priv;
+    char **f;
+    int nf, r = 0, j;
+    int err = 0;
+
+    f = malloc(ds->nv * sizeof *f);
+    if (f == NULL) {
+	return E_ALLOC;
+    }
+
+    gretl_push_c_numeric_locale();
+
+    while (r < maxrows && !err) {
+	int ret = csv_stream_getline(cs);
+
+	if (ret < 0) {
+	    err = E_ALLOC;
+	} else if (ret == 0) {
+	    break;
+	} else if (*cs->line == '\0') {
+	    continue;
+	}
+	nf = csv_split_fields(cs, f, ds->nv);
+	for (j=0; j<nsel && !err; j++) {
+	    if (sel[j] > nf) {
+		X[j*maxrows + r] = NADBL;
+	    } else {
+		X[j*maxrows + r] = csv_field_value(f[sel[j]-1], &err);
+	    }
+	}
+	if (err == E_DATA) {
+	    gretl_errmsg_sprintf(_("Invalid numeric value on line %d"),
+				 cs->lineno);
+	}
+	r++;
+    }
+
+    gretl_pop_c_numeric_locale();
+
+    free(f);
+    *nrows = r;
+
+    return err;
+}
+
+static int csv_rewind (data_stream *ds)
+{
+    csv_stream *cs = ds->priv;
+
+    cs->lineno = 1;
+
+    return fseek(cs->fp, cs->data_start, SEEK_SET)? E_DATA : 0;
+}
+
+static void csv_destroy (data_stream *ds)
+{
+    csv_stream *cs = ds->priv;
+
+    if (cs != NULL) {
+	if (cs->fp != NULL) {
+	    fclose(cs->fp);
+	}
+	free(cs->line);
+	free(cs);
+    }
+}
+
+static data_stream *csv_stream_open (const char *fname, int *err)
+{
+    data_stream *ds;
+    csv_stream *cs;
+    char **f = NULL;
+    char *s;
+    int i, nf, nmax;
+
+    ds = calloc(1, sizeof *ds);
+    cs = calloc(1, sizeof *cs);
+    if (ds == NULL || cs == NULL) {
+	free(ds);
+	free(cs);
+	*err = E_ALLOC;
+	return NULL;
+    }
+
+    ds->priv = cs;
+    ds->read_chunk = csv_read_chunk;
+    ds->rewind = csv_rewind;
+    ds->destroy = csv_destroy;
+
+    cs->len = 1024;
+    cs->line = malloc(cs->len);
+    cs->fp = gretl_fopen(fname, "r");
+
+    if (cs->line == NULL) {
+	*err = E_ALLOC;
+    } else if (cs->fp == NULL) {
+	*err = E_FOPEN;
+    } else if (csv_stream_getline(cs) <= 0) {
+	*err = E_DATA;
+    }
+
+    if (!*err) {
+	/* pick the delimiter from the header line */
+	int nc = 0, nt = 0, ns = 0;
+	int inquote = 0;
+
+	for (s=cs->line; *s; s++) {
+	    if (*s == '"') {
+		inquote = !inquote;
+	    } else if (!inquote) {
+		nc += (*s == ',');
+		nt += (*s == '\t');
+		ns += (*s == ';');
+	    }
+	}
+	if (nc >= nt && nc >= ns && nc > 0) {
+	    *cs->delim = ',';
+	} else if (nt >= ns && nt > 0) {
+	    *cs->delim = '\t';
+	} else if (ns > 0) {
+	    *cs->delim = ';';
+	} else {
+	    *cs->delim = ' ';
+	}
+	nmax = strlen(cs->line) / 2 + 1;
+	f = malloc(nmax * sizeof *f);
+	if (f == NULL) {
+	    *err = E_ALLOC;
+	}
+    }
+
+    if (!*err) {
+	nf = csv_split_fields(cs, f, nmax);
+	ds->nv = nf + 1;
+	ds->vnames = strings_array_new(ds->nv);
+	if (ds->vnames == NULL) {
+	    *err = E_ALLOC;
+	}
+	for (i=0; i<nf && !*err; i++) {
+	    s = f[i];
+	    while (isspace((unsigned char) *s)) s++;
+	    if (*s == '"') {
+		s++;
+		s[strcspn(s, "\"")] = '\0';
+	    }
+	    g_strchomp(s);
+	    ds->vnames[i+1] = gretl_strdup(s);
+	}
+	cs->data_start = ftell(cs->fp);
+    }
+
+    free(f);
+
+    if (*err) {
+	data_stream_destroy(ds);
+	ds = NULL;
+    }
+
+    return ds;
+}
+
+static data_stream *data_stream_open (const char *fname, int *err)
+{
+    if (has_suffix(fname, ".gdtb")) {
+	data_stream *(*opener) (const char *, int *);
+
+	opener = get_plugin_function("purebin_stream_open");
+	if (opener == NULL) {
+	    *err = E_FOPEN;
+	    return NULL;
+	}
+	return (*opener)(fname, err);
+    } else if (has_suffix(fname, ".csv") || has_suffix(fname, ".txt") ||
+	       has_suffix(fname, ".asc")) {
+	return csv_stream_open(fname, err);
+    } else {
+	gretl_errmsg_set(_("Out-of-core estimation requires a gdtb "
+			   "(pure binary) or plain text data file"));
+	*err = E_NOTIMP;
+	return NULL;
+    }
+}
+
+static int stream_series_id (const data_stream *ds, const char *vname)
+{
+    int i;
+
+    for (i=1; i<ds->nv; i++) {
+	if (!strcmp(ds->vnames[i], vname)) {
+	    return i;
+	}
+    }
+
+    gretl_errmsg_sprintf(_("Unknown variable '%s'"), vname);
+
+    return -1;
+}
+
+/* Specification of an out-of-core regression: positions in the
+   chunk buffer of the series used */
+
+typedef struct stream_spec_ {
+    int k;        /* number of regressors */
+    int ifc;      /* includes a constant? */
+    int *sel;     /* IDs in the stream of the series to read */
+    int nsel;     /* number of series to read */
+    int *xpos;    /* position of each regressor in sel, or -1 */
+    int ypos;     /* position of the dependent variable */
+    int wpos;     /* position of the weight variable, or -1 */
+    int cpos;     /* position of the cluster variable, or -1 */
+    char **names; /* names of the regressors */
+} stream_spec;
+
+static void stream_spec_free (stream_spec *s)
+{
+    free(s->sel);
+    free(s->xpos);
+    strings_array_free(s->names, s->k);
+}
+
+/* add series @v to the selection, if not already present,
+   and return its position */
+
+static int stream_select (stream_spec *s, int v)
+{
+    int i;
+
+    for (i=0; i<s->nsel; i++) {
+	if (s->sel[i] == v) {
+	    return i;
+	}
+    }
+
+    s->sel[s->nsel] = v;
+
+    return s->nsel++;
+}
+
+static int stream_spec_init (stream_spec *s, const data_stream *ds,
+			     const char *spec, gretl_bundle *opts)
+{
+    char **S;
+    int ns = 0;
+    int i, v;
+    int err = 0;
+
+    S = gretl_string_split(spec, &ns, NULL);
+    if (S == NULL || ns < 2) {
+	strings_array_free(S, ns);
+	return E_ARGS;
+    }
+
+    s->k = ns - 1;
+    s->ifc = 0;
+    s->nsel = 0;
+    s->wpos = s->cpos = -1;
+    s->sel = malloc((ns + 2) * sizeof *s->sel);
+    s->xpos = malloc(s->k * sizeof *s->xpos);
+    s->names = strings_array_new(s->k);
+
+    if (s->sel == NULL || s->xpos == NULL || s->names == NULL) {
+	strings_array_free(S, ns);
+	return E_ALLOC;
+    }
+
+    v = stream_series_id(ds, S[0]);
+    if (v < 0) {
+	err = E_UNKVAR;
+    } else {
+	s->ypos = stream_select(s, v);
+    }
+
+    for (i=0; i<s->k && !err; i++) {
+	const char *vname = S[i+1];
+
+	if (!strcmp(vname, "const") || !strcmp(vname, "0")) {
+	    s->xpos[i] = -1;
+	    s->ifc = 1;
+	    vname = "const";
+	} else if ((v = stream_series_id(ds, vname)) < 0) {
+	    err = E_UNKVAR;
+	} else {
+	    s->xpos[i] = stream_select(s, v);
+	}
+	if (!err) {
+	    s->names[i] = gretl_strdup(vname);
+	}
+    }
+
+    if (!err && opts != NULL && gretl_bundle_has_key(opts, "weights")) {
+	const char *wname = gretl_bundle_get_string(opts, "weights", &err);
+
+	if (!err && (v = stream_series_id(ds, wname)) < 0) {
+	    err = E_UNKVAR;
+	} else if (!err) {
+	    s->wpos = stream_select(s, v);
+	}
+    }
+
+    if (!err && opts != NULL && gretl_bundle_has_key(opts, "cluster")) {
+	const char *cname = gretl_bundle_get_string(opts, "cluster", &err);
+
+	if (!err && (v = stream_series_id(ds, cname)) < 0) {
+	    err = E_UNKVAR;
+	} else if (!err) {
+	    s->cpos = stream_select(s, v);
+	}
+    }
+
+    strings_array_free(S, ns);
+
+    return err;
+}
+
+/* Pack the usable observations in the chunk @X (of @nr rows, with
+   leading dimension @ld) into the rows of @T, as [x y] scaled by
+   the square root of the weight, if any. If @u is non-NULL, the
+   rows are further scaled by the corresponding (weighted) residual,
+   computed using @b and written into @u. If @cl is non-NULL it
+   receives the cluster values for the rows. If @ysum is non-NULL
+   the sum of weights and the weighted sum of y are added to its
+   two elements. Returns the number of rows packed, or -1 on
+   finding a negative weight.
+*/
+
+static int stream_pack_rows (const stream_spec *s, const double *X,
+			     int nr, int ld, gretl_matrix *T,
+			     const double *b, double *u, double *cl,
+			     double *ysum)
+{
+    int k = s->k;
+    double xj, wt, ut;
+    int i, j, r, n = 0;
+    int skip;
+
+    for (r=0; r<nr; r++) {
+	/* screen for missing values */
+	skip = 0;
+	for (j=0; j<s->nsel && !skip; j++) {
+	    skip = na(X[j*ld + r]);
+	}
+	if (skip) {
+	    continue;
+	}
+	if (s->wpos >= 0) {
+	    wt = X[s->wpos*ld + r];
+	    if (wt < 0) {
+		return -1;
+	    } else if (wt == 0) {
+		continue;
+	    }
+	    wt = sqrt(wt);
+	} else {
+	    wt = 1.0;
+	}
+	for (i=0; i<k; i++) {
+	    xj = (s->xpos[i] < 0)? 1.0 : X[s->xpos[i]*ld + r];
+	    T->val[i*T->rows + n] = wt * xj;
+	}
+	T->val[k*T->rows + n] = wt * X[s->ypos*ld + r];
+	if (ysum != NULL) {
+	    ysum[0] += wt * wt;
+	    ysum[1] += wt * T->val[k*T->rows + n];
+	}
+	if (u != NULL) {
+	    ut = T->val[k*T->rows + n];
+	    for (i=0; i<k; i++) {
+		ut -= b[i] * T->val[i*T->rows + n];
+	    }
+	    u[n] = ut;
+	    for (i=0; i<k; i++) {
+		T->val[i*T->rows + n] *= ut;
+	    }
+	}
+	if (cl != NULL) {
+	    cl[n] = X[s->cpos*ld + r];
+	}
+	n++;
+    }
+
+    return n;
+}
+
+struct stream_results {
+    gretl_matrix *XX;  /* X'X, then its inverse */
+    gretl_matrix *Xy;  /* X'y */
+    gretl_matrix *b;   /* coefficients */
+    gretl_matrix *M;   /* "meat" for robust variance */
+    double ypy;        /* y'y */
+    double ysum[2];    /* sum of weights, weighted sum of y */
+    double ess;        /* sum of squared residuals */
+    int nobs;          /* number of observations used */
+    int nclust;        /* number of clusters */
+};
+
+/* First pass: accumulate the cross-products of [X y] */
+
+static int stream_pass_1 (data_stream *ds, const stream_spec *s,
+			  struct stream_results *sr)
+{
+    int k = s->k, p = k + 1;
+    int B = STREAM_CHUNK_SIZE / s->nsel;
+    gretl_matrix *T, *A;
+    double *X;
+    int i, j, nr, n;
+    int err = 0;
+
+    X = malloc(B * s->nsel * sizeof *X);
+    T = gretl_matrix_alloc(B, p);
+    A = gretl_zero_matrix_new(p, p);
+
+    if (X == NULL || T == NULL || A == NULL) {
+	err = E_ALLOC;
+    }
+
+    sr->nobs = 0;
+    sr->ysum[0] = sr->ysum[1] = 0.0;
+
+    while (!err) {
+	err = ds->read_chunk(ds, s->sel, s->nsel, X, B, &nr);
+	if (err || nr == 0) {
+	    break;
+	}
+	gretl_matrix_reuse(T, B, p);
+	n = stream_pack_rows(s, X, nr, B, T, NULL, NULL, NULL, sr->ysum);
+	if (n < 0) {
+	    gretl_errmsg_set(_("Weight variable contains negative values"));
+	    err = E_DATA;
+	} else if (n > 0) {
+	    /* reshape to the actual number of rows */
+	    for (j=1; j<p; j++) {
+		memmove(T->val + j*n, T->val + j*B, n * sizeof(double));
+	    }
+	    gretl_matrix_reuse(T, n, p);
+	    sr->nobs += n;
+	    err = gretl_matrix_multiply_mod(T, GRETL_MOD_TRANSPOSE,
+					    T, GRETL_MOD_NONE,
+					    A, GRETL_MOD_CUMULATE);
+	}
+    }
+
+    if (!err) {
+	for (i=0; i<k; i++) {
+	    for (j=0; j<k; j++) {
+		gretl_matrix_set(sr->XX, i, j, gretl_matrix_get(A, i, j));
+	    }
+	    sr->Xy->val[i] = gretl_matrix_get(A, i, k);
+	}
+	sr->ypy = gretl_matrix_get(A, k, k);
+    }
+
+    free(X);
+    gretl_matrix_free(T);
+    gretl_matrix_free(A);
+
+    return err;
+}
+
+/* Second pass, for robust standard errors: accumulate the sum of
+   squared residuals and either \sum u_t^2 x_t x_t' or, if clustering,
+   \sum_g s_g s_g', where s_g is the sum of the scores x_t u_t over
+   the observations in cluster g.
+*/
+
+static int stream_pass_2 (data_stream *ds, const stream_spec *s,
+			  struct stream_results *sr)
+{
+    int k = s->k, p = k + 1;
+    int B = STREAM_CHUNK_SIZE / s->nsel;
+    GHashTable *ht = NULL;
+    gretl_matrix *T;
+    double *X, *u, *cl = NULL;
+    double *S = NULL;
+    int nS = 0, G = 0;
+    int i, j, nr, n;
+    int err = 0;
+
+    X = malloc(B * s->nsel * sizeof *X);
+    u = malloc(B * sizeof *u);
+    T = gretl_matrix_alloc(B, p);
+
+    if (X == NULL || u == NULL || T == NULL) {
+	err = E_ALLOC;
+    } else if (s->cpos >= 0) {
+	cl = malloc(B * sizeof *cl);
+	ht = g_hash_table_new_full(g_int64_hash, g_int64_equal, g_free, NULL);
+	if (cl == NULL) {
+	    err = E_ALLOC;
+	}
+    }
+
+    if (!err) {
+	err = ds->rewind(ds);
+    }
+
+    gretl_matrix_zero(sr->M);
+    sr->ess = 0.0;
+
+    while (!err) {
+	err = ds->read_chunk(ds, s->sel, s->nsel, X, B, &nr);
+	if (err || nr == 0) {
+	    break;
+	}
+	gretl_matrix_reuse(T, B, p);
+	n = stream_pack_rows(s, X, nr, B, T, sr->b->val, u, cl, NULL);
+	for (i=0; i<n; i++) {
+	    sr->ess += u[i] * u[i];
+	}
+	if (n > 0 && ht == NULL) {
+	    gretl_matrix_reuse(T, n, k);
+	    if (B != n) {
+		for (j=1; j<k; j++) {
+		    memmove(T->val + j*n, T->val + j*B, n * sizeof(double));
+		}
+	    }
+	    err = gretl_matrix_multiply_mod(T, GRETL_MOD_TRANSPOSE,
+					    T, GRETL_MOD_NONE,
+					    sr->M, GRETL_MOD_CUMULATE);
+	} else if (n > 0) {
+	    for (i=0; i<n && !err; i++) {
+		gint64 key = (gint64) cl[i];
+		gpointer val;
+		int g;
+
+		if (cl[i] != floor(cl[i])) {
+		    gretl_errmsg_set(_("The cluster variable must be "
+				       "integer-valued"));
+		    err = E_DATA;
+		    break;
+		}
+		if (g_hash_table_lookup_extended(ht, &key, NULL, &val)) {
+		    g = GPOINTER_TO_INT(val);
+		} else {
+		    gint64 *pk = g_new(gint64, 1);
+
+		    *pk = key;
+		    g = G++;
+		    g_hash_table_insert(ht, pk, GINT_TO_POINTER(g));
+		    if (G > nS) {
+			double *tmp;
+
+			nS = (nS == 0)? 1024 : 2 * nS;
+			tmp = realloc(S, nS * k * sizeof *S);
+			if (tmp == NULL) {
+			    err = E_ALLOC;
+			    break;
+			}
+			S = tmp;
+		    }
+		    for (j=0; j<k; j++) {
+			S[g*k+j] = 0.0;
+		    }
+		}
+		for (j=0; j<k; j++) {
+		    S[g*k+j] += T->val[j*B + i];
+		}
+	    }
+	}
+    }
+
+    if (!err && ht != NULL) {
+	/* sum of outer products of the cluster scores */
+	gretl_matrix *Sm = gretl_matrix_alloc(k, G);
+
+	if (Sm == NULL) {
+	    err = E_ALLOC;
+	} else {
+	    memcpy(Sm->val, S, k * G * sizeof *S);
+	    err = gretl_matrix_multiply_mod(Sm, GRETL_MOD_NONE,
+					    Sm, GRETL_MOD_TRANSPOSE,
+					    sr->M, GRETL_MOD_NONE);
+	    gretl_matrix_free(Sm);
+	}
+	sr->nclust = G;
+    }
+
+    if (ht != NULL) {
+	g_hash_table_destroy(ht);
+    }
+    free(X);
+    free(u);
+    free(cl);
+    free(S);
+    gretl_matrix_free(T);
+
+    return err;
+}
+
+/* Form the coefficient covariance matrix in @V, given (X'X)^{-1}
+   in sr->XX and, for the robust variants, the "meat" in sr->M.
+*/
+
+static int stream_vcv (struct stream_results *sr, const stream_spec *s,
+		       int robust, gretl_matrix *V)
+{
+    int n = sr->nobs, k = s->k;
+    double scale;
+    int err = 0;
+
+    if (s->cpos >= 0) {
+	int G = sr->nclust;
+
+	if (G < 2) {
+	    return E_TOOFEW;
+	}
+	err = gretl_matrix_qform(sr->XX, GRETL_MOD_NONE, sr->M,
+				 V, GRETL_MOD_NONE);
+	scale = G / (G - 1.0) * (n - 1.0) / (n - k);
+    } else if (robust) {
+	/* HC1 */
+	err = gretl_matrix_qform(sr->XX, GRETL_MOD_NONE, sr->M,
+				 V, GRETL_MOD_NONE);
+	scale = n / (double) (n - k);
+    } else {
+	gretl_matrix_copy_values(V, sr->XX);
+	scale = sr->ess / (n - k);
+    }
+
+    if (!err) {
+	gretl_matrix_multiply_by_scalar(V, scale);
+    }
+
+    return err;
+}
+
+static gretl_array *stream_param_names (const stream_spec *s, int *err)
+{
+    gretl_array *a = gretl_array_new(GRETL_TYPE_STRINGS, s->k, err);
+    int i;
+
+    for (i=0; i<s->k && !*err; i++) {
+	*err = gretl_array_set_string(a, i, s->names[i], 1);
+    }
+
+    return a;
+}
+
+static void stream_print (const char *fname, const char *yname,
+			  const stream_spec *s,
+			  const struct stream_results *sr,
+			  const gretl_matrix *V, double rsq,
+			  double adjrsq, double lnl, PRN *prn)
+{
+    const char *snames[] = {
+	N_("Sum squared resid"),
+	N_("S.E. of regression"),
+	N_("R-squared"),
+	N_("Adjusted R-squared"),
+	N_("Log-likelihood")
+    };
+    gretl_matrix *cs, *adds;
+    gretl_array *names;
+    int i, k = s->k;
+    int err = 0;
+
+    cs = gretl_matrix_alloc(k, 2);
+    adds = gretl_matrix_alloc(5, 1);
+    names = stream_param_names(s, &err);
+
+    if (cs == NULL || adds == NULL || err) {
+	goto bailout;
+    }
+
+    for (i=0; i<5 && !err; i++) {
+	err = gretl_array_append_string(names, (char *) _(snames[i]), 1);
+    }
+
+    for (i=0; i<k; i++) {
+	gretl_matrix_set(cs, i, 0, sr->b->val[i]);
+	gretl_matrix_set(cs, i, 1, sqrt(gretl_matrix_get(V, i, i)));
+    }
+
+    adds->val[0] = sr->ess;
+    adds->val[1] = sqrt(sr->ess / (sr->nobs - k));
+    adds->val[2] = rsq;
+    adds->val[3] = adjrsq;
+    adds->val[4] = lnl;
+
+    pprintf(prn, "\n%s %s, %s %d %s %s\n",
+	    (s->wpos >= 0)? "WLS" : "OLS", _("(out of core)"),
+	    _("using"), sr->nobs, _("observations from"), fname);
+    pprintf(prn, "%s: %s\n", _("Dependent variable"), yname);
+    if (s->cpos >= 0) {
+	pprintf(prn, _("Standard errors clustered by %d values\n"),
+		sr->nclust);
+    }
+
+    if (!err) {
+	print_model_from_matrices(cs, adds, names, sr->nobs - k,
+				  OPT_NONE, prn);
+    }
+
+ bailout:
+
+    gretl_matrix_free(cs);
+    gretl_matrix_free(adds);
+    gretl_array_destroy(names);
+}
+
+/**
+ * stream_ols:
+ * @fname: name of gdtb (pure binary) or delimited text file.
+ * @spec: regression specification, as the name of the dependent
+ * variable followed by the names of the regressors, separated by
+ * spaces, with "const" or "0" for the intercept.
+ * @opts: bundle of options, or NULL. Recognized keys are "weights"
+ * (name of weight variable), "cluster" (name of an integer-valued
+ * cluster variable), "robust" (boolean: use HC1 standard errors)
+ * and "verbose" (boolean: print the results).
+ * @prn: gretl printing struct.
+ * @err: location to receive error code.
+ *
+ * Estimates a linear regression by OLS or WLS without loading the
+ * data into memory, reading @fname in chunks of observations.
+ * Observations with missing values are skipped.
+ *
+ * Returns: a bundle holding the results under the same keys as
+ * the $model accessor where these are applicable (coeff, stderr,
+ * vcv, ess, rsq and so on), or NULL on failure.
+ */
+
+gretl_bundle *stream_ols (const char *fname, const char *spec,
+			  gretl_bundle *opts, PRN *prn, int *err)
+{
+    struct stream_results sr = {0};
+    stream_spec s = {0};
+    char fullname[MAXLEN];
+    data_stream *ds = NULL;
+    gretl_bundle *ret = NULL;
+    gretl_matrix *V = NULL;
+    gretl_matrix *se = NULL;
+    double tss, rsq, adjrsq, lnl, ybar;
+    int robust = 0, verbose = 0;
+    int i, k, n;
+
+    if (opts != NULL) {
+	robust = gretl_bundle_get_bool(opts, "robust", 0);
+	verbose = gretl_bundle_get_bool(opts, "verbose", 0);
+    }
+
+    *err = get_full_filename(fname, fullname, OPT_NONE);
+    if (!*err) {
+	ds = data_stream_open(fullname, err);
+    }
+    if (*err) {
+	return NULL;
+    }
+
+    *err = stream_spec_init(&s, ds, spec, opts);
+    if (*err) {
+	goto bailout;
+    }
+
+    k = s.k;
+    sr.XX = gretl_matrix_alloc(k, k);
+    sr.Xy = gretl_matrix_alloc(k, 1);
+    sr.b = gretl_matrix_alloc(k, 1);
+    sr.M = gretl_matrix_alloc(k, k);
+    V = gretl_matrix_alloc(k, k);
+    se = gretl_matrix_alloc(k, 1);
+
+    if (sr.XX == NULL || sr.Xy == NULL || sr.b == NULL ||
+	sr.M == NULL || V == NULL || se == NULL) {
+	*err = E_ALLOC;
+	goto bailout;
+    }
+
+    *err = stream_pass_1(ds, &s, &sr);
+    if (*err) {
+	goto bailout;
+    }
+
+    n = sr.nobs;
+    if (n <= k) {
+	*err = E_DF;
+	goto bailout;
+    }
+
+    /* (X'X)^{-1} and coefficients */
+    *err = gretl_invert_symmetric_matrix(sr.XX);
+    if (*err) {
+	*err = E_SINGULAR;
+	goto bailout;
+    }
+    gretl_matrix_multiply(sr.XX, sr.Xy, sr.b);
+
+    if (robust || s.cpos >= 0) {
+	*err = stream_pass_2(ds, &s, &sr);
+    } else {
+	/* y'y - b'X'y */
+	sr.ess = sr.ypy;
+	for (i=0; i<k; i++) {
+	    sr.ess -= sr.b->val[i] * sr.Xy->val[i];
+	}
+	if (sr.ess < 0) {
+	    sr.ess = 0.0;
+	}
+    }
+
+    if (!*err) {
+	*err = stream_vcv(&sr, &s, robust, V);
+    }
+
+    if (*err) {
+	goto bailout;
+    }
+
+    for (i=0; i<k; i++) {
+	se->val[i] = sqrt(gretl_matrix_get(V, i, i));
+    }
+
+    ybar = sr.ysum[1] / sr.ysum[0];
+    tss = s.ifc ? sr.ypy - sr.ysum[1] * ybar : sr.ypy;
+    rsq = (tss > 0)? 1.0 - sr.ess / tss : NADBL;
+    adjrsq = na(rsq) ? NADBL :
+	1.0 - (1.0 - rsq) * (n - s.ifc) / (double) (n - k);
+    lnl = -.5 * n * (1.0 + LN_2_PI - log(n) + log(sr.ess));
+
+    ret = gretl_bundle_new();
+    if (ret == NULL) {
+	*err = E_ALLOC;
+	goto bailout;
+    }
+
+    gretl_bundle_set_string(ret, "command", (s.wpos >= 0)? "wls" : "ols");
+    gretl_bundle_set_string(ret, "depvar", ds->vnames[s.sel[s.ypos]]);
+    gretl_bundle_set_int(ret, "nobs", n);
+    gretl_bundle_set_int(ret, "ncoeff", k);
+    gretl_bundle_set_int(ret, "df", n - k);
+    gretl_bundle_set_scalar(ret, "ess", sr.ess);
+    gretl_bundle_set_scalar(ret, "sigma", sqrt(sr.ess / (n - k)));
+    gretl_bundle_set_scalar(ret, "rsq", rsq);
+    gretl_bundle_set_scalar(ret, "adjrsq", adjrsq);
+    gretl_bundle_set_scalar(ret, "lnl", lnl);
+    gretl_bundle_set_scalar(ret, "aic", -2 * lnl + 2 * k);
+    gretl_bundle_set_scalar(ret, "bic", -2 * lnl + k * log(n));
+    gretl_bundle_set_scalar(ret, "hqc", -2 * lnl + 2 * k * log(log(n)));
+    gretl_bundle_set_scalar(ret, "ybar", ybar);
+    if (s.cpos >= 0) {
+	gretl_bundle_set_int(ret, "n_clusters", sr.nclust);
+    }
+    gretl_bundle_set_matrix(ret, "coeff", sr.b);
+    gretl_bundle_set_matrix(ret, "stderr", se);
+    gretl_bundle_set_matrix(ret, "vcv", V);
+    gretl_bundle_donate_data(ret, "parnames", stream_param_names(&s, err),
+			     GRETL_TYPE_ARRAY, 0);
+
+    if (verbose) {
+	stream_print(fname, ds->vnames[s.sel[s.ypos]], &s, &sr, V,
+		     rsq, adjrsq, lnl, prn);
+    }
+
+ bailout:
+
+    stream_spec_free(&s);
+    data_stream_destroy(ds);
+    gretl_matrix_free(sr.XX);
+    gretl_matrix_free(sr.Xy);
+    gretl_matrix_free(sr.b);
+    gretl_matrix_free(sr.M);
+    gretl_matrix_free(V);
+    gretl_matrix_free(se);
+
+    if (*err && ret != NULL) {
+	gretl_bundle_destroy(ret);
+	ret = NULL;
+    }
+
+    return ret;
+}
@@ -0,0 +1,45 @@
+/*
+ *  gretl -- Gnu Regression, Econometrics and Time-series Library
+ *  Copyright (C) 2001 Allin Cottrell and Riccardo "Jack" Lucchetti
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef STREAMOLS_H
+#define STREAMOLS_H
+
+typedef struct data_stream_ data_stream;
+
+/* A source of data that is read in chunks of observations rather
+   than being loaded in full: series are identified by their
+   1-based position in @vnames.
+*/
+
+struct data_stream_ {
+    int nv;         /* number of series, plus 1 */
+    char **vnames;  /* names of series (element 0 unused) */
+    int (*read_chunk) (data_stream *ds, const int *sel, int nsel,
+		       double *X, int maxrows, int *nrows);
+    int (*rewind) (data_stream *ds);
+    void (*destroy) (data_stream *ds);
+    void *priv;     /* source-specific data */
+};
+
+void data_stream_destroy (data_stream *ds);
+
+gretl_bundle *stream_ols (const char *fname, const char *spec,
+			  gretl_bundle *opts, PRN *prn, int *err);
+
+#endif /* STREAMOLS_H */
@@ -25,6 +25,7 @@
 #include "version.h"
 #include "matrix_extra.h"
 #include "uservar.h"
+#include "gretl_mt.h"
 
 #define ADEBUG 0
 #define WRITE_MATRICES 0
@@ -40,6 +41,10 @@ enum {
     DPD_REDO     = 1 << 5
 };
 
+/* number of per-unit vectors Z_i' u_i to be processed
+   together when forming a robust variance matrix */
+#define DPD_UNIT_BATCH 256
+
 #define gmm_sys(d) (d->flags & DPD_SYSTEM)
 #define dpd_style(d) (d->flags & DPD_DPDSTYLE)
 
@@ -113,7 +118,6 @@ struct ddset_ {
     gretl_matrix *Acpy;   /* back-up of A matrix */
     gretl_matrix *V;      /* covariance matrix */
     gretl_matrix *ZT;     /* transpose of full instrument matrix */
-    gretl_matrix *Zi;     /* per-unit instrument matrix */
     gretl_matrix *Y;      /* transformed dependent var */
     gretl_matrix *X;      /* lagged differences of y, indep vars, etc. */
     gretl_matrix *kmtmp;  /* workspace */
@@ -178,7 +182,6 @@ static int dpd_allocate_matrices (ddset *dpd)
 				     &dpd->H,     T, T,
 				     &dpd->A,     dpd->nz, dpd->nz,
 				     &dpd->Acpy,  dpd->nz, dpd->nz,
-				     &dpd->Zi,    T, dpd->nz,
 				     &dpd->Y,     dpd->totobs, 1,
 				     &dpd->X,     dpd->totobs, dpd->k,
 				     NULL);
@@ -738,6 +741,32 @@ static int dpd_sargan_test (ddset *dpd)
 
 /* \sigma^2 H_1, sliced and diced for unit i */
 
+/* Compute @g = Z_i' u_i, where Z_i' is made up of the @ni columns
+   of the stacked instrument matrix dpd->ZT starting at column @c:
+   we read these in place rather than copying Z_i out.
+*/
+
+static void unit_ZTu (const ddset *dpd, const double *u,
+		      int c, int ni, double *g)
+{
+    int nz = dpd->ZT->rows;
+    const double *z;
+    int j, t;
+
+    for (j=0; j<nz; j++) {
+	g[j] = 0.0;
+    }
+
+    for (t=0; t<ni; t++) {
+	if (u[t] != 0.0) {
+	    z = dpd->ZT->val + (c + t) * nz;
+	    for (j=0; j<nz; j++) {
+		g[j] += z[j] * u[t];
+	    }
+	}
+    }
+}
+
 static void make_asy_Hi (ddset *dpd, int i, gretl_matrix *H,
 			 char *mask)
 {
@@ -799,22 +828,18 @@ static int dpd_ar_test (ddset *dpd)
     double x, d0, d1, d2, d3;
     gretl_matrix_block *B = NULL;
     gretl_matrix *ui, *wi;
-    gretl_matrix *Xi, *Zi;
+    gretl_matrix *Xi, *Hw;
     gretl_matrix *Hi, *ZU;
     gretl_matrix *wX, *ZHw;
     gretl_matrix *Tmp;
     char *hmask = NULL;
     int HT, T = dpd->maxTi;
-    int save_rows, save_cols;
     int nz = dpd->nz;
-    int asy, ZU_cols;
+    int asy;
     int i, j, k, s, t;
     int nlags, m = 1;
     int err = 0;
 
-    save_rows = gretl_matrix_rows(dpd->Zi);
-    save_cols = gretl_matrix_cols(dpd->Zi);
-
     /* if non-robust and on first step, Hi is computed differently */
     if ((dpd->flags & DPD_TWOSTEP) || (dpd->flags & DPD_WINCORR)) {
 	asy = 0;
@@ -829,15 +854,12 @@ static int dpd_ar_test (ddset *dpd)
 	}
     }
 
-    /* The required size of the workspace matrix ZU depends on
-       whether or not we're in the system case */
-    ZU_cols = (gmm_sys(dpd))? 1 : T;
-
     B = gretl_matrix_block_new(&ui,  T, 1,
 			       &wi,  T, 1,
 			       &Xi,  T, dpd->k,
 			       &Hi,  HT, HT,
-			       &ZU,  nz, ZU_cols,
+			       &Hw,  HT, 1,
+			       &ZU,  nz, 1,
 			       &wX,  1, dpd->k,
 			       &ZHw, nz, 1,
 			       &Tmp, dpd->k, nz,
@@ -848,8 +870,6 @@ static int dpd_ar_test (ddset *dpd)
 	goto finish;
     }
 
-    Zi = gretl_matrix_reuse(dpd->Zi, T, nz);
-
  restart:
 
     /* initialize cumulators */
@@ -862,7 +882,7 @@ static int dpd_ar_test (ddset *dpd)
 
     for (i=0; i<dpd->N; i++) {
 	unit_info *unit = &dpd->ui[i];
-	int s_, t0, ni = unit->nobs;
+	int s_, s0, t0, ni = unit->nobs;
 	int Ti = ni - unit->nlev;
 	int nlags_i = 0;
 	double uw;
@@ -874,20 +894,17 @@ static int dpd_ar_test (ddset *dpd)
 	gretl_matrix_reuse(ui, Ti, -1);
 	gretl_matrix_reuse(wi, Ti, -1);
 	gretl_matrix_reuse(Xi, Ti, -1);
-	gretl_matrix_reuse(Zi, Ti, -1);
 
 	if (!asy) {
 	    gretl_matrix_reuse(Hi, Ti, Ti);
 	}
 
-	if (!gmm_sys(dpd)) {
-	    gretl_matrix_reuse(ZU, -1, Ti);
-	}
-
 	gretl_matrix_zero(wi);
 	t0 = data_index(dpd, i);
+	s0 = s;
 
-	/* Construct the per-unit matrices ui, wi, Xi and Zi. We have
+	/* Construct the per-unit matrices ui, wi and Xi (Z_i is
+	   read in place from dpd->ZT, starting at column s0). We have
 	   to be careful with the dpd->used values for the lags here:
 	   1 indicates an observation in (both levels and) differences
 	   while observations that are levels-only have a "used" value
@@ -915,10 +932,6 @@ static int dpd_ar_test (ddset *dpd)
 		    x = gretl_matrix_get(dpd->X, s, j);
 		    gretl_matrix_set(Xi, k, j, x);
 		}
-		for (j=0; j<nz; j++) {
-		    x = gretl_matrix_get(dpd->ZT, j, s);
-		    gretl_matrix_set(Zi, k, j, x);
-		}
 		k++;
 		s++;
 	    }
@@ -956,30 +969,20 @@ static int dpd_ar_test (ddset *dpd)
 
 	if (gmm_sys(dpd)) {
 	    /* Here we need (Z_i^f' u_i^f) * (u_i' w_i), which
-	       mixes full series and differences.
+	       mixes full series and differences: the levels
+	       residuals follow the differenced ones in uhat.
 	    */
-	    gretl_matrix_multiply_mod(Zi, GRETL_MOD_TRANSPOSE,
-				      ui, GRETL_MOD_NONE,
-				      ZU, GRETL_MOD_NONE);
-	    for (t=0; t<unit->nlev; t++) {
-		/* catch the levels terms */
-		for (j=0; j<nz; j++) {
-		    x = gretl_matrix_get(dpd->ZT, j, s);
-		    ZU->val[j] += x * dpd->uhat->val[s];
-		}
-		s++;
-	    }
+	    unit_ZTu(dpd, dpd->uhat->val + s0, s0, Ti + unit->nlev,
+		     ZU->val);
+	    s += unit->nlev;
 	    gretl_matrix_multiply_by_scalar(ZU, uw);
-	    gretl_matrix_add_to(ZHw, ZU);
 	} else {
-	    /* differences only: ZHw += Z_i' H_i w_i */
-	    gretl_matrix_multiply_mod(Zi, GRETL_MOD_TRANSPOSE,
-				      Hi, GRETL_MOD_NONE,
-				      ZU, GRETL_MOD_NONE);
-	    gretl_matrix_multiply_mod(ZU, GRETL_MOD_NONE,
-				      wi, GRETL_MOD_NONE,
-				      ZHw, GRETL_MOD_CUMULATE);
+	    /* differences only: ZHw += Z_i' (H_i w_i) */
+	    gretl_matrix_reuse(Hw, Ti, 1);
+	    gretl_matrix_multiply(Hi, wi, Hw);
+	    unit_ZTu(dpd, Hw->val, s0, Ti, ZU->val);
 	}
+	gretl_matrix_add_to(ZHw, ZU);
     }
 
     if (m == 1) {
@@ -1039,9 +1042,6 @@ static int dpd_ar_test (ddset *dpd)
     gretl_matrix_block_destroy(B);
     free(hmask);
 
-    /* restore original dimensions */
-    gretl_matrix_reuse(dpd->Zi, save_rows, save_cols);
-
     if (err) {
 	fprintf(stderr, "dpd_ar_test failed: %s\n",
 		errmsg_get_with_default(err));
@@ -1060,6 +1060,16 @@ static int dpd_ar_test (ddset *dpd)
    in particular the fact that the matrix named "D" below must be
    built column by column, taking the derivative of the "W" (or "A")
    matrix with respect to the successive independent variables.
+
+   Column j of D is -aV * XZW^{-1} * dW_j * W^{-1}Z'v_2, where
+
+   dW_j = -(1/N) \sum_i Z_i'(x_ij u_i' + u_i x_ij')Z_i
+
+   (u_i being the step-1 residuals). We never form the dW_j
+   matrices: writing r = W^{-1}Z'v_2 and z_i = Z_i r, the product
+   dW_j r equals -(1/N) Z' w_j, where w_j stacks the vectors
+   (x_ij'z_i) u_i + (u_i'z_i) x_ij. So all k columns of D can be
+   obtained with a single pass through Z.
 */
 
 static int windmeijer_correct (ddset *dpd, const gretl_matrix *uhat1,
@@ -1068,16 +1078,13 @@ static int windmeijer_correct (ddset *dpd, const gretl_matrix *uhat1,
     gretl_matrix_block *B;
     gretl_matrix *aV;  /* standard asymptotic variance */
     gretl_matrix *D;   /* finite-sample factor */
-    gretl_matrix *dWj; /* one component of the above */
-    gretl_matrix *ui;  /* per-unit residuals */
-    gretl_matrix *xij; /* per-unit X_j values */
-    gretl_matrix *mT;  /* workspace follows */
-    gretl_matrix *km;
-    gretl_matrix *k1;
+    gretl_matrix *W;   /* the w_j vectors, in columns */
+    gretl_matrix *zr;  /* stacked Z_i r */
+    gretl_matrix *ZW;  /* Z'W */
+    gretl_matrix *Zu;  /* workspace */
     gretl_matrix *R1;
-    gretl_matrix *Zui;
-    gretl_matrix *Zxi;
-    int i, j, t;
+    double xz, uz;
+    int i, j, t, s;
     int err = 0;
 
     aV = gretl_matrix_copy(dpd->vbeta);
@@ -1085,15 +1092,11 @@ static int windmeijer_correct (ddset *dpd, const gretl_matrix *uhat1,
 	return E_ALLOC;
     }
 
-    B = gretl_matrix_block_new(&D,   dpd->k, dpd->k,
-			       &dWj, dpd->nz, dpd->nz,
-			       &ui,  dpd->max_ni, 1,
-			       &xij, dpd->max_ni, 1,
-			       &mT,  dpd->nz, dpd->totobs,
-			       &km,  dpd->k, dpd->nz,
-			       &k1,  dpd->k, 1,
-			       &Zui, dpd->nz, 1,
-			       &Zxi, 1, dpd->nz,
+    B = gretl_matrix_block_new(&D,  dpd->k, dpd->k,
+			       &W,  dpd->totobs, dpd->k,
+			       &zr, dpd->totobs, 1,
+			       &ZW, dpd->nz, dpd->k,
+			       &Zu, dpd->nz, 1,
 			       NULL);
     if (B == NULL) {
 	err = E_ALLOC;
@@ -1106,67 +1109,46 @@ static int windmeijer_correct (ddset *dpd, const gretl_matrix *uhat1,
     gretl_matrix_multiply(aV, dpd->XZA, dpd->kmtmp);
     gretl_matrix_multiply_by_scalar(dpd->kmtmp, -1.0 / dpd->effN);
 
-    /* form W^{-1}Z'v_2 */
-    gretl_matrix_multiply(dpd->A, dpd->ZT, mT);
-    gretl_matrix_multiply(mT, dpd->uhat, R1);
+    /* form r = W^{-1}Z'v_2, then z_i = Z_i r for all units */
+    gretl_matrix_multiply(dpd->ZT, dpd->uhat, Zu);
+    gretl_matrix_multiply(dpd->A, Zu, R1);
+    gretl_matrix_multiply_mod(dpd->ZT, GRETL_MOD_TRANSPOSE,
+			      R1, GRETL_MOD_NONE,
+			      zr, GRETL_MOD_NONE);
 
-    for (j=0; j<dpd->k; j++) { /* loop across the X's */
-	int s = 0;
-
-	gretl_matrix_zero(dWj);
+    /* build the w_j vectors, unit by unit */
+    s = 0;
+    for (i=0; i<dpd->N; i++) {
+	int ni = dpd->ui[i].nobs;
 
-	/* form dWj = -(1/N) \sum Z_i'(X_j u' + u X_j')Z_i */
+	if (ni == 0) {
+	    continue;
+	}
 
-	for (i=0; i<dpd->N; i++) {
-	    int ni = dpd->ui[i].nobs;
+	uz = 0.0;
+	for (t=s; t<s+ni; t++) {
+	    uz += uhat1->val[t] * zr->val[t];
+	}
+	for (j=0; j<dpd->k; j++) {
+	    const double *xj = dpd->X->val + j * dpd->X->rows;
+	    double *wj = W->val + j * dpd->totobs;
 
-	    if (ni == 0) {
-		continue;
+	    xz = 0.0;
+	    for (t=s; t<s+ni; t++) {
+		xz += xj[t] * zr->val[t];
 	    }
-
-	    gretl_matrix_reuse(ui, ni, 1);
-	    gretl_matrix_reuse(xij, ni, 1);
-	    gretl_matrix_reuse(dpd->Zi, ni, dpd->nz);
-
-	    /* extract ui (first-step residuals) */
-	    for (t=0; t<ni; t++) {
-		ui->val[t] = uhat1->val[s++];
+	    for (t=s; t<s+ni; t++) {
+		wj[t] = xz * uhat1->val[t] + uz * xj[t];
 	    }
-
-	    /* extract xij */
-	    gretl_matrix_extract_matrix(xij, dpd->X, s - ni, j,
-					GRETL_MOD_NONE);
-
-	    /* extract Zi */
-	    gretl_matrix_extract_matrix(dpd->Zi, dpd->ZT, 0, s - ni,
-					GRETL_MOD_TRANSPOSE);
-
-	    gretl_matrix_multiply_mod(dpd->Zi, GRETL_MOD_TRANSPOSE,
-				      ui, GRETL_MOD_NONE,
-				      Zui, GRETL_MOD_NONE);
-
-	    gretl_matrix_multiply_mod(xij, GRETL_MOD_TRANSPOSE,
-				      dpd->Zi, GRETL_MOD_NONE,
-				      Zxi, GRETL_MOD_NONE);
-
-	    gretl_matrix_multiply_mod(Zui, GRETL_MOD_NONE,
-				      Zxi, GRETL_MOD_NONE,
-				      dWj, GRETL_MOD_CUMULATE);
-	}
-
-	gretl_matrix_add_self_transpose(dWj);
-        gretl_matrix_multiply_by_scalar(dWj, -1.0 / dpd->effN);
-
-        /* D[.,j] = -aV * XZW^{-1} * dWj * W^{-1}Z'v_2 */
-        gretl_matrix_multiply(dpd->kmtmp, dWj, km);
-        gretl_matrix_multiply(km, R1, k1);
-
-        /* write into appropriate column of D (k x k) */
-        for (i=0; i<dpd->k; i++) {
-            gretl_matrix_set(D, i, j, k1->val[i]);
 	}
+	s += ni;
     }
 
+    /* D = -aV * XZW^{-1} * (-1/N) Z'W */
+    gretl_matrix_multiply(dpd->ZT, W, ZW);
+    gretl_matrix_multiply(dpd->kmtmp, ZW, D);
+    gretl_matrix_multiply_by_scalar(D, -1.0 / dpd->effN);
+
     /* add to AsyV: D * AsyV */
     gretl_matrix_multiply_mod(D, GRETL_MOD_NONE,
 			      aV, GRETL_MOD_NONE,
@@ -1236,8 +1218,8 @@ static int dpd_variance_2 (ddset *dpd,
 
 static int dpd_variance_1 (ddset *dpd)
 {
-    gretl_matrix *V, *ui;
-    int i, t, k, c;
+    gretl_matrix *V, *G;
+    int i, k, c;
     int err = 0;
 
     if (!(dpd->flags & DPD_TWOSTEP) && !(dpd->flags & DPD_WINCORR)) {
@@ -1248,14 +1230,17 @@ static int dpd_variance_1 (ddset *dpd)
     }
 
     V = gretl_zero_matrix_new(dpd->nz, dpd->nz);
-    ui = gretl_column_vector_alloc(dpd->max_ni);
+    G = gretl_matrix_alloc(dpd->nz, DPD_UNIT_BATCH);
 
-    if (V == NULL || ui == NULL) {
+    if (V == NULL || G == NULL) {
 	gretl_matrix_free(V);
-	gretl_matrix_free(ui);
+	gretl_matrix_free(G);
 	return E_ALLOC;
     }
 
+    /* The vectors Z_i' v_i are written into the columns of G,
+       and each time G fills up we add G G' to V.
+    */
     c = k = 0;
 
     for (i=0; i<dpd->N; i++) {
@@ -1265,23 +1250,21 @@ static int dpd_variance_1 (ddset *dpd)
 	    continue;
 	}
 
-	/* get per-unit instruments matrix, Zi */
-	gretl_matrix_reuse(dpd->Zi, ni, dpd->nz);
-	gretl_matrix_reuse(ui, ni, 1);
-	gretl_matrix_extract_matrix(dpd->Zi, dpd->ZT, 0, c,
-				    GRETL_MOD_TRANSPOSE);
+	unit_ZTu(dpd, dpd->uhat->val + c, c, ni, G->val + k * dpd->nz);
 	c += ni;
 
-	/* load residuals into the ui vector */
-	for (t=0; t<ni; t++) {
-	    ui->val[t] = dpd->uhat->val[k++];
+	if (++k == DPD_UNIT_BATCH) {
+	    gretl_matrix_multiply_mod(G, GRETL_MOD_NONE,
+				      G, GRETL_MOD_TRANSPOSE,
+				      V, GRETL_MOD_CUMULATE);
+	    k = 0;
 	}
+    }
 
-	gretl_matrix_multiply_mod(ui, GRETL_MOD_TRANSPOSE,
-				  dpd->Zi, GRETL_MOD_NONE,
-				  dpd->L1, GRETL_MOD_NONE);
-	gretl_matrix_multiply_mod(dpd->L1, GRETL_MOD_TRANSPOSE,
-				  dpd->L1, GRETL_MOD_NONE,
+    if (k > 0) {
+	gretl_matrix_reuse(G, -1, k);
+	gretl_matrix_multiply_mod(G, GRETL_MOD_NONE,
+				  G, GRETL_MOD_TRANSPOSE,
 				  V, GRETL_MOD_CUMULATE);
     }
 
@@ -1306,7 +1289,7 @@ static int dpd_variance_1 (ddset *dpd)
 	gretl_matrix_free(V);
     }
 
-    gretl_matrix_free(ui);
+    gretl_matrix_free(G);
 
     return err;
 }
@@ -2525,12 +2508,12 @@ static void build_unit_D_matrix (ddset *dpd, int *goodobs, gretl_matrix *D)
 }
 
 static void build_unit_H_matrix (ddset *dpd, int *goodobs,
-				 gretl_matrix *D)
+				 gretl_matrix *D, gretl_matrix *H)
 {
     build_unit_D_matrix(dpd, goodobs, D);
     gretl_matrix_multiply_mod(D, GRETL_MOD_TRANSPOSE,
 			      D, GRETL_MOD_NONE,
-			      dpd->H, GRETL_MOD_NONE);
+			      H, GRETL_MOD_NONE);
 }
 
 static void make_dpdstyle_H (gretl_matrix *H, int nd)
@@ -3023,34 +3006,141 @@ static int trim_zero_inst (ddset *dpd, PRN *prn)
     return err;
 }
 
-/* allocate temporary storage needed by do_units() */
+/* per-thread workspace for do_units() */
+
+typedef struct unit_work_ unit_work;
+
+struct unit_work_ {
+    gretl_matrix_block *B;
+    gretl_matrix *D;   /* per-unit D matrix, if needed */
+    gretl_matrix *H;   /* per-unit H matrix, if needed */
+    gretl_matrix *Yi;  /* per-unit dependent variable */
+    gretl_matrix *Xi;  /* per-unit regressors */
+    gretl_matrix *Zi;  /* per-unit instruments */
+    gretl_matrix *Zc;  /* Zi, compacted */
+    gretl_matrix *Hc;  /* H, compacted */
+    gretl_matrix *Ac;  /* Zc H Zc' */
+    gretl_matrix *A;   /* partial sum of Z_i H_i Z_i' */
+    int *ridx;         /* non-zero rows of Zi */
+    int *cidx;         /* non-zero columns of Zi */
+};
 
-static int make_units_workspace (ddset *dpd, gretl_matrix **D,
-				 gretl_matrix **Yi, gretl_matrix **Xi)
+static void unit_work_free (unit_work *w)
 {
-    int err = 0;
+    if (w != NULL) {
+	gretl_matrix_block_destroy(w->B);
+	free(w->ridx);
+	free(w);
+    }
+}
 
-    if (dpd_style(dpd)) {
-	/* Ox/DPD-style H matrix: D matrix is not needed */
-	*D = NULL;
-    } else {
-	*D = gretl_matrix_alloc(dpd->T, dpd->max_ni);
-	if (*D == NULL) {
-	    return E_ALLOC;
+static unit_work *unit_work_new (ddset *dpd)
+{
+    unit_work *w = malloc(sizeof *w);
+    int nz = dpd->nz;
+    int ni = dpd->max_ni;
+
+    if (w == NULL) {
+	return NULL;
+    }
+
+    /* Note: if we're doing Ox/DPD-style, the H matrix is the
+       same for all units and the D matrix is not needed
+    */
+    w->B = gretl_matrix_block_new(&w->D,  dpd_style(dpd) ? 1 : dpd->T, ni,
+				  &w->H,  ni, ni,
+				  &w->Yi, 1, ni,
+				  &w->Xi, dpd->k, ni,
+				  &w->Zi, nz, ni,
+				  &w->Zc, nz, ni,
+				  &w->Hc, ni, ni,
+				  &w->Ac, nz, nz,
+				  &w->A,  nz, nz,
+				  NULL);
+    w->ridx = malloc((nz + ni) * sizeof *w->ridx);
+
+    if (w->B == NULL || w->ridx == NULL) {
+	gretl_matrix_block_destroy(w->B);
+	free(w->ridx);
+	free(w);
+	return NULL;
+    }
+
+    w->cidx = w->ridx + nz;
+    gretl_matrix_zero(w->A);
+
+    return w;
+}
+
+/* Cumulate Z_i H_i Z_i' into w->A. The GMM-style instrument
+   blocks in Z_i are mostly zeros, and so are the columns for
+   unused observations, so we first pick out the rows and columns
+   of Z_i that are not identically zero, do the computation on
+   the compacted matrices, then scatter the result into place.
+*/
+
+static void unit_A_cumulate (unit_work *w, const gretl_matrix *H)
+{
+    const gretl_matrix *Zi = w->Zi;
+    int nz = Zi->rows;
+    int nr = 0, nc = 0;
+    int i, j, nonzero;
+    const double *zj;
+    double x;
+
+    for (i=0; i<nz; i++) {
+	w->ridx[i] = 0;
+    }
+
+    for (j=0; j<Zi->cols; j++) {
+	zj = Zi->val + j * nz;
+	nonzero = 0;
+	for (i=0; i<nz; i++) {
+	    if (zj[i] != 0.0) {
+		w->ridx[i] = nonzero = 1;
+	    }
+	}
+	if (nonzero) {
+	    w->cidx[nc++] = j;
 	}
     }
 
-    *Yi = gretl_matrix_alloc(1, dpd->max_ni);
-    *Xi = gretl_matrix_alloc(dpd->k, dpd->max_ni);
+    /* convert the row flags to indices, in place */
+    for (i=0; i<nz; i++) {
+	if (w->ridx[i]) {
+	    w->ridx[nr++] = i;
+	}
+    }
 
-    if (*Yi == NULL || *Xi == NULL) {
-	gretl_matrix_free(*D);
-	gretl_matrix_free(*Yi);
-	gretl_matrix_free(*Xi);
-	err = E_ALLOC;
+    if (nr == 0) {
+	return;
     }
 
-    return err;
+    gretl_matrix_reuse(w->Zc, nr, nc);
+    gretl_matrix_reuse(w->Hc, nc, nc);
+    gretl_matrix_reuse(w->Ac, nr, nr);
+
+    for (j=0; j<nc; j++) {
+	for (i=0; i<nr; i++) {
+	    x = gretl_matrix_get(Zi, w->ridx[i], w->cidx[j]);
+	    gretl_matrix_set(w->Zc, i, j, x);
+	}
+	for (i=0; i<nc; i++) {
+	    x = gretl_matrix_get(H, w->cidx[i], w->cidx[j]);
+	    gretl_matrix_set(w->Hc, i, j, x);
+	}
+    }
+
+    gretl_matrix_qform(w->Zc, GRETL_MOD_NONE, w->Hc,
+		       w->Ac, GRETL_MOD_NONE);
+
+    for (j=0; j<nr; j++) {
+	double *aj = w->A->val + w->ridx[j] * nz;
+
+	for (i=0; i<nr; i++) {
+	    aj[w->ridx[i]] += gretl_matrix_get(w->Ac, i, j);
+	}
+    }
 }
 
 /* Stack the per-unit data matrices from unit @unum for future use,
@@ -3129,31 +3219,25 @@ static void stack_unit_data (ddset *dpd,
    and cumulate A = \sum_i Z_i H_i Z_i'.
 
    At this point we have already done the observations
-   accounts, which are recorded in the Goodobs lists.
+   accounts, which are recorded in the Goodobs lists. These
+   tell us where each unit's data go in the stacked matrices,
+   so the units can be processed in parallel, each thread
+   cumulating its own share of A.
 */
 
 static int do_units (ddset *dpd, const DATASET *dset,
 		     int **Goodobs)
 {
-#if DPDEBUG
-    char ystr[16];
-#endif
-    gretl_matrix *D = NULL;
-    gretl_matrix *Yi = NULL;
-    gretl_matrix *Xi = NULL;
-    gretl_matrix *Zi = NULL;
-    int i, t, Yrow;
+    int *pos = NULL;
+    int i, Yrow;
     int err = 0;
 
-    err = make_units_workspace(dpd, &D, &Yi, &Xi);
-    if (err) {
-	return err;
+    pos = malloc(dpd->N * sizeof *pos);
+    if (pos == NULL) {
+	return E_ALLOC;
     }
 
-    Zi = dpd->Zi;
-    gretl_matrix_reuse(Zi, dpd->nz, dpd->max_ni);
-
-    if (D == NULL) {
+    if (dpd_style(dpd)) {
 	/* the H matrix will not vary by unit */
 	int tau = dpd->t2max - dpd->t1min + 1;
 
@@ -3169,8 +3253,19 @@ static int do_units (ddset *dpd, const DATASET *dset,
     gretl_matrix_zero(dpd->A);
     gretl_matrix_zero(dpd->ZY);
 
-    /* initialize data stacker */
+    /* find the starting row of each unit's stacked data */
     Yrow = 0;
+    for (i=0; i<dpd->N; i++) {
+	int n = Goodobs[i][0];
+
+	pos[i] = Yrow;
+	if (n - 1 != 0) {
+	    Yrow += (n > 1)? n - 1 : 0;
+	    if (gmm_sys(dpd)) {
+		Yrow += n;
+	    }
+	}
+    }
 
 #if DPDEBUG
     /* this should not be necessary if stack_unit_data() is
@@ -3180,35 +3275,62 @@ static int do_units (ddset *dpd, const DATASET *dset,
     gretl_matrix_zero(dpd->ZT);
 #endif
 
-    for (i=0; i<dpd->N; i++) {
-	int *goodobs = Goodobs[i];
-	int Ti = goodobs[0] - 1;
+#if defined(_OPENMP)
+#pragma omp parallel if (gretl_use_openmp((guint64) dpd->N * dpd->nz * dpd->max_ni)) private(i)
+#endif
+    {
+	unit_work *w = unit_work_new(dpd);
+	const gretl_matrix *H = dpd->H;
 
-	if (Ti == 0) {
-	    continue;
+	if (w == NULL) {
+	    err = E_ALLOC;
+	} else if (!dpd_style(dpd)) {
+	    H = w->H;
 	}
 
-	t = data_index(dpd, i);
-	err = build_Y(dpd, goodobs, dset, t, Yi);
-	if (err) {
-	    break;
-	}
-	build_X(dpd, goodobs, dset, t, Xi);
-	build_Z(dpd, goodobs, dset, t, Zi, i);
+#if defined(_OPENMP)
+#pragma omp for
+#endif
+	for (i=0; i<dpd->N; i++) {
+	    int *goodobs = Goodobs[i];
+	    int Ti = goodobs[0] - 1;
+	    int t, row, uerr;
+
+	    if (Ti == 0 || err) {
+		continue;
+	    }
+
+	    t = data_index(dpd, i);
+	    uerr = build_Y(dpd, goodobs, dset, t, w->Yi);
+	    if (uerr) {
+		err = uerr;
+		continue;
+	    }
+	    build_X(dpd, goodobs, dset, t, w->Xi);
+	    build_Z(dpd, goodobs, dset, t, w->Zi, i);
 #if DPDEBUG
-	sprintf(ystr, "do_units: Y_%d", i);
-	gretl_matrix_print(Yi, ystr);
-	gretl_matrix_print(Xi, "do_units: Xi");
-	gretl_matrix_print(Zi, "do_units: Zi");
+	    fprintf(stderr, "do_units: unit %d\n", i);
+	    gretl_matrix_print(w->Yi, "do_units: Yi");
+	    gretl_matrix_print(w->Xi, "do_units: Xi");
+	    gretl_matrix_print(w->Zi, "do_units: Zi");
+#endif
+	    if (!dpd_style(dpd)) {
+		build_unit_H_matrix(dpd, goodobs, w->D, w->H);
+	    }
+	    unit_A_cumulate(w, H);
+	    /* stack the individual data matrices for future use */
+	    row = pos[i];
+	    stack_unit_data(dpd, w->Yi, w->Xi, w->Zi, goodobs, i, &row);
+	}
+
+	if (w != NULL) {
+#if defined(_OPENMP)
+#pragma omp critical (dpd_cumulate_A)
 #endif
-	if (D != NULL) {
-	    build_unit_H_matrix(dpd, goodobs, D);
+	    gretl_matrix_add_to(dpd->A, w->A);
+	    unit_work_free(w);
 	}
-	gretl_matrix_qform(Zi, GRETL_MOD_NONE,
-			   dpd->H, dpd->A, GRETL_MOD_CUMULATE);
-	/* stack the individual data matrices for future use */
-	stack_unit_data(dpd, Yi, Xi, Zi, goodobs, i, &Yrow);
-    }
+    } /* end (possibly) parallel section */
 
 #if DPDEBUG
     gretl_matrix_print(dpd->Y, "dpd->Y");
@@ -3220,9 +3342,7 @@ static int do_units (ddset *dpd, const DATASET *dset,
     gretl_matrix_write_as_text(dpd->X, "dpdX.mat", 0);
 #endif
 
-    gretl_matrix_free(D);
-    gretl_matrix_free(Yi);
-    gretl_matrix_free(Xi);
+    free(pos);
 
     return err;
 }
@@ -20,8 +20,10 @@
 #include "libgretl.h"
 #include "version.h"
 #include "libset.h"
+#include "gretl_mt.h"
 
 #define MINSAMP 8
+#define HMIN 96
 #define HDEBUG 0
 
 static int
@@ -59,15 +61,49 @@ do_hurst_plot (int n, DATASET *dset, const MODEL *pmod,
     return finalize_plot_input_file(fp);
 }
 
-static double cum_range (const double *x, int n, double xbar)
+/* Fill the cumulated sums of @x (n values) and of its squares,
+   @S and @Q, each of length n + 1. The data are first centered
+   on their overall mean: this doesn't affect the rescaled range
+   but limits cancellation error when the sub-sample variances
+   are computed from @Q.
+*/
+
+static void hurst_prefix_sums (const double *x, int n,
+			       double *S, double *Q)
 {
-    double w, wmin, wmax;
-    int i;
+    double d, xbar = 0.0;
+    int t;
 
-    w = wmin = wmax = 0.0;
+    for (t=0; t<n; t++) {
+	xbar += x[t];
+    }
+    xbar /= n;
 
-    for (i=1; i<n; i++) {
-	w += x[i-1] - xbar;
+    S[0] = Q[0] = 0.0;
+    for (t=0; t<n; t++) {
+	d = x[t] - xbar;
+	S[t+1] = S[t] + d;
+	Q[t+1] = Q[t] + d * d;
+    }
+}
+
+/* Rescaled range for the sub-sample of length @m starting at
+   offset @a, given the cumulated sums: the mean and standard
+   deviation are read off @S and @Q directly, and the partial
+   sums of deviations from the mean are S[a+k] - S[a] - k*xbar,
+   so only a single pass over @S is required.
+*/
+
+static double window_RS (const double *S, const double *Q,
+			 int a, int m)
+{
+    double xbar = (S[a+m] - S[a]) / m;
+    double v = (Q[a+m] - Q[a]) / m - xbar * xbar;
+    double w, wmin = 0.0, wmax = 0.0;
+    int k;
+
+    for (k=1; k<m; k++) {
+	w = S[a+k] - S[a] - k * xbar;
 	if (w > wmax) {
 	    wmax = w;
 	} else if (w < wmin) {
@@ -75,20 +111,49 @@ static double cum_range (const double *x, int n, double xbar)
 	}
     }
 
-    return wmax - wmin;
+    return (wmax - wmin) / (v > 0.0 ? sqrt(v) : 0.0);
 }
 
-static double stdev (const double *x, int n, double xbar)
+/* Compute the log (base 2) of the average rescaled range at each
+   of @depth levels of binary sub-sampling, and the log of the
+   corresponding sub-sample size, writing these into @lrs and
+   @lsz. The levels are independent given the cumulated sums, so
+   they may be done in parallel if @par is non-zero.
+*/
+
+static int hurst_rs_calc (const double *x, int n, int depth,
+			  double *lrs, double *lsz, int par)
 {
-    double dev, ssx = 0.0;
+    double *S = malloc(2 * (n + 1) * sizeof *S);
+    double *Q;
     int i;
 
-    for (i=0; i<n; i++) {
-	dev = x[i] - xbar;
-	ssx += dev * dev;
+    if (S == NULL) {
+	return E_ALLOC;
     }
 
-    return ssx > 0.0 ? sqrt(ssx / n) : 0.0;
+    Q = S + n + 1;
+    hurst_prefix_sums(x, n, S, Q);
+
+#if defined(_OPENMP)
+#pragma omp parallel for private(i) \
+    if (par && gretl_use_openmp((guint64) n * depth))
+#endif
+    for (i=0; i<depth; i++) {
+	int m = n >> i;
+	int j, nsub = n / m;
+	double RS = 0.0;
+
+	for (j=0; j<nsub; j++) {
+	    RS += window_RS(S, Q, j*m, m);
+	}
+	lrs[i] = log2(RS / nsub);
+	lsz[i] = log2(m);
+    }
+
+    free(S);
+
+    return 0;
 }
 
 static int hurst_calc (const double *x, int n, int depth,
@@ -101,7 +166,12 @@ static int hurst_calc (const double *x, int n, int depth,
 	N_("log(RS)")
     };
     int cw[] = { 5, 11, 11, 11 };
-    int m, i, j;
+    int i, err;
+
+    err = hurst_rs_calc(x, n, depth, dset->Z[1], dset->Z[2], 1);
+    if (err) {
+	return err;
+    }
 
     get_column_widths(heads, cw, 4);
 
@@ -111,34 +181,9 @@ static int hurst_calc (const double *x, int n, int depth,
 	    UTF_WIDTH(_(heads[2]), cw[2]), _(heads[2]),
 	    UTF_WIDTH(_(heads[3]), cw[3]), _(heads[3]));
 
-    for (i=0, m=n; i<depth; i++, m/=2) {
-	double RS = 0.0;
-	int nsub = n / m;
-
-#if HDEBUG
-	fprintf(stderr, "nsub = %d\n", nsub);
-	fprintf(stderr, "calculating at m = %d...\n", m);
-#endif
-
-	for (j=0; j<nsub; j++) {
-	    double xbar, r, s;
-
-	    xbar = gretl_mean(0, m-1, x + j*m);
-	    r = cum_range(x + j*m, m, xbar);
-	    s = stdev(x + j*m, m, xbar);
-#if HDEBUG
-	    fprintf(stderr, "range x + %d (%d) = %g\n", j*m, m, r);
-	    fprintf(stderr, "stdev x + %d (%d) = %g\n", j*m, m, s);
-#endif
-	    RS += r / s;
-	}
-
-	RS /= nsub;
-
-	dset->Z[1][i] = log2(RS);
-	dset->Z[2][i] = log2(m);
-
-	pprintf(prn, "%*d %#*.5g %#*.5g %#*.5g\n", cw[0], m, cw[1], RS,
+    for (i=0; i<depth; i++) {
+	pprintf(prn, "%*d %#*.5g %#*.5g %#*.5g\n", cw[0], n >> i,
+		cw[1], pow(2.0, dset->Z[1][i]),
 		cw[2], dset->Z[2][i], cw[3], dset->Z[1][i]);
     }
 
@@ -213,7 +258,7 @@ int hurst_exponent (int vnum, const DATASET *dset, gretlopt opt,
 
     T = t2 - t1 + 1;
 
-    if (T < 96) {
+    if (T < HMIN) {
 	pputs(prn, _("Sample is too small for Hurst exponent"));
 	pputc(prn, '\n');
 	return E_TOOFEW;
@@ -233,7 +278,11 @@ int hurst_exponent (int vnum, const DATASET *dset, gretlopt opt,
     pputs(prn, "\n\n");
 
     /* do the rescaled range calculations */
-    hurst_calc(dset->Z[vnum] + t1, T, k, hset, prn);
+    err = hurst_calc(dset->Z[vnum] + t1, T, k, hset, prn);
+    if (err) {
+	destroy_dataset(hset);
+	return err;
+    }
 
     strcpy(hset->varname[1], "RSavg");
     strcpy(hset->varname[2], "size");
@@ -290,3 +339,173 @@ int hurst_exponent (int vnum, const DATASET *dset, gretlopt opt,
 
     return err;
 }
+
+/* OLS slope of @y on @x (with intercept) and its standard error */
+
+static void hurst_slope (const double *y, const double *x, int n,
+			 double *b, double *se)
+{
+    double xbar = 0.0, ybar = 0.0;
+    double sxx = 0.0, sxy = 0.0, ssr = 0.0;
+    double a, e;
+    int i;
+
+    for (i=0; i<n; i++) {
+	xbar += x[i];
+	ybar += y[i];
+    }
+    xbar /= n;
+    ybar /= n;
+
+    for (i=0; i<n; i++) {
+	sxx += (x[i] - xbar) * (x[i] - xbar);
+	sxy += (x[i] - xbar) * (y[i] - ybar);
+    }
+
+    *b = sxy / sxx;
+    a = ybar - *b * xbar;
+
+    for (i=0; i<n; i++) {
+	e = y[i] - a - *b * x[i];
+	ssr += e * e;
+    }
+
+    *se = sqrt(ssr / (n - 2) / sxx);
+}
+
+/* Hurst exponent for a single column of data, with leading and
+   trailing NAs skipped: the result is NA if there are interior
+   NAs or the usable sample is too small.
+*/
+
+static int hurst_column (const double *x, int n, double *H,
+			 double *se)
+{
+    double *lrs;
+    int t1 = 0, t2 = n - 1;
+    int t, T, k, err = 0;
+
+    *H = *se = NADBL;
+
+    while (t1 < t2 && na(x[t1])) t1++;
+    while (t2 > t1 && na(x[t2])) t2--;
+
+    T = t2 - t1 + 1;
+    if (T < HMIN) {
+	return 0;
+    }
+    for (t=t1; t<=t2; t++) {
+	if (na(x[t])) {
+	    return 0;
+	}
+    }
+
+    k = get_depth(T);
+    lrs = malloc(2 * k * sizeof *lrs);
+
+    if (lrs == NULL) {
+	err = E_ALLOC;
+    } else {
+	err = hurst_rs_calc(x + t1, T, k, lrs, lrs + k, 0);
+	if (!err) {
+	    hurst_slope(lrs, lrs + k, k, H, se);
+	}
+	free(lrs);
+    }
+
+    return err;
+}
+
+/**
+ * hurst_matrix:
+ * @X: data matrix.
+ * @cols: list of (1-based) columns to use, or NULL for all.
+ * @opt: may include OPT_Q for no printed output.
+ * @prn: gretl printing struct.
+ *
+ * Estimates the Hurst exponent for each selected column of @X,
+ * in parallel if the amount of work warrants it.
+ *
+ * Returns: 0 on success, non-zero code on error; the estimates
+ * and their standard errors are made available via $result.
+ */
+
+int hurst_matrix (const gretl_matrix *X, const int *cols,
+		  gretlopt opt, PRN *prn)
+{
+    gretl_matrix *result;
+    char **colnames;
+    const char **S;
+    int nc, n = X->rows;
+    int j, err = 0;
+
+    nc = (cols != NULL)? cols[0] : X->cols;
+    for (j=1; cols != NULL && j<=nc; j++) {
+	if (cols[j] < 1 || cols[j] > X->cols) {
+	    return E_INVARG;
+	}
+    }
+
+    result = gretl_matrix_alloc(nc, 2);
+    if (result == NULL) {
+	return E_ALLOC;
+    }
+
+#if defined(_OPENMP)
+#pragma omp parallel for private(j) \
+    if (gretl_use_openmp((guint64) n * nc))
+#endif
+    for (j=0; j<nc; j++) {
+	int c = (cols != NULL)? cols[j+1] - 1 : j;
+	double H, se;
+	int jerr;
+
+	jerr = hurst_column(X->val + (size_t) c * n, n, &H, &se);
+	if (jerr) {
+#if defined(_OPENMP)
+#pragma omp critical (hurst_error)
+#endif
+	    err = jerr;
+	}
+	gretl_matrix_set(result, j, 0, H);
+	gretl_matrix_set(result, j, 1, se);
+    }
+
+    if (err) {
+	gretl_matrix_free(result);
+	return err;
+    }
+
+    if (!(opt & OPT_Q)) {
+	S = gretl_matrix_get_colnames(X);
+	pprintf(prn, "%s\n\n", _("Estimated Hurst exponents"));
+	pprintf(prn, "%12s %12s %12s\n", "", _("coeff"), _("std. error"));
+	for (j=0; j<nc; j++) {
+	    int c = (cols != NULL)? cols[j+1] - 1 : j;
+	    char tmp[16];
+
+	    if (S != NULL) {
+		pprintf(prn, "%12.12s", S[c]);
+	    } else {
+		sprintf(tmp, "col%d", c + 1);
+		pprintf(prn, "%12s", tmp);
+	    }
+	    if (na(result->val[j])) {
+		pprintf(prn, " %12s %12s\n", "NA", "NA");
+	    } else {
+		pprintf(prn, " %#12.5g %#12.5g\n",
+			gretl_matrix_get(result, j, 0),
+			gretl_matrix_get(result, j, 1));
+	    }
+	}
+	pputc(prn, '\n');
+    }
+
+    colnames = strings_array_new(2);
+    colnames[0] = gretl_strdup("hurst");
+    colnames[1] = gretl_strdup("se");
+    gretl_matrix_set_colnames(result, colnames);
+    set_last_result_data(result, GRETL_TYPE_MATRIX);
+
+    return 0;
+}
@@ -66,6 +66,8 @@ void set_maxim (lprec *lp);
 void set_minim (lprec *lp);
 unsigned char set_lp_name (lprec *lp, char *s);
 unsigned char set_obj_fn (lprec *lp, REAL *row);
+void set_rh_vec (lprec *lp, REAL *rh);
+void default_basis (lprec *lp);
 unsigned char add_constraint (lprec *lp, REAL *row,
 			      int constr_type, REAL rh);
 unsigned char set_col_name (lprec *lp, int col, char *name);
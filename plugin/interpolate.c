@@ -21,6 +21,8 @@
 #include "matrix_extra.h"
 #include "gretl_bfgs.h"
 #include "libset.h"
+#include "gretl_f2c.h"
+#include "clapack_double.h"
 
 #define CL_DEBUG 0
 #define SSR_LOGISTIC 1
@@ -61,7 +63,6 @@ struct gls_info {
     const gretl_matrix *X;
     const char *yname;
     gretl_matrix *CX;
-    gretl_matrix *VC;
     gretl_matrix *W;
     gretl_matrix *Z;
     gretl_matrix *Tmp1;
@@ -324,123 +325,175 @@ static int ar1_mle (struct gls_info *G, double s, double *rho,
     return err;
 }
 
-/* Produce W = CVC' without storing C */
+/* The Chow-Lin calculations require W = CVC', where C is the N x sN
+   aggregation matrix and V is either the AR(1) correlation matrix,
+   with elements a^|i-j|, or (Fernandez) the random-walk covariance
+   matrix inv(D'D), with elements min(i,j) + 1 (0-based). Neither V
+   nor C is ever formed: W is N x N and its elements are available
+   in closed form, and products involving V are computed by
+   recursion, in time linear in sN.
+*/
+
+/* 0-based high-frequency index of the observation selected
+   by low-frequency observation @i, when @agg is AGG_EOP
+   or AGG_SOP
+*/
 
-static void make_CVC (gretl_matrix *W, const gretl_matrix *VC,
-		      int s, int agg)
+static int sel_index (int i, int s, int agg)
+{
+    return agg == AGG_SOP ? i*s : i*s + s-1;
+}
+
+/* Fill @W with CVC', in the case where C cumulates
+   (AGG_SUM or AGG_AVG). For AR(1), W is Toeplitz with
+   w(0) = s + 2\sum_{d=1}^{s-1}(s-d)a^d and, at distance
+   g > 0, w(g) = a^{s(g-1)+1} (\sum_{k=0}^{s-1} a^k)^2.
+*/
+
+static void make_cum_W (gretl_matrix *W, int s, double a,
+			int method)
 {
-    double wij;
     int N = W->rows;
-    int i, j, k, ii;
+    double wij;
+    int i, j, k;
 
-    if (agg >= AGG_EOP) {
-	/* select rows of VC */
-	for (j=0; j<N; j++) {
-	    ii = agg == AGG_SOP ? 0 : s-1;
-	    for (i=0; i<N; i++) {
-		wij = gretl_matrix_get(VC, ii, j);
+    if (method == R_UROOT) {
+	/* off the diagonal, w(i,j) = s * (sum of (k+1) over
+	   block min(i,j)); on the diagonal we add the sum of
+	   min(u,v) for u,v in 0..s-1
+	*/
+	double mm = 0.0;
+
+	for (k=0; k<s; k++) {
+	    mm += k * (2*(s-1-k) + 1);
+	}
+	for (i=0; i<N; i++) {
+	    wij = s * (s * (double) i*s + s*(s+1)/2.0);
+	    for (j=i+1; j<N; j++) {
 		gretl_matrix_set(W, i, j, wij);
 		gretl_matrix_set(W, j, i, wij);
-		ii += s;
 	    }
+	    gretl_matrix_set(W, i, i, s * (double) s * (i*s + 1) + mm);
 	}
     } else {
-	/* cumulate rows of VC */
-	for (j=0; j<N; j++) {
-	    ii = 0;
+	double S = 0.0, w0 = s;
+	double apow = 1.0, as;
+	double *wg;
+
+	for (k=0; k<s; k++) {
+	    S += apow;
+	    if (k > 0) {
+		w0 += 2 * (s-k) * apow;
+	    }
+	    apow *= a;
+	}
+	as = apow; /* a^s */
+
+	/* use the first column of W to hold the Toeplitz terms */
+	wg = W->val;
+	wg[0] = w0;
+	if (N > 1) {
+	    wg[1] = a * S * S;
+	    for (k=2; k<N; k++) {
+		wg[k] = wg[k-1] * as;
+	    }
+	}
+	for (j=1; j<N; j++) {
 	    for (i=0; i<N; i++) {
-		wij = 0.0;
-		for (k=0; k<s; k++) {
-		    wij += gretl_matrix_get(VC, ii++, j);
-		}
-		gretl_matrix_set(W, i, j, wij);
-		gretl_matrix_set(W, j, i, wij);
+		gretl_matrix_set(W, i, j, wg[abs(i-j)]);
 	    }
 	}
     }
 }
 
-/* Build VC' without storing V or C as such */
+/* When C selects observations (AGG_EOP or AGG_SOP), CVC' is
+   itself either an AR(1) correlation matrix with coefficient
+   a^s, or the covariance matrix of a random walk observed at
+   the selected points. In both cases the inverse is
+   tridiagonal, so we write it directly into @W, and the log
+   determinant is available without factorization.
+*/
 
-static void make_VC (gretl_matrix *VC, int N,
-		     int s, double a, int agg)
+static void make_sel_W_inverse (gretl_matrix *W, int s, double a,
+				int agg, int method, double *ldet)
 {
-    int sN = s*N;
-    int i, j, k;
+    int N = W->rows;
+    int i;
 
-    if (agg >= AGG_EOP) {
-	k = agg == AGG_SOP ? 0 : s-1;
-	for (j=0; j<N; j++) {
-	    for (i=0; i<sN; i++) {
-		gretl_matrix_set(VC, i, j, pow(a, abs(k-i)));
+    gretl_matrix_zero(W);
+
+    if (method == R_UROOT) {
+	/* precision matrix of the random walk at times t_i,
+	   with t_{-1} = 0
+	*/
+	double h0, h1;
+
+	*ldet = 0.0;
+	h0 = sel_index(0, s, agg) + 1;
+	for (i=0; i<N; i++) {
+	    *ldet += log(h0);
+	    if (i < N-1) {
+		h1 = sel_index(i+1, s, agg) - sel_index(i, s, agg);
+		gretl_matrix_set(W, i, i, 1/h0 + 1/h1);
+		gretl_matrix_set(W, i, i+1, -1/h1);
+		gretl_matrix_set(W, i+1, i, -1/h1);
+		h0 = h1;
+	    } else {
+		gretl_matrix_set(W, i, i, 1/h0);
 	    }
-	    k += s;
 	}
     } else {
-	double vij;
-	int kk = 0;
+	double phi = 1.0, c, c2;
 
-	for (j=0; j<N; j++) {
-	    for (i=0; i<sN; i++) {
-		vij = 0;
-		for (k=0; k<s; k++) {
-		    vij += pow(a, abs(kk+k-i));
-		}
-		gretl_matrix_set(VC, i, j, vij);
+	for (i=0; i<s; i++) {
+	    phi *= a;
+	}
+	c = 1 / (1 - phi*phi);
+	c2 = c * (1 + phi*phi);
+	for (i=0; i<N; i++) {
+	    if (N == 1) {
+		gretl_matrix_set(W, i, i, 1.0);
+	    } else {
+		gretl_matrix_set(W, i, i, (i == 0 || i == N-1)? c : c2);
+	    }
+	    if (i < N-1) {
+		gretl_matrix_set(W, i, i+1, -phi * c);
+		gretl_matrix_set(W, i+1, i, -phi * c);
 	    }
-	    kk += s;
 	}
+	*ldet = (N - 1) * log(1 - phi*phi);
     }
 }
 
-/* The counterpart of make_VC() above, when using Fernandez
-   or when rho = 0.
+/* Set G->W to the inverse of CVC' for the given @a (ignored
+   when doing Fernandez), and write its log-determinant into
+   @ldet.
 */
 
-static void make_alt_VC (gretl_matrix *VC, int s, int agg,
-			 int method)
+static int cl_W_inverse (struct gls_info *G, double a, double *ldet)
 {
-    double vij, *vj, *cval;
-    int N = VC->cols;
-    int rows = VC->rows;
-    size_t colsz = rows * sizeof *vj;
-    int i, j, k;
-
-    vj = malloc(colsz);
-    gretl_matrix_zero(VC);
+    int err = 0;
 
-    /* (1) construct C' */
-    k = (agg == AGG_EOP)? s-1 : 0;
-    for (j=0; j<N; j++) {
-	if (agg >= AGG_EOP) {
-	    gretl_matrix_set(VC, k, j, 1);
-	} else {
-	    for (i=0; i<s; i++) {
-		gretl_matrix_set(VC, i+k, j, 1);
-	    }
-	}
-	k += s;
+    if (G->agg >= AGG_EOP) {
+	make_sel_W_inverse(G->W, G->s, a, G->agg, G->method, ldet);
+	return 0;
     }
 
-    if (method == R_UROOT) {
-	/* (2) premultiply by inv(D'D) */
-	for (k=0; k<2; k++) {
-	    cval = VC->val;
-	    for (j=0; j<N; j++) {
-		memcpy(vj, cval, colsz);
-		vij = vj[rows-1];
-		for (i=0; i<rows; i++) {
-		    cval[i] = vij;
-		    if (i < rows-1) {
-			vij += vj[rows-i-2];
-		    }
-		}
-		cval += rows;
-	    }
+    make_cum_W(G->W, G->s, a, G->method);
+    if (G->Wcpy == NULL) {
+	G->Wcpy = gretl_matrix_copy(G->W);
+	if (G->Wcpy == NULL) {
+	    return E_ALLOC;
 	}
+    } else {
+	gretl_matrix_copy_values(G->Wcpy, G->W);
+    }
+    err = gretl_invert_symmetric_matrix(G->W);
+    if (!err) {
+	*ldet = gretl_matrix_log_determinant(G->Wcpy, &err);
     }
 
-    free(vj);
+    return err;
 }
 
 /* Make the counterpart to VC' that's required for extrapolation;
@@ -482,67 +535,108 @@ static void make_EVC (gretl_matrix *EVC, int s,
     }
 }
 
-/* version of make_EVC() for use with fernandez */
+/* Multiply VC' into W*u and increment y by the result. We
+   first form x = C'Wu, of length sN; then Vx is obtained by
+   a forward and a backward recursion in the AR(1) case, or
+   by two cumulations in the random-walk case.
+*/
 
-static void make_EDDC (gretl_matrix *EVC,
-		       gretl_matrix *VC)
+static int multiply_by_VC (gretl_matrix *y,
+			   struct gls_info *G,
+			   int m, double a)
 {
-    double vij;
-    int i, j;
+    const double *Wu = G->Tmp1->val;
+    double *x, *f;
+    double xk;
+    int N = G->y0->rows;
+    int s = G->s;
+    int sN = s * N;
+    int i, j, k;
 
-    for (j=0; j<EVC->cols; j++) {
-	vij = gretl_matrix_get(VC, VC->rows-1, j);
-	for (i=0; i<EVC->rows; i++) {
-	    gretl_matrix_set(EVC, i, j, vij);
+    x = malloc(2 * sN * sizeof *x);
+    if (x == NULL) {
+	return E_ALLOC;
+    }
+    f = x + sN;
+
+    /* x = C'Wu */
+    for (k=0; k<sN; k++) {
+	x[k] = 0.0;
+    }
+    for (j=0; j<N; j++) {
+	if (G->agg >= AGG_EOP) {
+	    x[sel_index(j, s, G->agg)] = Wu[j];
+	} else {
+	    for (i=0; i<s; i++) {
+		x[j*s+i] = Wu[j];
+	    }
 	}
     }
-}
 
-/* Multiply VC' into W*u and increment y by the result */
+    if (G->method == R_UROOT) {
+	/* inv(D'D) x: cumulate backward, then forward */
+	double ext = 0.0;
 
-static void multiply_by_VC (gretl_matrix *y,
-			    struct gls_info *G,
-			    int m, double a)
-{
-    gretl_matrix *Wu = G->Tmp1;
-    gretl_matrix *EVC = NULL;
-    gretl_matrix ext = {0};
-    int i, sN = y->rows;
+	f[sN-1] = x[sN-1];
+	for (k=sN-2; k>=0; k--) {
+	    f[k] = f[k+1] + x[k];
+	}
+	xk = 0.0;
+	for (k=0; k<sN; k++) {
+	    xk += f[k];
+	    y->val[k] += xk;
+	    ext += (k + 1) * x[k];
+	}
+	/* the last row of VC' applies to all extrapolated obs */
+	for (i=0; i<m; i++) {
+	    y->val[sN+i] += ext;
+	}
+    } else if (a == 0) {
+	for (k=0; k<sN; k++) {
+	    y->val[k] += x[k];
+	}
+    } else {
+	/* (Vx)_k = f_k + b_k - x_k, where f_k = x_k + a f_{k-1}
+	   and b_k = x_k + a b_{k+1}
+	*/
+	f[0] = x[0];
+	for (k=1; k<sN; k++) {
+	    f[k] = x[k] + a * f[k-1];
+	}
+	xk = 0.0;
+	for (k=sN-1; k>=0; k--) {
+	    xk = x[k] + a * xk;
+	    y->val[k] += f[k] + xk - x[k];
+	}
+    }
+
+    free(x);
 
-    if (m > 0) {
+    if (m > 0 && G->method != R_UROOT) {
 	/* we need a different covariance matrix for
 	   extrapolation
 	*/
-	sN -= m;
-	gretl_matrix_reuse(y, sN, 1);
-	gretl_matrix_init(&ext);
-	ext.rows = m;
-	ext.cols = 1;
-	ext.val = y->val + sN;
-	EVC = gretl_matrix_alloc(m, sN / G->s);
-    }
-
-    gretl_matrix_multiply_mod(G->VC, GRETL_MOD_NONE,
-			      Wu, GRETL_MOD_NONE,
-			      y, GRETL_MOD_CUMULATE);
-
-    if (EVC != NULL) {
-	if (G->method == R_UROOT) {
-	    make_EDDC(EVC, G->VC);
+	gretl_matrix *EVC = gretl_matrix_alloc(m, N);
+
+	if (EVC != NULL) {
+	    make_EVC(EVC, s, a, G->agg);
+	    for (i=0; i<m; i++) {
+		xk = 0.0;
+		for (j=0; j<N; j++) {
+		    xk += gretl_matrix_get(EVC, i, j) * Wu[j];
+		}
+		y->val[sN+i] += xk;
+	    }
+	    gretl_matrix_free(EVC);
 	} else {
-	    make_EVC(EVC, G->s, a, G->agg);
-	}
-	gretl_matrix_multiply_mod(EVC, GRETL_MOD_NONE,
-				  Wu, GRETL_MOD_NONE,
-				  &ext, GRETL_MOD_CUMULATE);
-	gretl_matrix_reuse(y, sN+m, 1);
-	gretl_matrix_free(EVC);
-    } else if (m > 0) {
-	/* fallback */
-	for (i=0; i<m; i++) {
-	    y->val[sN+i] = NADBL;
+	    /* fallback */
+	    for (i=0; i<m; i++) {
+		y->val[sN+i] = NADBL;
+	    }
 	}
     }
+
+    return 0;
 }
 
 /* Carry out enough of the Chow-Lin GLS calculations to permit
@@ -556,14 +650,12 @@ static double cl_gls_calc (const double *rho, void *data)
 {
     struct gls_info *G = data;
     double a = *rho;
-    double ldet, crit;
+    double ldet = 0, crit;
     double SSR = NADBL;
     int N = G->y0->rows;
     int err = 0;
 
-    if (G->method == R_UROOT) {
-	make_alt_VC(G->VC, G->s, G->agg, G->method);
-    } else {
+    if (G->method != R_UROOT) {
 	if (!(G->flags & CL_TRUNC)) {
 	    /* if we're on a second pass after truncation
 	       to zero, @rho will not be given in
@@ -579,19 +671,14 @@ static double cl_gls_calc (const double *rho, void *data)
 	    }
 #endif
 	}
-	make_VC(G->VC, N, G->s, a, G->agg);
     }
 
-    make_CVC(G->W, G->VC, G->s, G->agg);
-    if ((G->flags & CL_NETVCV) && a > 0) {
-	gretl_matrix_multiply_by_scalar(G->W, 1/(1.0-a*a));
-    }
-    if (G->Wcpy == NULL) {
-	G->Wcpy = gretl_matrix_copy(G->W);
-    } else {
-	gretl_matrix_copy_values(G->Wcpy, G->W);
+    /* W here is the inverse of CVC' */
+    err = cl_W_inverse(G, a, &ldet);
+    if (!err && (G->flags & CL_NETVCV) && a > 0) {
+	gretl_matrix_multiply_by_scalar(G->W, 1.0 - a*a);
+	ldet -= N * log(1.0 - a*a);
     }
-    err = gretl_invert_symmetric_matrix(G->W);
 
     if (!err) {
 	gretl_matrix_qform(G->CX, GRETL_MOD_TRANSPOSE,
@@ -612,8 +699,6 @@ static double cl_gls_calc (const double *rho, void *data)
 	gretl_matrix_multiply_mod(G->CX, GRETL_MOD_NONE,
 				  G->b, GRETL_MOD_NONE,
 				  G->u, GRETL_MOD_DECREMENT);
-
-	ldet = gretl_matrix_log_determinant(G->Wcpy, &err);
     }
 
     if (!err) {
@@ -973,17 +1058,19 @@ static int cl_ols (struct gls_info *G,
 	/* no autocorrelation: GLS isn't needed */
 	int N = G->u->rows;
 	int nx = G->b->rows;
+	double ldet;
 
 	/* y = X\hat{\beta}_{OLS} */
 	make_X_beta(y, G->b->val, X, G->det);
 
 	/* add C'(CC')^{-1} * \hat{u}_{OLS} */
-	make_alt_VC(G->VC, G->s, G->agg, R_ACF1);
-	make_CVC(G->W, G->VC, G->s, G->agg);
-	gretl_invert_symmetric_matrix(G->W);
+	err = cl_W_inverse(G, 0.0, &ldet);
+	if (err) {
+	    return err;
+	}
 	gretl_matrix_reuse(G->Tmp1, N, 1);
 	gretl_matrix_multiply(G->W, G->u, G->Tmp1);
-	multiply_by_VC(y, G, m, 0);
+	err = multiply_by_VC(y, G, m, 0);
 	gretl_matrix_reuse(G->Tmp1, nx, N);
 
 	if (G->agg == AGG_AVG) {
@@ -1126,7 +1213,6 @@ static gretl_matrix *chow_lin_disagg (const gretl_matrix *Y0,
 
     /* workspace */
     B = gretl_matrix_block_new(&G.CX, N, nx,
-			       &G.VC, sN, N,
 			       &G.W, N, N,
 			       &G.b, nx, 1,
 			       &G.u, N, 1,
@@ -1223,7 +1309,7 @@ static gretl_matrix *chow_lin_disagg (const gretl_matrix *Y0,
 	    make_X_beta(y, G.b->val, X, det);
 	    gretl_matrix_reuse(G.Tmp1, N, 1);
 	    gretl_matrix_multiply(G.W, G.u, G.Tmp1);
-	    multiply_by_VC(y, &G, m, a);
+	    err = multiply_by_VC(y, &G, m, a);
 	    gretl_matrix_reuse(G.Tmp1, nx, N);
 
 	    if (prn != NULL && verbose) {
@@ -1253,6 +1339,29 @@ static gretl_matrix *chow_lin_disagg (const gretl_matrix *Y0,
     return Y;
 }
 
+/* Position of high-frequency observation @k in the ordering
+   used by denton_fd(): the multiplier for each low-frequency
+   period follows the @s observations belonging to that period,
+   and any observations beyond the last period come at the end.
+*/
+
+static int denton_xpos (int k, int s, int N)
+{
+    int j = k / s;
+
+    return k + (j < N ? j : N);
+}
+
+/* Set element (@i, @j) of a matrix held in LAPACK general band
+   storage, as required by dgbsv().
+*/
+
+static void denton_band_set (double *ab, int ldab, int kl, int ku,
+			     int i, int j, double x)
+{
+    ab[(size_t) j * ldab + kl + ku + i - j] = x;
+}
+
 /* The method of F. T. Denton, "Adjustment of Monthly or Quarterly
    Series to Annual Totals: An Approach Based on Quadratic
    Minimization", Journal of the American Statistical Association
@@ -1276,128 +1385,123 @@ static gretl_matrix *denton_fd (const gretl_matrix *Y0,
 				DATASET *dset,
 				int *err)
 {
-    gretl_matrix *M;
-    gretl_matrix *Y;
-    gretl_matrix *tmp;
-    gretl_matrix *DDp = NULL;
-    gretl_matrix *y0, *y;
-    gretl_matrix my0, my;
-    double pk, mij;
+    gretl_matrix *Y = NULL;
+    double *ab = NULL;
+    double *rhs = NULL;
+    integer *ipiv = NULL;
+    integer n, kl, ku, ldab, nrhs, info;
+    double pk;
     int N = Y0->rows;
     int ny = Y0->cols;
     int sN = s * N;
     int m = p->rows - sN;
     int sNm = sN + m;
     int dim = sNm + N;
-    int i, j, ii, k = 0;
-    int offset;
-
-    /* we need one big matrix, @M */
-    M = gretl_zero_matrix_new(dim, dim);
-    /* plus some workspace */
-    if (afd) {
-	tmp = gretl_matrix_alloc(dim, 1);
-    } else {
-	tmp = gretl_matrix_alloc(sNm, N);
-    }
-    /* and the return matrix */
+    int i, j, k, ii, offset;
+
+    /* The system to be solved has the form (D'D ~ diag(p)*J') |
+       (J*diag(p) ~ 0), see di Fonzo and Marini, equation (4), or
+       in the afd case, (D'D ~ J') | (J ~ 0). With the Lagrange
+       multiplier for each low-frequency period placed immediately
+       after the high-frequency observations it constrains, this
+       matrix is banded with half-bandwidth at most s (D'D being
+       tridiagonal), so we use a banded LU solver rather than
+       inverting it as a dense matrix.
+    */
+    kl = ku = MAX(s, 2);
+    ldab = 2 * kl + ku + 1;
+    n = dim;
+    nrhs = ny;
+
     Y = gretl_matrix_alloc(sNm, ny);
+    ab = calloc((size_t) ldab * dim, sizeof *ab);
+    rhs = calloc((size_t) dim * ny, sizeof *rhs);
+    ipiv = malloc(dim * sizeof *ipiv);
 
-    if (M == NULL || tmp == NULL || Y == NULL) {
+    if (Y == NULL || ab == NULL || rhs == NULL || ipiv == NULL) {
 	*err = E_ALLOC;
 	goto bailout;
     }
 
-    if (afd) {
-	DDp = gretl_zero_matrix_new(dim, 1);
-	if (DDp == NULL) {
-	    *err = E_ALLOC;
-	    goto bailout;
-	}
-    }
-
-    /* convenience pointers to columns of Y0, Y */
-    y0 = gretl_matrix_init_full(&my0, N, 1, Y0->val);
-    y = gretl_matrix_init_full(&my, sNm, 1, Y->val);
-
-    /* In @M, create (D'D ~ diag(p)*J') | (J*diag(p) ~ 0);
-       see di Fonzo and Marini, equation (4), or in the
-       afd case, (D'D ~ J') | (J ~ 0).
-    */
-
-    /* the upper left portion, D'D */
+    /* the D'D portion */
     for (i=0; i<sNm; i++) {
-	gretl_matrix_set(M, i, i, (i == 0 || i == sNm-1)? 1 : 2);
-	if (i > 0) {
-	    gretl_matrix_set(M, i, i-1, -1);
-	}
+	ii = denton_xpos(i, s, N);
+	denton_band_set(ab, ldab, kl, ku, ii, ii,
+			(i == 0 || i == sNm-1)? 1 : 2);
 	if (i < sNm-1) {
-	    gretl_matrix_set(M, i, i+1, -1);
+	    j = denton_xpos(i+1, s, N);
+	    denton_band_set(ab, ldab, kl, ku, ii, j, -1);
+	    denton_band_set(ab, ldab, kl, ku, j, ii, -1);
 	}
     }
 
-    /* the bottom and right portions, using @p (or not) */
-    k = offset = (agg == AGG_EOP)? s-1 : 0;
-    for (i=sNm; i<dim; i++) {
+    /* the constraints, using @p (or not) */
+    for (j=0; j<N; j++) {
+	ii = (j+1)*s + j; /* position of multiplier */
+	offset = j*s;
 	if (agg >= AGG_EOP) {
+	    k = (agg == AGG_EOP)? offset + s-1 : offset;
 	    pk = afd ? 1 : p->val[k];
-	    gretl_matrix_set(M, i, offset, pk);
-	    gretl_matrix_set(M, offset, i, pk);
-	    k += s;
+	    denton_band_set(ab, ldab, kl, ku, ii, denton_xpos(k, s, N), pk);
+	    denton_band_set(ab, ldab, kl, ku, denton_xpos(k, s, N), ii, pk);
 	} else {
-	    for (j=offset; j<offset+s; j++) {
+	    for (k=offset; k<offset+s; k++) {
 		pk = afd ? 1 : p->val[k];
-		gretl_matrix_set(M, i, j, pk);
-		gretl_matrix_set(M, j, i, pk);
-		k++;
+		denton_band_set(ab, ldab, kl, ku, ii, denton_xpos(k, s, N), pk);
+		denton_band_set(ab, ldab, kl, ku, denton_xpos(k, s, N), ii, pk);
 	    }
 	}
-	offset += s;
     }
 
-    *err = gretl_invert_symmetric_indef_matrix(M);
+    /* right-hand sides: (0 | y0) or, for afd, (D'Dp | y0) */
+    for (ii=0; ii<ny; ii++) {
+	double *r = rhs + ii * dim;
+	const double *y0 = Y0->val + ii * N;
 
-    for (ii=0; ii<ny && !*err; ii++) {
-	if (ii > 0) {
-	    /* pick up the current columns for reading and writing */
-	    y0->val = Y0->val + ii * N;
-	    y->val = Y->val + ii * sNm;
-	}
 	if (afd) {
-	    /* form (D'Dp | y0) */
-	    DDp->val[0] = p->val[0] - p->val[1];
+	    r[denton_xpos(0, s, N)] = p->val[0] - p->val[1];
 	    for (i=1; i<sNm-1; i++) {
-		DDp->val[i] = 2 * p->val[i] - p->val[i-1] - p->val[i+1];
-	    }
-	    DDp->val[sNm-1] = p->val[sNm-1] - p->val[sNm-2];
-	    memcpy(DDp->val + sNm, y0->val, N * sizeof(double));
-	    /* multiply M into (D'Dp | y0) */
-	    gretl_matrix_multiply(M, DDp, tmp);
-	    /* and extract the portion we want */
-	    memcpy(y->val, tmp->val, sNm * sizeof(double));
-	} else {
-	    /* extract the relevant portion of M-inverse and
-	       premultiply by (diag(p) ~ 0) | (0 ~ I)
-	    */
-	    for (j=0; j<N; j++) {
-		for (i=0; i<sNm; i++) {
-		    mij = gretl_matrix_get(M, i, j+sNm);
-		    gretl_matrix_set(tmp, i, j, mij * p->val[i]);
-		}
+		r[denton_xpos(i, s, N)] =
+		    2 * p->val[i] - p->val[i-1] - p->val[i+1];
 	    }
-	    gretl_matrix_multiply(tmp, y0, y);
+	    r[denton_xpos(sNm-1, s, N)] = p->val[sNm-1] - p->val[sNm-2];
+	}
+	for (j=0; j<N; j++) {
+	    r[(j+1)*s + j] = y0[j];
 	}
+    }
+
+    dgbsv_(&n, &kl, &ku, &nrhs, ab, &ldab, ipiv, rhs, &n, &info);
+
+    if (info < 0) {
+	*err = E_DATA;
+    } else if (info > 0) {
+	*err = E_SINGULAR;
+    }
+
+    for (ii=0; ii<ny && !*err; ii++) {
+	const double *r = rhs + ii * dim;
+	double *y = Y->val + ii * sNm;
 
-	if (agg == AGG_AVG) {
-	    gretl_matrix_multiply_by_scalar(y, s);
+	/* extract the solution for the high-frequency series,
+	   premultiplied by diag(p) in the proportional case
+	*/
+	for (i=0; i<sNm; i++) {
+	    y[i] = r[denton_xpos(i, s, N)];
+	    if (!afd) {
+		y[i] *= p->val[i];
+	    }
+	    if (agg == AGG_AVG) {
+		y[i] *= s;
+	    }
 	}
     }
 
  bailout:
 
-    gretl_matrix_free(M);
-    gretl_matrix_free(tmp);
-    gretl_matrix_free(DDp);
+    free(ab);
+    free(rhs);
+    free(ipiv);
 
     if (*err) {
 	gretl_matrix_free(Y);
@@ -28,6 +28,11 @@
 #include "varprint.h"
 #include "libset.h"
 #include "jprivate.h"
+#include "gretl_mt.h"
+
+#if defined(_OPENMP)
+# include <omp.h>
+#endif
 
 #define JDEBUG 0
 
@@ -1547,7 +1552,8 @@ static void coint_test_print_exog (GRETL_VAR *jvar,
 
 static int
 compute_coint_test (GRETL_VAR *jvar, const DATASET *dset,
-		    gretlopt opt, PRN *prn)
+		    const gretl_matrix *Tr, gretlopt opt,
+		    PRN *prn)
 {
     gretl_matrix *evals = jvar->jinfo->evals;
     gretl_matrix *tests;
@@ -1669,6 +1675,28 @@ compute_coint_test (GRETL_VAR *jvar, const DATASET *dset,
 	}
     }
 
+    if (Tr != NULL) {
+	/* bootstrap p-values for the trace test */
+	int B = Tr->rows;
+	int b, nb;
+
+	pputc(prn, '\n');
+	pprintf(prn, _("Bootstrap p-values (%d replications)"), B);
+	pprintf(prn, "\n%s %s %s\n", _("Rank"), _("Trace test"),
+		_("p-value"));
+	for (i=0; i<n; i++) {
+	    trace = gretl_matrix_get(tests, i, 0);
+	    nb = 0;
+	    for (b=0; b<B; b++) {
+		if (gretl_matrix_get(Tr, b, i) >= trace) {
+		    nb++;
+		}
+	    }
+	    pprintf(prn, "%4d%#11.5g [%6.4f]\n", i, trace, nb / (double) B);
+	    gretl_matrix_set(pvals, i, 0, nb / (double) B);
+	}
+    }
+
     pputc(prn, '\n');
 
     if (nexo > 0 || nrexo > 0) {
@@ -1730,11 +1758,577 @@ static int johansen_get_eigenvalues (gretl_matrix *S00,
     return err;
 }
 
+/* Bootstrap of the trace test (coint2 --bootstrap). For each
+   null hypothesis on the cointegration rank, r, the VECM is
+   estimated under H0 and the centered residuals are resampled
+   i.i.d. to generate artificial data recursively, starting from
+   the observed initial values. Deterministic terms and any
+   exogenous variables are held fixed. In each replication the
+   moment matrices S00, S01 and S11 are obtained in a single pass,
+   by forming the cross-product of [X | dY | Y1] and eliminating
+   the X block, so that the auxiliary regressions of stage 1 need
+   not be run as such. Replications are independent, so they are
+   shared out among threads; the sampling indices are drawn in
+   sequence beforehand, which means that the results do not
+   depend on the number of threads.
+*/
+
+#define JB_MAXFAIL 0.10 /* max. proportion of failed replications */
+
+typedef struct jboot_ jboot;
+typedef struct jb_work_ jb_work;
+
+struct jboot_ {
+    int T;                /* number of observations */
+    int n;                /* number of equations */
+    int p1;               /* columns of Y1, including restricted terms */
+    int k;                /* columns of X (stage 1 regressors) */
+    int ifc;              /* position of first lagged difference in X */
+    int nl;               /* number of lagged differences */
+    int *lags;            /* the lags of dY included in X */
+    const gretl_matrix *X; /* stage 1 regressors, or NULL */
+    gretl_matrix *R1x;    /* T x (p1 - n): restricted terms */
+    gretl_matrix *y0;     /* levels at the start of the sample */
+    gretl_matrix *d0;     /* pre-sample differences, by lag */
+    gretl_matrix *Gamma;  /* k x n: coefficients on X, under H0 */
+    gretl_matrix *Pi;     /* p1 x n: long-run matrix, under H0 */
+    gretl_matrix *E;      /* T x n: centered residuals, under H0 */
+};
+
+struct jb_work_ {
+    gretl_matrix *M;      /* T x (k + n + p1): [X | dY | Y1] */
+    gretl_matrix *G;      /* cross-product of M */
+    gretl_matrix *S00;
+    gretl_matrix *S01;
+    gretl_matrix *S11;
+    gretl_matrix *Tmp;
+    double *gdiag;        /* original diagonal of G */
+};
+
+static void jboot_free (jboot *jb)
+{
+    free(jb->lags);
+    gretl_matrix_free(jb->R1x);
+    gretl_matrix_free(jb->y0);
+    gretl_matrix_free(jb->d0);
+    gretl_matrix_free(jb->Gamma);
+    gretl_matrix_free(jb->Pi);
+    gretl_matrix_free(jb->E);
+}
+
+static int jboot_init (jboot *jb, const GRETL_VAR *jvar,
+		       const DATASET *dset)
+{
+    JohansenInfo *jv = jvar->jinfo;
+    int order = jvar->order;
+    int i, j, t, vi;
+    double x;
+
+    jb->T = jvar->T;
+    jb->n = jvar->neqns;
+    jb->p1 = jv->R1->cols;
+    jb->X = (jv->BB != NULL)? jvar->X : NULL;
+    jb->k = (jb->X != NULL)? jb->X->cols : 0;
+    jb->ifc = (jvar->detflags & DET_CONST)? 1 : 0;
+    jb->nl = 0;
+
+    jb->lags = malloc((order + 1) * sizeof *jb->lags);
+    jb->y0 = gretl_matrix_alloc(1, jb->n);
+    jb->d0 = gretl_matrix_alloc(order + 1, jb->n);
+    jb->Gamma = NULL;
+    jb->Pi = gretl_matrix_alloc(jb->p1, jb->n);
+    jb->E = gretl_matrix_alloc(jb->T, jb->n);
+    jb->R1x = NULL;
+
+    if (jb->k > 0) {
+	jb->Gamma = gretl_matrix_alloc(jb->k, jb->n);
+    }
+    if (jb->p1 > jb->n) {
+	jb->R1x = gretl_matrix_alloc(jb->T, jb->p1 - jb->n);
+    }
+
+    if (jb->lags == NULL || jb->y0 == NULL || jb->d0 == NULL ||
+	jb->Pi == NULL || jb->E == NULL ||
+	(jb->k > 0 && jb->Gamma == NULL) ||
+	(jb->p1 > jb->n && jb->R1x == NULL)) {
+	return E_ALLOC;
+    }
+
+    if (jb->X != NULL) {
+	for (j=1; j<=order; j++) {
+	    if (lag_wanted(jvar, j)) {
+		jb->lags[jb->nl++] = j;
+	    }
+	}
+    }
+
+    /* initial levels and pre-sample differences */
+    for (i=0; i<jb->n; i++) {
+	vi = jvar->ylist[i+1];
+	x = dset->Z[vi][jvar->t1-1];
+	gretl_matrix_set(jb->y0, 0, i, x);
+	for (j=1; j<=order; j++) {
+	    t = jvar->t1 - j;
+	    x = dset->Z[vi][t] - dset->Z[vi][t-1];
+	    gretl_matrix_set(jb->d0, j, i, x);
+	}
+    }
+
+    /* restricted terms: these are held fixed */
+    if (jb->R1x != NULL) {
+	const gretl_matrix *src = (jv->BB != NULL)? jv->YY : jv->R1;
+	int off = (jv->BB != NULL)? 2 * jb->n : jb->n;
+
+	for (j=0; j<jb->R1x->cols; j++) {
+	    for (t=0; t<jb->T; t++) {
+		x = gretl_matrix_get(src, t, off + j);
+		gretl_matrix_set(jb->R1x, t, j, x);
+	    }
+	}
+    }
+
+    return 0;
+}
+
+/* Estimate the VECM under the hypothesis of cointegration rank
+   @r, given the eigenvectors from the test on the original data:
+   fill out the long-run matrix, the coefficients on the stage 1
+   regressors and the centered residuals.
+*/
+
+static int jboot_H0_estimate (jboot *jb, const GRETL_VAR *jvar,
+			      int r)
+{
+    JohansenInfo *jv = jvar->jinfo;
+    gretl_matrix *beta = NULL;
+    gretl_matrix *alpha = NULL;
+    gretl_matrix *Q = NULL;
+    gretl_matrix *SB = NULL;
+    int n = jb->n;
+    int i, j;
+    int err = 0;
+
+    gretl_matrix_zero(jb->Pi);
+
+    if (r > 0) {
+	beta = gretl_matrix_alloc(jb->p1, r);
+	alpha = gretl_matrix_alloc(n, r);
+	Q = gretl_matrix_alloc(r, r);
+	SB = gretl_matrix_alloc(n, r);
+	if (beta == NULL || alpha == NULL || Q == NULL || SB == NULL) {
+	    err = E_ALLOC;
+	    goto bailout;
+	}
+	for (j=0; j<r; j++) {
+	    for (i=0; i<jb->p1; i++) {
+		gretl_matrix_set(beta, i, j, gretl_matrix_get(jv->Beta, i, j));
+	    }
+	}
+	/* alpha = S01 beta (beta' S11 beta)^{-1} */
+	gretl_matrix_qform(beta, GRETL_MOD_TRANSPOSE, jv->S11,
+			   Q, GRETL_MOD_NONE);
+	err = gretl_invert_symmetric_matrix(Q);
+	if (!err) {
+	    gretl_matrix_multiply(jv->S01, beta, SB);
+	    gretl_matrix_multiply(SB, Q, alpha);
+	    gretl_matrix_multiply_mod(beta, GRETL_MOD_NONE,
+				      alpha, GRETL_MOD_TRANSPOSE,
+				      jb->Pi, GRETL_MOD_NONE);
+	}
+    }
+
+    if (!err) {
+	/* E = R0 - R1 Pi, centered */
+	gretl_matrix_copy_values(jb->E, jv->R0);
+	gretl_matrix_multiply_mod(jv->R1, GRETL_MOD_NONE,
+				  jb->Pi, GRETL_MOD_NONE,
+				  jb->E, GRETL_MOD_DECREMENT);
+	gretl_matrix_center(jb->E);
+    }
+
+    if (!err && jb->k > 0) {
+	/* Gamma = B0 - B1 Pi */
+	const gretl_matrix *B = jv->BB;
+	double gij;
+	int c;
+
+	for (j=0; j<n; j++) {
+	    for (i=0; i<jb->k; i++) {
+		gij = gretl_matrix_get(B, i, j);
+		for (c=0; c<jb->p1; c++) {
+		    gij -= gretl_matrix_get(B, i, n + c) *
+			gretl_matrix_get(jb->Pi, c, j);
+		}
+		gretl_matrix_set(jb->Gamma, i, j, gij);
+	    }
+	}
+    }
+
+ bailout:
+
+    gretl_matrix_free(beta);
+    gretl_matrix_free(alpha);
+    gretl_matrix_free(Q);
+    gretl_matrix_free(SB);
+
+    return err;
+}
+
+static void jb_work_free (jb_work *w)
+{
+    if (w != NULL) {
+	gretl_matrix_free(w->M);
+	gretl_matrix_free(w->G);
+	gretl_matrix_free(w->S00);
+	gretl_matrix_free(w->S01);
+	gretl_matrix_free(w->S11);
+	gretl_matrix_free(w->Tmp);
+	free(w->gdiag);
+	free(w);
+    }
+}
+
+/* Allocate per-thread workspace: the fixed columns of the
+   data matrix (stage 1 regressors and restricted terms) are
+   written once, here.
+*/
+
+static jb_work *jb_work_new (const jboot *jb)
+{
+    jb_work *w = malloc(sizeof *w);
+    int n = jb->n, p1 = jb->p1;
+    int m = jb->k + n + p1;
+    int i, j;
+
+    if (w == NULL) {
+	return NULL;
+    }
+
+    w->M = gretl_matrix_alloc(jb->T, m);
+    w->G = gretl_matrix_alloc(m, m);
+    w->S00 = gretl_matrix_alloc(n, n);
+    w->S01 = gretl_matrix_alloc(n, p1);
+    w->S11 = gretl_matrix_alloc(p1, p1);
+    w->Tmp = gretl_matrix_alloc(p1, p1);
+    w->gdiag = malloc(m * sizeof *w->gdiag);
+
+    if (w->M == NULL || w->G == NULL || w->S00 == NULL ||
+	w->S01 == NULL || w->S11 == NULL || w->Tmp == NULL ||
+	w->gdiag == NULL) {
+	jb_work_free(w);
+	return NULL;
+    }
+
+    if (jb->k > 0) {
+	memcpy(w->M->val, jb->X->val, jb->T * jb->k * sizeof(double));
+    }
+    if (jb->R1x != NULL) {
+	j = jb->k + 2 * n;
+	for (i=0; i<jb->R1x->cols; i++) {
+	    memcpy(w->M->val + (j + i) * jb->T,
+		   jb->R1x->val + i * jb->T,
+		   jb->T * sizeof(double));
+	}
+    }
+
+    return w;
+}
+
+/* Generate the artificial data for one replication, given the
+   resampling indices in @s, and write them into w->M.
+*/
+
+static void jboot_generate (const jboot *jb, jb_work *w,
+			    const int *s)
+{
+    int T = jb->T, n = jb->n;
+    int k = jb->k, p1 = jb->p1;
+    double *X = w->M->val;
+    double *dY = X + k * T;
+    double *Y1 = dY + n * T;
+    int i, j, c, t, lag, col;
+    double x;
+
+    for (t=0; t<T; t++) {
+	/* lagged differences */
+	for (i=0; i<n; i++) {
+	    col = jb->ifc + i * jb->nl;
+	    for (j=0; j<jb->nl; j++) {
+		lag = jb->lags[j];
+		if (t - lag >= 0) {
+		    x = dY[i*T + t - lag];
+		} else {
+		    x = gretl_matrix_get(jb->d0, lag - t, i);
+		}
+		X[(col + j) * T + t] = x;
+	    }
+	}
+	/* lagged levels */
+	for (i=0; i<n; i++) {
+	    if (t == 0) {
+		Y1[i*T] = jb->y0->val[i];
+	    } else {
+		Y1[i*T + t] = Y1[i*T + t-1] + dY[i*T + t-1];
+	    }
+	}
+	/* current differences */
+	for (i=0; i<n; i++) {
+	    x = gretl_matrix_get(jb->E, s[t], i);
+	    for (c=0; c<k; c++) {
+		x += X[c*T + t] * gretl_matrix_get(jb->Gamma, c, i);
+	    }
+	    for (c=0; c<p1; c++) {
+		x += Y1[c*T + t] * gretl_matrix_get(jb->Pi, c, i);
+	    }
+	    dY[i*T + t] = x;
+	}
+    }
+}
+
+/* Given the cross-product matrix G = M'M, with M = [X | dY | Y1],
+   eliminate the X block in place (Gaussian elimination on the
+   first @k pivots, lower triangle only) so that what's left in
+   the lower-right block is the cross-product of the residuals
+   from regressing dY and Y1 on X.
+*/
+
+static int jboot_partial_out (gretl_matrix *G, int k, double *gdiag)
+{
+    int m = G->rows;
+    double *g = G->val;
+    double piv, f;
+    int a, b, j;
+
+    for (j=0; j<k; j++) {
+	gdiag[j] = g[j*m + j];
+    }
+
+    for (j=0; j<k; j++) {
+	piv = g[j*m + j];
+	if (piv <= 1.0e-12 * gdiag[j]) {
+	    return E_SINGULAR;
+	}
+	for (a=j+1; a<m; a++) {
+	    f = g[j*m + a] / piv;
+	    if (f != 0.0) {
+		for (b=a; b<m; b++) {
+		    g[a*m + b] -= f * g[j*m + b];
+		}
+	    }
+	}
+    }
+
+    return 0;
+}
+
+/* Run one bootstrap replication under H0: rank = @r, and write
+   the trace statistic into @trace.
+*/
+
+static int jboot_round (const jboot *jb, jb_work *w, const int *s,
+			int r, double *trace)
+{
+    gretl_matrix *evals = NULL;
+    int T = jb->T, n = jb->n;
+    int k = jb->k, p1 = jb->p1;
+    double x;
+    int i, j, err;
+
+    jboot_generate(jb, w, s);
+
+    err = gretl_matrix_multiply_mod(w->M, GRETL_MOD_TRANSPOSE,
+				    w->M, GRETL_MOD_NONE,
+				    w->G, GRETL_MOD_NONE);
+    if (!err) {
+	err = jboot_partial_out(w->G, k, w->gdiag);
+    }
+    if (err) {
+	return err;
+    }
+
+    /* transcribe the S matrices from the lower triangle of G */
+    for (j=0; j<n; j++) {
+	for (i=j; i<n; i++) {
+	    x = gretl_matrix_get(w->G, k+i, k+j) / T;
+	    gretl_matrix_set(w->S00, i, j, x);
+	    gretl_matrix_set(w->S00, j, i, x);
+	}
+    }
+    for (j=0; j<p1; j++) {
+	for (i=0; i<n; i++) {
+	    x = gretl_matrix_get(w->G, k+n+j, k+i) / T;
+	    gretl_matrix_set(w->S01, i, j, x);
+	}
+	for (i=j; i<p1; i++) {
+	    x = gretl_matrix_get(w->G, k+n+i, k+n+j) / T;
+	    gretl_matrix_set(w->S11, i, j, x);
+	    gretl_matrix_set(w->S11, j, i, x);
+	}
+    }
+
+    err = gretl_invert_symmetric_matrix(w->S00);
+    if (!err) {
+	gretl_matrix_qform(w->S01, GRETL_MOD_TRANSPOSE, w->S00,
+			   w->Tmp, GRETL_MOD_NONE);
+	evals = gretl_gensymm_eigenvals(w->Tmp, w->S11, NULL, &err);
+    }
+
+    if (!err) {
+	/* the n largest eigenvalues are the relevant ones */
+	qsort(evals->val, p1, sizeof(double), gretl_inverse_compare_doubles);
+	*trace = 0.0;
+	for (i=r; i<n; i++) {
+	    x = evals->val[i];
+	    if (x >= 1.0) {
+		err = E_SINGULAR;
+		break;
+	    }
+	    *trace -= T * log(1.0 - x);
+	}
+    }
+
+    gretl_matrix_free(evals);
+
+    return err;
+}
+
+static void jboot_draw_sample (int *s, int T)
+{
+    int t;
+
+    for (t=0; t<T; t++) {
+	s[t] = gretl_rand_int_max(T);
+    }
+}
+
+/* Returns the B x n matrix of bootstrap trace statistics, column
+   r holding the distribution under the null of rank r.
+*/
+
+static gretl_matrix *johansen_boot_trace (const GRETL_VAR *jvar,
+					  const DATASET *dset,
+					  int B, int *err)
+{
+    gretl_matrix *Tr = NULL;
+    jb_work **w = NULL;
+    int *samples = NULL;
+    int *errs = NULL;
+    jboot jb = {0};
+    int nt = 1, save_nt = 0;
+    int nfail = 0;
+    int b, r;
+
+    *err = jboot_init(&jb, jvar, dset);
+    if (*err) {
+	goto bailout;
+    }
+
+#if defined(_OPENMP) && !defined(OS_OSX)
+    if (gretl_use_openmp((guint64) B * jb.T * jb.n)) {
+	nt = get_omp_n_threads();
+    }
+#endif
+
+    Tr = gretl_matrix_alloc(B, jb.n);
+    w = calloc(nt, sizeof *w);
+    samples = malloc((size_t) B * jb.T * sizeof *samples);
+    errs = malloc(B * sizeof *errs);
+
+    if (Tr == NULL || w == NULL || samples == NULL || errs == NULL) {
+	*err = E_ALLOC;
+	goto bailout;
+    }
+
+    for (b=0; b<nt; b++) {
+	w[b] = jb_work_new(&jb);
+	if (w[b] == NULL) {
+	    *err = E_ALLOC;
+	    goto bailout;
+	}
+    }
+
+    if (nt > 1 && blas_is_openblas()) {
+	/* avoid over-subscription within the parallel region */
+	save_nt = blas_get_num_threads();
+	blas_set_num_threads(1);
+    }
+
+    for (r=0; r<jb.n && !*err; r++) {
+	double *tr = Tr->val + r * B;
+
+	*err = jboot_H0_estimate(&jb, jvar, r);
+	if (*err) {
+	    break;
+	}
+
+	/* draw the sampling arrays, in sequence */
+	for (b=0; b<B; b++) {
+	    jboot_draw_sample(samples + (size_t) b * jb.T, jb.T);
+	}
+
+#if defined(_OPENMP) && !defined(OS_OSX)
+#pragma omp parallel for private(b) num_threads(nt)
+	for (b=0; b<B; b++) {
+	    jb_work *wt = w[omp_get_thread_num()];
+
+	    errs[b] = jboot_round(&jb, wt, samples + (size_t) b * jb.T,
+				  r, &tr[b]);
+	}
+#else
+	for (b=0; b<B; b++) {
+	    errs[b] = jboot_round(&jb, w[0], samples + (size_t) b * jb.T,
+				  r, &tr[b]);
+	}
+#endif
+
+	/* re-run any failed rounds serially, with fresh draws */
+	for (b=0; b<B && !*err; b++) {
+	    while (errs[b]) {
+		if (errs[b] != E_SINGULAR ||
+		    ++nfail > JB_MAXFAIL * B * jb.n) {
+		    *err = errs[b];
+		    break;
+		}
+		jboot_draw_sample(samples, jb.T);
+		errs[b] = jboot_round(&jb, w[0], samples, r, &tr[b]);
+	    }
+	}
+    }
+
+    if (save_nt > 0) {
+	blas_set_num_threads(save_nt);
+    }
+
+    if (*err == E_SINGULAR) {
+	gretl_errmsg_set("Excessive collinearity in resampled datasets");
+    }
+
+ bailout:
+
+    if (w != NULL) {
+	for (b=0; b<nt; b++) {
+	    jb_work_free(w[b]);
+	}
+	free(w);
+    }
+    free(samples);
+    free(errs);
+    jboot_free(&jb);
+
+    if (*err) {
+	gretl_matrix_free(Tr);
+	Tr = NULL;
+    }
+
+    return Tr;
+}
+
 /* Public entry point for cointegration test */
 
 int johansen_coint_test (GRETL_VAR *jvar, const DATASET *dset,
 			 gretlopt opt, PRN *prn)
 {
+    gretl_matrix *Tr = NULL;
     int p1 = jvar->jinfo->R1->cols;
     int p = jvar->neqns;
     int err = 0;
@@ -1759,9 +2353,17 @@ int johansen_coint_test (GRETL_VAR *jvar, const DATASET *dset,
 
     if (err) {
 	pputs(prn, _("Failed to find eigenvalues\n"));
-    } else {
+    } else if (opt & OPT_B) {
+	Tr = johansen_boot_trace(jvar, dset, libset_get_int(BOOTREP), &err);
+    }
+
+    if (!err) {
 	johansen_ll_calc(jvar, jvar->jinfo->evals);
-	compute_coint_test(jvar, dset, opt, prn);
+	compute_coint_test(jvar, dset, Tr, opt, prn);
+	if (Tr != NULL) {
+	    /* the bootstrap distributions go to $result */
+	    set_last_result_data(Tr, GRETL_TYPE_MATRIX);
+	}
 
 	if (!(opt & OPT_Q)) {
 	    print_beta_and_alpha(jvar, jvar->jinfo->evals, p,
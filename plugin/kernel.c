@@ -20,6 +20,8 @@
 #include "libgretl.h"
 #include "version.h"
 #include "nonparam.h"
+#include "gretl_cmatrix.h"
+#include "gretl_mt.h"
 
 #define KDEBUG 0
 
@@ -30,6 +32,22 @@
 #define ROOT5  2.23606797749979     /* sqrt(5) */
 #define EPMULT 0.3354101966249685   /* 3 over (4 * sqrt(5)) */
 
+/* Beyond KD_BIN_MIN observations the density is by default
+   computed by linear binning of the data on a fine grid, followed
+   by discrete convolution of the bin weights with the kernel (via
+   FFT when that pays off); see Wand and Jones, Kernel Smoothing,
+   Appendix D. The bin width is at most 1/KD_BIN_RES times the
+   bandwidth, and the fine grid has at most KD_BIN_MAX points: if
+   both conditions cannot be met we fall back to direct summation.
+*/
+
+#define KD_BIN_MIN 10000
+#define KD_BIN_RES 20
+#define KD_BIN_MAX 1048576
+
+/* Gaussian kernel: truncate at this many bandwidths */
+#define GAUSS_TAIL 6.0
+
 enum {
     GAUSSIAN_KERNEL,
     EPANECHNIKOV_KERNEL
@@ -39,6 +57,7 @@ typedef struct kernel_info_ kernel_info;
 
 struct kernel_info_ {
     int type;        /* Gaussian or Epanechnikov */
+    int exact;       /* use direct summation? */
     double *x;       /* single data array */
     gretl_matrix *X; /* for multiple data */
     int n;           /* number of elements in x */
@@ -59,20 +78,15 @@ static double ep_pdf (double z)
     }
 }
 
-static double kernel (kernel_info *kinfo, double x0, int j)
+static double kernel (const kernel_info *kinfo, const double *x,
+		      double h, double x0)
 {
-    double h, den = 0.0;
+    double den = 0.0;
     int in_range = 0;
     int i;
 
-    if (kinfo->hvec != NULL) {
-	h = kinfo->hvec[j];
-    } else {
-	h = kinfo->h;
-    }
-
     for (i=0; i<kinfo->n; i++) {
-	double z = (x0 - kinfo->x[i]) / h;
+	double z = (x0 - x[i]) / h;
 
 	if (kinfo->type == GAUSSIAN_KERNEL) {
 	    den += normal_pdf(z);
@@ -85,7 +99,7 @@ static double kernel (kernel_info *kinfo, double x0, int j)
 		break;
 	    }
 
-	    den += ep_pdf(z);
+	    den += dt;
 	}
     }
 
@@ -94,15 +108,158 @@ static double kernel (kernel_info *kinfo, double x0, int j)
     return den;
 }
 
+/* Number of bins per step of the output grid needed to keep the
+   bin width within h/KD_BIN_RES, or 0 if that would require more
+   than KD_BIN_MAX bins.
+*/
+
+static int kernel_bin_factor (const kernel_info *kinfo, double h)
+{
+    double r = ceil(KD_BIN_RES * kinfo->xstep / h);
+
+    if (!(r * kinfo->kn < KD_BIN_MAX)) {
+	return 0;
+    }
+
+    return (r < 1)? 1 : (int) r;
+}
+
+/* Binned approximation to the density of @x with bandwidth @h,
+   written into the kinfo->kn + 1 elements of @f. The data are
+   assigned to the points of a grid which refines that on which
+   the density is wanted by the factor @r, each observation being
+   split between its two neighbouring grid points in proportion
+   to proximity; the density on the grid is then the convolution
+   of these weights with the kernel.
+*/
+
+static int kernel_binned (const kernel_info *kinfo, const double *x,
+			  double h, int r, double *f)
+{
+    double *c, *w, *y;
+    double d, p, u, tail;
+    int M, L, nx, nh;
+    int i, k, err = 0;
+
+    M = r * kinfo->kn + 1;
+    d = kinfo->xstep / r;
+
+    /* half-width of the discretized kernel */
+    tail = (kinfo->type == GAUSSIAN_KERNEL)? GAUSS_TAIL : ROOT5;
+    p = ceil(tail * h / d);
+    L = (p >= M)? M - 1 : (int) p;
+
+    nx = M + L;
+    nh = 2 * L + 1;
+
+    c = calloc(nx, sizeof *c);
+    w = malloc(nh * sizeof *w);
+    y = malloc(nx * sizeof *y);
+
+    if (c == NULL || w == NULL || y == NULL) {
+	err = E_ALLOC;
+	goto bailout;
+    }
+
+    /* linear binning */
+    for (i=0; i<kinfo->n; i++) {
+	p = (x[i] - kinfo->xmin) / d;
+	k = (int) floor(p);
+	if (k < 0) {
+	    c[0] += 1.0;
+	} else if (k >= M - 1) {
+	    c[M-1] += 1.0;
+	} else {
+	    u = p - k;
+	    c[k] += 1.0 - u;
+	    c[k+1] += u;
+	}
+    }
+
+    /* kernel weights, shifted so as to form a causal filter */
+    for (k=0; k<nh; k++) {
+	u = (k - L) * d / h;
+	w[k] = (kinfo->type == GAUSSIAN_KERNEL)? normal_pdf(u) : ep_pdf(u);
+    }
+
+    if (gretl_fft_worthwhile(M, nh)) {
+	err = gretl_fft_convolve(c, nx, w, nh, y);
+    } else {
+	int j, j0;
+
+	for (i=0; i<nx; i++) {
+	    y[i] = 0.0;
+	    j0 = (i >= nh)? i - nh + 1 : 0;
+	    for (j=j0; j<=i; j++) {
+		y[i] += w[i-j] * c[j];
+	    }
+	}
+    }
+
+    if (!err) {
+	/* the density at output point t is in y[t*r + L] */
+	for (k=0; k<=kinfo->kn; k++) {
+	    f[k] = y[k*r + L] / (h * kinfo->n);
+	    if (f[k] < 0.0) {
+		/* FFT rounding */
+		f[k] = 0.0;
+	    }
+	}
+    }
+
+ bailout:
+
+    free(c);
+    free(w);
+    free(y);
+
+    return err;
+}
+
+/* Fill @f with the density of @x at the kinfo->kn + 1 points
+   starting at kinfo->xmin, using bandwidth @h.
+*/
+
+static int kernel_fill (const kernel_info *kinfo, const double *x,
+			double h, double *f)
+{
+    double xt;
+    int t;
+
+    if (!kinfo->exact && kinfo->n >= KD_BIN_MIN) {
+	int r = kernel_bin_factor(kinfo, h);
+
+	if (r > 0) {
+	    return kernel_binned(kinfo, x, h, r, f);
+	}
+    }
+
+    for (t=0; t<=kinfo->kn; t++) {
+	xt = kinfo->xmin + t * kinfo->xstep;
+	f[t] = kernel(kinfo, x, h, xt);
+    }
+
+    return 0;
+}
+
 static int density_plot (kernel_info *kinfo, const char *vname)
 {
     FILE *fp;
     gchar *tmp = NULL;
-    double xt, xdt;
+    double xt, *f;
     int t, err = 0;
 
-    fp = open_plot_input_file(PLOT_KERNEL, 0, &err);
+    f = malloc((kinfo->kn + 1) * sizeof *f);
+    if (f == NULL) {
+	return E_ALLOC;
+    }
+
+    err = kernel_fill(kinfo, kinfo->x, kinfo->h, f);
+    if (!err) {
+	fp = open_plot_input_file(PLOT_KERNEL, 0, &err);
+    }
     if (err) {
+	free(f);
 	return err;
     }
 
@@ -125,16 +282,16 @@ static int density_plot (kernel_info *kinfo, const char *vname)
 
     fputs("plot \\\n'-' using 1:2 w lines\n", fp);
 
-    xt = kinfo->xmin;
     for (t=0; t<=kinfo->kn; t++) {
-	xdt = kernel(kinfo, xt, 0);
-	fprintf(fp, "%g %g\n", xt, xdt);
-	xt += kinfo->xstep;
+	xt = kinfo->xmin + t * kinfo->xstep;
+	fprintf(fp, "%g %g\n", xt, f[t]);
     }
     fputs("e\n", fp);
 
     gretl_pop_c_numeric_locale();
 
+    free(f);
+
     return finalize_plot_input_file(fp);
 }
 
@@ -142,7 +299,6 @@ static gretl_matrix *density_matrix (kernel_info *kinfo,
 				     int *err)
 {
     gretl_matrix *m;
-    double xt, xdt;
     int t;
 
     m = gretl_matrix_alloc(kinfo->kn + 1, 2);
@@ -151,22 +307,34 @@ static gretl_matrix *density_matrix (kernel_info *kinfo,
 	return NULL;
     }
 
-    xt = kinfo->xmin;
     for (t=0; t<=kinfo->kn; t++) {
-	xdt = kernel(kinfo, xt, 0);
-	gretl_matrix_set(m, t, 0, xt);
-	gretl_matrix_set(m, t, 1, xdt);
-	xt += kinfo->xstep;
+	gretl_matrix_set(m, t, 0, kinfo->xmin + t * kinfo->xstep);
+    }
+
+    *err = kernel_fill(kinfo, kinfo->x, kinfo->h, m->val + m->rows);
+
+    if (*err) {
+	gretl_matrix_free(m);
+	m = NULL;
     }
 
     return m;
 }
 
+/* Note: the columns of kinfo->X are handled in parallel where
+   OpenMP is available, each being written directly into the
+   corresponding column of the output matrix. Since each column
+   has its own bandwidth the FFT lengths in gretl_fft_convolve()
+   generally differ across columns: this relies on the FFT plan
+   cache in libgretl never recycling a plan that is in use by
+   another thread (when all cached plans are busy a one-off plan
+   is made instead).
+*/
+
 static gretl_matrix *multi_density_matrix (kernel_info *kinfo,
 					   int *err)
 {
     gretl_matrix *m;
-    double xt, xdtj;
     int nc = kinfo->X->cols;
     int t, j;
 
@@ -176,15 +344,31 @@ static gretl_matrix *multi_density_matrix (kernel_info *kinfo,
 	return NULL;
     }
 
-    xt = kinfo->xmin;
     for (t=0; t<=kinfo->kn; t++) {
-	gretl_matrix_set(m, t, 0, xt);
-	for (j=0; j<nc; j++) {
-	    kinfo->x = kinfo->X->val + j * kinfo->n;
-	    xdtj = kernel(kinfo, xt, j);
-	    gretl_matrix_set(m, t, j+1, xdtj);
+	gretl_matrix_set(m, t, 0, kinfo->xmin + t * kinfo->xstep);
+    }
+
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(dynamic) \
+    if (nc > 1 && gretl_use_openmp((guint64) nc * kinfo->n))
+#endif
+    for (j=0; j<nc; j++) {
+	const double *xj = kinfo->X->val + (size_t) j * kinfo->n;
+	double *fj = m->val + (size_t) (j+1) * m->rows;
+	int err_j;
+
+	err_j = kernel_fill(kinfo, xj, kinfo->hvec[j], fj);
+	if (err_j) {
+#if defined(_OPENMP)
+#pragma omp critical (kd_error)
+#endif
+	    *err = err_j;
 	}
-	xt += kinfo->xstep;
+    }
+
+    if (*err) {
+	gretl_matrix_free(m);
+	m = NULL;
     }
 
     return m;
@@ -261,6 +445,7 @@ static int set_kernel_params (kernel_info *kinfo,
 
     kinfo->type = (opt & OPT_O)? EPANECHNIKOV_KERNEL :
 	GAUSSIAN_KERNEL;
+    kinfo->exact = (opt & OPT_X)? 1 : 0;
 
     return err;
 }
@@ -354,6 +539,11 @@ multiple_kd_matrix (const gretl_matrix *X, double bwscale,
 	qsort(xi, kinfo.n, sizeof *xi, gretl_compare_doubles);
 	bw = kernel_bandwidth(xi, kinfo.n);
 	kinfo.hvec[j] = bwscale * bw;
+	if (!(kinfo.hvec[j] > 0.0)) {
+	    /* e.g. a constant column */
+	    *err = E_DATA;
+	    break;
+	}
 	kinfo.x = xi;
 	kernel_xmin_xmax(&kinfo);
 	if (j == 0) {
@@ -373,6 +563,7 @@ multiple_kd_matrix (const gretl_matrix *X, double bwscale,
     kinfo.xstep = (kinfo.xmax - kinfo.xmin) / kinfo.kn;
     kinfo.type = (opt & OPT_O)? EPANECHNIKOV_KERNEL :
 	GAUSSIAN_KERNEL;
+    kinfo.exact = (opt & OPT_X)? 1 : 0;
 
     if (!*err) {
 	m = multi_density_matrix(&kinfo, err);
@@ -2443,16 +2443,18 @@ svm_model *svm_train(const svm_problem *prob, const svm_parameter *param)
     return model;
 }
 
-// Stratified cross validation
+// Assign observations to folds for cross validation: on return
+// perm holds the observation indices grouped by fold, and fold i
+// occupies positions fold_start[i] to fold_start[i+1]-1. The
+// return value is the number of folds actually used.
 
-void svm_cross_validation (const svm_problem *prob,
-			   const svm_parameter *param,
-			   int nr_fold, double *target)
+int svm_cross_validation_folds (const svm_problem *prob,
+				const svm_parameter *param,
+				int nr_fold, int *perm,
+				int *fold_start)
 {
     int i;
-    int *fold_start;
     int l = prob->l;
-    int *perm = Malloc(int, l);
     int nr_class;
 
     if (nr_fold > l) {
@@ -2460,7 +2462,6 @@ void svm_cross_validation (const svm_problem *prob,
 	fprintf(stderr, "WARNING: # folds > # data. Will use # folds = # data "
 		"instead (i.e., leave-one-out cross validation)\n");
     }
-    fold_start = Malloc(int, nr_fold+1);
 
     // stratified cv may not give leave-one-out rate
     // Each class to l folds -> some folds may have zero elements
@@ -2520,6 +2521,24 @@ void svm_cross_validation (const svm_problem *prob,
 	}
     }
 
+    return nr_fold;
+}
+
+// Stratified cross validation
+
+void svm_cross_validation (const svm_problem *prob,
+			   const svm_parameter *param,
+			   int nr_fold, double *target)
+{
+    int i;
+    int *fold_start;
+    int l = prob->l;
+    int *perm = Malloc(int, l);
+
+    fold_start = Malloc(int, nr_fold+1);
+    nr_fold = svm_cross_validation_folds(prob, param, nr_fold,
+					 perm, fold_start);
+
     for (i=0; i<nr_fold; i++) {
 	int begin = fold_start[i];
 	int end = fold_start[i+1];
@@ -73,6 +73,7 @@ struct svm_model
 
 struct svm_model *svm_train(const struct svm_problem *prob, const struct svm_parameter *param);
 void svm_cross_validation(const struct svm_problem *prob, const struct svm_parameter *param, int nr_fold, double *target);
+int svm_cross_validation_folds(const struct svm_problem *prob, const struct svm_parameter *param, int nr_fold, int *perm, int *fold_start);
 
 int svm_save_model(const char *model_file_name, const struct svm_model *model);
 struct svm_model *svm_load_model(const char *model_file_name);
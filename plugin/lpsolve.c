@@ -48,6 +48,8 @@ static void (*set_maxim) (lprec *lp);
 static void (*set_minim) (lprec *lp);
 static unsigned char (*set_lp_name) (lprec *lp, char *s);
 static unsigned char (*set_obj_fn) (lprec *lp, REAL *row);
+static void (*set_rh_vec) (lprec *lp, REAL *rh);
+static void (*default_basis) (lprec *lp);
 static unsigned char (*add_constraint) (lprec *lp, REAL *row,
 					int constr_type, REAL rh);
 static unsigned char (*set_col_name) (lprec *lp, int col, char *name);
@@ -116,6 +118,8 @@ static int gretl_lpsolve_init (void)
 	set_maxim           = lpget(lphandle, "set_maxim", &err);
 	set_minim           = lpget(lphandle, "set_minim", &err);
 	set_obj_fn          = lpget(lphandle, "set_obj_fn", &err);
+	set_rh_vec          = lpget(lphandle, "set_rh_vec", &err);
+	default_basis       = lpget(lphandle, "default_basis", &err);
 	add_constraint      = lpget(lphandle, "add_constraint", &err);
 	set_col_name        = lpget(lphandle, "set_col_name", &err);
 	set_row_name        = lpget(lphandle, "set_row_name", &err);
@@ -627,6 +631,134 @@ static int maybe_catch_solve (lprec *lp, gretlopt opt,
     return retval;
 }
 
+/* Check the optional "sweep" matrices in the top-level bundle:
+   each column of rhs_sweep (nr x K) and/or objective_sweep
+   (nc x K) specifies a variant of the base problem. Returns
+   K, or 0 if no sweep is wanted.
+*/
+
+static int get_lp_sweep (gretl_bundle *b, lprec *lp,
+			 const gretl_matrix **pR,
+			 const gretl_matrix **pO,
+			 int *err)
+{
+    const gretl_matrix *R = NULL;
+    const gretl_matrix *O = NULL;
+    int K = 0;
+
+    if (gretl_bundle_has_key(b, "rhs_sweep")) {
+	R = gretl_bundle_get_matrix(b, "rhs_sweep", err);
+	if (!*err && R->rows != get_Nrows(lp)) {
+	    *err = E_NONCONF;
+	}
+    }
+    if (!*err && gretl_bundle_has_key(b, "objective_sweep")) {
+	O = gretl_bundle_get_matrix(b, "objective_sweep", err);
+	if (!*err && O->rows != get_Ncolumns(lp)) {
+	    *err = E_NONCONF;
+	}
+    }
+
+    if (!*err) {
+	if (R != NULL && O != NULL && R->cols != O->cols) {
+	    *err = E_NONCONF;
+	} else {
+	    K = (R != NULL)? R->cols : (O != NULL)? O->cols : 0;
+	}
+    }
+
+    if (*err) {
+	gretl_errmsg_set("lpsolve: invalid sweep specification");
+	K = 0;
+    }
+
+    *pR = R;
+    *pO = O;
+
+    return K;
+}
+
+/* Solve the sequence of @K problems obtained by replacing the
+   right-hand sides and/or the objective coefficients of the base
+   problem. The model is modified in place and lpsolve starts
+   each solution from the final basis of the preceding one, so
+   the cost of closely related problems is mostly incremental.
+   Results are added to @ret; problems that are not solved to
+   optimality get NaN values and their status code is recorded.
+*/
+
+static int lp_run_sweep (lprec *lp, int K,
+			 const gretl_matrix *R,
+			 const gretl_matrix *O,
+			 gretl_bundle *ret)
+{
+    gretl_matrix *SO, *SV, *SS;
+    int nr = get_Nrows(lp);
+    int nc = get_Ncolumns(lp);
+    int psize = 1 + nr + nc;
+    double *prim = malloc(psize * sizeof *prim);
+    double *rh = malloc((nr + 1) * sizeof *rh);
+    double *obj = malloc((nc + 1) * sizeof *obj);
+    int i, k, status;
+
+    SO = gretl_matrix_alloc(K, 1);
+    SV = gretl_matrix_alloc(K, nc);
+    SS = gretl_matrix_alloc(K, 1);
+
+    if (prim == NULL || rh == NULL || obj == NULL ||
+	SO == NULL || SV == NULL || SS == NULL) {
+	free(prim);
+	free(rh);
+	free(obj);
+	gretl_matrix_free(SO);
+	gretl_matrix_free(SV);
+	gretl_matrix_free(SS);
+	return E_ALLOC;
+    }
+
+    rh[0] = obj[0] = 0.0;
+
+    for (k=0; k<K; k++) {
+	if (R != NULL) {
+	    for (i=0; i<nr; i++) {
+		rh[i+1] = gretl_matrix_get(R, i, k);
+	    }
+	    set_rh_vec(lp, rh);
+	}
+	if (O != NULL) {
+	    for (i=0; i<nc; i++) {
+		obj[i+1] = gretl_matrix_get(O, i, k);
+	    }
+	    set_obj_fn(lp, obj);
+	}
+	status = solve(lp);
+	SS->val[k] = status;
+	if (status == OPTIMAL && get_primal_solution(lp, prim)) {
+	    SO->val[k] = get_objective(lp);
+	    for (i=0; i<nc; i++) {
+		gretl_matrix_set(SV, k, i, prim[1+nr+i]);
+	    }
+	} else {
+	    SO->val[k] = NADBL;
+	    for (i=0; i<nc; i++) {
+		gretl_matrix_set(SV, k, i, NADBL);
+	    }
+	    /* don't start the next problem from a dud basis */
+	    default_basis(lp);
+	}
+    }
+
+    gretl_bundle_donate_data(ret, "sweep_objective", SO, GRETL_TYPE_MATRIX, 0);
+    gretl_bundle_donate_data(ret, "sweep_variables", SV, GRETL_TYPE_MATRIX, 0);
+    gretl_bundle_donate_data(ret, "sweep_status", SS, GRETL_TYPE_MATRIX, 0);
+
+    free(prim);
+    free(rh);
+    free(obj);
+
+    return 0;
+}
+
 /* driver function */
 
 gretl_bundle *gretl_lpsolve (gretl_bundle *b, PRN *prn, int *err)
@@ -694,6 +826,19 @@ gretl_bundle *gretl_lpsolve (gretl_bundle *b, PRN *prn, int *err)
 	    *err = get_lp_model_data(lp, ret, cnames, rnames,
 				     opt, vprn);
 	}
+	if (!*err) {
+	    const gretl_matrix *RS = NULL;
+	    const gretl_matrix *OS = NULL;
+	    int K = get_lp_sweep(b, lp, &RS, &OS, err);
+
+	    if (K > 0) {
+		*err = lp_run_sweep(lp, K, RS, OS, ret);
+	    }
+	}
+	if (*err && ret != NULL) {
+	    gretl_bundle_destroy(ret);
+	    ret = NULL;
+	}
     }
 
     if (lp != NULL) {
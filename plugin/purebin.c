@@ -20,6 +20,7 @@
 #include "libgretl.h"
 #include "version.h"
 #include "varinfo_priv.h"
+#include "streamols.h"
 
 /* Writing and reading of gretl-native "pure binary" data files,
    developed in December 2020 as an alterative to the original
@@ -30,6 +31,14 @@
 
 #define GBIN_VERSION 1 /* allow for future extension */
 
+#if defined(_WIN64)
+# define gbin_fseek(a,b,c) _fseeki64(a,b,c)
+#elif defined(WIN32)
+# define gbin_fseek(a,b,c) fseek(a,(long) b,c)
+#else
+# define gbin_fseek(a,b,c) fseeko(a,b,c)
+#endif
+
 typedef struct gbin_header_ gbin_header;
 
 struct gbin_header_ {
@@ -635,6 +644,138 @@ int purebin_read_varnames (const char *fname,
     return err;
 }
 
+/* Support for reading the data in chunks of observations,
+   for out-of-core estimation: since the values are stored
+   series by series we have to seek to the current position
+   within each selected series in turn.
+*/
+
+typedef struct gbin_stream_ {
+    FILE *fp;
+    gint64 offset; /* position of the start of the data */
+    int n;         /* number of observations */
+    int t;         /* current observation */
+} gbin_stream;
+
+static int gbin_read_chunk (data_stream *ds, const int *sel, int nsel,
+			    double *X, int maxrows, int *nrows)
+{
+    gbin_stream *gs = ds->priv;
+    gint64 pos;
+    int j, nr = gs->n - gs->t;
+    int err = 0;
+
+    if (nr > maxrows) {
+	nr = maxrows;
+    }
+
+    for (j=0; j<nsel && nr > 0 && !err; j++) {
+	pos = gs->offset + ((gint64) (sel[j] - 1) * gs->n + gs->t) *
+	    sizeof(double);
+	if (gbin_fseek(gs->fp, pos, SEEK_SET) != 0 ||
+	    fread(X + j * maxrows, sizeof(double), nr, gs->fp) != (size_t) nr) {
+	    gretl_errmsg_sprintf("failed reading variable %d", sel[j]);
+	    err = E_DATA;
+	}
+    }
+
+    if (!err) {
+	gs->t += nr;
+	*nrows = nr;
+    }
+
+    return err;
+}
+
+static int gbin_rewind (data_stream *ds)
+{
+    gbin_stream *gs = ds->priv;
+
+    gs->t = 0;
+    return 0;
+}
+
+static void gbin_destroy (data_stream *ds)
+{
+    gbin_stream *gs = ds->priv;
+
+    if (gs != NULL) {
+	fclose(gs->fp);
+	free(gs);
+    }
+}
+
+data_stream *purebin_stream_open (const char *fname, int *err)
+{
+    gbin_header gh = {0};
+    char vname[VNAMELEN];
+    data_stream *ds = NULL;
+    gbin_stream *gs = NULL;
+    FILE *fp = NULL;
+    char c;
+    int i, j;
+
+    *err = read_purebin_basics(fname, &gh, &fp, NULL);
+    if (*err == E_DATA) {
+	gretl_errmsg_sprintf(_("%s: not a pure binary data file"), fname);
+	return NULL;
+    } else if (*err) {
+	return NULL;
+    }
+
+    ds = calloc(1, sizeof *ds);
+    gs = calloc(1, sizeof *gs);
+    if (ds == NULL || gs == NULL) {
+	*err = E_ALLOC;
+	goto bailout;
+    }
+
+    ds->nv = gh.nvars;
+    ds->vnames = strings_array_new(gh.nvars);
+    if (ds->vnames == NULL) {
+	*err = E_ALLOC;
+	goto bailout;
+    }
+
+    for (i=1; i<gh.nvars; i++) {
+	j = 0;
+	while ((c = fgetc(fp)) != '\0' && j < VNAMELEN - 1) {
+	    vname[j++] = c;
+	}
+	vname[j] = '\0';
+	ds->vnames[i] = gretl_strdup(vname);
+    }
+
+    /* skip the varinfo structs to reach the data */
+    for (i=1; i<gh.nvars && !*err; i++) {
+	*err = varinfo_read(NULL, 0, fp);
+    }
+
+    if (!*err) {
+	gs->fp = fp;
+	gs->n = gh.nobs;
+	gs->offset = (gint64) ftell(fp);
+	ds->priv = gs;
+	ds->read_chunk = gbin_read_chunk;
+	ds->rewind = gbin_rewind;
+	ds->destroy = gbin_destroy;
+    }
+
+ bailout:
+
+    if (*err) {
+	fclose(fp);
+	free(gs);
+	if (ds != NULL) {
+	    ds->priv = NULL;
+	    data_stream_destroy(ds);
+	    ds = NULL;
+	}
+    }
+
+    return ds;
+}
+
 int purebin_write_data (const char *fname,
 			const int *list,
 			const DATASET *dset,
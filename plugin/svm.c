@@ -1192,7 +1192,7 @@ static double scale_y (double y, sv_wrapper *w)
     return -1 + 2 * (y - w->ymin) / (w->ymax - w->ymin);
 }
 
-static double unscale_y (double y, sv_wrapper *w)
+static double unscale_y (double y, const sv_wrapper *w)
 {
     return w->ymin + (w->ymax - w->ymin) * (y + 1) / 2.0;
 }
@@ -1644,6 +1644,75 @@ static void custom_xvalidate (const sv_data *prob,
     }
 }
 
+/* Contribution of a single prediction to the cross validation
+   criterion: the loss for regression, or 1 for a correct
+   prediction in the case of classification.
+*/
+
+static double xvalid_score (const sv_parm *parm,
+			    const sv_wrapper *w,
+			    double yi, double yhi)
+{
+    if (doing_regression(parm)) {
+	if (w->flags & W_YSCALE) {
+	    yi = unscale_y(yi, w);
+	    yhi = unscale_y(yhi, w);
+	}
+	if (w->regcrit == REG_ROUND_MISS) {
+	    return (yi != round(yhi));
+	} else if (w->regcrit == REG_ROUND_MAD) {
+	    return fabs(yi - round(yhi));
+	} else if (w->regcrit == REG_MAD) {
+	    return fabs(yi - yhi);
+	} else {
+	    return (yi - yhi) * (yi - yhi);
+	}
+    } else {
+	return (yhi == yi);
+    }
+}
+
+static void print_xvalid_crit (sv_parm *parm,
+			       sv_wrapper *w,
+			       double crit,
+			       int iter,
+			       PRN *prn)
+{
+    if (prn == NULL) {
+	return;
+    } else if (doing_regression(parm)) {
+	const char *s = (w->regcrit == REG_MSE)? "MSE" :
+	    (w->regcrit == REG_ROUND_MISS)? "miss ratio" : "MAD";
+
+	print_xvalid_iter(parm, w, -crit, s, iter, prn);
+    } else {
+	print_xvalid_iter(parm, w, crit, "percent correct", iter, prn);
+    }
+}
+
+/* Convert the sum of scores over all observations into the
+   criterion to be maximized, and print it if wanted.
+*/
+
+static double xvalid_crit (sv_parm *parm,
+			   sv_wrapper *w,
+			   double sum, int n,
+			   int iter, PRN *prn)
+{
+    double crit;
+
+    if (doing_regression(parm)) {
+	crit = -sum / n;
+    } else {
+	/* classification: percent correct */
+	crit = 100.0 * sum / (double) n;
+    }
+
+    print_xvalid_crit(parm, w, crit, iter, prn);
+
+    return crit;
+}
+
 /* implement a single cross validation pass */
 
 static int xvalidate_once (sv_data *prob,
@@ -1654,6 +1723,7 @@ static int xvalidate_once (sv_data *prob,
 			   int iter,
 			   PRN *prn)
 {
+    double sum = 0.0;
     int i, n = prob->l;
 
     if (w->fsize != NULL) {
@@ -1663,53 +1733,12 @@ static int xvalidate_once (sv_data *prob,
 	svm_cross_validation(prob, parm, w->nfold, targ);
     }
 
-    if (doing_regression(parm)) {
-	double yi, yhi, dev, minimand = 0;
-
-	for (i=0; i<prob->l; i++) {
-	    yi = prob->y[i];
-	    yhi = targ[i];
-	    if (w->flags & W_YSCALE) {
-		yi = unscale_y(yi, w);
-		yhi = unscale_y(yhi, w);
-	    }
-	    dev = yi - yhi;
-	    if (w->regcrit == REG_ROUND_MISS) {
-		minimand += (yi != round(yhi));
-	    } else if (w->regcrit == REG_ROUND_MAD) {
-		minimand += fabs(yi - round(yhi));
-	    } else if (w->regcrit == REG_MAD) {
-		minimand += fabs(dev);
-	    } else {
-		minimand += dev * dev;
-	    }
-	}
-	minimand /= n;
-	if (prn != NULL) {
-	    const char *s = (w->regcrit == REG_MSE)? "MSE" :
-		(w->regcrit == REG_ROUND_MISS)? "miss ratio" : "MAD";
-
-	    print_xvalid_iter(parm, w, minimand, s, iter, prn);
-	}
-	*crit = -minimand;
-    } else {
-	/* classification */
-	double pc_correct = 0;
-	int n_correct = 0;
-
-	for (i=0; i<n; i++) {
-	    if (targ[i] == prob->y[i]) {
-		n_correct++;
-	    }
-	}
-	pc_correct = 100.0 * n_correct / (double) n;
-	if (prn != NULL) {
-	    print_xvalid_iter(parm, w, pc_correct,
-			      "percent correct", iter, prn);
-	}
-	*crit = pc_correct;
+    for (i=0; i<n; i++) {
+	sum += xvalid_score(parm, w, prob->y[i], targ[i]);
     }
 
+    *crit = xvalid_crit(parm, w, sum, n, iter, prn);
+
     return 0;
 }
 
@@ -2391,6 +2420,255 @@ static int call_mpi_cross_validation (sv_data *data,
 
 #endif /* HAVE_MPI */
 
+#if defined(_OPENMP)
+
+/* Shared-memory parallelization of the parameter search: each
+   combination of parameter values and fold is a separate task.
+   The folds must then be fixed in advance, which rules out the
+   case where fresh random folds are wanted on each pass.
+   Probability estimation is not needed for the criterion,
+   except in the case of classification with random folds (when
+   svm_cross_validation() predicts via the probabilities), and
+   it would involve the non-thread-safe random number generator,
+   so we skip that case too.
+*/
+
+static int can_xvalidate_parallel (const sv_parm *parm,
+				   const sv_wrapper *w)
+{
+    const sv_grid *g = w->grid;
+
+    if (omp_get_max_threads() < 2) {
+	return 0;
+    } else if (g->n[G_C] * g->n[G_g] * g->n[G_p] < 2) {
+	return 0;
+    } else if (w->fsize == NULL) {
+	if (w->flags & W_REFOLD) {
+	    return 0;
+	} else if (parm->probability && !doing_regression(parm)) {
+	    return 0;
+	}
+    }
+
+    return 1;
+}
+
+/* Assign the observations to folds just as xvalidate_once()
+   would: on return @perm gives the order in which the
+   observations are to be used and @fid holds the fold to which
+   each position in @perm belongs. The return value is the
+   number of folds.
+*/
+
+static int xvalid_fold_layout (sv_data *prob, sv_parm *parm,
+			       sv_wrapper *w, int *perm,
+			       int *fid, int *err)
+{
+    int nf = w->nfold;
+    int i, j;
+
+    if (w->fsize != NULL) {
+	for (j=0; j<prob->l; j++) {
+	    perm[j] = j;
+	    if (w->flags & W_CONSEC) {
+		/* the last block takes up any remainder */
+		fid[j] = j / w->fsize[1];
+		if (fid[j] >= nf) {
+		    fid[j] = nf - 1;
+		}
+	    } else {
+		fid[j] = w->flist[j+1] - 1;
+	    }
+	}
+    } else {
+	int *fstart = malloc((nf + 1) * sizeof *fstart);
+
+	if (fstart == NULL) {
+	    *err = E_ALLOC;
+	    return 0;
+	}
+	maybe_set_svm_seed(w);
+	nf = svm_cross_validation_folds(prob, parm, nf, perm, fstart);
+	for (i=0; i<nf; i++) {
+	    for (j=fstart[i]; j<fstart[i+1]; j++) {
+		fid[j] = i;
+	    }
+	}
+	free(fstart);
+    }
+
+    return nf;
+}
+
+/* Set the parameters in @parm to the values for point @g
+   of the search grid, in the order used by
+   call_cross_validation().
+*/
+
+static void xvalid_set_point (sv_parm *parm, sv_grid *grid, int g)
+{
+    int np = grid->n[G_p];
+    int ng = grid->n[G_g];
+
+    if (!grid->null[G_C]) {
+	parm->C = grid_get_C(grid, g / (ng * np));
+    }
+    if (!grid->null[G_g]) {
+	parm->gamma = grid_get_g(grid, (g / np) % ng);
+    }
+    if (!grid->null[G_p]) {
+	if (uses_epsilon(parm)) {
+	    parm->p = grid_get_p(grid, g % np);
+	} else if (uses_nu(parm)) {
+	    parm->nu = grid_get_p(grid, g % np);
+	}
+    }
+}
+
+/* Train on all folds other than @f and return the sum of the
+   scores for the observations in fold @f.
+*/
+
+static double xvalid_fold_task (const sv_data *prob,
+				const sv_parm *parm,
+				const sv_wrapper *w,
+				const int *perm,
+				const int *fid,
+				int f, int *err)
+{
+    struct svm_problem subprob;
+    struct svm_model *submodel;
+    double yhat, sum = 0.0;
+    int j, k = 0;
+
+    subprob.x = malloc(prob->l * sizeof *subprob.x);
+    subprob.y = malloc(prob->l * sizeof *subprob.y);
+
+    if (subprob.x == NULL || subprob.y == NULL) {
+	free(subprob.x);
+	free(subprob.y);
+	*err = E_ALLOC;
+	return 0;
+    }
+
+    for (j=0; j<prob->l; j++) {
+	if (fid[j] != f) {
+	    subprob.x[k] = prob->x[perm[j]];
+	    subprob.y[k] = prob->y[perm[j]];
+	    k++;
+	}
+    }
+    subprob.l = k;
+
+    submodel = svm_train(&subprob, parm);
+
+    if (submodel == NULL) {
+	*err = E_DATA;
+    } else {
+	for (j=0; j<prob->l; j++) {
+	    if (fid[j] == f) {
+		k = perm[j];
+		yhat = svm_predict(submodel, prob->x[k]);
+		sum += xvalid_score(parm, w, prob->y[k], yhat);
+	    }
+	}
+	svm_free_and_destroy_model(&submodel);
+    }
+
+    free(subprob.x);
+    free(subprob.y);
+
+    return sum;
+}
+
+/* Compute the cross validation criterion for all the points
+   on the search grid, writing the results into @crit. The
+   kernel cache is divided between the threads, so as not to
+   multiply the memory requirement.
+*/
+
+static int parallel_xvalidation (sv_data *prob,
+				 sv_parm *parm,
+				 sv_wrapper *w,
+				 double *crit)
+{
+    sv_grid *grid = w->grid;
+    int ncom = grid->n[G_C] * grid->n[G_g] * grid->n[G_p];
+    int nt = omp_get_max_threads();
+    double csize = parm->cache_size;
+    double *score = NULL;
+    int *perm = NULL;
+    int *fid = NULL;
+    int i, g, nf, ntask;
+    int err = 0;
+
+    perm = malloc(prob->l * sizeof *perm);
+    fid = malloc(prob->l * sizeof *fid);
+    if (perm == NULL || fid == NULL) {
+	err = E_ALLOC;
+	goto bailout;
+    }
+
+    nf = xvalid_fold_layout(prob, parm, w, perm, fid, &err);
+    if (err) {
+	goto bailout;
+    }
+
+    ntask = ncom * nf;
+    score = calloc(ntask, sizeof *score);
+    if (score == NULL) {
+	err = E_ALLOC;
+	goto bailout;
+    }
+
+    if (nt > ntask) {
+	nt = ntask;
+    }
+    csize /= nt;
+    if (csize < 100) {
+	/* but don't go below 100 MB, unless so specified */
+	csize = MIN(100, parm->cache_size);
+    }
+
+#pragma omp parallel for schedule(dynamic) num_threads(nt) private(i)
+    for (i=0; i<ntask; i++) {
+	sv_parm pi = *parm;
+	int ierr = 0;
+
+	if (err) {
+	    continue;
+	}
+	xvalid_set_point(&pi, grid, i / nf);
+	pi.probability = 0;
+	pi.cache_size = csize;
+	score[i] = xvalid_fold_task(prob, &pi, w, perm, fid, i % nf, &ierr);
+	if (ierr) {
+	    err = ierr;
+	}
+    }
+
+    if (!err) {
+	for (g=0; g<ncom; g++) {
+	    double sum = 0.0;
+
+	    for (i=0; i<nf; i++) {
+		sum += score[g * nf + i];
+	    }
+	    crit[g] = xvalid_crit(parm, w, sum, prob->l, g, NULL);
+	}
+    }
+
+ bailout:
+
+    free(perm);
+    free(fid);
+    free(score);
+
+    return err;
+}
+
+#endif /* _OPENMP */
+
 static int call_cross_validation (sv_data *data,
 				  sv_parm *parm,
 				  sv_wrapper *w,
@@ -2414,6 +2692,7 @@ static int call_cross_validation (sv_data *data,
     if (w->grid != NULL) {
 	sv_grid *grid = w->grid;
 	double cmax = -DBL_MAX;
+	double *pcrit = NULL;
 	double *p3 = NULL;
 	int nC = grid->n[G_C];
 	int ng = grid->n[G_g];
@@ -2441,6 +2720,23 @@ static int call_cross_validation (sv_data *data,
 
 	maybe_hush(w);
 
+#if defined(_OPENMP)
+	if (can_xvalidate_parallel(parm, w)) {
+	    /* compute all the criterion values up front */
+	    pcrit = malloc(nC * ng * np * sizeof *pcrit);
+	    if (pcrit == NULL) {
+		err = E_ALLOC;
+	    } else {
+		err = parallel_xvalidation(data, parm, w, pcrit);
+	    }
+	    if (err) {
+		maybe_resume_printing(w);
+		free(pcrit);
+		return err;
+	    }
+	}
+#endif
+
 	for (i=0; i<nC; i++) {
 	    if (!grid->null[G_C]) {
 		parm->C = grid_get_C(grid, i);
@@ -2453,7 +2749,12 @@ static int call_cross_validation (sv_data *data,
 		    if (!grid->null[G_p]) {
 			*p3 = grid_get_p(grid, k);
 		    }
-		    xvalidate_once(data, parm, w, targ, &crit, iter, prn);
+		    if (pcrit != NULL) {
+			crit = pcrit[iter];
+			print_xvalid_crit(parm, w, crit, iter, prn);
+		    } else {
+			xvalidate_once(data, parm, w, targ, &crit, iter, prn);
+		    }
 		    if (crit > cmax) {
 			cmax = crit;
 			ibest = i;
@@ -2474,6 +2775,7 @@ static int call_cross_validation (sv_data *data,
 	}
 
 	maybe_resume_printing(w);
+	free(pcrit);
 
 	if (!grid->null[G_C]) {
 	    parm->C = grid_get_C(grid, ibest);
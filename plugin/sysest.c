@@ -942,20 +942,290 @@ static gretlopt sys_ols_opt (const equation_system *sys,
     return opt;
 }
 
-static int allocate_Xi_etc (gretl_matrix **Xi,
-			    gretl_matrix **Xj,
-			    gretl_matrix **M,
-			    int T, int k)
+/* Cache for the per-equation cross-moment matrices, X_i'X_j and
+   X_i'y_l. These do not change from one iteration to the next
+   (the X data are either the original regressors or first-stage
+   fitted values), so we compute them once and on each pass just
+   reweight them by the elements of Sigma-inverse.
+*/
+
+typedef struct sys_moments_ sys_moments;
+
+struct sys_moments_ {
+    int m;              /* number of equations */
+    gretl_matrix **XX;  /* X_i'X_j for j <= i, packed by rows */
+    gretl_matrix **Xy;  /* X_i'y_l, at position i*m + l */
+    gretl_matrix *XXi;  /* (X'X)^{-1} when regressors are common */
+    gretl_matrix *Sig;  /* Sigma (not inverted), common case */
+};
+
+#define XX_block(s,i,j) (s->XX[(i)*((i)+1)/2 + (j)])
+
+static void sys_moments_free (sys_moments *sm)
+{
+    int i, n;
+
+    if (sm == NULL) {
+	return;
+    }
+
+    if (sm->XX != NULL) {
+	n = sm->m * (sm->m + 1) / 2;
+	for (i=0; i<n; i++) {
+	    gretl_matrix_free(sm->XX[i]);
+	}
+	free(sm->XX);
+    }
+    if (sm->Xy != NULL) {
+	n = sm->m * sm->m;
+	for (i=0; i<n; i++) {
+	    gretl_matrix_free(sm->Xy[i]);
+	}
+	free(sm->Xy);
+    }
+    gretl_matrix_free(sm->XXi);
+    gretl_matrix_free(sm->Sig);
+    free(sm);
+}
+
+static sys_moments *sys_moments_new (int m)
+{
+    sys_moments *sm = malloc(sizeof *sm);
+
+    if (sm != NULL) {
+	sm->m = m;
+	sm->XX = calloc(m * (m + 1) / 2, sizeof *sm->XX);
+	sm->Xy = calloc(m * m, sizeof *sm->Xy);
+	sm->XXi = sm->Sig = NULL;
+	if (sm->XX == NULL || sm->Xy == NULL) {
+	    sys_moments_free(sm);
+	    sm = NULL;
+	}
+    }
+
+    return sm;
+}
+
+/* Compute the moment matrices: if @cross is non-zero we want all
+   the cross-equation blocks, otherwise just the ones pertaining
+   to each equation on its own.
+*/
+
+static int sys_moments_fill (sys_moments *sm, equation_system *sys,
+			     DATASET *dset, int k, int cross)
 {
-    *Xi = gretl_matrix_alloc(T, k);
-    *Xj = gretl_matrix_alloc(T, k);
-    *M = gretl_matrix_alloc(k, k);
+    MODEL **models = sys->models;
+    int method = sys->method;
+    int m = sys->neqns;
+    int T = sys->T;
+    gretl_matrix *Xi, *Xj;
+    const gretl_matrix *Xk;
+    gretl_matrix *M;
+    int i, j, l, c, t;
+    int err = 0;
 
-    if (*Xi == NULL || *Xj == NULL || *M == NULL) {
+    Xi = gretl_matrix_alloc(T, k);
+    Xj = gretl_matrix_alloc(T, k);
+    if (Xi == NULL || Xj == NULL) {
+	err = E_ALLOC;
+	goto bailout;
+    }
+
+    for (i=0; i<m && !err; i++) {
+	err = make_sys_X_block(Xi, models[i], dset, sys->t1, method);
+
+	for (j=0; j<=i && !err; j++) {
+	    if (i != j) {
+		if (!cross) {
+		    continue;
+		}
+		err = make_sys_X_block(Xj, models[j], dset, sys->t1, method);
+		Xk = Xj;
+	    } else if (method == SYS_METHOD_LIML) {
+		err = make_liml_X_block(Xj, models[i], dset, sys->t1);
+		Xk = Xj;
+	    } else {
+		Xk = Xi;
+	    }
+	    if (!err) {
+		M = gretl_matrix_alloc(Xi->cols, Xk->cols);
+		if (M == NULL) {
+		    err = E_ALLOC;
+		} else {
+		    XX_block(sm, i, j) = M;
+		    err = gretl_matrix_multiply_mod(Xi, GRETL_MOD_TRANSPOSE,
+						    Xk, GRETL_MOD_NONE,
+						    M, GRETL_MOD_NONE);
+		}
+	    }
+	}
+
+	for (l=0; l<m && !err; l++) {
+	    const double *yl;
+
+	    if (l != i && !cross) {
+		continue;
+	    }
+	    if (method == SYS_METHOD_LIML) {
+		yl = gretl_model_get_data(models[l], "liml_y");
+	    } else {
+		yl = dset->Z[system_get_depvar(sys, l)];
+	    }
+	    M = gretl_column_vector_alloc(Xi->cols);
+	    if (M == NULL) {
+		err = E_ALLOC;
+		break;
+	    }
+	    sm->Xy[i*m + l] = M;
+	    /* multiply X'[i] into y[l] */
+	    for (c=0; c<Xi->cols; c++) {
+		double xx = 0.0;
+
+		for (t=0; t<T; t++) {
+		    xx += gretl_matrix_get(Xi, t, c) * yl[t + sys->t1];
+		}
+		M->val[c] = xx;
+	    }
+	}
+    }
+
+ bailout:
+
+    gretl_matrix_free(Xi);
+    gretl_matrix_free(Xj);
+
+    return err;
+}
+
+/* Check for the case of SUR where all the equations have the same
+   regressors: then Sigma-inverse (x) X'X can be inverted in closed
+   form as Sigma (x) (X'X)^{-1} and we don't need the big system
+   matrix. If so, set up (X'X)^{-1} on @sm.
+*/
+
+static void sys_check_common_X (sys_moments *sm, equation_system *sys)
+{
+    const int *l0 = sys->models[0]->list;
+    const int *li;
+    int i, j;
+
+    if (sys->method != SYS_METHOD_SUR || sys->R != NULL) {
+	return;
+    }
+
+    for (i=1; i<sys->neqns; i++) {
+	li = sys->models[i]->list;
+	if (li[0] != l0[0]) {
+	    return;
+	}
+	for (j=2; j<=li[0]; j++) {
+	    if (li[j] != l0[j]) {
+		return;
+	    }
+	}
+    }
+
+    sm->XXi = gretl_matrix_copy(XX_block(sm, 0, 0));
+    sm->Sig = gretl_matrix_alloc(sm->m, sm->m);
+
+    if (sm->XXi == NULL || sm->Sig == NULL ||
+	gretl_invert_symmetric_matrix(sm->XXi)) {
+	/* fall back on the general method */
+	gretl_matrix_free(sm->XXi);
+	gretl_matrix_free(sm->Sig);
+	sm->XXi = sm->Sig = NULL;
+    }
+}
+
+/* Form the big stacked X matrix and y vector from the cached
+   moments. If @cross is zero we skip the cross-equation blocks;
+   if @weight is zero we ignore sys->S.
+*/
+
+static void sys_fill_X_y (equation_system *sys, sys_moments *sm,
+			  gretl_matrix *X, gretl_matrix *y,
+			  int cross, int weight)
+{
+    MODEL **models = sys->models;
+    int m = sys->neqns;
+    int krow = 0, v = 0;
+    int i, j, l, c;
+    double sij;
+
+    for (i=0; i<m; i++) {
+	int kcol = 0;
+
+	for (j=0; j<=i; j++) {
+	    if (i == j || cross) {
+		sij = weight ? gretl_matrix_get(sys->S, i, j) : 1.0;
+		insert_sys_X_block(X, XX_block(sm, i, j), krow, kcol, sij);
+	    }
+	    kcol += models[j]->ncoeff;
+	}
+	krow += models[i]->ncoeff;
+    }
+
+    for (i=0; i<m; i++) {
+	int lmin = cross ? 0 : i;
+	int lmax = cross ? m : i + 1;
+
+	for (c=0; c<models[i]->ncoeff; c++) {
+	    double yv = 0.0;
+
+	    for (l=lmin; l<lmax; l++) {
+		sij = weight ? gretl_matrix_get(sys->S, i, l) : 1.0;
+		yv += sm->Xy[i*m + l]->val[c] * sij;
+	    }
+	    gretl_vector_set(y, v++, yv);
+	}
+    }
+}
+
+/* SUR with common regressors: the coefficients are just the
+   per-equation OLS ones and the covariance matrix is
+   Sigma (x) (X'X)^{-1}.
+*/
+
+static int sur_common_X_coeffs (equation_system *sys,
+				const DATASET *dset,
+				sys_moments *sm, int do_iters)
+{
+    const gretl_matrix *XXi = sm->XXi;
+    int m = sys->neqns;
+    int k = XXi->rows;
+    gretl_matrix *b, *V;
+    int i, r, c, v = 0;
+    int err = 0;
+
+    V = gretl_matrix_kronecker_product_new(sm->Sig, XXi, &err);
+    if (err) {
+	return err;
+    }
+
+    b = gretl_column_vector_alloc(m * k);
+    if (b == NULL) {
+	gretl_matrix_free(V);
 	return E_ALLOC;
-    } else {
-	return 0;
     }
+
+    for (i=0; i<m; i++) {
+	const double *xy = sm->Xy[i*m + i]->val;
+
+	for (r=0; r<k; r++) {
+	    double bir = 0.0;
+
+	    for (c=0; c<k; c++) {
+		bir += gretl_matrix_get(XXi, r, c) * xy[c];
+	    }
+	    b->val[v++] = bir;
+	}
+    }
+
+    system_attach_coeffs(sys, b);
+    system_attach_vcv(sys, V);
+    transcribe_sys_results(sys, dset, do_iters);
+
+    return 0;
 }
 
 static int ols_data_to_sys (equation_system *sys, int mk)
@@ -1012,17 +1282,15 @@ static int ols_data_to_sys (equation_system *sys, int mk)
 int system_estimate (equation_system *sys, DATASET *dset,
 		     gretlopt opt, PRN *prn)
 {
-    int i, j, k, T, t;
-    int v, l, mk, krow, nr;
+    int i, k, T, t;
+    int mk, nr;
     int orig_t1 = dset->t1;
     int orig_t2 = dset->t2;
     gretl_matrix *X = NULL;
     gretl_matrix *y = NULL;
-    gretl_matrix *Xi = NULL;
-    gretl_matrix *Xj = NULL;
-    gretl_matrix *M = NULL;
     gretl_matrix **pX = NULL;
     gretl_matrix **py = NULL;
+    sys_moments *sm = NULL;
     MODEL **models = NULL;
     int method = sys->method;
     double llbak = -1.0e9;
@@ -1190,6 +1458,28 @@ int system_estimate (equation_system *sys, DATASET *dset,
 	goto save_etc;
     }
 
+    /* compute the cross-moment matrices, once only */
+    sm = sys_moments_new(sys->neqns);
+    if (sm == NULL) {
+	err = E_ALLOC;
+    } else {
+	err = sys_moments_fill(sm, sys, dset, k, !single_equation);
+    }
+    if (!err && nr == 0) {
+	sys_check_common_X(sm, sys);
+	if (sm->XXi != NULL) {
+	    /* we won't need the big matrices */
+	    gretl_matrix_free(X);
+	    gretl_matrix_free(y);
+	    X = y = NULL;
+	}
+    }
+
+    if (err) {
+	fprintf(stderr, "after trying to make X'X blocks: err = %d\n", err);
+	goto cleanup;
+    }
+
     /* marker for iterated versions of SUR, WLS, or 3SLS; also for
        loopback in case of restricted 3SLS, where we want to compute
        restricted TSLS estimates first
@@ -1198,6 +1488,10 @@ int system_estimate (equation_system *sys, DATASET *dset,
 
     gls_sigma_from_uhat(sys, sys->S, 0);
 
+    if (sm->Sig != NULL) {
+	gretl_matrix_copy_values(sm->Sig, sys->S);
+    }
+
     if (method == SYS_METHOD_WLS) {
 	gretl_matrix_zero(X);
 	err = gretl_invert_diagonal_matrix(sys->S);
@@ -1211,142 +1505,36 @@ int system_estimate (equation_system *sys, DATASET *dset,
     fprintf(stderr, "system_estimate: on invert, err=%d\n", err);
 #endif
 
-    if (!err && Xi == NULL) {
-	/* the test against NULL here allows for the possibility
-	   that we're iterating
-	*/
-	err = allocate_Xi_etc(&Xi, &Xj, &M, T, k);
-    }
-
     if (err) goto cleanup;
 
-    /* form the big stacked X matrix: Xi = data matrix for equation i,
-       specified in lists[i]
-    */
-
-    krow = 0;
-    for (i=0; i<sys->neqns && !err; i++) {
-	int kcol = 0;
-
-	err = make_sys_X_block(Xi, models[i], dset, sys->t1, method);
-
-	for (j=0; j<=i && !err; j++) {
-	    const gretl_matrix *Xk;
-	    double sij;
-
-	    if (i != j) {
-		if (single_equation || rsingle) {
-		    kcol += models[j]->ncoeff;
-		    continue;
-		}
-		err = make_sys_X_block(Xj, models[j], dset, sys->t1, method);
-		Xk = Xj;
-	    } else if (method == SYS_METHOD_LIML) {
-		err = make_liml_X_block(Xj, models[i], dset, sys->t1);
-		Xk = Xj;
-	    } else {
-		Xk = Xi;
-	    }
-
-	    M->rows = Xi->cols;
-	    M->cols = Xk->cols;
-
-	    err = gretl_matrix_multiply_mod(Xi, GRETL_MOD_TRANSPOSE,
-					    Xk, GRETL_MOD_NONE,
-					    M, GRETL_MOD_NONE);
-
-	    if (rsingle || (single_equation && method != SYS_METHOD_WLS)) {
-		sij = 1.0;
-	    } else {
-		sij = gretl_matrix_get(sys->S, i, j);
-	    }
-
-	    insert_sys_X_block(X, M, krow, kcol, sij);
-	    kcol += models[j]->ncoeff;
-	}
-
-	krow += models[i]->ncoeff;
-    }
-
-    if (err) {
-	fprintf(stderr, "after trying to make X matrix: err = %d\n", err);
-	goto cleanup;
-    }
-
-    if (nr > 0) {
-	/* there are restrictions to be imposed */
-	augment_X_with_restrictions(X, mk, sys);
-    }
-
-    if (!do_iteration && !rsingle) {
-	/* we're not coming back this way, so free some storage */
-	gretl_matrix_free(Xj);
-	Xj = NULL;
-	gretl_matrix_free(M);
-	M = NULL;
-    }
-
-    /* form stacked Y column vector (m x k) */
-
-    v = 0;
-    for (i=0; i<sys->neqns; i++) {
-
-	/* loop over the m vertically-arranged blocks */
-	make_sys_X_block(Xi, models[i], dset, sys->t1, method);
-
-	for (j=0; j<models[i]->ncoeff; j++) {
-	    /* loop over the rows within each of the m blocks */
-	    double yv = 0.0;
-	    int lmin = 0, lmax = sys->neqns;
-
-	    if (single_equation || rsingle) {
-		/* no cross terms wanted */
-		lmin = i;
-		lmax = i + 1;
-	    }
-
-	    for (l=lmin; l<lmax; l++) {
-		/* loop over the components that must be
-		   added to form each element */
-		const double *yl = NULL;
-		double sil, xx = 0.0;
-
-		if (method == SYS_METHOD_LIML) {
-		    yl = gretl_model_get_data(models[l], "liml_y");
-		} else {
-		    yl = dset->Z[system_get_depvar(sys, l)];
-		}
-
-		/* multiply X'[l] into y */
-		for (t=0; t<T; t++) {
-		    xx += gretl_matrix_get(Xi, t, j) * yl[t + sys->t1];
-		}
+    if (sm->XXi != NULL) {
+	/* SUR with common regressors */
+	err = sur_common_X_coeffs(sys, dset, sm, do_iteration);
+    } else {
+	/* form the big stacked X matrix and y vector, using
+	   Sigma-inverse as weights unless we're doing single-
+	   equation estimation
+	*/
+	int cross = !(single_equation || rsingle);
+	int weight = !(rsingle || (single_equation && method != SYS_METHOD_WLS));
 
-		if (rsingle || (single_equation && method != SYS_METHOD_WLS)) {
-		    sil = 1.0;
-		} else {
-		    sil = gretl_matrix_get(sys->S, i, l);
-		}
+	sys_fill_X_y(sys, sm, X, y, cross, weight);
 
-		yv += xx * sil;
-	    }
-	    gretl_vector_set(y, v++, yv);
+	if (nr > 0) {
+	    /* there are restrictions to be imposed */
+	    augment_X_with_restrictions(X, mk, sys);
+	    augment_y_with_restrictions(y, mk, nr, sys);
 	}
-    }
 
-    if (nr > 0) {
-	/* there are restrictions */
-	augment_y_with_restrictions(y, mk, nr, sys);
+	/* The estimates calculated below will be SUR, 3SLS or LIML,
+	   depending on how the data matrices above were constructed --
+	   unless, that is, we're just doing restricted OLS, WLS or TSLS
+	   estimates.
+	*/
+	err = calculate_sys_coeffs(sys, dset, X, y, mk, nr,
+				   do_iteration);
     }
 
-    /* The estimates calculated below will be SUR, 3SLS or LIML,
-       depending on how the data matrices above were constructed --
-       unless, that is, we're just doing restricted OLS, WLS or TSLS
-       estimates.
-    */
-    err = calculate_sys_coeffs(sys, dset, X, y, mk, nr,
-			       do_iteration);
-
     if (!err && rsingle) {
 	/* take one more pass */
 	rsingle = 0;
@@ -1388,9 +1576,7 @@ int system_estimate (equation_system *sys, DATASET *dset,
 
  cleanup:
 
-    gretl_matrix_free(Xi);
-    gretl_matrix_free(Xj);
-    gretl_matrix_free(M);
+    sys_moments_free(sm);
     gretl_matrix_free(X);
     gretl_matrix_free(y);
 
@@ -26,6 +26,8 @@
 #include "csvdata.h"
 #include "importer.h"
 
+#include <libxml/xmlreader.h>
+
 #ifdef WIN32
 # include "gretl_win32.h"
 #endif
@@ -117,111 +119,128 @@ static void xlsx_info_free (xlsx_info *xinfo)
     }
 }
 
-/* Parse what we need from sharedStrings.xml */
+/* Get the number of strings from the <sst> element */
 
-static int xlsx_read_shared_strings (xlsx_info *xinfo, PRN *prn)
+static int xlsx_sst_count (xmlTextReaderPtr reader, int *n, PRN *prn)
 {
-    xmlDocPtr doc = NULL;
-    xmlNodePtr cur = NULL;
-    xmlNodePtr val;
     char *tmp;
-    int i, n = 0;
     int err = 0;
 
-    err = gretl_xml_open_doc_root(xinfo->stringsfile, "sst",
-				  &doc, &cur);
-
-    if (err) {
-	pprintf(prn, "Couldn't find shared strings table\n");
-	pprintf(prn, "%s", gretl_errmsg_get());
-	return err;
-    }
-
-    tmp = (char *) xmlGetProp(cur, (XUC) "uniqueCount");
+    tmp = (char *) xmlTextReaderGetAttribute(reader, (XUC) "uniqueCount");
     if (tmp == NULL) {
-	tmp = (char *) xmlGetProp(cur, (XUC) "count");
+	tmp = (char *) xmlTextReaderGetAttribute(reader, (XUC) "count");
     }
 
     if (tmp == NULL) {
 	pprintf(prn, "didn't get sst count\n");
 	err = E_DATA;
     } else {
-	n = atoi(tmp);
-	if (n <= 0) {
+	*n = atoi(tmp);
+	if (*n <= 0) {
 	    pprintf(prn, "didn't get valid sst count\n");
 	    err = E_DATA;
 	}
-	free(tmp);
+	xmlFree(tmp);
     }
 
-    if (!err) {
-	xinfo->strings = strings_array_new(n);
-	if (xinfo->strings == NULL) {
-	    err = E_ALLOC;
-	}
-    }
+    return err;
+}
 
-    cur = cur->xmlChildrenNode;
+/* Parse what we need from sharedStrings.xml. This file can be
+   very large, so rather than building a tree we use a streaming
+   reader and store each string once, in order, as we go.
 
-    /* The strings in an <sst> are mostly set up as
+   The strings in an <sst> are mostly set up as
 
-       <si><t>XXX</t></si>
-       <si><t>YYY</t></si> ...
+   <si><t>XXX</t></si>
+   <si><t>YYY</t></si> ...
 
-       But there are also weird cases where junk is interposed
-       and the structure becomes
+   But there are also cases of "rich text" where the string is
+   split into runs, with formatting interposed, as in
 
-       <si><r>...<t>XXX</t></r><r>...<t>YYY</t></r></si> ...
+   <si><r>...<t>XXX</t></r><r>...<t>YYY</t></r></si> ...
 
-       That is, an <si> element may contain more than one <r>
-       element, which embeds a <t> along with formatting crap.
-    */
+   in which case the string is the concatenation of the <t>
+   elements. Phonetic annotations (<rPh>) are skipped.
+*/
 
-    i = 0;
-    while (cur != NULL && !err) {
-	if (!xmlStrcmp(cur->name, (XUC) "si")) {
-	    int gotstr = 0;
-
-	    val = cur->xmlChildrenNode;
-	    while (val != NULL && !err && !gotstr) {
-		if (!xmlStrcmp(val->name, (XUC) "t")) {
-		    /* got a regular <t> element */
-		    tmp = (char *) xmlNodeGetContent(val);
-		    if (tmp == NULL) {
-			pprintf(prn, "failed reading string %d\n", i);
-			err = E_DATA;
-		    } else {
-			xinfo->strings[i++] = g_strstrip(tmp);
-			gotstr = 1;
+static int xlsx_read_shared_strings (xlsx_info *xinfo, PRN *prn)
+{
+    xmlTextReaderPtr reader;
+    GString *buf = NULL;
+    const char *name;
+    int in_si = 0, in_t = 0, in_rph = 0;
+    int type, ret = 0, i = 0, n = 0;
+    int err = 0;
+
+    reader = xmlReaderForFile(xinfo->stringsfile, NULL, XML_PARSE_NONET);
+    if (reader == NULL) {
+	pprintf(prn, "Couldn't find shared strings table\n");
+	return E_FOPEN;
+    }
+
+    while (!err && (ret = xmlTextReaderRead(reader)) == 1) {
+	type = xmlTextReaderNodeType(reader);
+	if (type == XML_READER_TYPE_ELEMENT) {
+	    name = (const char *) xmlTextReaderConstLocalName(reader);
+	    if (!strcmp(name, "sst")) {
+		err = xlsx_sst_count(reader, &n, prn);
+		if (!err) {
+		    xinfo->strings = strings_array_new(n);
+		    buf = g_string_sized_new(64);
+		    if (xinfo->strings == NULL || buf == NULL) {
+			err = E_ALLOC;
 		    }
-		} else if (!xmlStrcmp(val->name, (XUC) "r")) {
-		    /* hunt for <t> inside an <r> element */
-		    xmlNodePtr sub = val->xmlChildrenNode;
-
-		    while (sub != NULL && !err && i < n) {
-			if (!xmlStrcmp(sub->name, (XUC) "t")) {
-			    tmp = (char *) xmlNodeGetContent(sub);
-			    if (tmp == NULL) {
-				pprintf(prn, "failed reading string %d\n", i);
-				err = E_DATA;
-			    } else {
-				xinfo->strings[i++] = g_strstrip(tmp);
-				gotstr = 1;
-			    }
-			}
-			sub = sub->next;
+		}
+	    } else if (buf == NULL) {
+		continue;
+	    } else if (!strcmp(name, "si")) {
+		g_string_truncate(buf, 0);
+		in_si = !xmlTextReaderIsEmptyElement(reader);
+		if (!in_si) {
+		    xinfo->strings[i++] = gretl_strdup("");
+		    if (i == n) {
+			break;
 		    }
 		}
-		val = val->next;
+	    } else if (!strcmp(name, "rPh")) {
+		in_rph = !xmlTextReaderIsEmptyElement(reader);
+	    } else if (!strcmp(name, "t")) {
+		in_t = in_si && !in_rph &&
+		    !xmlTextReaderIsEmptyElement(reader);
 	    }
+	} else if (type == XML_READER_TYPE_END_ELEMENT && in_si) {
+	    name = (const char *) xmlTextReaderConstLocalName(reader);
+	    if (!strcmp(name, "t")) {
+		in_t = 0;
+	    } else if (!strcmp(name, "rPh")) {
+		in_rph = 0;
+	    } else if (!strcmp(name, "si")) {
+		xinfo->strings[i] = gretl_strdup(buf->str);
+		if (xinfo->strings[i] == NULL) {
+		    err = E_ALLOC;
+		} else {
+		    g_strstrip(xinfo->strings[i++]);
+		}
+		in_si = 0;
+		if (i == n) {
+		    break;
+		}
+	    }
+	} else if (in_t && (type == XML_READER_TYPE_TEXT ||
+			    type == XML_READER_TYPE_CDATA ||
+			    type == XML_READER_TYPE_SIGNIFICANT_WHITESPACE)) {
+	    g_string_append(buf, (const char *) xmlTextReaderConstValue(reader));
 	}
-	if (i == n) {
-	    break;
-	}
-	cur = cur->next;
     }
 
-    if (!err && i < n) {
+    if (!err && ret < 0) {
+	pprintf(prn, "error parsing %s\n", xinfo->stringsfile);
+	err = E_DATA;
+    } else if (!err && buf == NULL) {
+	pprintf(prn, "Couldn't find shared strings table\n");
+	err = E_DATA;
+    } else if (!err && i < n) {
 	pprintf(prn, "expected %d shared strings but only found %d\n",
 		n, i);
 	err = E_DATA;
@@ -234,7 +253,10 @@ static int xlsx_read_shared_strings (xlsx_info *xinfo, PRN *prn)
 	xinfo->strings = NULL;
     }
 
-    xmlFreeDoc(doc);
+    if (buf != NULL) {
+	g_string_free(buf, TRUE);
+    }
+    xmlFreeTextReader(reader);
 
     return err;
 }
@@ -612,288 +634,365 @@ static void xlsx_set_dims (xlsx_info *xinfo, int r, int c)
     }
 }
 
-static char *node_get_inline_string (xmlNodePtr val)
-{
-    xmlNodePtr ist = val->xmlChildrenNode;
-    char *ret = NULL;
-
-    if (ist != NULL && !xmlStrcmp(ist->name, (XUC) "t")) {
-	char *tmp = (char *) xmlNodeGetContent(ist);
+/* Per-cell state for the streaming worksheet reader: the text
+   buffers are reused from cell to cell.
+*/
 
-	if (tmp != NULL) {
-	    ret = gretl_strdup(g_strstrip(tmp));
-	    free(tmp);
-	}
-    }
+typedef struct xlsx_cell_ xlsx_cell;
+
+struct xlsx_cell_ {
+    int row, col;   /* 1-based coordinates */
+    int type;       /* CELL_NUMBER, CELL_STRINGREF, etc. */
+    int inline_str; /* cell type is "inlineStr" */
+    int gotv;       /* got a <v> element */
+    int gotf;       /* got an <f> element */
+    int gotis;      /* got an <is> element with a <t> child */
+    GString *v;     /* content of <v> */
+    GString *f;     /* content of <f> */
+    GString *is;    /* content of <is><t> */
+};
 
-    return ret;
-}
+enum {
+    IN_NONE,
+    IN_V,
+    IN_F,
+    IN_IS
+};
 
-static int has_formula_child (xmlNodePtr val)
+static int xlsx_cell_init (xlsx_cell *cell)
 {
-    int ret = 0;
+    cell->v = g_string_sized_new(32);
+    cell->f = g_string_sized_new(32);
+    cell->is = g_string_sized_new(32);
 
-    while (val) {
-	if (!xmlStrcmp(val->name, (XUC) "f")) {
-	    ret = 1;
-	    break;
-	}
-	val = val->next;
+    if (cell->v == NULL || cell->f == NULL || cell->is == NULL) {
+	return E_ALLOC;
     }
 
-    return ret;
+    return 0;
 }
 
-static int get_cell_basics (xmlNodePtr cur,
-			    char **cref, int *celltype,
-			    int *row, int *col,
+static void xlsx_cell_clear (xlsx_cell *cell)
+{
+    if (cell->v != NULL) g_string_free(cell->v, TRUE);
+    if (cell->f != NULL) g_string_free(cell->f, TRUE);
+    if (cell->is != NULL) g_string_free(cell->is, TRUE);
+}
+
+/* Get the reference ("r") and type ("t") attributes of the cell
+   element on which @reader is positioned, and reset the rest of
+   the cell info.
+*/
+
+static int xlsx_cell_start (xmlTextReaderPtr reader,
+			    xlsx_cell *cell,
 			    PRN *prn)
 {
-    char *ctype = NULL;
-    int err = 0;
+    const char *ctype = "n";
+    int err;
 
     pputs(prn, " cell");
 
-    *cref = (char *) xmlGetProp(cur, (XUC) "r");
-    if (*cref == NULL) {
+    cell->type = CELL_NONE;
+    cell->inline_str = 0;
+    cell->gotv = cell->gotf = cell->gotis = 0;
+    g_string_truncate(cell->v, 0);
+    g_string_truncate(cell->f, 0);
+    g_string_truncate(cell->is, 0);
+
+    if (xmlTextReaderMoveToAttribute(reader, (XUC) "r") != 1) {
 	pprintf(prn, ": couldn't find 'r' property\n");
 	return E_DATA;
     }
 
-    err = xlsx_cell_get_coordinates(*cref, row, col);
+    err = xlsx_cell_get_coordinates((const char *)
+				    xmlTextReaderConstValue(reader),
+				    &cell->row, &cell->col);
     if (err) {
 	pprintf(prn, ": couldn't find coordinates\n");
+	xmlTextReaderMoveToElement(reader);
 	return E_DATA;
     }
 
-    ctype = (char *) xmlGetProp(cur, (XUC) "t");
-    if (ctype == NULL) {
-	/* default to numeric? */
-	ctype = gretl_strdup("n");
-    }
+    if (xmlTextReaderMoveToAttribute(reader, (XUC) "t") == 1) {
+	ctype = (const char *) xmlTextReaderConstValue(reader);
+    } /* else default to numeric */
 
-    pprintf(prn, "(%d, %d; type %s)", *row, *col, ctype);
+    pprintf(prn, "(%d, %d; type %s)", cell->row, cell->col, ctype);
 
     if (!strcmp(ctype, "n") || !strcmp(ctype, "b")) {
 	/* numeric or boolean (0/1) */
-	*celltype = CELL_NUMBER;
+	cell->type = CELL_NUMBER;
     } else if (!strcmp(ctype, "d")) {
 	/* date: try numeric? */
-	*celltype = CELL_NUMBER;
+	cell->type = CELL_NUMBER;
     } else if (!strcmp(ctype, "s")) {
 	/* reference to entry in string table */
-	*celltype = CELL_STRINGREF;
+	cell->type = CELL_STRINGREF;
     } else if (!strcmp(ctype, "str")) {
 	/* string representing a formula */
-	*celltype = CELL_FORMULA;
+	cell->type = CELL_FORMULA;
     } else if (!strcmp(ctype, "inlineStr")) {
-	/* in-cell string literal (or maybe formula!) */
-	if (has_formula_child(cur->xmlChildrenNode)) {
-	    *celltype = CELL_FORMULA;
+	/* in-cell string literal (or maybe formula!): we
+	   can't tell which until we've seen the children */
+	cell->inline_str = 1;
+    }
+
+    xmlTextReaderMoveToElement(reader);
+
+    return 0;
+}
+
+/* Process a cell once all of its child elements have been read:
+   on the first pass we just check the top-left cell and record
+   the coordinates; on the second we fill in the dataset; on the
+   third (if needed) the string-valued variables.
+*/
+
+static int xlsx_process_cell (xlsx_info *xinfo, xlsx_cell *cell,
+			      int pass, PRN *prn, PRN *myprn)
+{
+    const char *strval = NULL;
+    double xval = NADBL;
+    int row = cell->row;
+    int col = cell->col;
+    int gotv = 0;
+    int err = 0;
+
+    if (cell->inline_str) {
+	cell->type = cell->gotf ? CELL_FORMULA : CELL_ISTRING;
+    }
+
+    if (cell->type == CELL_ISTRING) {
+	if (cell->gotis) {
+	    strval = g_strstrip(cell->is->str);
+	    gotv = 1;
+	}
+    } else if (cell->gotv) {
+	const char *s = cell->v->str;
+
+	if (cell->type == CELL_NUMBER) {
+	    pprintf(myprn, " value = %s\n", s);
+	    if (*s != '\0' && check_atof(s) == 0) {
+		xval = atof(s);
+	    }
+	} else if (cell->type == CELL_STRINGREF) {
+	    /* look up string table */
+	    strval = xlsx_string_value(s, xinfo, prn);
+	    if (strval == NULL) {
+		pputs(myprn, " value = ?\n");
+		err = E_DATA;
+	    } else {
+		pprintf(myprn, " value = '%s'\n", strval);
+	    }
+	}
+	gotv = 1;
+    }
+
+    if (!err && pass == 1) {
+	/* on the first pass, check for obs column, varname status */
+	xlsx_check_top_left(xinfo, row, col, strval, xval, myprn);
+    }
+
+    if (err) {
+	pprintf(myprn, ": (%d, %d) error", row, col);
+    } else if (!gotv) {
+	pprintf(myprn, ": (%d, %d) no data value", row, col);
+	if (cell->gotf) {
+	    pprintf(myprn, ": formula = '%s'\n", cell->f->str);
 	} else {
-	    *celltype = CELL_ISTRING;
+	    pputc(myprn, '\n');
 	}
     }
 
-    free(ctype);
+    if (!err && pass > 1 && col > xinfo->xoffset && row > xinfo->yoffset) {
+	int i = xlsx_var_index(xinfo, col);
+	int t = xlsx_obs_index(xinfo, row);
+	int strcell = cell->type == CELL_STRINGREF ||
+	    cell->type == CELL_ISTRING;
+
+	/* here we're on the second or possibly third pass,
+	   with a dataset allocated */
+
+	if (pass == 3) {
+	    if (i > 0 && t >= 0) {
+		if (in_gretl_list(xinfo->codelist, i)) {
+		    xlsx_handle_stringval3(xinfo, i, t, strval, prn);
+		}
+	    }
+	} else if (strcell) {
+	    if (row == xinfo->namerow) {
+		err = xlsx_set_varname(xinfo, i, strval, row, col, prn);
+	    } else if (col == xinfo->obscol) {
+		err = xlsx_set_obs_string(xinfo, row, col, t, strval, prn);
+	    } else if (strval != NULL) {
+		err = xlsx_handle_stringval(xinfo, i, t, strval,
+					    row, col, prn);
+	    }
+	} else if (row == xinfo->namerow) {
+	    err = xlsx_set_varname(xinfo, i, strval, row, col, prn);
+	} else if (gotv) {
+	    err = xlsx_set_value(xinfo, i, t, xval);
+	} else if (cell->gotf) {
+	    xlsx_maybe_handle_formula(xinfo, cell->f->str, i, t);
+	}
+    }
 
     return err;
 }
 
-/* Read the cells in a given row: the basic info we want from
-   each cell is its reference ("r"), e.g. "A2"; its type
-   ("t"), e.g. "s", if present; and its value, which is
-   not a property but a sub-element "<v>...</v>".
+/* Make one pass through the <sheetData> of a worksheet. Since
+   worksheet files can be very large, we don't build a tree but
+   stream the XML, processing each cell as it's completed. The
+   basic info we want from each cell is its reference ("r"),
+   e.g. "A2"; its type ("t"), e.g. "s", if present; and its
+   value, which is not a property but a sub-element "<v>...</v>".
 */
 
-static int xlsx_read_row (xmlNodePtr cur, xlsx_info *xinfo,
-			  int i, PRN *prn)
+static int xlsx_worksheet_pass (xlsx_info *xinfo, int pass, PRN *prn)
 {
+    xmlTextReaderPtr reader;
+    xlsx_cell cell = {0};
     PRN *myprn = NULL;
-    xmlNodePtr val;
-    char *tmp;
+    const char *name;
+    int in_data = 0, in_cell = 0;
+    int child = IN_NONE, in_t = 0;
     int row = -1, col = -1;
-    int pass, empty = 1;
+    int empty = 1, done = 0;
+    int type, ret = 0;
     int err = 0;
 
-    if (xinfo->codelist != NULL) {
-	pass = 3;
-    } else if (xinfo->dset != NULL) {
-	/* if we never found anything in the (possibly notional)
-	   top-left cell, set the observations column number
-	*/
-	if (xinfo->flags & BOOK_TOP_LEFT_EMPTY) {
-	    xinfo->obscol = xinfo->xoffset + 1;
-	}
-	pass = 2;
-    } else {
-	pass = 1;
-    }
-
 #if XDEBUG
     myprn = prn;
-    pprintf(myprn, "*** Reading row (pass %d)...\n", pass);
+    pprintf(myprn, "*** Reading worksheet (pass %d)...\n", pass);
 #endif
 
-    cur = cur->xmlChildrenNode;
-
-    /* loop across cells in row */
+    reader = xmlReaderForFile(xinfo->sheetfile, NULL, XML_PARSE_NONET);
+    if (reader == NULL) {
+	pprintf(prn, "didn't get worksheet\n");
+	return E_FOPEN;
+    }
 
-    while (cur != NULL && !err) {
-	if (!xmlStrcmp(cur->name, (XUC) "c")) {
-	    /* we got a cell in the given row */
-	    char *cref = NULL;
-	    char *formula = NULL;
-	    const char *strval = NULL;
-	    double xval = NADBL;
-	    int celltype = CELL_NONE;
-	    int gotv = 0;
-	    int gotf = 0;
+    err = xlsx_cell_init(&cell);
 
-	    err = get_cell_basics(cur, &cref, &celltype, &row, &col, myprn);
-	    if (err) {
-		break;
-	    }
+    while (!err && !done && (ret = xmlTextReaderRead(reader)) == 1) {
+	int cell_done = 0;
+	int row_done = 0;
 
-	    if (0 /* row <= xinfo->yoffset || col <= xinfo->xoffset */) {
-		/* outside of the specified reading area (checking needed) */
-		fprintf(stderr, "skipping %s (row %d, col %d)\n", cref, row, col);
-		goto skipit;
-	    }
+	type = xmlTextReaderNodeType(reader);
 
-	    if (pass >= 2 && row > xinfo->maxrow) {
-		goto skipit;
-	    }
+	if (type == XML_READER_TYPE_ELEMENT) {
+	    int leaf = xmlTextReaderIsEmptyElement(reader);
 
-	    val = cur->xmlChildrenNode;
-
-	    /* try to find a value in the current row/cell */
-
-	    while (val && !err && !gotv) {
-		if (!xmlStrcmp(val->name, (XUC) "v")) {
-		    /* value element */
-		    tmp = (char *) xmlNodeGetContent(val);
-		    if (tmp != NULL) {
-			if (celltype == CELL_NUMBER) {
-			    pprintf(myprn, " value = %s\n", tmp);
-			    if (*tmp != '\0' && check_atof(tmp) == 0) {
-				xval = atof(tmp);
-			    }
-			} else if (celltype == CELL_STRINGREF) {
-			    /* look up string table */
-			    strval = xlsx_string_value(tmp, xinfo, prn);
-			    if (strval == NULL) {
-				pputs(myprn, " value = ?\n");
-				err = E_DATA;
-			    } else {
-				pprintf(myprn, " value = '%s'\n", strval);
-			    }
-			}
-			free(tmp);
-			gotv = 1;
-		    }
-		} else if (celltype == CELL_FORMULA &&
-			   !xmlStrcmp(val->name, (XUC) "f")) {
-		    /* formula element */
-		    formula = (char *) xmlNodeGetContent(val);
-		    if (formula != NULL) {
-			gotf = 1;
-		    }
-		} else if (celltype == CELL_ISTRING &&
-			   !xmlStrcmp(val->name, (XUC) "is")) {
-		    /* string element */
-		    strval = node_get_inline_string(val);
-		    if (strval != NULL) {
-			gotv = 1;
-		    }
+	    name = (const char *) xmlTextReaderConstLocalName(reader);
+	    if (!in_data) {
+		if (!strcmp(name, "sheetData")) {
+		    in_data = 1;
+		    done = leaf;
 		}
-		/* proceed to next child of given cell */
-		val = val->next;
+	    } else if (!strcmp(name, "row")) {
+		empty = 1;
+		row_done = leaf;
+	    } else if (!strcmp(name, "c")) {
+		err = xlsx_cell_start(reader, &cell, myprn);
+		in_cell = !leaf;
+		cell_done = leaf;
+	    } else if (!in_cell) {
+		; /* not interested */
+	    } else if (!strcmp(name, "v")) {
+		child = leaf ? IN_NONE : IN_V;
+		if (leaf) {
+		    cell.gotv = 1;
+		}
+	    } else if (!strcmp(name, "f")) {
+		child = leaf ? IN_NONE : IN_F;
+		if (leaf) {
+		    cell.gotf = 1;
+		}
+	    } else if (!strcmp(name, "is")) {
+		child = leaf ? IN_NONE : IN_IS;
+	    } else if (child == IN_IS && !strcmp(name, "t")) {
+		cell.gotis = 1;
+		in_t = !leaf;
+	    } else if (child == IN_IS && !strcmp(name, "rPh")) {
+		/* skip phonetic annotation */
+		child = leaf ? IN_IS : IN_NONE;
 	    }
-
-	    if (!err && xinfo->dset == NULL) {
-		/* on the first pass, check for obs column, varname status */
-		xlsx_check_top_left(xinfo, row, col, strval, xval, myprn);
+	} else if (type == XML_READER_TYPE_END_ELEMENT) {
+	    name = (const char *) xmlTextReaderConstLocalName(reader);
+	    if (!in_data) {
+		; /* not interested */
+	    } else if (!strcmp(name, "sheetData")) {
+		done = 1;
+	    } else if (!strcmp(name, "row")) {
+		row_done = 1;
+	    } else if (!strcmp(name, "c")) {
+		in_cell = 0;
+		cell_done = 1;
+	    } else if (!strcmp(name, "v")) {
+		cell.gotv = 1;
+		child = IN_NONE;
+	    } else if (!strcmp(name, "f")) {
+		cell.gotf = 1;
+		child = IN_NONE;
+	    } else if (!strcmp(name, "is")) {
+		child = IN_NONE;
+	    } else if (!strcmp(name, "t")) {
+		in_t = 0;
+	    } else if (!strcmp(name, "rPh")) {
+		child = IN_IS;
 	    }
-
-	    if (err) {
-		pprintf(myprn, ": (%s) error", cref);
-	    } else if (!gotv) {
-		pprintf(myprn, ": (%s) no data value", cref);
-		if (gotf) {
-		    pprintf(myprn, ": formula = '%s'\n", formula);
-		} else {
-		    pputc(myprn, '\n');
-		}
+	} else if (child != IN_NONE &&
+		   (type == XML_READER_TYPE_TEXT ||
+		    type == XML_READER_TYPE_CDATA ||
+		    type == XML_READER_TYPE_SIGNIFICANT_WHITESPACE)) {
+	    const char *s = (const char *) xmlTextReaderConstValue(reader);
+
+	    if (child == IN_V) {
+		g_string_append(cell.v, s);
+	    } else if (child == IN_F) {
+		g_string_append(cell.f, s);
+	    } else if (in_t) {
+		g_string_append(cell.is, s);
 	    }
+	}
 
-	    if (!err && xinfo->dset != NULL &&
-		col > xinfo->xoffset &&
-		row > xinfo->yoffset) {
-		int i = xlsx_var_index(xinfo, col);
-		int t = xlsx_obs_index(xinfo, row);
-		int strcell = celltype == CELL_STRINGREF || celltype == CELL_ISTRING;
-
-		/* here we're on the second or possibly third pass,
-		   with a dataset allocated */
-
-		if (pass == 3) {
-		    if (i > 0 && t >= 0) {
-			if (in_gretl_list(xinfo->codelist, i)) {
-			    xlsx_handle_stringval3(xinfo, i, t, strval, prn);
-			}
-		    }
-		} else if (strcell) {
-		    if (row == xinfo->namerow) {
-			err = xlsx_set_varname(xinfo, i, strval, row, col, prn);
-		    } else if (col == xinfo->obscol) {
-			err = xlsx_set_obs_string(xinfo, row, col, t, strval, prn);
-		    } else if (strval != NULL) {
-			err = xlsx_handle_stringval(xinfo, i, t, strval,
-						    row, col, prn);
-		    }
-		    if (celltype == CELL_ISTRING) {
-			/* finished with copy of string literal */
-			free((char *) strval);
-		    }
-		} else if (row == xinfo->namerow) {
-		   err = xlsx_set_varname(xinfo, i, strval, row, col, prn);
-		} else if (gotv) {
-		    err = xlsx_set_value(xinfo, i, t, xval);
-		} else if (gotf) {
-		    xlsx_maybe_handle_formula(xinfo, formula, i, t);
+	if (!err && cell_done) {
+	    row = cell.row;
+	    col = cell.col;
+	    child = IN_NONE;
+	    in_t = 0;
+	    if (pass > 1 && row > xinfo->maxrow) {
+		; /* skip it */
+	    } else {
+		err = xlsx_process_cell(xinfo, &cell, pass, prn, myprn);
+		if (cell.gotv || cell.gotf || cell.gotis) {
+		    empty = 0;
 		}
-	    } else if (celltype == CELL_ISTRING && strval != NULL) {
-		/* finished with copy of string literal */
-		free((char *) strval);
 	    }
+	}
 
-	    if (gotv || gotf) {
-		empty = 0;
+	if (!err && row_done) {
+	    if (empty) {
+		pputs(myprn, " xlsx_read_row: empty row!\n");
+	    } else if (pass == 1) {
+		xlsx_set_dims(xinfo, row, col);
 	    }
-
-	skipit:
-
-	    free(cref);
-	    free(formula);
 	}
+    }
 
-	/* move onto next cell in row */
-	cur = cur->next;
-    } /* end loop across cells in row */
-
-    if (!err) {
-	if (empty) {
-	    pputs(myprn, " xlsx_read_row: empty row!\n");
-	} else if (pass == 1) {
-	    xlsx_set_dims(xinfo, row, col);
-	}
+    if (!err && ret < 0) {
+	pprintf(prn, "error parsing %s\n", xinfo->sheetfile);
+	err = E_DATA;
     }
 
     if (err) {
-	fprintf(stderr, "xlsx_read_row: returning %d\n", err);
+	fprintf(stderr, "xlsx_worksheet_pass: returning %d\n", err);
     }
 
+    xlsx_cell_clear(&cell);
+    xmlFreeTextReader(reader);
+
     return err;
 }
 
@@ -967,11 +1066,6 @@ static int xlsx_read_worksheet (xlsx_info *xinfo,
 				const char *fname,
 				PRN *prn)
 {
-    xmlDocPtr doc = NULL;
-    xmlNodePtr data_node = NULL;
-    xmlNodePtr cur = NULL;
-    xmlNodePtr c1;
-    int i, gotdata = 0;
     int err = 0;
 
     sprintf(xinfo->sheetfile, "xl%c%s", SLASH,
@@ -984,31 +1078,8 @@ static int xlsx_read_worksheet (xlsx_info *xinfo,
 
     sprintf(xinfo->stringsfile, "xl%csharedStrings.xml", SLASH);
 
-    err = gretl_xml_open_doc_root(xinfo->sheetfile, "worksheet",
-				  &doc, &cur);
-
-    if (err) {
-	pprintf(prn, "didn't get worksheet\n");
-	pprintf(prn, "%s", gretl_errmsg_get());
-	return err;
-    }
-
-    /* walk the tree, first pass */
-    i = 0;
-    cur = cur->xmlChildrenNode;
-    while (cur != NULL && !err && !gotdata) {
-        if (!xmlStrcmp(cur->name, (XUC) "sheetData")) {
-	    data_node = c1 = cur->xmlChildrenNode;
-	    while (c1 != NULL && !err) {
-		if (!xmlStrcmp(c1->name, (XUC) "row")) {
-		    err = xlsx_read_row(c1, xinfo, i++, prn);
-		}
-		c1 = c1->next;
-	    }
-	    gotdata = 1;
-	}
-	cur = cur->next;
-    }
+    /* first pass: dimensions and top-left cell */
+    err = xlsx_worksheet_pass(xinfo, 1, prn);
 
 #if XDEBUG
     if (!err) {
@@ -1021,16 +1092,15 @@ static int xlsx_read_worksheet (xlsx_info *xinfo,
     if (!err && xinfo->dset == NULL) {
 	err = xlsx_check_dimensions(xinfo, prn);
 	if (!err) {
+	    /* if we never found anything in the (possibly notional)
+	       top-left cell, set the observations column number
+	    */
+	    if (xinfo->flags & BOOK_TOP_LEFT_EMPTY) {
+		xinfo->obscol = xinfo->xoffset + 1;
+	    }
 	    /* second pass: get actual data */
-	    i = 0;
 	    gretl_push_c_numeric_locale();
-	    c1 = data_node;
-	    while (c1 != NULL && !err) {
-		if (!xmlStrcmp(c1->name, (XUC) "row")) {
-		    err = xlsx_read_row(c1, xinfo, i++, prn);
-		}
-		c1 = c1->next;
-	    }
+	    err = xlsx_worksheet_pass(xinfo, 2, prn);
 	    gretl_pop_c_numeric_locale();
 	}
     }
@@ -1039,14 +1109,7 @@ static int xlsx_read_worksheet (xlsx_info *xinfo,
 	err = xlsx_non_numeric_check(xinfo, prn);
 	if (!err && xinfo->codelist != NULL) {
 	    /* third pass, if needed: get string-valued vars */
-	    c1 = data_node;
-	    i = 0;
-	    while (c1 != NULL && !err) {
-		if (!xmlStrcmp(c1->name, (XUC) "row")) {
-		    err = xlsx_read_row(c1, xinfo, i++, prn);
-		}
-		c1 = c1->next;
-	    }
+	    err = xlsx_worksheet_pass(xinfo, 3, prn);
 	    if (!err) {
 		err = gretl_string_table_validate(xinfo->st, OPT_S);
 		if (err) {
@@ -1058,40 +1121,38 @@ static int xlsx_read_worksheet (xlsx_info *xinfo,
 	}
     }
 
-    xmlFreeDoc(doc);
-
     return err;
 }
 
 /* A quick check to see if a worksheet XML file contains
-   any actual data. */
+   any actual data: we stop reading at the first row. */
 
 static int xlsx_sheet_has_data (const char *fname)
 {
-    xmlDocPtr doc = NULL;
-    xmlNodePtr c1, cur = NULL;
+    xmlTextReaderPtr reader;
     gchar *fullname;
-    int err, ret = 0;
+    const char *name;
+    int in_data = 0;
+    int ret = 0;
 
     fullname = g_strdup_printf("xl%c%s", SLASH, fname);
+    reader = xmlReaderForFile(fullname, NULL, XML_PARSE_NONET);
 
-    err = gretl_xml_open_doc_root(fullname, "worksheet",
-				  &doc, &cur);
-    if (!err) {
-	cur = cur->xmlChildrenNode;
-	while (cur != NULL && ret == 0) {
-	    if (!xmlStrcmp(cur->name, (XUC) "sheetData")) {
-		c1 = cur->xmlChildrenNode;
-		while (c1 != NULL && ret == 0) {
-		    if (!xmlStrcmp(c1->name, (XUC) "row")) {
-			ret = 1;
-		    }
-		    c1 = c1->next;
-		}
-	    }
-	    cur = cur->next;
+    while (reader != NULL && xmlTextReaderRead(reader) == 1) {
+	if (xmlTextReaderNodeType(reader) != XML_READER_TYPE_ELEMENT) {
+	    continue;
 	}
-	xmlFreeDoc(doc);
+	name = (const char *) xmlTextReaderConstLocalName(reader);
+	if (!strcmp(name, "sheetData")) {
+	    in_data = 1;
+	} else if (in_data && !strcmp(name, "row")) {
+	    ret = 1;
+	    break;
+	}
+    }
+
+    if (reader != NULL) {
+	xmlFreeTextReader(reader);
     }
 
     if (!ret) {